@@ -264,6 +264,36 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
                 default=True,
                 )
 
+        cls.use_light_tree = BoolProperty(
+                name="Light Tree",
+                description="Pick lights by their estimated contribution to the shading point rather than their area, "
+                            "reducing noise in scenes with many lights",
+                default=False,
+                )
+
+        cls.use_adaptive_sampling = BoolProperty(
+                name="Adaptive Sampling",
+                description="Stop sampling pixels once their noise is below the threshold, "
+                            "the number of samples is used as the maximum (CPU only)",
+                default=False,
+                )
+        cls.adaptive_threshold = FloatProperty(
+                name="Adaptive Threshold",
+                description="Noise level at which pixels stop being sampled, lower values give less noise "
+                            "(zero for automatic, based on the number of samples)",
+                min=0.0, max=1.0,
+                soft_min=0.0, soft_max=0.1,
+                default=0.0,
+                precision=4,
+                )
+        cls.adaptive_min_samples = IntProperty(
+                name="Adaptive Min Samples",
+                description="Number of samples every pixel takes before its noise is tested "
+                            "(zero for automatic, based on the number of samples)",
+                min=0, max=4096,
+                default=0,
+                )
+
         cls.caustics_reflective = BoolProperty(
                 name="Reflective Caustics",
                 description="Use reflective caustics, resulting in a brighter image (more noise but added realism)",
@@ -456,11 +486,29 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
                 description="Use BVH spatial splits: longer builder time, faster render",
                 default=False,
                 )
+        cls.debug_use_obvh = BoolProperty(
+                name="Use 8-wide BVH",
+                description="Use BVH with 8 children per node on CPUs with AVX2 support",
+                default=True,
+                )
         cls.use_cache = BoolProperty(
                 name="Cache BVH",
                 description="Cache last built BVH to disk for faster re-render if no geometry changed",
                 default=False,
                 )
+        cls.use_texture_cache = BoolProperty(
+                name="Texture Cache",
+                description="Load image tiles and mipmap levels on demand while rendering, "
+                            "instead of loading all images in memory beforehand (CPU only, "
+                            "works best with tiled and mipmapped .tx files)",
+                default=False,
+                )
+        cls.texture_cache_size = IntProperty(
+                name="Cache Size",
+                description="Maximum memory used by the texture cache in megabytes",
+                min=64, max=65536,
+                default=1024,
+                )
         cls.tile_order = EnumProperty(
                 name="Tile Order",
                 description="Tile order for rendering",
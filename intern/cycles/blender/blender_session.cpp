@@ -441,6 +441,12 @@ void BlenderSession::render()
 		Pass::add(PASS_BVH_TRAVERSAL_STEPS, passes);
 #endif
 
+		/* stopping converged pixels early is only supported on the CPU */
+		if(scene->integrator->use_adaptive_sampling && session_params.device.type == DEVICE_CPU) {
+			Pass::add(PASS_ADAPTIVE_AUX_BUFFER, passes);
+			Pass::add(PASS_SAMPLE_COUNT, passes);
+		}
+
 		if(session_params.device.advanced_shading) {
 
 			/* loop over passes */
@@ -36,6 +36,7 @@
 #include "util_debug.h"
 #include "util_foreach.h"
 #include "util_opengl.h"
+#include "util_optimization.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -217,6 +218,17 @@ void BlenderSync::sync_integrator()
 	integrator->sample_all_lights_direct = get_boolean(cscene, "sample_all_lights_direct");
 	integrator->sample_all_lights_indirect = get_boolean(cscene, "sample_all_lights_indirect");
 
+	/* light tree is built along with the light distribution */
+	bool use_light_tree = get_boolean(cscene, "use_light_tree");
+	if(integrator->use_light_tree != use_light_tree) {
+		integrator->use_light_tree = use_light_tree;
+		scene->light_manager->tag_update(scene);
+	}
+
+	integrator->use_adaptive_sampling = get_boolean(cscene, "use_adaptive_sampling");
+	integrator->adaptive_threshold = get_float(cscene, "adaptive_threshold");
+	integrator->adaptive_min_samples = get_int(cscene, "adaptive_min_samples");
+
 	int diffuse_samples = get_int(cscene, "diffuse_samples");
 	int glossy_samples = get_int(cscene, "glossy_samples");
 	int transmission_samples = get_int(cscene, "transmission_samples");
@@ -408,27 +420,42 @@ SceneParams BlenderSync::get_scene_params(BL::Scene b_scene, bool background, bo
 	else if(shadingsystem == 1)
 		params.shadingsystem = SHADINGSYSTEM_OSL;
 	
-	if(background)
+	if(background && params.shadingsystem != SHADINGSYSTEM_OSL)
+		params.persistent_data = r.use_persistent_data();
+	else
+		params.persistent_data = false;
+
+	/* with persistent data, mesh BVHs are kept between frames and refit when
+	 * the topology did not change, only the scene BVH of instances is rebuilt */
+	if(background && !params.persistent_data)
 		params.bvh_type = SceneParams::BVH_STATIC;
+	else if(background)
+		params.bvh_type = SceneParams::BVH_DYNAMIC;
 	else
 		params.bvh_type = (SceneParams::BVHType)RNA_enum_get(&cscene, "debug_bvh_type");
 
 	params.use_bvh_spatial_split = RNA_boolean_get(&cscene, "debug_use_spatial_splits");
 	params.use_bvh_cache = (background)? RNA_boolean_get(&cscene, "use_cache"): false;
 
-	if(background && params.shadingsystem != SHADINGSYSTEM_OSL)
-		params.persistent_data = r.use_persistent_data();
-	else
-		params.persistent_data = false;
-
 #if !(defined(__GNUC__) && (defined(i386) || defined(_M_IX86)))
 	if(is_cpu) {
 		params.use_qbvh = system_cpu_support_sse2();
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX2
+		/* 8-wide BVH is only traversed by the AVX2 kernel */
+		params.use_obvh = system_cpu_support_avx2() &&
+		                  RNA_boolean_get(&cscene, "debug_use_obvh");
+#endif
 	}
 	else
 #endif
 	{
 		params.use_qbvh = false;
+		params.use_obvh = false;
+	}
+
+	if(is_cpu) {
+		params.use_texture_cache = RNA_boolean_get(&cscene, "use_texture_cache");
+		params.texture_cache_size = RNA_int_get(&cscene, "texture_cache_size");
 	}
 
 	return params;
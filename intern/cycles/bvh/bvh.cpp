@@ -63,7 +63,9 @@ BVH::BVH(const BVHParams& params_, const vector<Object*>& objects_)
 
 BVH *BVH::create(const BVHParams& params, const vector<Object*>& objects)
 {
-	if(params.use_qbvh)
+	if(params.use_obvh)
+		return new OBVH(params, objects);
+	else if(params.use_qbvh)
 		return new QBVH(params, objects);
 	else
 		return new RegularBVH(params, objects);
@@ -260,6 +262,73 @@ void BVH::refit(Progress& progress)
 	refit_nodes();
 }
 
+void BVH::refit_primitives(int start, int end, BoundBox& bbox, uint& visibility)
+{
+	for(int prim = start; prim < end; prim++) {
+		int pidx = pack.prim_index[prim];
+		int tob = pack.prim_object[prim];
+		Object *ob = objects[tob];
+
+		if(pidx == -1) {
+			/* object instance */
+			bbox.grow(ob->bounds);
+		}
+		else {
+			/* primitives */
+			const Mesh *mesh = ob->mesh;
+
+			if(pack.prim_type[prim] & PRIMITIVE_ALL_CURVE) {
+				/* curves */
+				int str_offset = (params.top_level)? mesh->curve_offset: 0;
+				const Mesh::Curve& curve = mesh->curves[pidx - str_offset];
+				int k = PRIMITIVE_UNPACK_SEGMENT(pack.prim_type[prim]);
+
+				curve.bounds_grow(k, &mesh->curve_keys[0], bbox);
+
+				visibility |= PATH_RAY_CURVE;
+
+				/* motion curves */
+				if(mesh->use_motion_blur) {
+					Attribute *attr = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
+
+					if(attr) {
+						size_t mesh_size = mesh->curve_keys.size();
+						size_t steps = mesh->motion_steps - 1;
+						float4 *key_steps = attr->data_float4();
+
+						for(size_t i = 0; i < steps; i++)
+							curve.bounds_grow(k, key_steps + i*mesh_size, bbox);
+					}
+				}
+			}
+			else {
+				/* triangles */
+				int tri_offset = (params.top_level)? mesh->tri_offset: 0;
+				const Mesh::Triangle& triangle = mesh->triangles[pidx - tri_offset];
+				const float3 *vpos = &mesh->verts[0];
+
+				triangle.bounds_grow(vpos, bbox);
+
+				/* motion triangles */
+				if(mesh->use_motion_blur) {
+					Attribute *attr = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
+
+					if(attr) {
+						size_t mesh_size = mesh->verts.size();
+						size_t steps = mesh->motion_steps - 1;
+						float3 *vert_steps = attr->data_float3();
+
+						for(size_t i = 0; i < steps; i++)
+							triangle.bounds_grow(vert_steps + i*mesh_size, bbox);
+					}
+				}
+			}
+		}
+
+		visibility |= ob->visibility;
+	}
+}
+
 /* Triangles */
 
 void BVH::pack_triangle(int idx, float4 woop[3])
@@ -328,7 +397,8 @@ void BVH::pack_instances(size_t nodes_size)
 	 * BVH's are stored in global arrays. This function merges them into the
 	 * top level BVH, adjusting indexes and offsets where appropriate. */
 	bool use_qbvh = params.use_qbvh;
-	size_t nsize = (use_qbvh)? BVH_QNODE_SIZE: BVH_NODE_SIZE;
+	bool use_obvh = params.use_obvh;
+	size_t nsize = (use_obvh)? BVH_ONODE_SIZE: (use_qbvh)? BVH_QNODE_SIZE: BVH_NODE_SIZE;
 
 	/* adjust primitive index to point to the triangle in the global array, for
 	 * meshes with transform applied and already in the top level BVH */
@@ -413,7 +483,8 @@ void BVH::pack_instances(size_t nodes_size)
 
 		BVH *bvh = mesh->bvh;
 
-		int noffset = nodes_offset/nsize;
+		/* OBVH nodes are addressed by offset, the others by node index */
+		int noffset = (use_obvh)? nodes_offset: nodes_offset/nsize;
 		int mesh_tri_offset = mesh->tri_offset;
 		int mesh_curve_offset = mesh->curve_offset;
 
@@ -454,15 +525,29 @@ void BVH::pack_instances(size_t nodes_size)
 
 		/* merge nodes */
 		if(bvh->pack.nodes.size()) {
-			/* For QBVH we're packing a child bbox into 6 float4,
-			 * and for regular BVH they're packed into 3 float4.
+			/* For OBVH we're packing a child bbox into 12 float4, for QBVH
+			 * into 6 float4, and for regular BVH they're packed into 3 float4.
 			 */
-			size_t nsize_bbox = (use_qbvh)? 6: 3;
+			size_t nsize_bbox = (use_obvh)? 12: (use_qbvh)? 6: 3;
 			int4 *bvh_nodes = &bvh->pack.nodes[0];
 			size_t bvh_nodes_size = bvh->pack.nodes.size(); 
 			bool *bvh_is_leaf = (bvh->pack.is_leaf.size() != 0) ? &bvh->pack.is_leaf[0] : NULL;
 
-			for(size_t i = 0, j = 0; i < bvh_nodes_size; i+=nsize, j++) {
+			for(size_t i = 0, j = 0; i < bvh_nodes_size; j++) {
+				if(use_obvh && bvh_is_leaf && bvh_is_leaf[j]) {
+					/* OBVH leaves only store the primitive range */
+					int4 data = bvh_nodes[i];
+
+					data.x += prim_offset;
+					data.y += prim_offset;
+
+					pack_nodes[pack_nodes_offset] = data;
+
+					pack_nodes_offset += BVH_ONODE_LEAF_SIZE;
+					i += BVH_ONODE_LEAF_SIZE;
+					continue;
+				}
+
 				memcpy(pack_nodes + pack_nodes_offset, bvh_nodes + i, nsize_bbox*sizeof(int4));
 
 				/* modify offsets into arrays */
@@ -476,7 +561,7 @@ void BVH::pack_instances(size_t nodes_size)
 					data.x += (data.x < 0)? -noffset: noffset;
 					data.y += (data.y < 0)? -noffset: noffset;
 
-					if(use_qbvh) {
+					if(use_qbvh || use_obvh) {
 						data.z += (data.z < 0)? -noffset: noffset;
 						data.w += (data.w < 0)? -noffset: noffset;
 					}
@@ -491,7 +576,20 @@ void BVH::pack_instances(size_t nodes_size)
 				       &bvh_nodes[i + nsize_bbox+1],
 				       sizeof(int4) * (nsize - (nsize_bbox+1)));
 
+				/* OBVH stores the other four children in the last float4. */
+				if(use_obvh) {
+					int4 data1 = bvh_nodes[i + nsize_bbox+1];
+
+					data1.x += (data1.x < 0)? -noffset: noffset;
+					data1.y += (data1.y < 0)? -noffset: noffset;
+					data1.z += (data1.z < 0)? -noffset: noffset;
+					data1.w += (data1.w < 0)? -noffset: noffset;
+
+					pack_nodes[pack_nodes_offset + nsize_bbox+1] = data1;
+				}
+
 				pack_nodes_offset += nsize;
+				i += nsize;
 			}
 		}
 
@@ -606,69 +704,7 @@ void RegularBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility
 
 	if(leaf) {
 		/* refit leaf node */
-		for(int prim = c0; prim < c1; prim++) {
-			int pidx = pack.prim_index[prim];
-			int tob = pack.prim_object[prim];
-			Object *ob = objects[tob];
-
-			if(pidx == -1) {
-				/* object instance */
-				bbox.grow(ob->bounds);
-			}
-			else {
-				/* primitives */
-				const Mesh *mesh = ob->mesh;
-
-				if(pack.prim_type[prim] & PRIMITIVE_ALL_CURVE) {
-					/* curves */
-					int str_offset = (params.top_level)? mesh->curve_offset: 0;
-					const Mesh::Curve& curve = mesh->curves[pidx - str_offset];
-					int k = PRIMITIVE_UNPACK_SEGMENT(pack.prim_type[prim]);
-
-					curve.bounds_grow(k, &mesh->curve_keys[0], bbox);
-
-					visibility |= PATH_RAY_CURVE;
-
-					/* motion curves */
-					if(mesh->use_motion_blur) {
-						Attribute *attr = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-						if(attr) {
-							size_t mesh_size = mesh->curve_keys.size();
-							size_t steps = mesh->motion_steps - 1;
-							float4 *key_steps = attr->data_float4();
-
-							for(size_t i = 0; i < steps; i++)
-								curve.bounds_grow(k, key_steps + i*mesh_size, bbox);
-						}
-					}
-				}
-				else {
-					/* triangles */
-					int tri_offset = (params.top_level)? mesh->tri_offset: 0;
-					const Mesh::Triangle& triangle = mesh->triangles[pidx - tri_offset];
-					const float3 *vpos = &mesh->verts[0];
-
-					triangle.bounds_grow(vpos, bbox);
-
-					/* motion triangles */
-					if(mesh->use_motion_blur) {
-						Attribute *attr = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-						if(attr) {
-							size_t mesh_size = mesh->verts.size();
-							size_t steps = mesh->motion_steps - 1;
-							float3 *vert_steps = attr->data_float3();
-
-							for(size_t i = 0; i < steps; i++)
-								triangle.bounds_grow(vert_steps + i*mesh_size, bbox);
-						}
-					}
-				}
-			}
-
-			visibility |= ob->visibility;
-		}
+		refit_primitives(c0, c1, bbox, visibility);
 
 		pack_node(idx, bbox, bbox, c0, c1, visibility, data[3].w);
 	}
@@ -845,69 +881,7 @@ void QBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
 	int4 c = data[6];
 	if(leaf) {
 		/* Refit leaf node. */
-		for(int prim = c.x; prim < c.y; prim++) {
-			int pidx = pack.prim_index[prim];
-			int tob = pack.prim_object[prim];
-			Object *ob = objects[tob];
-
-			if(pidx == -1) {
-				/* Object instance. */
-				bbox.grow(ob->bounds);
-			}
-			else {
-				/* Primitives. */
-				const Mesh *mesh = ob->mesh;
-
-				if(pack.prim_type[prim] & PRIMITIVE_ALL_CURVE) {
-					/* Curves. */
-					int str_offset = (params.top_level)? mesh->curve_offset: 0;
-					const Mesh::Curve& curve = mesh->curves[pidx - str_offset];
-					int k = PRIMITIVE_UNPACK_SEGMENT(pack.prim_type[prim]);
-
-					curve.bounds_grow(k, &mesh->curve_keys[0], bbox);
-
-					visibility |= PATH_RAY_CURVE;
-
-					/* Motion curves. */
-					if(mesh->use_motion_blur) {
-						Attribute *attr = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-						if(attr) {
-							size_t mesh_size = mesh->curve_keys.size();
-							size_t steps = mesh->motion_steps - 1;
-							float4 *key_steps = attr->data_float4();
-
-							for(size_t i = 0; i < steps; i++)
-								curve.bounds_grow(k, key_steps + i*mesh_size, bbox);
-						}
-					}
-				}
-				else {
-					/* Triangles. */
-					int tri_offset = (params.top_level)? mesh->tri_offset: 0;
-					const Mesh::Triangle& triangle = mesh->triangles[pidx - tri_offset];
-					const float3 *vpos = &mesh->verts[0];
-
-					triangle.bounds_grow(vpos, bbox);
-
-					/* Motion triangles. */
-					if(mesh->use_motion_blur) {
-						Attribute *attr = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-						if(attr) {
-							size_t mesh_size = mesh->verts.size();
-							size_t steps = mesh->motion_steps - 1;
-							float3 *vert_steps = attr->data_float3();
-
-							for(size_t i = 0; i < steps; i++)
-								triangle.bounds_grow(vert_steps + i*mesh_size, bbox);
-						}
-					}
-				}
-			}
-
-			visibility |= ob->visibility;
-		}
+		refit_primitives(c.x, c.y, bbox, visibility);
 
 		/* TODO(sergey): This is actually a copy of pack_leaf(),
 		 * but this chunk of code only knows actual data and has
@@ -966,4 +940,200 @@ void QBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
 	}
 }
 
+/* OBVH */
+
+OBVH::OBVH(const BVHParams& params_, const vector<Object*>& objects_)
+: BVH(params_, objects_)
+{
+	params.use_obvh = true;
+}
+
+void OBVH::pack_leaf(const BVHStackEntry& e, const LeafNode *leaf)
+{
+	float4 data[BVH_ONODE_LEAF_SIZE];
+
+	memset(data, 0, sizeof(data));
+
+	if(leaf->num_triangles() == 1 && pack.prim_index[leaf->m_lo] == -1) {
+		/* object */
+		data[0].x = __int_as_float(~(leaf->m_lo));
+		data[0].y = __int_as_float(0);
+	}
+	else {
+		/* triangle */
+		data[0].x = __int_as_float(leaf->m_lo);
+		data[0].y = __int_as_float(leaf->m_hi);
+	}
+	data[0].z = __uint_as_float(leaf->m_visibility);
+	if(leaf->num_triangles() != 0) {
+		data[0].w = __uint_as_float(pack.prim_type[leaf->m_lo]);
+	}
+
+	memcpy(&pack.nodes[e.idx], data, sizeof(float4)*BVH_ONODE_LEAF_SIZE);
+}
+
+void OBVH::pack_inner(const BVHStackEntry& e, const BVHStackEntry *en, int num)
+{
+	float data[BVH_ONODE_SIZE*4];
+
+	for(int i = 0; i < num; i++) {
+		float3 bb_min = en[i].node->m_bounds.min;
+		float3 bb_max = en[i].node->m_bounds.max;
+
+		data[0*8 + i] = bb_min.x;
+		data[1*8 + i] = bb_max.x;
+		data[2*8 + i] = bb_min.y;
+		data[3*8 + i] = bb_max.y;
+		data[4*8 + i] = bb_min.z;
+		data[5*8 + i] = bb_max.z;
+
+		data[6*8 + i] = __int_as_float(en[i].encodeIdx());
+	}
+
+	for(int i = num; i < 8; i++) {
+		/* We store BB which would never be recorded as intersection
+		 * so kernel might safely assume there are always 8 child nodes.
+		 */
+		data[0*8 + i] = FLT_MAX;
+		data[1*8 + i] = -FLT_MAX;
+
+		data[2*8 + i] = FLT_MAX;
+		data[3*8 + i] = -FLT_MAX;
+
+		data[4*8 + i] = FLT_MAX;
+		data[5*8 + i] = -FLT_MAX;
+
+		data[6*8 + i] = __int_as_float(0);
+	}
+
+	memcpy(&pack.nodes[e.idx], data, sizeof(float4)*BVH_ONODE_SIZE);
+}
+
+/* Octo SIMD Nodes */
+
+void OBVH::pack_nodes(const BVHNode *root)
+{
+	/* leaves are the same as in the binary BVH, all other nodes are inner */
+	size_t num_nodes = root->getSubtreeSize(BVH_STAT_ONODE_COUNT);
+	size_t num_leaves = root->getSubtreeSize(BVH_STAT_LEAF_COUNT);
+	size_t node_size = (num_nodes - num_leaves)*BVH_ONODE_SIZE +
+	                   num_leaves*BVH_ONODE_LEAF_SIZE;
+
+	/* resize arrays */
+	pack.nodes.clear();
+	pack.is_leaf.clear();
+	pack.is_leaf.resize(num_nodes);
+
+	/* for top level BVH, first merge existing BVH's so we know the offsets */
+	if(params.top_level)
+		pack_instances(node_size);
+	else
+		pack.nodes.resize(node_size);
+
+	/* nodes are stored in the order their offset is assigned, which is the
+	 * order of is_leaf as well */
+	int nextNodeIdx = 0;
+	int nextLeafIdx = 0;
+
+	vector<BVHStackEntry> stack;
+	stack.reserve(BVHParams::MAX_DEPTH*8);
+	stack.push_back(BVHStackEntry(root, nextNodeIdx));
+	pack.is_leaf[nextLeafIdx++] = root->is_leaf();
+	nextNodeIdx += (root->is_leaf())? BVH_ONODE_LEAF_SIZE: BVH_ONODE_SIZE;
+
+	while(stack.size()) {
+		BVHStackEntry e = stack.back();
+		stack.pop_back();
+
+		if(e.node->is_leaf()) {
+			/* leaf node */
+			const LeafNode* leaf = reinterpret_cast<const LeafNode*>(e.node);
+			pack_leaf(e, leaf);
+		}
+		else {
+			/* inner node, collect up to 8 nodes from the binary subtree */
+			const BVHNode *nodes[8];
+			int numnodes = e.node->collect_children(nodes, 8);
+
+			/* push entries on the stack */
+			for(int i = 0; i < numnodes; i++) {
+				stack.push_back(BVHStackEntry(nodes[i], nextNodeIdx));
+				pack.is_leaf[nextLeafIdx++] = nodes[i]->is_leaf();
+				nextNodeIdx += (nodes[i]->is_leaf())? BVH_ONODE_LEAF_SIZE: BVH_ONODE_SIZE;
+			}
+
+			/* set node */
+			pack_inner(e, &stack[stack.size()-numnodes], numnodes);
+		}
+	}
+
+	assert(nextNodeIdx == node_size);
+
+	/* root index to start traversal at, to handle case of single leaf node */
+	pack.root_index = (pack.is_leaf[0])? -1: 0;
+}
+
+void OBVH::refit_nodes()
+{
+	assert(!params.top_level);
+
+	BoundBox bbox = BoundBox::empty;
+	uint visibility = 0;
+	refit_node(0, (pack.is_leaf[0])? true: false, bbox, visibility);
+}
+
+void OBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
+{
+	int4 *data = &pack.nodes[idx];
+
+	if(leaf) {
+		/* Refit leaf node. */
+		int4 c = data[0];
+		refit_primitives(c.x, c.y, bbox, visibility);
+
+		float4 leaf_data[BVH_ONODE_LEAF_SIZE];
+		memset(leaf_data, 0, sizeof(leaf_data));
+		leaf_data[0].x = __int_as_float(c.x);
+		leaf_data[0].y = __int_as_float(c.y);
+		leaf_data[0].z = __uint_as_float(visibility);
+		leaf_data[0].w = __uint_as_float(c.w);
+		memcpy(&pack.nodes[idx],
+		       leaf_data,
+		       sizeof(float4)*BVH_ONODE_LEAF_SIZE);
+	}
+	else {
+		/* Refit inner node, set bbox from children. */
+		int c[8] = {data[12].x, data[12].y, data[12].z, data[12].w,
+		            data[13].x, data[13].y, data[13].z, data[13].w};
+		BoundBox child_bbox[8];
+		uint child_visibility[8] = {0};
+
+		for(int i = 0; i < 8; ++i) {
+			child_bbox[i] = BoundBox::empty;
+			if(c[i] != 0) {
+				refit_node((c[i] < 0)? -c[i]-1: c[i], (c[i] < 0),
+				           child_bbox[i], child_visibility[i]);
+				bbox.grow(child_bbox[i]);
+				visibility |= child_visibility[i];
+			}
+		}
+
+		float inner_data[BVH_ONODE_SIZE*4];
+		for(int i = 0; i < 8; ++i) {
+			float3 bb_min = child_bbox[i].min;
+			float3 bb_max = child_bbox[i].max;
+			inner_data[0*8 + i] = bb_min.x;
+			inner_data[1*8 + i] = bb_max.x;
+			inner_data[2*8 + i] = bb_min.y;
+			inner_data[3*8 + i] = bb_max.y;
+			inner_data[4*8 + i] = bb_min.z;
+			inner_data[5*8 + i] = bb_max.z;
+			inner_data[6*8 + i] = __int_as_float(c[i]);
+		}
+		memcpy(&pack.nodes[idx],
+		       inner_data,
+		       sizeof(float4)*BVH_ONODE_SIZE);
+	}
+}
+
 CCL_NAMESPACE_END
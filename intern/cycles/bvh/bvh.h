@@ -37,6 +37,8 @@ class Progress;
 
 #define BVH_NODE_SIZE	4
 #define BVH_QNODE_SIZE	7
+#define BVH_ONODE_SIZE	14
+#define BVH_ONODE_LEAF_SIZE	1
 #define BVH_ALIGN		4096
 #define TRI_NODE_SIZE	3
 
@@ -62,7 +64,8 @@ struct PackedBVH {
 	/* mapping from BVH primitive index, to the object id of that primitive. */
 	array<int> prim_object;
 	/* quick array to lookup if a node is a leaf, not used for traversal, only
-	 * for instance BVH merging  */
+	 * for instance BVH merging. OBVH leaves are smaller than inner nodes, so
+	 * this is in the order nodes are stored rather than by node index. */
 	array<bool> is_leaf;
 
 	/* index of the root node. */
@@ -110,6 +113,9 @@ protected:
 	/* merge instance BVH's */
 	void pack_instances(size_t nodes_size);
 
+	/* refit bounds and visibility of leaf primitives */
+	void refit_primitives(int start, int end, BoundBox& bbox, uint& visibility);
+
 	/* for subclasses to implement */
 	virtual void pack_nodes(const BVHNode *root) = 0;
 	virtual void refit_nodes() = 0;
@@ -156,6 +162,28 @@ protected:
 	void refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility);
 };
 
+/* OBVH
+ *
+ * Octo BVH, with each node having eight children, to use with AVX instructions.
+ * Leaves only store their primitive range in a single float4, so nodes differ
+ * in size and are addressed by their offset in the nodes array. */
+
+class OBVH : public BVH {
+protected:
+	/* constructor */
+	friend class BVH;
+	OBVH(const BVHParams& params, const vector<Object*>& objects);
+
+	/* pack */
+	void pack_nodes(const BVHNode *root);
+	void pack_leaf(const BVHStackEntry& e, const LeafNode *leaf);
+	void pack_inner(const BVHStackEntry& e, const BVHStackEntry *en, int num);
+
+	/* refit */
+	void refit_nodes();
+	void refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility);
+};
+
 CCL_NAMESPACE_END
 
 #endif /* __BVH_H__ */
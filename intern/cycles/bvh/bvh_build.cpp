@@ -62,6 +62,30 @@ public:
 	BVHObjectBinning range;
 };
 
+/* Spatial Split Build Task
+ *
+ * Spatial splits insert duplicate references, so every task builds from its
+ * own copy of the references in its range. */
+
+class BVHSpatialSplitBuildTask : public Task {
+public:
+	BVHSpatialSplitBuildTask(BVHBuild *build,
+	                         InnerNode *node,
+	                         int child,
+	                         const BVHRange& range_,
+	                         const vector<BVHReference>& references_,
+	                         int level)
+	: range(range_),
+	  references(references_.begin() + range_.start(), references_.begin() + range_.end())
+	{
+		range.set_start(0);
+		run = function_bind(&BVHBuild::thread_build_spatial_split_node, build, node, child, &range, &references, level);
+	}
+
+	BVHRange range;
+	vector<BVHReference> references;
+};
+
 /* Constructor / Destructor */
 
 BVHBuild::BVHBuild(const vector<Object*>& objects_,
@@ -235,8 +259,6 @@ BVHNode* BVHBuild::run()
 		params.use_spatial_split = false;
 
 	spatial_min_overlap = root.bounds().safe_area() * params.spatial_split_alpha;
-	spatial_right_bounds.clear();
-	spatial_right_bounds.resize(max(root.size(), (int)BVHParams::NUM_SPATIAL_BINS) - 1);
 
 	/* init progress updates */
 	double build_start_time;
@@ -245,16 +267,37 @@ BVHNode* BVHBuild::run()
 	progress_total = references.size();
 	progress_original_total = progress_total;
 
-	prim_type.resize(references.size());
-	prim_index.resize(references.size());
-	prim_object.resize(references.size());
+	if(params.use_spatial_split) {
+		/* leaves are appended as tasks finish, see spatial_storage_add_prims */
+		prim_type.clear();
+		prim_index.clear();
+		prim_object.clear();
+		prim_type.reserve(references.size());
+		prim_index.reserve(references.size());
+		prim_object.reserve(references.size());
+	}
+	else {
+		prim_type.resize(references.size());
+		prim_index.resize(references.size());
+		prim_object.resize(references.size());
+	}
 
 	/* build recursively */
 	BVHNode *rootnode;
 
 	if(params.use_spatial_split) {
-		/* singlethreaded spatial split build */
-		rootnode = build_node(root, 0);
+		/* multithreaded spatial split build */
+		BVHSpatialStorage storage;
+		storage.right_bounds.resize(max(root.size(), (int)BVHParams::NUM_SPATIAL_BINS) - 1);
+
+		rootnode = build_node(root, &references, 0, &storage);
+
+		/* tasks build from their own copies, no need to keep these around */
+		references.free_memory();
+
+		task_pool.wait_work();
+
+		spatial_storage_add_prims(&storage);
 	}
 	else {
 		/* multithreaded binning build */
@@ -270,7 +313,7 @@ BVHNode* BVHBuild::run()
 			rootnode = NULL;
 			VLOG(1) << "BVH build cancelled.";
 		}
-		else if(!params.use_spatial_split) {
+		else {
 			/*rotate(rootnode, 4, 5);*/
 			rootnode->update_visibility();
 			VLOG(1) << "BVH build statistics:\n"
@@ -325,7 +368,54 @@ void BVHBuild::thread_build_node(InnerNode *inner, int child, BVHObjectBinning *
 	}
 }
 
-bool BVHBuild::range_within_max_leaf_size(const BVHRange& range)
+void BVHBuild::thread_build_spatial_split_node(InnerNode *inner,
+                                               int child,
+                                               BVHRange *range,
+                                               vector<BVHReference> *references,
+                                               int level)
+{
+	if(progress.get_cancel())
+		return;
+
+	/* build nodes */
+	BVHSpatialStorage storage;
+	storage.right_bounds.resize(max(range->size(), (int)BVHParams::NUM_SPATIAL_BINS) - 1);
+
+	BVHNode *node = build_node(*range, references, level, &storage);
+
+	/* set child in inner node */
+	inner->children[child] = node;
+
+	/* add primitives of the leaves, also updates progress */
+	spatial_storage_add_prims(&storage);
+}
+
+void BVHBuild::spatial_storage_add_prims(BVHSpatialStorage *storage)
+{
+	int start;
+
+	{
+		thread_scoped_lock lock(build_mutex);
+
+		start = prim_type.size();
+		prim_type.insert(prim_type.end(), storage->prim_type.begin(), storage->prim_type.end());
+		prim_index.insert(prim_index.end(), storage->prim_index.begin(), storage->prim_index.end());
+		prim_object.insert(prim_object.end(), storage->prim_object.begin(), storage->prim_object.end());
+
+		progress_count += storage->prim_type.size();
+		progress_total += storage->num_duplicates;
+		progress_update();
+	}
+
+	/* leaves of this task only, no other thread accesses them */
+	foreach(LeafNode *leaf, storage->leaves) {
+		leaf->m_lo += start;
+		leaf->m_hi += start;
+	}
+}
+
+bool BVHBuild::range_within_max_leaf_size(const BVHRange& range,
+                                          const vector<BVHReference>& references) const
 {
 	size_t size = range.size();
 	size_t max_leaf_size = max(params.max_triangle_leaf_size, params.max_curve_leaf_size);
@@ -338,7 +428,7 @@ bool BVHBuild::range_within_max_leaf_size(const BVHRange& range)
 	size_t num_motion_curves = 0;
 
 	for(int i = 0; i < size; i++) {
-		BVHReference& ref = references[range.start() + i];
+		const BVHReference& ref = references[range.start() + i];
 
 		if(ref.prim_type() & PRIMITIVE_CURVE)
 			num_curves++;
@@ -364,8 +454,8 @@ BVHNode* BVHBuild::build_node(const BVHObjectBinning& range, int level)
 	 * visibility tests, since object instances do not check visibility flag */
 	if(!(range.size() > 0 && params.top_level && level == 0)) {
 		/* make leaf node when threshold reached or SAH tells us */
-		if(params.small_enough_for_leaf(size, level) || (range_within_max_leaf_size(range) && leafSAH < splitSAH))
-			return create_leaf_node(range);
+		if(params.small_enough_for_leaf(size, level) || (range_within_max_leaf_size(range, references) && leafSAH < splitSAH))
+			return create_leaf_node(range, references, NULL);
 	}
 
 	/* perform split */
@@ -393,29 +483,25 @@ BVHNode* BVHBuild::build_node(const BVHObjectBinning& range, int level)
 	return inner;
 }
 
-/* single threaded spatial split builder */
-BVHNode* BVHBuild::build_node(const BVHRange& range, int level)
+/* multithreaded spatial split builder */
+BVHNode* BVHBuild::build_node(const BVHRange& range,
+                              vector<BVHReference> *references,
+                              int level,
+                              BVHSpatialStorage *storage)
 {
-	/* progress update */
-	progress_update();
-	if(progress.get_cancel())
-		return NULL;
-
 	/* small enough or too deep => create leaf. */
 	if(!(range.size() > 0 && params.top_level && level == 0)) {
 		if(params.small_enough_for_leaf(range.size(), level)) {
-			progress_count += range.size();
-			return create_leaf_node(range);
+			return create_leaf_node(range, *references, storage);
 		}
 	}
 
 	/* splitting test */
-	BVHMixedSplit split(this, range, level);
+	BVHMixedSplit split(this, storage, range, references, level);
 
 	if(!(range.size() > 0 && params.top_level && level == 0)) {
 		if(split.no_split) {
-			progress_count += range.size();
-			return create_leaf_node(range);
+			return create_leaf_node(range, *references, storage);
 		}
 	}
 	
@@ -423,18 +509,31 @@ BVHNode* BVHBuild::build_node(const BVHRange& range, int level)
 	BVHRange left, right;
 	split.split(this, left, right, range);
 
-	progress_total += left.size() + right.size() - range.size();
-	size_t total = progress_total;
+	storage->num_duplicates += left.size() + right.size() - range.size();
+
+	if(range.size() < THREAD_TASK_SIZE) {
+		/* local build */
+		size_t num_references = references->size();
+
+		/* left node */
+		BVHNode *leftnode = build_node(left, references, level + 1, storage);
 
-	/* left node */
-	BVHNode *leftnode = build_node(left, level + 1);
+		/* right node (modify start for splits in the left node) */
+		right.set_start(right.start() + references->size() - num_references);
+		BVHNode *rightnode = build_node(right, references, level + 1, storage);
 
-	/* right node (modify start for splits) */
-	right.set_start(right.start() + progress_total - total);
-	BVHNode *rightnode = build_node(right, level + 1);
+		/* inner node */
+		return new InnerNode(range.bounds(), leftnode, rightnode);
+	}
+	else {
+		/* threaded build */
+		InnerNode *inner = new InnerNode(range.bounds());
 
-	/* inner node */
-	return new InnerNode(range.bounds(), leftnode, rightnode);
+		task_pool.push(new BVHSpatialSplitBuildTask(this, inner, 0, left, *references, level + 1), true);
+		task_pool.push(new BVHSpatialSplitBuildTask(this, inner, 1, right, *references, level + 1), true);
+
+		return inner;
+	}
 }
 
 /* Create Nodes */
@@ -481,25 +580,38 @@ BVHNode *BVHBuild::create_primitive_leaf_node(const int *p_type,
                                               const BoundBox& bounds,
                                               uint visibility,
                                               int start,
-                                              int num)
+                                              int num,
+                                              BVHSpatialStorage *storage)
 {
+	vector<int>& r_prim_type = (storage)? storage->prim_type: prim_type;
+	vector<int>& r_prim_index = (storage)? storage->prim_index: prim_index;
+	vector<int>& r_prim_object = (storage)? storage->prim_object: prim_object;
+
 	for(int i = 0; i < num; ++i) {
-		if(start + i == prim_index.size()) {
+		if(start + i == r_prim_index.size()) {
 			assert(params.use_spatial_split);
-			prim_type.push_back(p_type[i]);
-			prim_index.push_back(p_index[i]);
-			prim_object.push_back(p_object[i]);
+			r_prim_type.push_back(p_type[i]);
+			r_prim_index.push_back(p_index[i]);
+			r_prim_object.push_back(p_object[i]);
 		}
 		else {
-			prim_type[start + i] = p_type[i];
-			prim_index[start + i] = p_index[i];
-			prim_object[start + i] = p_object[i];
+			r_prim_type[start + i] = p_type[i];
+			r_prim_index[start + i] = p_index[i];
+			r_prim_object[start + i] = p_object[i];
 		}
 	}
-	return new LeafNode(bounds, visibility, start, start + num);
+
+	LeafNode *leaf = new LeafNode(bounds, visibility, start, start + num);
+
+	if(storage)
+		storage->leaves.push_back(leaf);
+
+	return leaf;
 }
 
-BVHNode* BVHBuild::create_leaf_node(const BVHRange& range)
+BVHNode* BVHBuild::create_leaf_node(const BVHRange& range,
+                                    vector<BVHReference>& references,
+                                    BVHSpatialStorage *storage)
 {
 	/* TODO(sergey): Consider writing own allocator which would
 	 * not do heap allocation if number of elements is relatively small.
@@ -535,10 +647,11 @@ BVHNode* BVHBuild::create_leaf_node(const BVHRange& range)
 		}
 	}
 
-	/* Create leaf nodes for every existing primitive. */
+	/* Create leaf nodes for every existing primitive.
+	 * With spatial splits these index the storage of the task for now. */
 	BVHNode *leaves[PRIMITIVE_NUM_TOTAL + 1] = {NULL};
 	int num_leaves = 0;
-	int start = range.start();
+	int start = (storage)? (int)storage->prim_type.size(): range.start();
 	for(int i = 0; i < PRIMITIVE_NUM_TOTAL; ++i) {
 		int num = (int)p_type[i].size();
 		if(num != 0) {
@@ -550,7 +663,8 @@ BVHNode* BVHBuild::create_leaf_node(const BVHRange& range)
 			                                                bounds[i],
 			                                                visibility[i],
 			                                                start,
-			                                                num);
+			                                                num,
+			                                                storage);
 			++num_leaves;
 			start += num;
 		}
@@ -563,6 +677,11 @@ BVHNode* BVHBuild::create_leaf_node(const BVHRange& range)
 		 */
 		const BVHReference *ref = (ob_num)? &references[range.start()]: NULL;
 		leaves[num_leaves] = create_object_leaf_nodes(ref, start, ob_num);
+		if(storage) {
+			/* objects only go into top level BVH's, built without spatial splits */
+			assert(ob_num == 0);
+			storage->leaves.push_back((LeafNode*)leaves[num_leaves]);
+		}
 		++num_leaves;
 	}
 
@@ -30,12 +30,40 @@
 CCL_NAMESPACE_BEGIN
 
 class BVHBuildTask;
+class BVHSpatialSplitBuildTask;
 class BVHParams;
 class InnerNode;
+class LeafNode;
 class Mesh;
 class Object;
 class Progress;
 
+/* BVH Spatial Storage
+ *
+ * The spatial split builder runs in tasks that each have their own storage,
+ * for finding splits and for the primitives of the leaves they create. Those
+ * get added to the BVH at once when the task is done. */
+
+struct BVHSpatialStorage
+{
+	BVHSpatialStorage() : num_duplicates(0) {}
+
+	/* accumulated bounds when sweeping from right to left */
+	vector<BoundBox> right_bounds;
+
+	/* bins used for histogram when selecting best split plane */
+	BVHSpatialBin bins[3][BVHParams::NUM_SPATIAL_BINS];
+
+	/* primitives of the leaves, which index these until added to the BVH */
+	vector<int> prim_type;
+	vector<int> prim_index;
+	vector<int> prim_object;
+	vector<LeafNode*> leaves;
+
+	/* references added by spatial splits, for progress */
+	size_t num_duplicates;
+};
+
 /* BVH Builder */
 
 class BVHBuild
@@ -58,6 +86,7 @@ protected:
 	friend class BVHObjectSplit;
 	friend class BVHSpatialSplit;
 	friend class BVHBuildTask;
+	friend class BVHSpatialSplitBuildTask;
 
 	/* adding references */
 	void add_reference_mesh(BoundBox& root, BoundBox& center, Mesh *mesh, int i);
@@ -65,9 +94,14 @@ protected:
 	void add_references(BVHRange& root);
 
 	/* building */
-	BVHNode *build_node(const BVHRange& range, int level);
+	BVHNode *build_node(const BVHRange& range,
+	                    vector<BVHReference> *references,
+	                    int level,
+	                    BVHSpatialStorage *storage);
 	BVHNode *build_node(const BVHObjectBinning& range, int level);
-	BVHNode *create_leaf_node(const BVHRange& range);
+	BVHNode *create_leaf_node(const BVHRange& range,
+	                          vector<BVHReference>& references,
+	                          BVHSpatialStorage *storage);
 	BVHNode *create_object_leaf_nodes(const BVHReference *ref, int start, int num);
 
 	/* Leaf node type splitting. */
@@ -77,13 +111,21 @@ protected:
 	                                    const BoundBox& bounds,
 	                                    uint visibility,
 	                                    int start,
-	                                    int nun);
+	                                    int nun,
+	                                    BVHSpatialStorage *storage);
 
-	bool range_within_max_leaf_size(const BVHRange& range);
+	bool range_within_max_leaf_size(const BVHRange& range,
+	                                const vector<BVHReference>& references) const;
 
 	/* threads */
 	enum { THREAD_TASK_SIZE = 4096 };
 	void thread_build_node(InnerNode *node, int child, BVHObjectBinning *range, int level);
+	void thread_build_spatial_split_node(InnerNode *node,
+	                                     int child,
+	                                     BVHRange *range,
+	                                     vector<BVHReference> *references,
+	                                     int level);
+	void spatial_storage_add_prims(BVHSpatialStorage *storage);
 	thread_mutex build_mutex;
 
 	/* progress */
@@ -115,8 +157,6 @@ protected:
 
 	/* spatial splitting */
 	float spatial_min_overlap;
-	vector<BoundBox> spatial_right_bounds;
-	BVHSpatialBin spatial_bins[3][BVHParams::NUM_SPATIAL_BINS];
 
 	/* threads */
 	TaskPool task_pool;
@@ -61,6 +61,15 @@ int BVHNode::getSubtreeSize(BVH_STAT stat) const
 				}
 			}
 			return cnt;
+		case BVH_STAT_ONODE_COUNT:
+			cnt = 1;
+			if(!is_leaf()) {
+				const BVHNode *nodes[8];
+				int num_nodes = collect_children(nodes, 8);
+				for(int i = 0; i < num_nodes; i++)
+					cnt += nodes[i]->getSubtreeSize(stat);
+			}
+			return cnt;
 		default:
 			assert(0); /* unknown mode */
 	}
@@ -106,6 +115,38 @@ uint BVHNode::update_visibility()
 	return m_visibility;
 }
 
+int BVHNode::collect_children(const BVHNode **nodes, int max_nodes) const
+{
+	assert(!is_leaf());
+
+	int num_nodes = 0;
+	for(int i = 0; i < num_children(); i++)
+		nodes[num_nodes++] = get_child(i);
+
+	/* Open the inner node with the largest surface area, until there are
+	 * enough children or only leaves are left. */
+	while(num_nodes < max_nodes) {
+		int best = -1;
+		float best_area = -FLT_MAX;
+
+		for(int i = 0; i < num_nodes; i++) {
+			if(!nodes[i]->is_leaf() && nodes[i]->m_bounds.safe_area() > best_area) {
+				best = i;
+				best_area = nodes[i]->m_bounds.safe_area();
+			}
+		}
+
+		if(best == -1)
+			break;
+
+		const BVHNode *node = nodes[best];
+		nodes[best] = node->get_child(0);
+		nodes[num_nodes++] = node->get_child(1);
+	}
+
+	return num_nodes;
+}
+
 /* Inner Node */
 
 void InnerNode::print(int depth) const
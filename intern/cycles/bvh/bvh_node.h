@@ -32,6 +32,7 @@ enum BVH_STAT
 	BVH_STAT_TRIANGLE_COUNT,
 	BVH_STAT_CHILDNODE_COUNT,
 	BVH_STAT_QNODE_COUNT,
+	BVH_STAT_ONODE_COUNT,
 };
 
 class BVHParams;
@@ -59,6 +60,9 @@ public:
 	void deleteSubtree();
 
 	uint update_visibility();
+
+	/* Children of a wide BVH node, found by opening inner nodes. */
+	int collect_children(const BVHNode **nodes, int max_nodes) const;
 };
 
 class InnerNode : public BVHNode
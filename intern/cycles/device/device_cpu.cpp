@@ -29,6 +29,7 @@
 #include "kernel_compat_cpu.h"
 #include "kernel_types.h"
 #include "kernel_globals.h"
+#include "kernel_texture_cache_globals.h"
 
 #include "osl_shader.h"
 #include "osl_globals.h"
@@ -54,6 +55,7 @@ public:
 #ifdef WITH_OSL
 	OSLGlobals osl_globals;
 #endif
+	TextureCacheGlobals texture_cache_globals;
 	
 	CPUDevice(DeviceInfo& info, Stats &stats, bool background)
 	: Device(info, stats, background)
@@ -61,6 +63,8 @@ public:
 #ifdef WITH_OSL
 		kernel_globals.osl = &osl_globals;
 #endif
+		kernel_globals.texture_cache = NULL;
+		kernel_globals.texture_cache_tdata = NULL;
 
 		/* do now to avoid thread issues */
 		system_cpu_support_sse2();
@@ -139,6 +143,11 @@ public:
 #endif
 	}
 
+	void *texture_cache_memory()
+	{
+		return &texture_cache_globals;
+	}
+
 	void thread_run(DeviceTask *task)
 	{
 		if(task->type == DeviceTask::PATH_TRACE)
@@ -170,6 +179,7 @@ public:
 #ifdef WITH_OSL
 		OSLShader::thread_init(&kg, &kernel_globals, &osl_globals);
 #endif
+		TextureCache::thread_init(&kg, &texture_cache_globals);
 
 		RenderTile tile;
 
@@ -223,6 +233,28 @@ public:
 
 				tile.sample = sample + 1;
 
+				if(task.adaptive_sampling) {
+					/* test convergence every few samples, once a whole tile
+					 * converged its remaining samples are skipped */
+					if((sample + 1) % 4 == 0 && sample + 1 < end_sample &&
+					   kernel_cpu_adaptive_sampling_converged(&kg, render_buffer, sample + 1, end_sample,
+					                                          tile.x, tile.y, tile.w, tile.h, tile.offset, tile.stride))
+					{
+						kernel_cpu_adaptive_sampling_adjust(&kg, render_buffer, end_sample,
+						                                    tile.x, tile.y, tile.w, tile.h, tile.offset, tile.stride);
+
+						for(int i = tile.sample; i < end_sample; i++)
+							task.update_progress_sample();
+
+						tile.sample = end_sample;
+						task.update_progress(&tile);
+						break;
+					}
+
+					kernel_cpu_adaptive_sampling_adjust(&kg, render_buffer, sample + 1,
+					                                    tile.x, tile.y, tile.w, tile.h, tile.offset, tile.stride);
+				}
+
 				task.update_progress(&tile);
 			}
 
@@ -237,6 +269,7 @@ public:
 #ifdef WITH_OSL
 		OSLShader::thread_free(&kg);
 #endif
+		TextureCache::thread_free(&kg);
 	}
 
 	void thread_film_convert(DeviceTask& task)
@@ -322,6 +355,7 @@ public:
 #ifdef WITH_OSL
 		OSLShader::thread_init(&kg, &kernel_globals, &osl_globals);
 #endif
+		TextureCache::thread_init(&kg, &texture_cache_globals);
 		void(*shader_kernel)(KernelGlobals*, uint4*, float4*, int, int, int, int);
 
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX2
@@ -366,6 +400,7 @@ public:
 #ifdef WITH_OSL
 		OSLShader::thread_free(&kg);
 #endif
+		TextureCache::thread_free(&kg);
 	}
 
 	int get_split_task_count(DeviceTask& task)
@@ -65,6 +65,7 @@ public:
 
 	bool need_finish_queue;
 	bool integrator_branched;
+	bool adaptive_sampling;
 protected:
 	double last_update_time;
 };
@@ -0,0 +1,168 @@
+/*
+ * Copyright 2011-2016, Blender Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* 8-wide BVH, nodes store the bounds of all children as AVX vectors:
+ *
+ * 0-1: min.x, 2-3: max.x, 4-5: min.y, 6-7: max.y, 8-9: min.z, 10-11: max.z,
+ * 12-13: child node addresses.
+ *
+ * Leaves are a single float4 with the primitive range, visibility and type.
+ * As nodes differ in size, node addresses are float4 offsets into the nodes
+ * array rather than node indices.
+ */
+
+struct OBVHStackItem {
+	int addr;
+	float dist;
+};
+
+ccl_device_inline int obvh_node_intersect(KernelGlobals *__restrict kg,
+                                          const avxf& tnear,
+                                          const avxf& tfar,
+                                          const avx3f& org_idir,
+                                          const avx3f& idir,
+                                          const int near_x,
+                                          const int near_y,
+                                          const int near_z,
+                                          const int far_x,
+                                          const int far_y,
+                                          const int far_z,
+                                          const int nodeAddr,
+                                          avxf *__restrict dist)
+{
+	const int offset = nodeAddr;
+	const avxf tnear_x = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+near_x), idir.x, org_idir.x);
+	const avxf tnear_y = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+near_y), idir.y, org_idir.y);
+	const avxf tnear_z = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+near_z), idir.z, org_idir.z);
+	const avxf tfar_x = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+far_x), idir.x, org_idir.x);
+	const avxf tfar_y = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+far_y), idir.y, org_idir.y);
+	const avxf tfar_z = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+far_z), idir.z, org_idir.z);
+
+	const avxf tNear = max4(tnear_x, tnear_y, tnear_z, tnear);
+	const avxf tFar = min4(tfar_x, tfar_y, tfar_z, tfar);
+	*dist = tNear;
+	return movemask(tNear <= tFar);
+}
+
+ccl_device_inline int obvh_node_intersect_robust(KernelGlobals *__restrict kg,
+                                                 const avxf& tnear,
+                                                 const avxf& tfar,
+                                                 const avx3f& P_idir,
+                                                 const avx3f& idir,
+                                                 const int near_x,
+                                                 const int near_y,
+                                                 const int near_z,
+                                                 const int far_x,
+                                                 const int far_y,
+                                                 const int far_z,
+                                                 const int nodeAddr,
+                                                 const float difl,
+                                                 avxf *__restrict dist)
+{
+	const int offset = nodeAddr;
+	const avxf tnear_x = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+near_x), idir.x, P_idir.x);
+	const avxf tnear_y = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+near_y), idir.y, P_idir.y);
+	const avxf tnear_z = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+near_z), idir.z, P_idir.z);
+	const avxf tfar_x = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+far_x), idir.x, P_idir.x);
+	const avxf tfar_y = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+far_y), idir.y, P_idir.y);
+	const avxf tfar_z = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+far_z), idir.z, P_idir.z);
+
+	const float round_down = 1.0f - difl;
+	const float round_up = 1.0f + difl;
+	const avxf tNear = max4(tnear_x, tnear_y, tnear_z, tnear);
+	const avxf tFar = min4(tfar_x, tfar_y, tfar_z, tfar);
+	*dist = tNear;
+	return movemask(round_down*tNear <= round_up*tFar);
+}
+
+/* Push the children that were hit onto the stack, sorted so the closest one
+ * ends up on top, and return the closest one to be traversed next. node_dist
+ * may be NULL for traversal that does not track distances. */
+ccl_device_inline int obvh_node_children_push(KernelGlobals *__restrict kg,
+                                              const int nodeAddr,
+                                              int child_mask,
+                                              const avxf& dist,
+                                              OBVHStackItem *__restrict stack,
+                                              int *__restrict stack_ptr,
+                                              float *__restrict node_dist)
+{
+	const int offset = nodeAddr;
+	const float4 cnodes[2] = {kernel_tex_fetch(__bvh_nodes, offset+12),
+	                          kernel_tex_fetch(__bvh_nodes, offset+13)};
+
+	int r = __bscf(child_mask);
+	int c0 = __float_as_int(cnodes[r >> 2][r & 3]);
+	float d0 = dist[r];
+
+	/* One child was hit, continue with it. */
+	if(child_mask == 0) {
+		if(node_dist) *node_dist = d0;
+		return c0;
+	}
+
+	r = __bscf(child_mask);
+	int c1 = __float_as_int(cnodes[r >> 2][r & 3]);
+	float d1 = dist[r];
+
+	/* Two children were hit, push the far one and continue with the closest. */
+	if(child_mask == 0) {
+		++*stack_ptr;
+		kernel_assert(*stack_ptr < BVH_OSTACK_SIZE);
+		if(d1 < d0) {
+			stack[*stack_ptr].addr = c0;
+			stack[*stack_ptr].dist = d0;
+			if(node_dist) *node_dist = d1;
+			return c1;
+		}
+		stack[*stack_ptr].addr = c1;
+		stack[*stack_ptr].dist = d1;
+		if(node_dist) *node_dist = d0;
+		return c0;
+	}
+
+	/* Three or more children were hit, push all of them and sort the pushed
+	 * items by distance with the closest one on top. */
+	const int first = *stack_ptr + 1;
+	stack[first].addr = c0;
+	stack[first].dist = d0;
+	stack[first+1].addr = c1;
+	stack[first+1].dist = d1;
+	*stack_ptr = first + 1;
+
+	while(child_mask != 0) {
+		r = __bscf(child_mask);
+		++*stack_ptr;
+		stack[*stack_ptr].addr = __float_as_int(cnodes[r >> 2][r & 3]);
+		stack[*stack_ptr].dist = dist[r];
+	}
+	kernel_assert(*stack_ptr < BVH_OSTACK_SIZE);
+
+	for(int i = first + 1; i <= *stack_ptr; i++) {
+		OBVHStackItem item = stack[i];
+		int j = i - 1;
+		while(j >= first && stack[j].dist < item.dist) {
+			stack[j+1] = stack[j];
+			j--;
+		}
+		stack[j+1] = item;
+	}
+
+	/* Pop the closest one. */
+	const int addr = stack[*stack_ptr].addr;
+	if(node_dist) *node_dist = stack[*stack_ptr].dist;
+	--*stack_ptr;
+	return addr;
+}
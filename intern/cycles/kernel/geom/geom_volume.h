@@ -62,7 +62,7 @@ ccl_device float volume_attribute_float(KernelGlobals *kg, const ShaderData *sd,
 	if(dx) *dx = 0.0f;
 	if(dy) *dy = 0.0f;
 
-	/* todo: support float textures to lower memory usage for single floats */
+	/* single channel images on the CPU return the value in all channels */
 	return average(float4_to_float3(r));
 }
 
@@ -37,6 +37,20 @@ void kernel_const_copy(KernelGlobals *kg, const char *name, void *host, size_t s
 		assert(0);
 }
 
+template<typename T>
+static void kernel_tex_image_copy(texture_image<T> *images, int num_images, int array_index,
+                                  device_ptr mem, size_t width, size_t height, size_t depth,
+                                  InterpolationType interpolation)
+{
+	if(array_index >= 0 && array_index < num_images) {
+		texture_image<T> *tex = &images[array_index];
+
+		tex->data = (T*)mem;
+		tex->dimensions_set(width, height, depth);
+		tex->interpolation = interpolation;
+	}
+}
+
 void kernel_tex_copy(KernelGlobals *kg, const char *name, device_ptr mem, size_t width, size_t height, size_t depth, InterpolationType interpolation)
 {
 	if(0) {
@@ -50,6 +64,27 @@ void kernel_tex_copy(KernelGlobals *kg, const char *name, device_ptr mem, size_t
 #define KERNEL_IMAGE_TEX(type, ttype, tname)
 #include "kernel_textures.h"
 
+	/* check the longer names first, they share a prefix with float and byte images */
+	else if(strstr(name, "__tex_image_half4")) {
+		int id = atoi(name + strlen("__tex_image_half4_"));
+		kernel_tex_image_copy(kg->texture_half4_images, MAX_HALF4_IMAGES, id - IMAGE_HALF4_START,
+		                      mem, width, height, depth, interpolation);
+	}
+	else if(strstr(name, "__tex_image_float1")) {
+		int id = atoi(name + strlen("__tex_image_float1_"));
+		kernel_tex_image_copy(kg->texture_float1_images, MAX_FLOAT1_IMAGES, id - IMAGE_FLOAT1_START,
+		                      mem, width, height, depth, interpolation);
+	}
+	else if(strstr(name, "__tex_image_byte1")) {
+		int id = atoi(name + strlen("__tex_image_byte1_"));
+		kernel_tex_image_copy(kg->texture_byte1_images, MAX_BYTE1_IMAGES, id - IMAGE_BYTE1_START,
+		                      mem, width, height, depth, interpolation);
+	}
+	else if(strstr(name, "__tex_image_half1")) {
+		int id = atoi(name + strlen("__tex_image_half1_"));
+		kernel_tex_image_copy(kg->texture_half1_images, MAX_HALF1_IMAGES, id - IMAGE_HALF1_START,
+		                      mem, width, height, depth, interpolation);
+	}
 	else if(strstr(name, "__tex_image_float")) {
 		texture_image_float4 *tex = NULL;
 		int id = atoi(name + strlen("__tex_image_float_"));
@@ -128,5 +163,19 @@ void kernel_cpu_shader(KernelGlobals *kg, uint4 *input, float4 *output, int type
 		kernel_shader_evaluate(kg, input, output, (ShaderEvalType)type, i, sample);
 }
 
+/* Adaptive Sampling
+ *
+ * Only loops over the tile buffer, no need for optimized variants. */
+
+bool kernel_cpu_adaptive_sampling_converged(KernelGlobals *kg, float *buffer, int sample, int num_samples, int x, int y, int w, int h, int offset, int stride)
+{
+	return kernel_adaptive_sampling_tile_converged(kg, buffer, sample, num_samples, x, y, w, h, offset, stride);
+}
+
+void kernel_cpu_adaptive_sampling_adjust(KernelGlobals *kg, float *buffer, int sample, int x, int y, int w, int h, int offset, int stride)
+{
+	kernel_adaptive_sampling_tile_adjust(kg, buffer, sample, x, y, w, h, offset, stride);
+}
+
 CCL_NAMESPACE_END
 
@@ -42,6 +42,10 @@ void kernel_cpu_convert_to_half_float(KernelGlobals *kg, uchar4 *rgba, float *bu
 	float sample_scale, int x, int y, int offset, int stride);
 void kernel_cpu_shader(KernelGlobals *kg, uint4 *input, float4 *output,
 	int type, int i, int offset, int sample);
+bool kernel_cpu_adaptive_sampling_converged(KernelGlobals *kg, float *buffer, int sample, int num_samples,
+	int x, int y, int w, int h, int offset, int stride);
+void kernel_cpu_adaptive_sampling_adjust(KernelGlobals *kg, float *buffer, int sample,
+	int x, int y, int w, int h, int offset, int stride);
 
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE2
 void kernel_cpu_sse2_path_trace(KernelGlobals *kg, float *buffer, unsigned int *rng_state,
@@ -0,0 +1,188 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+CCL_NAMESPACE_BEGIN
+
+/* Adaptive Sampling
+ *
+ * Every second sample is also accumulated in an auxiliary pass, the difference
+ * between the two halves estimates the error of a pixel, as in "A Hierarchical
+ * Automatic Stopping Condition for Monte Carlo Global Illumination", Dammertz
+ * et al. Converged pixels are flagged in the w component of the auxiliary pass
+ * and skipped by path tracing, the number of samples they took is stored in
+ * the sample count pass. */
+
+ccl_device_inline bool kernel_adaptive_sampling_skip(KernelGlobals *kg, ccl_global float *buffer, int sample)
+{
+	if(!(kernel_data.film.pass_flag & PASS_ADAPTIVE_AUX_BUFFER) || sample == 0)
+		return false;
+
+	ccl_global float4 *aux = (ccl_global float4*)(buffer + kernel_data.film.pass_adaptive_aux_buffer);
+	return (aux->w != 0.0f);
+}
+
+ccl_device_inline void kernel_adaptive_sampling_write(KernelGlobals *kg, ccl_global float *buffer, int sample, float4 L)
+{
+	if(!(kernel_data.film.pass_flag & PASS_ADAPTIVE_AUX_BUFFER))
+		return;
+
+	ccl_global float4 *aux = (ccl_global float4*)(buffer + kernel_data.film.pass_adaptive_aux_buffer);
+
+	if(sample == 0)
+		*aux = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+	else if(sample & 1)
+		*aux = *aux + make_float4(L.x, L.y, L.z, 0.0f);
+
+	kernel_write_pass_float(buffer + kernel_data.film.pass_sample_count, sample, 1.0f);
+}
+
+#ifdef __KERNEL_CPU__
+
+/* Flag the pixel as converged when its error is below the threshold. */
+ccl_device void kernel_adaptive_sampling_convergence(KernelGlobals *kg, ccl_global float *buffer, float threshold)
+{
+	ccl_global float4 *aux = (ccl_global float4*)(buffer + kernel_data.film.pass_adaptive_aux_buffer);
+
+	if(aux->w != 0.0f)
+		return;
+
+	float4 I = *((ccl_global float4*)(buffer + kernel_data.film.pass_combined));
+	float num_samples = buffer[kernel_data.film.pass_sample_count];
+
+	/* difference of accumulated even and odd samples, relative to the square
+	 * root of the intensity since noise is perceived relative to brightness */
+	float error = (fabsf(I.x - 2.0f*aux->x) + fabsf(I.y - 2.0f*aux->y) + fabsf(I.z - 2.0f*aux->z)) /
+	              (num_samples*0.0001f + sqrtf(max(I.x + I.y + I.z, 0.0f)));
+
+	if(error < threshold*num_samples)
+		aux->w = 1.0f;
+}
+
+/* Pixels next to unconverged ones keep sampling too, so that pixels of which
+ * both halves happen to agree do not stop early. Returns true when all pixels
+ * of the row or column converged. */
+ccl_device bool kernel_adaptive_sampling_filter(KernelGlobals *kg, ccl_global float *buffer, int num, int step)
+{
+	int pass_offset = kernel_data.film.pass_adaptive_aux_buffer;
+	bool prev_converged = true;
+	bool all_converged = true;
+
+	for(int i = 0; i < num; i++) {
+		ccl_global float4 *aux = (ccl_global float4*)(buffer + i*step + pass_offset);
+		bool converged = (aux->w != 0.0f);
+
+		if(!converged) {
+			all_converged = false;
+
+			if(i > 0)
+				((ccl_global float4*)(buffer + (i - 1)*step + pass_offset))->w = 0.0f;
+		}
+		else if(!prev_converged)
+			aux->w = 0.0f;
+
+		prev_converged = converged;
+	}
+
+	return all_converged;
+}
+
+/* Scale passes of converged pixels as if they took as many samples as the
+ * rest of the tile, so that buffers can be normalized as a whole. */
+ccl_device void kernel_adaptive_sampling_adjust(KernelGlobals *kg, ccl_global float *buffer, int sample)
+{
+	float num_samples = buffer[kernel_data.film.pass_sample_count];
+
+	if(num_samples >= (float)sample || num_samples == 0.0f)
+		return;
+
+	/* passes written only for the first sample keep their value */
+	int flag = kernel_data.film.pass_flag;
+	float depth = (flag & PASS_DEPTH)? buffer[kernel_data.film.pass_depth]: 0.0f;
+	float object_id = (flag & PASS_OBJECT_ID)? buffer[kernel_data.film.pass_object_id]: 0.0f;
+	float material_id = (flag & PASS_MATERIAL_ID)? buffer[kernel_data.film.pass_material_id]: 0.0f;
+	float converged = buffer[kernel_data.film.pass_adaptive_aux_buffer + 3];
+
+	float scale = (float)sample/num_samples;
+
+	for(int i = 0; i < kernel_data.film.pass_stride; i++)
+		buffer[i] *= scale;
+
+	if(flag & PASS_DEPTH)
+		buffer[kernel_data.film.pass_depth] = depth;
+	if(flag & PASS_OBJECT_ID)
+		buffer[kernel_data.film.pass_object_id] = object_id;
+	if(flag & PASS_MATERIAL_ID)
+		buffer[kernel_data.film.pass_material_id] = material_id;
+
+	buffer[kernel_data.film.pass_adaptive_aux_buffer + 3] = converged;
+	buffer[kernel_data.film.pass_sample_count] = (float)sample;
+}
+
+/* Test convergence of the pixels in a tile after the given number of samples,
+ * out of num_samples in total, returns true when all of them converged.
+ *
+ * A zero threshold or minimum number of samples is chosen from the total, so
+ * that pixels stop later as the number of samples goes up, and the result
+ * converges to the render using all samples. */
+ccl_device bool kernel_adaptive_sampling_tile_converged(KernelGlobals *kg, ccl_global float *buffer, int sample,
+	int num_samples, int x, int y, int w, int h, int offset, int stride)
+{
+	int pass_stride = kernel_data.film.pass_stride;
+
+	if(!(kernel_data.film.pass_flag & PASS_ADAPTIVE_AUX_BUFFER))
+		return false;
+
+	int min_samples = kernel_data.integrator.adaptive_min_samples;
+	if(min_samples == 0)
+		min_samples = max(4, (int)sqrtf((float)num_samples));
+
+	if(sample < min_samples)
+		return false;
+
+	float threshold = kernel_data.integrator.adaptive_threshold;
+	if(threshold == 0.0f)
+		threshold = 1.0f/(float)num_samples;
+
+	for(int j = y; j < y + h; j++)
+		for(int i = x; i < x + w; i++)
+			kernel_adaptive_sampling_convergence(kg, buffer + (offset + i + j*stride)*pass_stride, threshold);
+
+	bool all_converged = true;
+
+	for(int j = y; j < y + h; j++)
+		all_converged &= kernel_adaptive_sampling_filter(kg, buffer + (offset + x + j*stride)*pass_stride, w, pass_stride);
+	for(int i = x; i < x + w; i++)
+		all_converged &= kernel_adaptive_sampling_filter(kg, buffer + (offset + i + y*stride)*pass_stride, h, stride*pass_stride);
+
+	return all_converged;
+}
+
+ccl_device void kernel_adaptive_sampling_tile_adjust(KernelGlobals *kg, ccl_global float *buffer, int sample,
+	int x, int y, int w, int h, int offset, int stride)
+{
+	int pass_stride = kernel_data.film.pass_stride;
+
+	if(!(kernel_data.film.pass_flag & PASS_ADAPTIVE_AUX_BUFFER))
+		return;
+
+	for(int j = y; j < y + h; j++)
+		for(int i = x; i < x + w; i++)
+			kernel_adaptive_sampling_adjust(kg, buffer + (offset + i + j*stride)*pass_stride, sample);
+}
+
+#endif  /* __KERNEL_CPU__ */
+
+CCL_NAMESPACE_END
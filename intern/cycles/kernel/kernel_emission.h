@@ -161,7 +161,12 @@ ccl_device_noinline float3 indirect_primitive_emission(KernelGlobals *kg, Shader
 	{
 		/* multiple importance sampling, get triangle light pdf,
 		 * and compute weight with respect to BSDF pdf */
-		float pdf = triangle_light_pdf(kg, sd->Ng, sd->I, t);
+		float pdf_triangle = kernel_data.integrator.pdf_triangles;
+
+		if(kernel_data.integrator.use_light_tree)
+			pdf_triangle = light_tree_triangle_pdf(kg, sd->object, sd->prim, sd->P + sd->I*t);
+
+		float pdf = triangle_light_pdf(kg, sd->Ng, sd->I, t, pdf_triangle);
 		float mis_weight = power_heuristic(bsdf_pdf, pdf);
 
 		return L*mis_weight;
@@ -16,6 +16,10 @@
 
 /* Constant Globals */
 
+#ifdef __KERNEL_CPU__
+#include "kernel_texture_cache.h"
+#endif
+
 CCL_NAMESPACE_BEGIN
 
 /* On the CPU, we pass along the struct KernelGlobals to nearly everywhere in
@@ -31,12 +35,16 @@ struct OSLThreadData;
 struct OSLShadingSystem;
 #endif
 
-#define MAX_BYTE_IMAGES   1024
-#define MAX_FLOAT_IMAGES  1024
+struct TextureCacheGlobals;
+struct TextureCacheThreadData;
 
 typedef struct KernelGlobals {
 	texture_image_uchar4 texture_byte_images[MAX_BYTE_IMAGES];
 	texture_image_float4 texture_float_images[MAX_FLOAT_IMAGES];
+	texture_image_half4 texture_half4_images[MAX_HALF4_IMAGES];
+	texture_image_float texture_float1_images[MAX_FLOAT1_IMAGES];
+	texture_image_uchar texture_byte1_images[MAX_BYTE1_IMAGES];
+	texture_image_half texture_half1_images[MAX_HALF1_IMAGES];
 
 #define KERNEL_TEX(type, ttype, name) ttype name;
 #define KERNEL_IMAGE_TEX(type, ttype, name)
@@ -52,8 +60,63 @@ typedef struct KernelGlobals {
 	OSLThreadData *osl_tdata;
 #endif
 
+	/* Image files looked up through the texture cache instead of the arrays
+	 * above, NULL when all images are loaded in memory. */
+	TextureCacheGlobals *texture_cache;
+	TextureCacheThreadData *texture_cache_tdata;
+
 } KernelGlobals;
 
+/* Image lookups, dispatched on the storage type of the slot */
+
+ccl_device float4 kernel_tex_image_interp_impl(KernelGlobals *kg, int tex, float x, float y)
+{
+	if(tex < MAX_FLOAT_IMAGES)
+		return kg->texture_float_images[tex].interp(x, y);
+	else if(tex < IMAGE_HALF4_START)
+		return kg->texture_byte_images[tex - MAX_FLOAT_IMAGES].interp(x, y);
+	else if(tex < IMAGE_FLOAT1_START)
+		return kg->texture_half4_images[tex - IMAGE_HALF4_START].interp(x, y);
+	else if(tex < IMAGE_BYTE1_START)
+		return kg->texture_float1_images[tex - IMAGE_FLOAT1_START].interp(x, y);
+	else if(tex < IMAGE_HALF1_START)
+		return kg->texture_byte1_images[tex - IMAGE_BYTE1_START].interp(x, y);
+	else
+		return kg->texture_half1_images[tex - IMAGE_HALF1_START].interp(x, y);
+}
+
+ccl_device float4 kernel_tex_image_interp_3d_impl(KernelGlobals *kg, int tex, float x, float y, float z)
+{
+	if(tex < MAX_FLOAT_IMAGES)
+		return kg->texture_float_images[tex].interp_3d(x, y, z);
+	else if(tex < IMAGE_HALF4_START)
+		return kg->texture_byte_images[tex - MAX_FLOAT_IMAGES].interp_3d(x, y, z);
+	else if(tex < IMAGE_FLOAT1_START)
+		return kg->texture_half4_images[tex - IMAGE_HALF4_START].interp_3d(x, y, z);
+	else if(tex < IMAGE_BYTE1_START)
+		return kg->texture_float1_images[tex - IMAGE_FLOAT1_START].interp_3d(x, y, z);
+	else if(tex < IMAGE_HALF1_START)
+		return kg->texture_byte1_images[tex - IMAGE_BYTE1_START].interp_3d(x, y, z);
+	else
+		return kg->texture_half1_images[tex - IMAGE_HALF1_START].interp_3d(x, y, z);
+}
+
+ccl_device float4 kernel_tex_image_interp_3d_ex_impl(KernelGlobals *kg, int tex, float x, float y, float z, int interpolation)
+{
+	if(tex < MAX_FLOAT_IMAGES)
+		return kg->texture_float_images[tex].interp_3d_ex(x, y, z, interpolation);
+	else if(tex < IMAGE_HALF4_START)
+		return kg->texture_byte_images[tex - MAX_FLOAT_IMAGES].interp_3d_ex(x, y, z, interpolation);
+	else if(tex < IMAGE_FLOAT1_START)
+		return kg->texture_half4_images[tex - IMAGE_HALF4_START].interp_3d_ex(x, y, z, interpolation);
+	else if(tex < IMAGE_BYTE1_START)
+		return kg->texture_float1_images[tex - IMAGE_FLOAT1_START].interp_3d_ex(x, y, z, interpolation);
+	else if(tex < IMAGE_HALF1_START)
+		return kg->texture_byte1_images[tex - IMAGE_BYTE1_START].interp_3d_ex(x, y, z, interpolation);
+	else
+		return kg->texture_half1_images[tex - IMAGE_HALF1_START].interp_3d_ex(x, y, z, interpolation);
+}
+
 #endif
 
 /* For CUDA, constant memory textures must be globals, so we can't put them
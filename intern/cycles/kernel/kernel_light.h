@@ -577,9 +577,8 @@ ccl_device void triangle_light_sample(KernelGlobals *kg, int prim, int object,
 }
 
 ccl_device float triangle_light_pdf(KernelGlobals *kg,
-	const float3 Ng, const float3 I, float t)
+	const float3 Ng, const float3 I, float t, float pdf)
 {
-	float pdf = kernel_data.integrator.pdf_triangles;
 	float cos_pi = fabsf(dot(Ng, I));
 
 	if(cos_pi == 0.0f)
@@ -617,6 +616,171 @@ ccl_device int light_distribution_sample(KernelGlobals *kg, float randt)
 	return clamp(first-1, 0, kernel_data.integrator.num_distribution-1);
 }
 
+/* Light Tree
+ *
+ * Nodes store bounds and orientation cones of their emitters, used to pick the
+ * child with the higher estimated contribution to the shading point:
+ *
+ * 0: bounds min, energy or probability of child 0 for fixed split nodes
+ * 1: bounds max, cos theta_o (spread of normals around axis)
+ * 2: axis, cos theta_e (spread of emission around normals)
+ * 3: child 0 or ~distribution index for leaves, child 1, parent, flags */
+
+/* Bounds on the contribution of the node emitters to P, using the closest and
+ * farthest distance to the node bounds. */
+ccl_device void light_tree_node_importance(KernelGlobals *kg, int node, float3 P,
+                                           float *min_importance, float *max_importance)
+{
+	int offset = node*LIGHT_TREE_NODE_SIZE;
+	float4 data0 = kernel_tex_fetch(__light_tree_nodes, offset + 0);
+	float4 data1 = kernel_tex_fetch(__light_tree_nodes, offset + 1);
+
+	*min_importance = 0.0f;
+	*max_importance = 0.0f;
+
+	float energy = data0.w;
+	if(energy == 0.0f)
+		return;
+
+	float3 bmin = float4_to_float3(data0);
+	float3 bmax = float4_to_float3(data1);
+	float3 V = P - 0.5f*(bmin + bmax);
+	float radius_sq = 0.25f*len_squared(bmax - bmin);
+	float dist_sq = len_squared(V);
+
+	float3 closest = max(max(bmin - P, P - bmax), make_float3(0.0f, 0.0f, 0.0f));
+	float min_dist_sq = len_squared(closest);
+	float max_dist = sqrtf(dist_sq) + sqrtf(radius_sq);
+
+	/* inside the bounding sphere any orientation can contribute */
+	float cos_i = 1.0f;
+
+	if(dist_sq > radius_sq) {
+		float4 data2 = kernel_tex_fetch(__light_tree_nodes, offset + 2);
+		float4 data3 = kernel_tex_fetch(__light_tree_nodes, offset + 3);
+
+		float3 axis = float4_to_float3(data2);
+		float cos_theta = dot(axis, V)/sqrtf(dist_sq);
+
+		if(__float_as_int(data3.w) & LIGHT_TREE_TWO_SIDED)
+			cos_theta = fabsf(cos_theta);
+
+		/* smallest angle between the emitter normals and the direction to P is
+		 * theta - theta_u - theta_o, with theta_u the angle the bounding sphere
+		 * subtends, computed with cosines to avoid trigonometric functions */
+		float sin_theta = safe_sqrtf(1.0f - cos_theta*cos_theta);
+		float sin_u = sqrtf(radius_sq/dist_sq);
+		float cos_u = safe_sqrtf(1.0f - sin_u*sin_u);
+
+		if(cos_theta < cos_u) {
+			float cos_t = cos_theta*cos_u + sin_theta*sin_u;
+			float sin_t = sin_theta*cos_u - cos_theta*sin_u;
+			float cos_o = data1.w;
+
+			if(cos_t < cos_o) {
+				float sin_o = safe_sqrtf(1.0f - cos_o*cos_o);
+				cos_i = cos_t*cos_o + sin_t*sin_o;
+
+				if(cos_i <= data2.w)
+					return;
+			}
+		}
+	}
+
+	*min_importance = energy*cos_i/max(max_dist*max_dist, 1e-12f);
+	*max_importance = energy*cos_i/max(min_dist_sq, 1e-12f);
+}
+
+ccl_device float light_tree_split_probability(KernelGlobals *kg, int node, float4 data3, float3 P)
+{
+	if(__float_as_int(data3.w) & LIGHT_TREE_FIXED_SPLIT)
+		return kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE).w;
+
+	float min_importance0, max_importance0, min_importance1, max_importance1;
+	light_tree_node_importance(kg, __float_as_int(data3.x), P, &min_importance0, &max_importance0);
+	light_tree_node_importance(kg, __float_as_int(data3.y), P, &min_importance1, &max_importance1);
+
+	/* neither child can contribute, pick any */
+	float max_importance = max_importance0 + max_importance1;
+	if(max_importance == 0.0f)
+		return 0.5f;
+
+	/* average the probabilities from both bounds, so a child with a nearby
+	 * emitter in large bounds is not starved by a compact sibling */
+	float max_prob0 = max_importance0/max_importance;
+	float min_importance = min_importance0 + min_importance1;
+	float min_prob0 = (min_importance > 0.0f)? min_importance0/min_importance: max_prob0;
+
+	return 0.5f*(min_prob0 + max_prob0);
+}
+
+/* Pick a leaf node, reusing randt for each level. */
+ccl_device int light_tree_sample(KernelGlobals *kg, float3 P, float randt, float *pdf)
+{
+	int node = 0;
+	*pdf = 1.0f;
+
+	for(;;) {
+		float4 data3 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 3);
+
+		if(__float_as_int(data3.x) < 0)
+			return node;
+
+		float prob0 = light_tree_split_probability(kg, node, data3, P);
+
+		if(randt < prob0) {
+			node = __float_as_int(data3.x);
+			randt = randt/prob0;
+			*pdf *= prob0;
+		}
+		else {
+			node = __float_as_int(data3.y);
+			randt = (randt - prob0)/(1.0f - prob0);
+			*pdf *= 1.0f - prob0;
+		}
+
+		/* keep float rounding from reaching 1.0 */
+		randt = min(randt, 0.99999994f);
+	}
+}
+
+/* Probability of picking a leaf node from P. */
+ccl_device float light_tree_pdf(KernelGlobals *kg, int node, float3 P)
+{
+	float pdf = 1.0f;
+	int parent = __float_as_int(kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 3).z);
+
+	while(parent != -1) {
+		float4 data3 = kernel_tex_fetch(__light_tree_nodes, parent*LIGHT_TREE_NODE_SIZE + 3);
+		float prob0 = light_tree_split_probability(kg, parent, data3, P);
+
+		pdf *= (__float_as_int(data3.x) == node)? prob0: 1.0f - prob0;
+		node = parent;
+		parent = __float_as_int(data3.z);
+	}
+
+	return pdf;
+}
+
+/* Area pdf of sampling a triangle from P, zero if it is not an emitter. */
+ccl_device float light_tree_triangle_pdf(KernelGlobals *kg, int object, int prim, float3 P)
+{
+	uint map_offset = kernel_tex_fetch(__light_tree_map, object*2 + 0);
+
+	if(map_offset == 0)
+		return 0.0f;
+
+	int tri_offset = kernel_tex_fetch(__light_tree_map, object*2 + 1);
+	int node = kernel_tex_fetch(__light_tree_map, map_offset + prim - tri_offset);
+
+	if(node == -1)
+		return 0.0f;
+
+	float area = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE).w;
+
+	return (area > 0.0f)? light_tree_pdf(kg, node, P)/area: 0.0f;
+}
+
 /* Generic Light */
 
 ccl_device bool light_select_reached_max_bounces(KernelGlobals *kg, int index, int bounce)
@@ -628,7 +792,20 @@ ccl_device bool light_select_reached_max_bounces(KernelGlobals *kg, int index, i
 ccl_device void light_sample(KernelGlobals *kg, float randt, float randu, float randv, float time, float3 P, int bounce, LightSample *ls)
 {
 	/* sample index */
-	int index = light_distribution_sample(kg, randt);
+	int index;
+	float select_pdf = 1.0f;
+	float pdf_triangle = kernel_data.integrator.pdf_triangles;
+
+	if(kernel_data.integrator.use_light_tree) {
+		int node = light_tree_sample(kg, P, randt, &select_pdf);
+		float4 data0 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 0);
+		float4 data3 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 3);
+
+		index = ~__float_as_int(data3.x);
+		pdf_triangle = (data0.w > 0.0f)? select_pdf/data0.w: 0.0f;
+	}
+	else
+		index = light_distribution_sample(kg, randt);
 
 	/* fetch light data */
 	float4 l = kernel_tex_fetch(__light_distribution, index);
@@ -642,7 +819,7 @@ ccl_device void light_sample(KernelGlobals *kg, float randt, float randu, float
 
 		/* compute incoming direction, distance and pdf */
 		ls->D = normalize_len(ls->P - P, &ls->t);
-		ls->pdf = triangle_light_pdf(kg, ls->Ng, -ls->D, ls->t);
+		ls->pdf = triangle_light_pdf(kg, ls->Ng, -ls->D, ls->t, pdf_triangle);
 		ls->shader |= shader_flag;
 	}
 	else {
@@ -654,6 +831,11 @@ ccl_device void light_sample(KernelGlobals *kg, float randt, float randu, float
 		}
 
 		lamp_light_sample(kg, lamp, randu, randv, P, ls);
+
+		/* lamp pdfs leave out the selection probability, replace the uniform
+		 * one the evaluation was scaled with */
+		if(kernel_data.integrator.use_light_tree && select_pdf > 0.0f)
+			ls->eval_fac *= kernel_data.integrator.pdf_lights/select_pdf;
 	}
 }
 
@@ -30,6 +30,7 @@
 #include "kernel_shader.h"
 #include "kernel_light.h"
 #include "kernel_passes.h"
+#include "kernel_adaptive_sampling.h"
 
 #ifdef __SUBSURFACE__
 #include "kernel_subsurface.h"
@@ -1212,6 +1213,10 @@ ccl_device void kernel_path_trace(KernelGlobals *kg,
 	rng_state += index;
 	buffer += index*pass_stride;
 
+	/* skip converged pixels */
+	if(kernel_adaptive_sampling_skip(kg, buffer, sample))
+		return;
+
 	/* initialize random numbers and ray */
 	RNG rng;
 	Ray ray;
@@ -1228,6 +1233,7 @@ ccl_device void kernel_path_trace(KernelGlobals *kg,
 
 	/* accumulate result in output buffer */
 	kernel_write_pass_float4(buffer, sample, L);
+	kernel_adaptive_sampling_write(kg, buffer, sample, L);
 
 	path_rng_end(kg, rng_state, rng);
 }
@@ -1244,6 +1250,10 @@ ccl_device void kernel_branched_path_trace(KernelGlobals *kg,
 	rng_state += index;
 	buffer += index*pass_stride;
 
+	/* skip converged pixels */
+	if(kernel_adaptive_sampling_skip(kg, buffer, sample))
+		return;
+
 	/* initialize random numbers and ray */
 	RNG rng;
 	Ray ray;
@@ -1260,6 +1270,7 @@ ccl_device void kernel_branched_path_trace(KernelGlobals *kg,
 
 	/* accumulate result in output buffer */
 	kernel_write_pass_float4(buffer, sample, L);
+	kernel_adaptive_sampling_write(kg, buffer, sample, L);
 
 	path_rng_end(kg, rng_state, rng);
 }
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* CPU texture cache lookups, kept out of the optimized kernels since the
+ * texture system does its own filtering. */
+
+#include "kernel_compat_cpu.h"
+#include "kernel_math.h"
+#include "kernel_types.h"
+#include "kernel_globals.h"
+#include "kernel_texture_cache_globals.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Threads */
+
+void TextureCache::thread_init(KernelGlobals *kg, TextureCacheGlobals *texture_cache)
+{
+	/* no texture cache used? */
+	if(!texture_cache || !texture_cache->ts) {
+		kg->texture_cache = NULL;
+		kg->texture_cache_tdata = NULL;
+		return;
+	}
+
+	TextureCacheThreadData *tdata = new TextureCacheThreadData();
+	tdata->thread_info = texture_cache->ts->get_perthread_info();
+
+	kg->texture_cache = texture_cache;
+	kg->texture_cache_tdata = tdata;
+}
+
+void TextureCache::thread_free(KernelGlobals *kg)
+{
+	if(!kg->texture_cache)
+		return;
+
+	delete kg->texture_cache_tdata;
+
+	kg->texture_cache = NULL;
+	kg->texture_cache_tdata = NULL;
+}
+
+/* Lookup */
+
+bool TextureCache::lookup(KernelGlobals *kg, int id, float x, float y, float2 dx, float2 dy, float4 *result)
+{
+	TextureCacheGlobals *tcg = kg->texture_cache;
+
+	if(id < 0 || id >= (int)tcg->images.size() || !tcg->images[id].handle)
+		return false;
+
+	const TextureCacheGlobals::Image& img = tcg->images[id];
+	OIIO::TextureOpt options;
+
+	options.swrap = OIIO::TextureOpt::WrapPeriodic;
+	options.twrap = OIIO::TextureOpt::WrapPeriodic;
+	options.fill = 1.0f;
+
+	switch(img.interpolation) {
+		case INTERPOLATION_CLOSEST:
+			options.interpmode = OIIO::TextureOpt::InterpClosest;
+			options.mipmode = OIIO::TextureOpt::MipModeNoMIP;
+			break;
+		case INTERPOLATION_CUBIC:
+		case INTERPOLATION_SMART:
+			options.interpmode = OIIO::TextureOpt::InterpSmartBicubic;
+			break;
+		default:
+			options.interpmode = OIIO::TextureOpt::InterpBilinear;
+			break;
+	}
+
+	/* images are stored bottom to top, texture lookups go top to bottom */
+	float rgba[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+	bool status;
+
+#if OIIO_VERSION < 10500
+	/* the number of channels is an option here, which defaults to one */
+	options.nchannels = 4;
+	status = kg->texture_cache->ts->texture(img.handle, kg->texture_cache_tdata->thread_info,
+	                                        options, x, 1.0f - y, dx.x, -dx.y, dy.x, -dy.y,
+	                                        rgba);
+#else
+	status = kg->texture_cache->ts->texture(img.handle, kg->texture_cache_tdata->thread_info,
+	                                        options, x, 1.0f - y, dx.x, -dx.y, dy.x, -dy.y,
+	                                        4, rgba);
+#endif
+
+	if(!status) {
+		*result = make_float4(1.0f, 0.0f, 1.0f, 1.0f);
+		return true;
+	}
+
+	/* single channel images are expanded by the texture system */
+	if(img.channels == 2) {
+		rgba[3] = rgba[1];
+		rgba[1] = rgba[0];
+		rgba[2] = rgba[0];
+	}
+
+	/* the texture system returns associated alpha, match images loaded
+	 * without alpha which keep their unassociated color */
+	if(!img.use_alpha) {
+		if(rgba[3] != 0.0f && rgba[3] != 1.0f) {
+			float invw = 1.0f/rgba[3];
+			rgba[0] *= invw;
+			rgba[1] *= invw;
+			rgba[2] *= invw;
+		}
+		rgba[3] = 1.0f;
+	}
+
+	*result = make_float4(rgba[0], rgba[1], rgba[2], rgba[3]);
+	return true;
+}
+
+CCL_NAMESPACE_END
+
@@ -0,0 +1,49 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KERNEL_TEXTURE_CACHE_H__
+#define __KERNEL_TEXTURE_CACHE_H__
+
+/* Texture Cache
+ *
+ * On the CPU, image files can be looked up through an OpenImageIO texture
+ * system instead of being fully loaded before rendering. Tiles and mip levels
+ * are then read on demand and kept in a cache of limited size. The image slots
+ * using it are set up externally by the ImageManager.
+ *
+ * Before/after a thread starts rendering, thread_init/thread_free must be
+ * called to set up the per thread texture system state. */
+
+CCL_NAMESPACE_BEGIN
+
+struct KernelGlobals;
+struct TextureCacheGlobals;
+
+class TextureCache {
+public:
+	/* per thread data */
+	static void thread_init(KernelGlobals *kg, TextureCacheGlobals *texture_cache);
+	static void thread_free(KernelGlobals *kg);
+
+	/* lookup with texture space derivatives for mip selection, returns false
+	 * if the image slot is not in the cache */
+	static bool lookup(KernelGlobals *kg, int id, float x, float y, float2 dx, float2 dy, float4 *result);
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __KERNEL_TEXTURE_CACHE_H__ */
+
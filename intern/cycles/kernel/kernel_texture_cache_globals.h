@@ -0,0 +1,56 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KERNEL_TEXTURE_CACHE_GLOBALS_H__
+#define __KERNEL_TEXTURE_CACHE_GLOBALS_H__
+
+#include <OpenImageIO/texture.h>
+
+#include "util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+struct TextureCacheGlobals {
+	TextureCacheGlobals()
+	{
+		ts = NULL;
+	}
+
+	struct Image {
+		Image()
+		: handle(NULL), interpolation(INTERPOLATION_LINEAR), channels(4), use_alpha(true) {}
+
+		OIIO::TextureSystem::TextureHandle *handle;
+		InterpolationType interpolation;
+		int channels;
+		bool use_alpha;
+	};
+
+	OIIO::TextureSystem *ts;
+
+	/* indexed by image slot, slots without handle are loaded in memory */
+	vector<Image> images;
+};
+
+/* thread key for thread specific data lookup */
+struct TextureCacheThreadData {
+	OIIO::TextureSystem::Perthread *thread_info;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __KERNEL_TEXTURE_CACHE_GLOBALS_H__ */
+
@@ -30,6 +30,7 @@ CCL_NAMESPACE_BEGIN
 #define OBJECT_SIZE 		11
 #define OBJECT_VECTOR_SIZE	6
 #define LIGHT_SIZE			5
+#define LIGHT_TREE_NODE_SIZE	4
 #define FILTER_TABLE_SIZE	256
 #define RAMP_TABLE_SIZE		256
 #define PARTICLE_SIZE 		5
@@ -48,6 +49,20 @@ CCL_NAMESPACE_BEGIN
 
 #define TEX_NUM_FLOAT_IMAGES	5
 
+/* CPU image slots are numbered by storage type: float4, byte4, half4, and
+ * single channel float, byte and half. KernelGlobals and the image manager
+ * both use these ranges. */
+#define MAX_FLOAT_IMAGES	1024
+#define MAX_BYTE_IMAGES		1024
+#define MAX_HALF4_IMAGES	512
+#define MAX_FLOAT1_IMAGES	512
+#define MAX_BYTE1_IMAGES	512
+#define MAX_HALF1_IMAGES	512
+#define IMAGE_HALF4_START	(MAX_FLOAT_IMAGES + MAX_BYTE_IMAGES)
+#define IMAGE_FLOAT1_START	(IMAGE_HALF4_START + MAX_HALF4_IMAGES)
+#define IMAGE_BYTE1_START	(IMAGE_FLOAT1_START + MAX_FLOAT1_IMAGES)
+#define IMAGE_HALF1_START	(IMAGE_BYTE1_START + MAX_BYTE1_IMAGES)
+
 #define SHADER_NONE				(~0)
 #define OBJECT_NONE				(~0)
 #define PRIM_NONE				(~0)
@@ -60,6 +75,9 @@ CCL_NAMESPACE_BEGIN
 #ifdef __KERNEL_SSE2__
 #  define __QBVH__
 #endif
+#ifdef __KERNEL_AVX2__
+#  define __OBVH__
+#endif
 #define __KERNEL_SHADING__
 #define __KERNEL_ADV_SHADING__
 #define __BRANCHED_PATH__
@@ -323,6 +341,8 @@ typedef enum PassType {
 #ifdef __KERNEL_DEBUG__
 	PASS_BVH_TRAVERSAL_STEPS = (1 << 26),
 #endif
+	PASS_ADAPTIVE_AUX_BUFFER = (1 << 27),
+	PASS_SAMPLE_COUNT = (1 << 28),
 } PassType;
 
 #define PASS_ALL (~0)
@@ -414,6 +434,13 @@ typedef enum LightType {
 	LIGHT_TRIANGLE
 } LightType;
 
+/* Light Tree Node Flags */
+
+enum LightTreeNodeFlag {
+	LIGHT_TREE_TWO_SIDED = (1 << 0),
+	LIGHT_TREE_FIXED_SPLIT = (1 << 1),
+};
+
 /* Camera Type */
 
 enum CameraType {
@@ -865,6 +892,11 @@ typedef struct KernelFilm {
 	float mist_inv_depth;
 	float mist_falloff;
 
+	int pass_adaptive_aux_buffer;
+	int pass_sample_count;
+	int pass_pad6;
+	int pass_pad7;
+
 #ifdef __KERNEL_DEBUG__
 	int pass_bvh_traversal_steps;
 	int pass_pad3, pass_pad4, pass_pad5;
@@ -937,6 +969,7 @@ typedef struct KernelIntegrator {
 
 	/* mis */
 	int use_lamp_mis;
+	int use_light_tree;
 
 	/* sampler */
 	int sampling_pattern;
@@ -947,6 +980,11 @@ typedef struct KernelIntegrator {
 	int volume_max_steps;
 	float volume_step_size;
 	int volume_samples;
+
+	/* adaptive sampling */
+	int adaptive_min_samples;
+	float adaptive_threshold;
+	int pad1;
 } KernelIntegrator;
 
 typedef struct KernelBVH {
@@ -957,7 +995,8 @@ typedef struct KernelBVH {
 	int have_curves;
 	int have_instancing;
 	int use_qbvh;
-	int pad1, pad2;
+	int use_obvh;
+	int pad1;
 } KernelBVH;
 
 typedef enum CurveFlag {
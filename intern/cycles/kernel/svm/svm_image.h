@@ -48,7 +48,7 @@ ccl_device_inline float svm_image_texture_frac(float x, int *ix)
 	return x - (float)i;
 }
 
-ccl_device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y, uint srgb, uint use_alpha)
+ccl_device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y, float2 dx, float2 dy, uint srgb, uint use_alpha)
 {
 	/* first slots are used by float textures, which are not supported here */
 	if(id < TEX_NUM_FLOAT_IMAGES)
@@ -130,16 +130,28 @@ ccl_device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y,
 
 #else
 
-ccl_device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y, uint srgb, uint use_alpha)
+/* byte images are clamped after unassociating alpha */
+ccl_device_inline bool svm_image_texture_is_byte(int id)
+{
+#ifdef __KERNEL_CPU__
+	return (id >= MAX_FLOAT_IMAGES && id < IMAGE_HALF4_START) ||
+	       (id >= IMAGE_BYTE1_START && id < IMAGE_HALF1_START);
+#else
+	return (id >= TEX_NUM_FLOAT_IMAGES);
+#endif
+}
+
+ccl_device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y, float2 dx, float2 dy, uint srgb, uint use_alpha)
 {
 #ifdef __KERNEL_CPU__
 #ifdef __KERNEL_SSE2__
 	ssef r_ssef;
 	float4 &r = (float4 &)r_ssef;
-	r = kernel_tex_image_interp(id, x, y);
 #else
-	float4 r = kernel_tex_image_interp(id, x, y);
+	float4 r;
 #endif
+	if(!(kg->texture_cache && TextureCache::lookup(kg, id, x, y, dx, dy, &r)))
+		r = kernel_tex_image_interp(id, x, y);
 #else
 	float4 r;
 
@@ -319,7 +331,7 @@ ccl_device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y,
 
 	if(use_alpha && alpha != 1.0f && alpha != 0.0f) {
 		r_ssef = r_ssef / ssef(alpha);
-		if(id >= TEX_NUM_FLOAT_IMAGES)
+		if(svm_image_texture_is_byte(id))
 			r_ssef = min(r_ssef, ssef(1.0f));
 		r.w = alpha;
 	}
@@ -335,7 +347,7 @@ ccl_device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y,
 		r.y *= invw;
 		r.z *= invw;
 
-		if(id >= TEX_NUM_FLOAT_IMAGES) {
+		if(svm_image_texture_is_byte(id)) {
 			r.x = min(r.x, 1.0f);
 			r.y = min(r.y, 1.0f);
 			r.z = min(r.z, 1.0f);
@@ -354,6 +366,31 @@ ccl_device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y,
 
 #endif
 
+/* Texture space derivatives for mip selection by the texture cache. SVM does
+ * not track derivatives of the texture coordinate, so they are estimated from
+ * the ray differentials of the default UV map. Only used for nodes flagged as
+ * reading that map unmodified, others use the finest level. */
+ccl_device_inline void svm_image_texture_differentials(KernelGlobals *kg, ShaderData *sd, float2 *dx, float2 *dy)
+{
+	*dx = make_float2(0.0f, 0.0f);
+	*dy = make_float2(0.0f, 0.0f);
+
+#if defined(__KERNEL_CPU__) && defined(__RAY_DIFFERENTIALS__)
+	if(kg->texture_cache) {
+		AttributeElement elem;
+		int offset = find_attribute(kg, sd, ATTR_STD_UV, &elem);
+
+		if(offset != ATTR_STD_NOT_FOUND) {
+			float3 uv_dx, uv_dy;
+			primitive_attribute_float3(kg, sd, elem, offset, &uv_dx, &uv_dy);
+
+			*dx = make_float2(uv_dx.x, uv_dx.y);
+			*dy = make_float2(uv_dy.x, uv_dy.y);
+		}
+	}
+#endif
+}
+
 /* Remap coordnate from 0..1 box to -1..-1 */
 ccl_device_inline float3 texco_remap_square(float3 co)
 {
@@ -363,9 +400,11 @@ ccl_device_inline float3 texco_remap_square(float3 co)
 ccl_device void svm_node_tex_image(KernelGlobals *kg, ShaderData *sd, float *stack, uint4 node)
 {
 	uint id = node.y;
-	uint co_offset, out_offset, alpha_offset, srgb;
+	uint co_offset, out_offset, alpha_offset, flags;
 
-	decode_node_uchar4(node.z, &co_offset, &out_offset, &alpha_offset, &srgb);
+	decode_node_uchar4(node.z, &co_offset, &out_offset, &alpha_offset, &flags);
+
+	uint srgb = flags & NODE_IMAGE_SRGB;
 
 	float3 co = stack_load_float3(stack, co_offset);
 	float2 tex_co;
@@ -381,7 +420,14 @@ ccl_device void svm_node_tex_image(KernelGlobals *kg, ShaderData *sd, float *sta
 	else {
 		tex_co = make_float2(co.x, co.y);
 	}
-	float4 f = svm_image_texture(kg, id, tex_co.x, tex_co.y, srgb, use_alpha);
+
+	float2 dx = make_float2(0.0f, 0.0f);
+	float2 dy = make_float2(0.0f, 0.0f);
+
+	if(flags & NODE_IMAGE_UV_DIFFERENTIALS)
+		svm_image_texture_differentials(kg, sd, &dx, &dy);
+
+	float4 f = svm_image_texture(kg, id, tex_co.x, tex_co.y, dx, dy, srgb, use_alpha);
 
 	if(stack_valid(out_offset))
 		stack_store_float3(stack, out_offset, make_float3(f.x, f.y, f.z));
@@ -466,14 +512,15 @@ ccl_device void svm_node_tex_image_box(KernelGlobals *kg, ShaderData *sd, float
 	uint id = node.y;
 
 	float4 f = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+	float2 zero = make_float2(0.0f, 0.0f);
 	uint use_alpha = stack_valid(alpha_offset);
 
 	if(weight.x > 0.0f)
-		f += weight.x*svm_image_texture(kg, id, co.y, co.z, srgb, use_alpha);
+		f += weight.x*svm_image_texture(kg, id, co.y, co.z, zero, zero, srgb, use_alpha);
 	if(weight.y > 0.0f)
-		f += weight.y*svm_image_texture(kg, id, co.x, co.z, srgb, use_alpha);
+		f += weight.y*svm_image_texture(kg, id, co.x, co.z, zero, zero, srgb, use_alpha);
 	if(weight.z > 0.0f)
-		f += weight.z*svm_image_texture(kg, id, co.y, co.x, srgb, use_alpha);
+		f += weight.z*svm_image_texture(kg, id, co.y, co.x, zero, zero, srgb, use_alpha);
 
 	if(stack_valid(out_offset))
 		stack_store_float3(stack, out_offset, make_float3(f.x, f.y, f.z));
@@ -500,7 +547,8 @@ ccl_device void svm_node_tex_environment(KernelGlobals *kg, ShaderData *sd, floa
 		uv = direction_to_mirrorball(co);
 
 	uint use_alpha = stack_valid(alpha_offset);
-	float4 f = svm_image_texture(kg, id, uv.x, uv.y, srgb, use_alpha);
+	float2 zero = make_float2(0.0f, 0.0f);
+	float4 f = svm_image_texture(kg, id, uv.x, uv.y, zero, zero, srgb, use_alpha);
 
 	if(stack_valid(out_offset))
 		stack_store_float3(stack, out_offset, make_float3(f.x, f.y, f.z));
@@ -341,6 +341,11 @@ typedef enum NodeImageProjection {
 	NODE_IMAGE_PROJ_TUBE   = 3,
 } NodeImageProjection;
 
+typedef enum NodeImageFlags {
+	NODE_IMAGE_SRGB = 1,
+	NODE_IMAGE_UV_DIFFERENTIALS = 2,
+} NodeImageFlags;
+
 typedef enum NodeBumpOffset {
 	NODE_BUMP_OFFSET_CENTER,
 	NODE_BUMP_OFFSET_DX,
@@ -23,6 +23,8 @@
 #include "util_path.h"
 #include "util_progress.h"
 
+#include "kernel_texture_cache_globals.h"
+
 #ifdef WITH_OSL
 #include <OSL/oslexec.h>
 #endif
@@ -34,19 +36,26 @@ ImageManager::ImageManager()
 	need_update = true;
 	pack_images = false;
 	osl_texture_system = NULL;
+	use_texture_cache = false;
+	texture_cache_size = 0;
 	animation_frame = 0;
 
-	tex_num_images = TEX_NUM_IMAGES;
-	tex_num_float_images = TEX_NUM_FLOAT_IMAGES;
-	tex_image_byte_start = TEX_IMAGE_BYTE_START;
+	/* generic limits, half and single channel images are not supported */
+	for(int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+		tex_num_images[type] = 0;
+		tex_start_images[type] = 0;
+	}
+
+	tex_num_images[IMAGE_DATA_TYPE_FLOAT4] = TEX_NUM_FLOAT_IMAGES;
+	tex_num_images[IMAGE_DATA_TYPE_BYTE4] = TEX_NUM_IMAGES;
+	tex_start_images[IMAGE_DATA_TYPE_BYTE4] = TEX_IMAGE_BYTE_START;
 }
 
 ImageManager::~ImageManager()
 {
-	for(size_t slot = 0; slot < images.size(); slot++)
-		assert(!images[slot]);
-	for(size_t slot = 0; slot < float_images.size(); slot++)
-		assert(!float_images[slot]);
+	for(int type = 0; type < IMAGE_DATA_NUM_TYPES; type++)
+		for(size_t slot = 0; slot < images[type].size(); slot++)
+			assert(!images[type][slot]);
 }
 
 void ImageManager::set_pack_images(bool pack_images_)
@@ -59,15 +68,31 @@ void ImageManager::set_osl_texture_system(void *texture_system)
 	osl_texture_system = texture_system;
 }
 
+void ImageManager::set_texture_cache(bool use_texture_cache_, int texture_cache_size_)
+{
+	use_texture_cache = use_texture_cache_;
+	texture_cache_size = texture_cache_size_;
+}
+
 void ImageManager::set_extended_image_limits(const DeviceInfo& info)
 {
 	if(info.type == DEVICE_CPU) {
-		tex_num_images = TEX_EXTENDED_NUM_IMAGES_CPU;
-		tex_num_float_images = TEX_EXTENDED_NUM_FLOAT_IMAGES;
-		tex_image_byte_start = TEX_EXTENDED_IMAGE_BYTE_START;
+		tex_num_images[IMAGE_DATA_TYPE_FLOAT4] = TEX_EXTENDED_NUM_FLOAT_IMAGES;
+		tex_num_images[IMAGE_DATA_TYPE_BYTE4] = TEX_EXTENDED_NUM_IMAGES_CPU;
+		tex_num_images[IMAGE_DATA_TYPE_HALF4] = TEX_EXTENDED_NUM_HALF4_IMAGES;
+		tex_num_images[IMAGE_DATA_TYPE_FLOAT] = TEX_EXTENDED_NUM_FLOAT1_IMAGES;
+		tex_num_images[IMAGE_DATA_TYPE_BYTE] = TEX_EXTENDED_NUM_BYTE1_IMAGES;
+		tex_num_images[IMAGE_DATA_TYPE_HALF] = TEX_EXTENDED_NUM_HALF1_IMAGES;
+
+		tex_start_images[IMAGE_DATA_TYPE_FLOAT4] = 0;
+		tex_start_images[IMAGE_DATA_TYPE_BYTE4] = TEX_EXTENDED_IMAGE_BYTE_START;
+		tex_start_images[IMAGE_DATA_TYPE_HALF4] = TEX_EXTENDED_IMAGE_HALF4_START;
+		tex_start_images[IMAGE_DATA_TYPE_FLOAT] = TEX_EXTENDED_IMAGE_FLOAT1_START;
+		tex_start_images[IMAGE_DATA_TYPE_BYTE] = TEX_EXTENDED_IMAGE_BYTE1_START;
+		tex_start_images[IMAGE_DATA_TYPE_HALF] = TEX_EXTENDED_IMAGE_HALF1_START;
 	}
 	else if((info.type == DEVICE_CUDA || info.type == DEVICE_MULTI) && info.extended_images) {
-		tex_num_images = TEX_EXTENDED_NUM_IMAGES_GPU;
+		tex_num_images[IMAGE_DATA_TYPE_BYTE4] = TEX_EXTENDED_NUM_IMAGES_GPU;
 	}
 }
 
@@ -76,33 +101,34 @@ bool ImageManager::set_animation_frame_update(int frame)
 	if(frame != animation_frame) {
 		animation_frame = frame;
 
-		for(size_t slot = 0; slot < images.size(); slot++)
-			if(images[slot] && images[slot]->animated)
-				return true;
-
-		for(size_t slot = 0; slot < float_images.size(); slot++)
-			if(float_images[slot] && float_images[slot]->animated)
-				return true;
+		for(int type = 0; type < IMAGE_DATA_NUM_TYPES; type++)
+			for(size_t slot = 0; slot < images[type].size(); slot++)
+				if(images[type][slot] && images[type][slot]->animated)
+					return true;
 	}
 	
 	return false;
 }
 
-bool ImageManager::is_float_image(const string& filename, void *builtin_data, bool& is_linear)
+ImageManager::ImageDataType ImageManager::get_image_metadata(const string& filename, void *builtin_data, bool& is_linear)
 {
-	bool is_float = false;
+	bool is_float = false, is_half = false;
+	int channels = 4;
 	is_linear = false;
 
 	if(builtin_data) {
 		if(builtin_image_info_cb) {
-			int width, height, depth, channels;
+			int width, height, depth;
 			builtin_image_info_cb(filename, builtin_data, is_float, width, height, depth, channels);
 		}
 
-		if(is_float)
+		if(is_float) {
 			is_linear = true;
+			return (channels == 1)? IMAGE_DATA_TYPE_FLOAT: IMAGE_DATA_TYPE_FLOAT4;
+		}
 
-		return is_float;
+		/* byte builtin images are premultiplied assuming 4 channels */
+		return IMAGE_DATA_TYPE_BYTE4;
 	}
 
 	ImageInput *in = ImageInput::create(filename);
@@ -125,6 +151,17 @@ bool ImageManager::is_float_image(const string& filename, void *builtin_data, bo
 				}
 			}
 
+			/* half float images are kept as half float if all channels are */
+			if(spec.format == TypeDesc::HALF) {
+				is_half = true;
+
+				for(size_t channel = 0; channel < spec.channelformats.size(); channel++)
+					if(spec.channelformats[channel] != TypeDesc::HALF)
+						is_half = false;
+			}
+
+			channels = spec.nchannels;
+
 			/* basic color space detection, not great but better than nothing
 			 * before we do OpenColorIO integration */
 			if(is_float) {
@@ -148,7 +185,52 @@ bool ImageManager::is_float_image(const string& filename, void *builtin_data, bo
 		delete in;
 	}
 
-	return is_float;
+	if(is_half)
+		return (channels == 1)? IMAGE_DATA_TYPE_HALF: IMAGE_DATA_TYPE_HALF4;
+	else if(is_float)
+		return (channels == 1)? IMAGE_DATA_TYPE_FLOAT: IMAGE_DATA_TYPE_FLOAT4;
+	else
+		return (channels == 1)? IMAGE_DATA_TYPE_BYTE: IMAGE_DATA_TYPE_BYTE4;
+}
+
+bool ImageManager::is_float_image(const string& filename, void *builtin_data, bool& is_linear)
+{
+	ImageDataType type = get_image_metadata(filename, builtin_data, is_linear);
+
+	return (type != IMAGE_DATA_TYPE_BYTE4 && type != IMAGE_DATA_TYPE_BYTE);
+}
+
+int ImageManager::type_index_to_flattened_slot(int slot, ImageDataType type)
+{
+	return tex_start_images[type] + slot;
+}
+
+int ImageManager::flattened_slot_to_type_index(int flat_slot, ImageDataType *type)
+{
+	/* types start at increasing offsets, types without slots are skipped */
+	for(int i = IMAGE_DATA_NUM_TYPES - 1; i >= 0; i--) {
+		if(tex_num_images[i] > 0 && flat_slot >= tex_start_images[i]) {
+			*type = (ImageDataType)i;
+			return flat_slot - tex_start_images[i];
+		}
+	}
+
+	*type = IMAGE_DATA_TYPE_FLOAT4;
+	return flat_slot;
+}
+
+string ImageManager::name_from_type(int type)
+{
+	switch(type) {
+		case IMAGE_DATA_TYPE_FLOAT4: return "float";
+		case IMAGE_DATA_TYPE_BYTE4: return "byte";
+		case IMAGE_DATA_TYPE_HALF4: return "half4";
+		case IMAGE_DATA_TYPE_FLOAT: return "float1";
+		case IMAGE_DATA_TYPE_BYTE: return "byte1";
+		case IMAGE_DATA_TYPE_HALF: return "half1";
+	}
+
+	return "";
 }
 
 static bool image_equals(ImageManager::Image *image, const string& filename, void *builtin_data, InterpolationType interpolation)
@@ -164,159 +246,96 @@ int ImageManager::add_image(const string& filename, void *builtin_data, bool ani
 	Image *img;
 	size_t slot;
 
-	/* load image info and find out if we need a float texture */
-	is_float = (pack_images)? false: is_float_image(filename, builtin_data, is_linear);
-
-	if(is_float) {
-		/* find existing image */
-		for(slot = 0; slot < float_images.size(); slot++) {
-			img = float_images[slot];
-			if(img && image_equals(img, filename, builtin_data, interpolation)) {
-				if(img->frame != frame) {
-					img->frame = frame;
-					img->need_load = true;
-				}
-				if(img->use_alpha != use_alpha) {
-					img->use_alpha = use_alpha;
-					img->need_load = true;
-				}
-				img->users++;
-				return slot;
+	/* load image info and find out which type of texture slot we need */
+	ImageDataType type = (pack_images)? IMAGE_DATA_TYPE_BYTE4: get_image_metadata(filename, builtin_data, is_linear);
+
+	/* fall back to types supported by the device */
+	if(type == IMAGE_DATA_TYPE_HALF && tex_num_images[type] == 0)
+		type = IMAGE_DATA_TYPE_FLOAT;
+	if((type == IMAGE_DATA_TYPE_FLOAT || type == IMAGE_DATA_TYPE_HALF4) && tex_num_images[type] == 0)
+		type = IMAGE_DATA_TYPE_FLOAT4;
+	if(type == IMAGE_DATA_TYPE_BYTE && tex_num_images[type] == 0)
+		type = IMAGE_DATA_TYPE_BYTE4;
+
+	is_float = (type != IMAGE_DATA_TYPE_BYTE4 && type != IMAGE_DATA_TYPE_BYTE);
+
+	/* find existing image */
+	for(slot = 0; slot < images[type].size(); slot++) {
+		img = images[type][slot];
+		if(img && image_equals(img, filename, builtin_data, interpolation)) {
+			if(img->frame != frame) {
+				img->frame = frame;
+				img->need_load = true;
 			}
-		}
-
-		/* find free slot */
-		for(slot = 0; slot < float_images.size(); slot++) {
-			if(!float_images[slot])
-				break;
-		}
-
-		if(slot == float_images.size()) {
-			/* max images limit reached */
-			if(float_images.size() == tex_num_float_images) {
-				printf("ImageManager::add_image: float image limit reached %d, skipping '%s'\n",
-				       tex_num_float_images, filename.c_str());
-				return -1;
+			if(img->use_alpha != use_alpha) {
+				img->use_alpha = use_alpha;
+				img->need_load = true;
 			}
-
-			float_images.resize(float_images.size() + 1);
+			img->users++;
+			return type_index_to_flattened_slot(slot, type);
 		}
-
-		/* add new image */
-		img = new Image();
-		img->filename = filename;
-		img->builtin_data = builtin_data;
-		img->need_load = true;
-		img->animated = animated;
-		img->frame = frame;
-		img->interpolation = interpolation;
-		img->users = 1;
-		img->use_alpha = use_alpha;
-
-		float_images[slot] = img;
 	}
-	else {
-		for(slot = 0; slot < images.size(); slot++) {
-			img = images[slot];
-			if(img && image_equals(img, filename, builtin_data, interpolation)) {
-				if(img->frame != frame) {
-					img->frame = frame;
-					img->need_load = true;
-				}
-				if(img->use_alpha != use_alpha) {
-					img->use_alpha = use_alpha;
-					img->need_load = true;
-				}
-				img->users++;
-				return slot+tex_image_byte_start;
-			}
-		}
-
-		/* find free slot */
-		for(slot = 0; slot < images.size(); slot++) {
-			if(!images[slot])
-				break;
-		}
 
-		if(slot == images.size()) {
-			/* max images limit reached */
-			if(images.size() == tex_num_images) {
-				printf("ImageManager::add_image: byte image limit reached %d, skipping '%s'\n",
-				       tex_num_images, filename.c_str());
-				return -1;
-			}
+	/* find free slot */
+	for(slot = 0; slot < images[type].size(); slot++) {
+		if(!images[type][slot])
+			break;
+	}
 
-			images.resize(images.size() + 1);
+	if(slot == images[type].size()) {
+		/* max images limit reached */
+		if((int)images[type].size() == tex_num_images[type]) {
+			printf("ImageManager::add_image: %s image limit reached %d, skipping '%s'\n",
+			       name_from_type(type).c_str(), tex_num_images[type], filename.c_str());
+			return -1;
 		}
 
-		/* add new image */
-		img = new Image();
-		img->filename = filename;
-		img->builtin_data = builtin_data;
-		img->need_load = true;
-		img->animated = animated;
-		img->frame = frame;
-		img->interpolation = interpolation;
-		img->users = 1;
-		img->use_alpha = use_alpha;
+		images[type].resize(images[type].size() + 1);
+	}
 
-		images[slot] = img;
+	/* add new image */
+	img = new Image();
+	img->filename = filename;
+	img->builtin_data = builtin_data;
+	img->need_load = true;
+	img->animated = animated;
+	img->frame = frame;
+	img->interpolation = interpolation;
+	img->users = 1;
+	img->use_alpha = use_alpha;
 
-		slot += tex_image_byte_start;
-	}
+	images[type][slot] = img;
 
 	need_update = true;
 
-	return slot;
+	return type_index_to_flattened_slot(slot, type);
 }
 
-void ImageManager::remove_image(int slot)
+void ImageManager::remove_image(int flat_slot)
 {
-	if(slot >= tex_image_byte_start) {
-		slot -= tex_image_byte_start;
+	ImageDataType type;
+	int slot = flattened_slot_to_type_index(flat_slot, &type);
 
-		assert(images[slot] != NULL);
+	assert(images[type][slot] != NULL);
 
-		/* decrement user count */
-		images[slot]->users--;
-		assert(images[slot]->users >= 0);
+	/* decrement user count */
+	images[type][slot]->users--;
+	assert(images[type][slot]->users >= 0);
 
-		/* don't remove immediately, rather do it all together later on. one of
-		 * the reasons for this is that on shader changes we add and remove nodes
-		 * that use them, but we do not want to reload the image all the time. */
-		if(images[slot]->users == 0)
-			need_update = true;
-	}
-	else {
-		/* decrement user count */
-		float_images[slot]->users--;
-		assert(float_images[slot]->users >= 0);
-
-		/* don't remove immediately, rather do it all together later on. one of
-		 * the reasons for this is that on shader changes we add and remove nodes
-		 * that use them, but we do not want to reload the image all the time. */
-		if(float_images[slot]->users == 0)
-			need_update = true;
-	}
+	/* don't remove immediately, rather do it all together later on. one of
+	 * the reasons for this is that on shader changes we add and remove nodes
+	 * that use them, but we do not want to reload the image all the time. */
+	if(images[type][slot]->users == 0)
+		need_update = true;
 }
 
 void ImageManager::remove_image(const string& filename, void *builtin_data, InterpolationType interpolation)
 {
-	size_t slot;
-
-	for(slot = 0; slot < images.size(); slot++) {
-		if(images[slot] && image_equals(images[slot], filename, builtin_data, interpolation)) {
-			remove_image(slot+tex_image_byte_start);
-			break;
-		}
-	}
-
-	if(slot == images.size()) {
-		/* see if it's in a float texture slot */
-		for(slot = 0; slot < float_images.size(); slot++) {
-			if(float_images[slot] && image_equals(float_images[slot], filename, builtin_data, interpolation)) {
-				remove_image(slot);
-				break;
+	for(int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+		for(size_t slot = 0; slot < images[type].size(); slot++) {
+			if(images[type][slot] && image_equals(images[type][slot], filename, builtin_data, interpolation)) {
+				remove_image(type_index_to_flattened_slot(slot, (ImageDataType)type));
+				return;
 			}
 		}
 	}
@@ -328,39 +347,47 @@ void ImageManager::remove_image(const string& filename, void *builtin_data, Inte
  */
 void ImageManager::tag_reload_image(const string& filename, void *builtin_data, InterpolationType interpolation)
 {
-	size_t slot;
-
-	for(slot = 0; slot < images.size(); slot++) {
-		if(images[slot] && image_equals(images[slot], filename, builtin_data, interpolation)) {
-			images[slot]->need_load = true;
-			break;
-		}
-	}
-
-	if(slot == images.size()) {
-		/* see if it's in a float texture slot */
-		for(slot = 0; slot < float_images.size(); slot++) {
-			if(float_images[slot] && image_equals(float_images[slot], filename, builtin_data, interpolation)) {
-				float_images[slot]->need_load = true;
-				break;
+	for(int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+		for(size_t slot = 0; slot < images[type].size(); slot++) {
+			if(images[type][slot] && image_equals(images[type][slot], filename, builtin_data, interpolation)) {
+				images[type][slot]->need_load = true;
+				return;
 			}
 		}
 	}
 }
 
-bool ImageManager::file_load_image(Image *img, device_vector<uchar4>& tex_img)
+/* Pixel values in the storage types */
+
+template<typename T> static T image_pixel_from_float(float f);
+
+template<> uchar image_pixel_from_float<uchar>(float f)
+{
+	return (uchar)(f*255.0f);
+}
+
+template<> float image_pixel_from_float<float>(float f)
+{
+	return f;
+}
+
+template<> half image_pixel_from_float<half>(float f)
+{
+	half4 h;
+	float4_store_half(&h.x, make_float4(f, f, f, f), 1.0f);
+	return h.x;
+}
+
+bool ImageManager::file_load_image_generic(Image *img, ImageInput **in, int &width, int &height, int &depth, int &components)
 {
 	if(img->filename == "")
 		return false;
 
-	ImageInput *in = NULL;
-	int width, height, depth, components;
-
 	if(!img->builtin_data) {
 		/* load image from file through OIIO */
-		in = ImageInput::create(img->filename);
+		*in = ImageInput::create(img->filename);
 
-		if(!in)
+		if(!*in)
 			return false;
 
 		ImageSpec spec = ImageSpec();
@@ -369,8 +396,9 @@ bool ImageManager::file_load_image(Image *img, device_vector<uchar4>& tex_img)
 		if(img->use_alpha == false)
 			config.attribute("oiio:UnassociatedAlpha", 1);
 
-		if(!in->open(img->filename, spec, config)) {
-			delete in;
+		if(!(*in)->open(img->filename, spec, config)) {
+			delete *in;
+			*in = NULL;
 			return false;
 		}
 
@@ -381,7 +409,7 @@ bool ImageManager::file_load_image(Image *img, device_vector<uchar4>& tex_img)
 	}
 	else {
 		/* load image using builtin images callbacks */
-		if(!builtin_image_info_cb || !builtin_image_pixels_cb)
+		if(!builtin_image_info_cb || !builtin_image_pixels_cb || !builtin_image_float_pixels_cb)
 			return false;
 
 		bool is_float;
@@ -389,54 +417,98 @@ bool ImageManager::file_load_image(Image *img, device_vector<uchar4>& tex_img)
 	}
 
 	/* we only handle certain number of components */
-	if(!(components >= 1 && components <= 4)) {
-		if(in) {
-			in->close();
-			delete in;
+	if(components < 1 || width == 0 || height == 0) {
+		if(*in) {
+			(*in)->close();
+			delete *in;
+			*in = NULL;
 		}
 
 		return false;
 	}
 
-	/* read RGBA pixels */
-	uchar *pixels = (uchar*)tex_img.resize(width, height, depth);
+	return true;
+}
+
+template<TypeDesc::BASETYPE FileFormat, typename StorageType, typename DeviceType>
+bool ImageManager::file_load_image(Image *img, device_vector<DeviceType>& tex_img)
+{
+	ImageInput *in = NULL;
+	int width, height, depth, components;
+
+	if(!file_load_image_generic(img, &in, width, height, depth, components))
+		return false;
+
+	/* read pixels, single channel types store the first channel only, others
+	 * are expanded to RGBA below */
+	const int num_channels = sizeof(DeviceType)/sizeof(StorageType);
+	const StorageType alpha_one = image_pixel_from_float<StorageType>(1.0f);
+	StorageType *pixels = (StorageType*)tex_img.resize(width, height, depth);
+	int num_pixels = width*height*depth;
 	bool cmyk = false;
 
 	if(in) {
+		StorageType *readpixels = pixels;
+		vector<StorageType> tmppixels;
+
+		if(components > num_channels) {
+			tmppixels.resize(num_pixels*components);
+			readpixels = &tmppixels[0];
+		}
+
 		if(depth <= 1) {
-			int scanlinesize = width*components*sizeof(uchar);
+			int scanlinesize = width*components*sizeof(StorageType);
 
-			in->read_image(TypeDesc::UINT8,
-				(uchar*)pixels + (height-1)*scanlinesize,
+			in->read_image(FileFormat,
+				(uchar*)readpixels + (height-1)*scanlinesize,
 				AutoStride,
 				-scanlinesize,
 				AutoStride);
 		}
 		else {
-			in->read_image(TypeDesc::UINT8, (uchar*)pixels);
+			in->read_image(FileFormat, (uchar*)readpixels);
+		}
+
+		if(components > num_channels) {
+			for(int i = num_pixels-1; i >= 0; i--)
+				for(int c = 0; c < num_channels; c++)
+					pixels[i*num_channels+c] = tmppixels[i*components+c];
+
+			components = num_channels;
+			tmppixels.clear();
 		}
 
-		cmyk = strcmp(in->format_name(), "jpeg") == 0 && components == 4;
+		cmyk = FileFormat == TypeDesc::UINT8 && strcmp(in->format_name(), "jpeg") == 0 && components == 4;
 
 		in->close();
 		delete in;
 	}
+	else if(FileFormat == TypeDesc::FLOAT) {
+		builtin_image_float_pixels_cb(img->filename, img->builtin_data, (float*)pixels);
+	}
+	else if(FileFormat == TypeDesc::UINT8) {
+		builtin_image_pixels_cb(img->filename, img->builtin_data, (uchar*)pixels);
+	}
 	else {
-		builtin_image_pixels_cb(img->filename, img->builtin_data, pixels);
+		/* no half float builtin images */
+		return false;
 	}
 
+	if(num_channels == 1)
+		return true;
+
 	if(cmyk) {
 		/* CMYK */
-		for(int i = width*height*depth-1; i >= 0; i--) {
+		for(int i = num_pixels-1; i >= 0; i--) {
 			pixels[i*4+2] = (pixels[i*4+2]*pixels[i*4+3])/255;
 			pixels[i*4+1] = (pixels[i*4+1]*pixels[i*4+3])/255;
 			pixels[i*4+0] = (pixels[i*4+0]*pixels[i*4+3])/255;
-			pixels[i*4+3] = 255;
+			pixels[i*4+3] = alpha_one;
 		}
 	}
 	else if(components == 2) {
 		/* grayscale + alpha */
-		for(int i = width*height*depth-1; i >= 0; i--) {
+		for(int i = num_pixels-1; i >= 0; i--) {
 			pixels[i*4+3] = pixels[i*2+1];
 			pixels[i*4+2] = pixels[i*2+0];
 			pixels[i*4+1] = pixels[i*2+0];
@@ -445,8 +517,8 @@ bool ImageManager::file_load_image(Image *img, device_vector<uchar4>& tex_img)
 	}
 	else if(components == 3) {
 		/* RGB */
-		for(int i = width*height*depth-1; i >= 0; i--) {
-			pixels[i*4+3] = 255;
+		for(int i = num_pixels-1; i >= 0; i--) {
+			pixels[i*4+3] = alpha_one;
 			pixels[i*4+2] = pixels[i*3+2];
 			pixels[i*4+1] = pixels[i*3+1];
 			pixels[i*4+0] = pixels[i*3+0];
@@ -454,8 +526,8 @@ bool ImageManager::file_load_image(Image *img, device_vector<uchar4>& tex_img)
 	}
 	else if(components == 1) {
 		/* grayscale */
-		for(int i = width*height*depth-1; i >= 0; i--) {
-			pixels[i*4+3] = 255;
+		for(int i = num_pixels-1; i >= 0; i--) {
+			pixels[i*4+3] = alpha_one;
 			pixels[i*4+2] = pixels[i];
 			pixels[i*4+1] = pixels[i];
 			pixels[i*4+0] = pixels[i];
@@ -463,289 +535,215 @@ bool ImageManager::file_load_image(Image *img, device_vector<uchar4>& tex_img)
 	}
 
 	if(img->use_alpha == false) {
-		for(int i = width*height*depth-1; i >= 0; i--) {
-			pixels[i*4+3] = 255;
+		for(int i = num_pixels-1; i >= 0; i--) {
+			pixels[i*4+3] = alpha_one;
 		}
 	}
 
 	return true;
 }
 
-bool ImageManager::file_load_float_image(Image *img, device_vector<float4>& tex_img)
+/* Image files can be read on demand through a texture cache on the CPU with
+ * SVM, OSL has its own texture system. Tiles and mip levels are then loaded
+ * as rendering needs them, from tiled and mipmapped files like .tx directly,
+ * other files are tiled in memory. */
+TextureCacheGlobals *ImageManager::texture_cache(Device *device)
 {
-	if(img->filename == "")
-		return false;
+	if(!use_texture_cache || osl_texture_system || pack_images)
+		return NULL;
 
-	ImageInput *in = NULL;
-	int width, height, depth, components;
+	TextureCacheGlobals *tcg = (TextureCacheGlobals*)device->texture_cache_memory();
 
-	if(!img->builtin_data) {
-		/* load image from file through OIIO */
-		in = ImageInput::create(img->filename);
+	if(tcg && !tcg->ts) {
+		OIIO::TextureSystem *ts = OIIO::TextureSystem::create(false);
 
-		if(!in)
-			return false;
+		ts->attribute("automip", 1);
+		ts->attribute("autotile", 64);
+		ts->attribute("gray_to_rgb", 1);
+		ts->attribute("max_memory_MB", (float)texture_cache_size);
 
-		ImageSpec spec = ImageSpec();
-		ImageSpec config = ImageSpec();
+		tcg->ts = ts;
+	}
 
-		if(img->use_alpha == false)
-			config.attribute("oiio:UnassociatedAlpha",1);
+	return tcg;
+}
 
-		if(!in->open(img->filename, spec, config)) {
-			delete in;
-			return false;
-		}
+bool ImageManager::texture_cache_load_image(TextureCacheGlobals *tcg, Image *img, int slot)
+{
+	if(img->filename == "" || img->builtin_data)
+		return false;
 
-		/* we only handle certain number of components */
-		width = spec.width;
-		height = spec.height;
-		depth = spec.depth;
-		components = spec.nchannels;
-	}
-	else {
-		/* load image using builtin images callbacks */
-		if(!builtin_image_info_cb || !builtin_image_float_pixels_cb)
-			return false;
+	OIIO::TextureSystem *ts = tcg->ts;
+	ustring filename(img->filename);
+	ImageSpec spec;
 
-		bool is_float;
-		builtin_image_info_cb(img->filename, img->builtin_data, is_float, width, height, depth, components);
-	}
+	/* read the file again in case it was modified */
+	ts->invalidate(filename);
 
-	if(components < 1 || width == 0 || height == 0) {
-		if(in) {
-			in->close();
-			delete in;
-		}
+	if(!ts->get_imagespec(filename, 0, spec)) {
+		ts->geterror();
 		return false;
 	}
 
-	/* read RGBA pixels */
-	float *pixels = (float*)tex_img.resize(width, height, depth);
-	bool cmyk = false;
-
-	if(in) {
-		float *readpixels = pixels;
-		vector<float> tmppixels;
+	/* 3d textures are loaded in memory */
+	if(spec.depth > 1 || spec.nchannels < 1)
+		return false;
 
-		if(components > 4) {
-			tmppixels.resize(width*height*components);
-			readpixels = &tmppixels[0];
-		}
+	TextureCacheGlobals::Image& cache_img = tcg->images[slot];
 
-		if(depth <= 1) {
-			int scanlinesize = width*components*sizeof(float);
+	cache_img.handle = ts->get_texture_handle(filename);
+	cache_img.interpolation = img->interpolation;
+	cache_img.channels = spec.nchannels;
+	cache_img.use_alpha = img->use_alpha;
 
-			in->read_image(TypeDesc::FLOAT,
-				(uchar*)readpixels + (height-1)*scanlinesize,
-				AutoStride,
-				-scanlinesize,
-				AutoStride);
-		}
-		else {
-			in->read_image(TypeDesc::FLOAT, (uchar*)readpixels);
-		}
+	return (cache_img.handle != NULL);
+}
 
-		if(components > 4) {
-			for(int i = width*height-1; i >= 0; i--) {
-				pixels[i*4+3] = tmppixels[i*components+3];
-				pixels[i*4+2] = tmppixels[i*components+2];
-				pixels[i*4+1] = tmppixels[i*components+1];
-				pixels[i*4+0] = tmppixels[i*components+0];
-			}
+template<TypeDesc::BASETYPE FileFormat, typename StorageType, typename DeviceType>
+void ImageManager::device_load_image_type(Device *device, Image *img, device_vector<DeviceType>& tex_img, const string& name)
+{
+	if(tex_img.device_pointer) {
+		thread_scoped_lock device_lock(device_mutex);
+		device->tex_free(tex_img);
+	}
 
-			tmppixels.clear();
-		}
+	if(!file_load_image<FileFormat, StorageType, DeviceType>(img, tex_img)) {
+		/* on failure to load, we set a 1x1 pixels pink image */
+		StorageType *pixels = (StorageType*)tex_img.resize(1, 1);
+		const int num_channels = sizeof(DeviceType)/sizeof(StorageType);
 
-		cmyk = strcmp(in->format_name(), "jpeg") == 0 && components == 4;
+		pixels[0] = image_pixel_from_float<StorageType>(TEX_IMAGE_MISSING_R);
 
-		in->close();
-		delete in;
-	}
-	else {
-		builtin_image_float_pixels_cb(img->filename, img->builtin_data, pixels);
-	}
-
-	if(cmyk) {
-		/* CMYK */
-		for(int i = width*height*depth-1; i >= 0; i--) {
-			pixels[i*4+3] = 255;
-			pixels[i*4+2] = (pixels[i*4+2]*pixels[i*4+3])/255;
-			pixels[i*4+1] = (pixels[i*4+1]*pixels[i*4+3])/255;
-			pixels[i*4+0] = (pixels[i*4+0]*pixels[i*4+3])/255;
-		}
-	}
-	else if(components == 2) {
-		/* grayscale + alpha */
-		for(int i = width*height*depth-1; i >= 0; i--) {
-			pixels[i*4+3] = pixels[i*2+1];
-			pixels[i*4+2] = pixels[i*2+0];
-			pixels[i*4+1] = pixels[i*2+0];
-			pixels[i*4+0] = pixels[i*2+0];
-		}
-	}
-	else if(components == 3) {
-		/* RGB */
-		for(int i = width*height*depth-1; i >= 0; i--) {
-			pixels[i*4+3] = 1.0f;
-			pixels[i*4+2] = pixels[i*3+2];
-			pixels[i*4+1] = pixels[i*3+1];
-			pixels[i*4+0] = pixels[i*3+0];
-		}
-	}
-	else if(components == 1) {
-		/* grayscale */
-		for(int i = width*height*depth-1; i >= 0; i--) {
-			pixels[i*4+3] = 1.0f;
-			pixels[i*4+2] = pixels[i];
-			pixels[i*4+1] = pixels[i];
-			pixels[i*4+0] = pixels[i];
+		if(num_channels == 4) {
+			pixels[1] = image_pixel_from_float<StorageType>(TEX_IMAGE_MISSING_G);
+			pixels[2] = image_pixel_from_float<StorageType>(TEX_IMAGE_MISSING_B);
+			pixels[3] = image_pixel_from_float<StorageType>(TEX_IMAGE_MISSING_A);
 		}
 	}
 
-	if(img->use_alpha == false) {
-		for(int i = width*height*depth-1; i >= 0; i--) {
-			pixels[i*4+3] = 1.0f;
-		}
+	if(!pack_images) {
+		thread_scoped_lock device_lock(device_mutex);
+		device->tex_alloc(name.c_str(), tex_img, img->interpolation, true);
 	}
-
-	return true;
 }
 
-void ImageManager::device_load_image(Device *device, DeviceScene *dscene, int slot, Progress *progress)
+void ImageManager::device_load_image(Device *device, DeviceScene *dscene, ImageDataType type, int slot, Progress *progress)
 {
 	if(progress->get_cancel())
 		return;
 	
-	Image *img;
-	bool is_float;
-
-	if(slot >= tex_image_byte_start) {
-		img = images[slot - tex_image_byte_start];
-		is_float = false;
-	}
-	else {
-		img = float_images[slot];
-		is_float = true;
-	}
+	Image *img = images[type][slot];
 
 	if(osl_texture_system && !img->builtin_data)
 		return;
 
-	if(is_float) {
-		string filename = path_filename(float_images[slot]->filename);
-		progress->set_status("Updating Images", "Loading " + filename);
-
-		device_vector<float4>& tex_img = dscene->tex_float_image[slot];
-
-		if(tex_img.device_pointer) {
-			thread_scoped_lock device_lock(device_mutex);
-			device->tex_free(tex_img);
-		}
-
-		if(!file_load_float_image(img, tex_img)) {
-			/* on failure to load, we set a 1x1 pixels pink image */
-			float *pixels = (float*)tex_img.resize(1, 1);
-
-			pixels[0] = TEX_IMAGE_MISSING_R;
-			pixels[1] = TEX_IMAGE_MISSING_G;
-			pixels[2] = TEX_IMAGE_MISSING_B;
-			pixels[3] = TEX_IMAGE_MISSING_A;
-		}
-
-		string name;
+	int flat_slot = type_index_to_flattened_slot(slot, type);
+	TextureCacheGlobals *tcg = texture_cache(device);
 
-		if(slot >= 100) name = string_printf("__tex_image_float_%d", slot);
-		else if(slot >= 10) name = string_printf("__tex_image_float_0%d", slot);
-		else name = string_printf("__tex_image_float_00%d", slot);
+	if(tcg) {
+		tcg->images[flat_slot] = TextureCacheGlobals::Image();
 
-		if(!pack_images) {
-			thread_scoped_lock device_lock(device_mutex);
-			device->tex_alloc(name.c_str(), tex_img, img->interpolation, true);
+		if(texture_cache_load_image(tcg, img, flat_slot)) {
+			img->need_load = false;
+			return;
 		}
 	}
-	else {
-		string filename = path_filename(images[slot - tex_image_byte_start]->filename);
-		progress->set_status("Updating Images", "Loading " + filename);
-
-		device_vector<uchar4>& tex_img = dscene->tex_image[slot - tex_image_byte_start];
 
-		if(tex_img.device_pointer) {
-			thread_scoped_lock device_lock(device_mutex);
-			device->tex_free(tex_img);
-		}
-
-		if(!file_load_image(img, tex_img)) {
-			/* on failure to load, we set a 1x1 pixels pink image */
-			uchar *pixels = (uchar*)tex_img.resize(1, 1);
-
-			pixels[0] = (TEX_IMAGE_MISSING_R * 255);
-			pixels[1] = (TEX_IMAGE_MISSING_G * 255);
-			pixels[2] = (TEX_IMAGE_MISSING_B * 255);
-			pixels[3] = (TEX_IMAGE_MISSING_A * 255);
-		}
+	string filename = path_filename(img->filename);
+	progress->set_status("Updating Images", "Loading " + filename);
 
-		string name;
+	/* float and byte images keep their names for other devices */
+	string name;
 
-		if(slot >= 100) name = string_printf("__tex_image_%d", slot);
-		else if(slot >= 10) name = string_printf("__tex_image_0%d", slot);
-		else name = string_printf("__tex_image_00%d", slot);
+	if(type == IMAGE_DATA_TYPE_BYTE4)
+		name = string_printf("__tex_image_%03d", flat_slot);
+	else
+		name = string_printf("__tex_image_%s_%03d", name_from_type(type).c_str(), flat_slot);
 
-		if(!pack_images) {
-			thread_scoped_lock device_lock(device_mutex);
-			device->tex_alloc(name.c_str(), tex_img, img->interpolation, true);
-		}
+	switch(type) {
+		case IMAGE_DATA_TYPE_FLOAT4:
+			device_load_image_type<TypeDesc::FLOAT, float, float4>(device, img, dscene->tex_float_image[slot], name);
+			break;
+		case IMAGE_DATA_TYPE_BYTE4:
+			device_load_image_type<TypeDesc::UINT8, uchar, uchar4>(device, img, dscene->tex_image[slot], name);
+			break;
+		case IMAGE_DATA_TYPE_HALF4:
+			device_load_image_type<TypeDesc::HALF, half, half4>(device, img, dscene->tex_half4_image[slot], name);
+			break;
+		case IMAGE_DATA_TYPE_FLOAT:
+			device_load_image_type<TypeDesc::FLOAT, float, float>(device, img, dscene->tex_float1_image[slot], name);
+			break;
+		case IMAGE_DATA_TYPE_BYTE:
+			device_load_image_type<TypeDesc::UINT8, uchar, uchar>(device, img, dscene->tex_byte1_image[slot], name);
+			break;
+		case IMAGE_DATA_TYPE_HALF:
+			device_load_image_type<TypeDesc::HALF, half, half>(device, img, dscene->tex_half1_image[slot], name);
+			break;
+		default:
+			assert(0);
+			break;
 	}
 
 	img->need_load = false;
 }
 
-void ImageManager::device_free_image(Device *device, DeviceScene *dscene, int slot)
+template<typename DeviceType>
+void ImageManager::device_free_image_type(Device *device, device_vector<DeviceType>& tex_img)
 {
-	Image *img;
-	bool is_float;
-
-	if(slot >= tex_image_byte_start) {
-		img = images[slot - tex_image_byte_start];
-		is_float = false;
-	}
-	else {
-		img = float_images[slot];
-		is_float = true;
+	if(tex_img.device_pointer) {
+		thread_scoped_lock device_lock(device_mutex);
+		device->tex_free(tex_img);
 	}
 
+	tex_img.clear();
+}
+
+void ImageManager::device_free_image(Device *device, DeviceScene *dscene, ImageDataType type, int slot)
+{
+	Image *img = images[type][slot];
+
 	if(img) {
+		int flat_slot = type_index_to_flattened_slot(slot, type);
+		TextureCacheGlobals *tcg = (TextureCacheGlobals*)device->texture_cache_memory();
+
+		if(tcg && flat_slot < (int)tcg->images.size() && tcg->images[flat_slot].handle) {
+			tcg->ts->invalidate(ustring(img->filename));
+			tcg->images[flat_slot] = TextureCacheGlobals::Image();
+		}
+
 		if(osl_texture_system && !img->builtin_data) {
 #ifdef WITH_OSL
-			ustring filename(images[slot]->filename);
+			ustring filename(img->filename);
 			((OSL::TextureSystem*)osl_texture_system)->invalidate(filename);
 #endif
 		}
-		else if(is_float) {
-			device_vector<float4>& tex_img = dscene->tex_float_image[slot];
-
-			if(tex_img.device_pointer) {
-				thread_scoped_lock device_lock(device_mutex);
-				device->tex_free(tex_img);
-			}
-
-			tex_img.clear();
-
-			delete float_images[slot];
-			float_images[slot] = NULL;
-		}
 		else {
-			device_vector<uchar4>& tex_img = dscene->tex_image[slot - tex_image_byte_start];
-
-			if(tex_img.device_pointer) {
-				thread_scoped_lock device_lock(device_mutex);
-				device->tex_free(tex_img);
+			switch(type) {
+				case IMAGE_DATA_TYPE_FLOAT4:
+					device_free_image_type(device, dscene->tex_float_image[slot]);
+					break;
+				case IMAGE_DATA_TYPE_BYTE4:
+					device_free_image_type(device, dscene->tex_image[slot]);
+					break;
+				case IMAGE_DATA_TYPE_HALF4:
+					device_free_image_type(device, dscene->tex_half4_image[slot]);
+					break;
+				case IMAGE_DATA_TYPE_FLOAT:
+					device_free_image_type(device, dscene->tex_float1_image[slot]);
+					break;
+				case IMAGE_DATA_TYPE_BYTE:
+					device_free_image_type(device, dscene->tex_byte1_image[slot]);
+					break;
+				case IMAGE_DATA_TYPE_HALF:
+					device_free_image_type(device, dscene->tex_half1_image[slot]);
+					break;
+				default:
+					assert(0);
+					break;
 			}
 
-			tex_img.clear();
-
-			delete images[slot - tex_image_byte_start];
-			images[slot - tex_image_byte_start] = NULL;
+			delete images[type][slot];
+			images[type][slot] = NULL;
 		}
 	}
 }
@@ -755,31 +753,35 @@ void ImageManager::device_update(Device *device, DeviceScene *dscene, Progress&
 	if(!need_update)
 		return;
 
-	TaskPool pool;
+	TextureCacheGlobals *tcg = texture_cache(device);
 
-	for(size_t slot = 0; slot < images.size(); slot++) {
-		if(!images[slot])
-			continue;
+	if(tcg) {
+		size_t num_slots = 0;
 
-		if(images[slot]->users == 0) {
-			device_free_image(device, dscene, slot + tex_image_byte_start);
-		}
-		else if(images[slot]->need_load) {
-			if(!osl_texture_system || images[slot]->builtin_data) 
-				pool.push(function_bind(&ImageManager::device_load_image, this, device, dscene, slot + tex_image_byte_start, &progress));
+		for(int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+			size_t type_slots = tex_start_images[type] + images[type].size();
+
+			if(images[type].size() && type_slots > num_slots)
+				num_slots = type_slots;
 		}
+
+		tcg->images.resize(num_slots);
 	}
 
-	for(size_t slot = 0; slot < float_images.size(); slot++) {
-		if(!float_images[slot])
-			continue;
+	TaskPool pool;
 
-		if(float_images[slot]->users == 0) {
-			device_free_image(device, dscene, slot);
-		}
-		else if(float_images[slot]->need_load) {
-			if(!osl_texture_system || float_images[slot]->builtin_data) 
-				pool.push(function_bind(&ImageManager::device_load_image, this, device, dscene, slot, &progress));
+	for(int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+		for(size_t slot = 0; slot < images[type].size(); slot++) {
+			if(!images[type][slot])
+				continue;
+
+			if(images[type][slot]->users == 0) {
+				device_free_image(device, dscene, (ImageDataType)type, slot);
+			}
+			else if(images[type][slot]->need_load) {
+				if(!osl_texture_system || images[type][slot]->builtin_data)
+					pool.push(function_bind(&ImageManager::device_load_image, this, device, dscene, (ImageDataType)type, slot, &progress));
+			}
 		}
 	}
 
@@ -797,23 +799,24 @@ void ImageManager::device_pack_images(Device *device,
 {
 	/* for OpenCL, we pack all image textures inside a single big texture, and
 	 * will do our own interpolation in the kernel */
+	vector<Image*>& byte_images = images[IMAGE_DATA_TYPE_BYTE4];
 	size_t size = 0;
 
-	for(size_t slot = 0; slot < images.size(); slot++) {
-		if(!images[slot])
+	for(size_t slot = 0; slot < byte_images.size(); slot++) {
+		if(!byte_images[slot])
 			continue;
 
 		device_vector<uchar4>& tex_img = dscene->tex_image[slot];
 		size += tex_img.size();
 	}
 
-	uint4 *info = dscene->tex_image_packed_info.resize(images.size());
+	uint4 *info = dscene->tex_image_packed_info.resize(byte_images.size());
 	uchar4 *pixels = dscene->tex_image_packed.resize(size);
 
 	size_t offset = 0;
 
-	for(size_t slot = 0; slot < images.size(); slot++) {
-		if(!images[slot])
+	for(size_t slot = 0; slot < byte_images.size(); slot++) {
+		if(!byte_images[slot])
 			continue;
 
 		device_vector<uchar4>& tex_img = dscene->tex_image[slot];
@@ -823,13 +826,12 @@ void ImageManager::device_pack_images(Device *device,
 		/* The image options are packed
 		   bit 0 -> periodic
 		   bit 1 + 2 -> interpolation type */
-		uint8_t interpolation = (images[slot]->interpolation << 1) + 1;
+		uint8_t interpolation = (byte_images[slot]->interpolation << 1) + 1;
 		info[slot] = make_uint4(tex_img.data_width, tex_img.data_height, offset, interpolation);
 
 		memcpy(pixels+offset, (void*)tex_img.data_pointer, tex_img.memory_size());
 		offset += tex_img.size();
 	}
-
 	if(dscene->tex_image_packed.size()) {
 		if(dscene->tex_image_packed.device_pointer) {
 			thread_scoped_lock device_lock(device_mutex);
@@ -848,21 +850,25 @@ void ImageManager::device_pack_images(Device *device,
 
 void ImageManager::device_free_builtin(Device *device, DeviceScene *dscene)
 {
-	for(size_t slot = 0; slot < images.size(); slot++)
-		if(images[slot] && images[slot]->builtin_data)
-			device_free_image(device, dscene, slot + tex_image_byte_start);
-
-	for(size_t slot = 0; slot < float_images.size(); slot++)
-		if(float_images[slot] && float_images[slot]->builtin_data)
-			device_free_image(device, dscene, slot);
+	for(int type = 0; type < IMAGE_DATA_NUM_TYPES; type++)
+		for(size_t slot = 0; slot < images[type].size(); slot++)
+			if(images[type][slot] && images[type][slot]->builtin_data)
+				device_free_image(device, dscene, (ImageDataType)type, slot);
 }
 
 void ImageManager::device_free(Device *device, DeviceScene *dscene)
 {
-	for(size_t slot = 0; slot < images.size(); slot++)
-		device_free_image(device, dscene, slot + tex_image_byte_start);
-	for(size_t slot = 0; slot < float_images.size(); slot++)
-		device_free_image(device, dscene, slot);
+	for(int type = 0; type < IMAGE_DATA_NUM_TYPES; type++)
+		for(size_t slot = 0; slot < images[type].size(); slot++)
+			device_free_image(device, dscene, (ImageDataType)type, slot);
+
+	TextureCacheGlobals *tcg = (TextureCacheGlobals*)device->texture_cache_memory();
+
+	if(tcg && tcg->ts) {
+		OIIO::TextureSystem::destroy(tcg->ts);
+		tcg->ts = NULL;
+		tcg->images.clear();
+	}
 
 	device->tex_free(dscene->tex_image_packed);
 	device->tex_free(dscene->tex_image_packed_info);
@@ -870,8 +876,8 @@ void ImageManager::device_free(Device *device, DeviceScene *dscene)
 	dscene->tex_image_packed.clear();
 	dscene->tex_image_packed_info.clear();
 
-	images.clear();
-	float_images.clear();
+	for(int type = 0; type < IMAGE_DATA_NUM_TYPES; type++)
+		images[type].clear();
 }
 
 CCL_NAMESPACE_END
@@ -20,25 +20,36 @@
 #include "device.h"
 #include "device_memory.h"
 
+#include "util_image.h"
 #include "util_string.h"
 #include "util_thread.h"
 #include "util_vector.h"
 
-#include "kernel_types.h"  /* for TEX_NUM_FLOAT_IMAGES */
+#include "kernel_types.h"  /* for TEX_NUM_FLOAT_IMAGES and the cpu slots */
 
 CCL_NAMESPACE_BEGIN
 
-/* generic */
+/* generic, float4 slots followed by byte4 slots. The CUDA kernel and the packed
+ * OpenCL images address images by these slot numbers, so other storage types
+ * fall back to float4 or byte4 slots on those devices. */
 #define TEX_NUM_IMAGES			94
 #define TEX_IMAGE_BYTE_START	TEX_NUM_FLOAT_IMAGES
 
 /* extended gpu */
 #define TEX_EXTENDED_NUM_IMAGES_GPU		145
 
-/* extended cpu */
-#define TEX_EXTENDED_NUM_FLOAT_IMAGES	1024
-#define TEX_EXTENDED_NUM_IMAGES_CPU		1024
-#define TEX_EXTENDED_IMAGE_BYTE_START	TEX_EXTENDED_NUM_FLOAT_IMAGES
+/* extended cpu, the slot ranges of KernelGlobals from kernel_types.h */
+#define TEX_EXTENDED_NUM_FLOAT_IMAGES	MAX_FLOAT_IMAGES
+#define TEX_EXTENDED_NUM_IMAGES_CPU		MAX_BYTE_IMAGES
+#define TEX_EXTENDED_NUM_HALF4_IMAGES	MAX_HALF4_IMAGES
+#define TEX_EXTENDED_NUM_FLOAT1_IMAGES	MAX_FLOAT1_IMAGES
+#define TEX_EXTENDED_NUM_BYTE1_IMAGES	MAX_BYTE1_IMAGES
+#define TEX_EXTENDED_NUM_HALF1_IMAGES	MAX_HALF1_IMAGES
+#define TEX_EXTENDED_IMAGE_BYTE_START	MAX_FLOAT_IMAGES
+#define TEX_EXTENDED_IMAGE_HALF4_START	IMAGE_HALF4_START
+#define TEX_EXTENDED_IMAGE_FLOAT1_START	IMAGE_FLOAT1_START
+#define TEX_EXTENDED_IMAGE_BYTE1_START	IMAGE_BYTE1_START
+#define TEX_EXTENDED_IMAGE_HALF1_START	IMAGE_HALF1_START
 
 /* color to use when textures are not found */
 #define TEX_IMAGE_MISSING_R 1
@@ -49,9 +60,23 @@ CCL_NAMESPACE_BEGIN
 class Device;
 class DeviceScene;
 class Progress;
+struct TextureCacheGlobals;
 
 class ImageManager {
 public:
+	/* storage types of image slots, the half and single channel types are
+	 * only available on the CPU, other devices fall back to float4 or byte4 */
+	enum ImageDataType {
+		IMAGE_DATA_TYPE_FLOAT4 = 0,
+		IMAGE_DATA_TYPE_BYTE4 = 1,
+		IMAGE_DATA_TYPE_HALF4 = 2,
+		IMAGE_DATA_TYPE_FLOAT = 3,
+		IMAGE_DATA_TYPE_BYTE = 4,
+		IMAGE_DATA_TYPE_HALF = 5,
+
+		IMAGE_DATA_NUM_TYPES
+	};
+
 	ImageManager();
 	~ImageManager();
 
@@ -61,6 +86,7 @@ public:
 	void remove_image(const string& filename, void *builtin_data, InterpolationType interpolation);
 	void tag_reload_image(const string& filename, void *builtin_data, InterpolationType interpolation);
 	bool is_float_image(const string& filename, void *builtin_data, bool& is_linear);
+	ImageDataType get_image_metadata(const string& filename, void *builtin_data, bool& is_linear);
 
 	void device_update(Device *device, DeviceScene *dscene, Progress& progress);
 	void device_free(Device *device, DeviceScene *dscene);
@@ -68,6 +94,7 @@ public:
 
 	void set_osl_texture_system(void *texture_system);
 	void set_pack_images(bool pack_images_);
+	void set_texture_cache(bool use_texture_cache_, int texture_cache_size_);
 	void set_extended_image_limits(const DeviceInfo& info);
 	bool set_animation_frame_update(int frame);
 
@@ -91,22 +118,38 @@ public:
 	};
 
 private:
-	int tex_num_images;
-	int tex_num_float_images;
-	int tex_image_byte_start;
+	/* slots are numbered per storage type, the kernel uses flattened slots
+	 * where each type starts at its own offset */
+	int tex_num_images[IMAGE_DATA_NUM_TYPES];
+	int tex_start_images[IMAGE_DATA_NUM_TYPES];
 	thread_mutex device_mutex;
 	int animation_frame;
 
-	vector<Image*> images;
-	vector<Image*> float_images;
+	vector<Image*> images[IMAGE_DATA_NUM_TYPES];
 	void *osl_texture_system;
 	bool pack_images;
+	bool use_texture_cache;
+	int texture_cache_size;
+
+	int type_index_to_flattened_slot(int slot, ImageDataType type);
+	int flattened_slot_to_type_index(int flat_slot, ImageDataType *type);
+	string name_from_type(int type);
+
+	bool file_load_image_generic(Image *img, ImageInput **in, int &width, int &height, int &depth, int &components);
+
+	template<TypeDesc::BASETYPE FileFormat, typename StorageType, typename DeviceType>
+	bool file_load_image(Image *img, device_vector<DeviceType>& tex_img);
+
+	TextureCacheGlobals *texture_cache(Device *device);
+	bool texture_cache_load_image(TextureCacheGlobals *tcg, Image *img, int slot);
 
-	bool file_load_image(Image *img, device_vector<uchar4>& tex_img);
-	bool file_load_float_image(Image *img, device_vector<float4>& tex_img);
+	template<TypeDesc::BASETYPE FileFormat, typename StorageType, typename DeviceType>
+	void device_load_image_type(Device *device, Image *img, device_vector<DeviceType>& tex_img, const string& name);
+	template<typename DeviceType>
+	void device_free_image_type(Device *device, device_vector<DeviceType>& tex_img);
 
-	void device_load_image(Device *device, DeviceScene *dscene, int slot, Progress *progess);
-	void device_free_image(Device *device, DeviceScene *dscene, int slot);
+	void device_load_image(Device *device, DeviceScene *dscene, ImageDataType type, int slot, Progress *progess);
+	void device_free_image(Device *device, DeviceScene *dscene, ImageDataType type, int slot);
 
 	void device_pack_images(Device *device, DeviceScene *dscene, Progress& progess);
 };
@@ -64,6 +64,12 @@ public:
 	bool sample_all_lights_direct;
 	bool sample_all_lights_indirect;
 
+	bool use_light_tree;
+
+	bool use_adaptive_sampling;
+	float adaptive_threshold;
+	int adaptive_min_samples;
+
 	enum Method {
 		BRANCHED_PATH = 0,
 		PATH = 1
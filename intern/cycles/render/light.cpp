@@ -19,6 +19,7 @@
 #include "integrator.h"
 #include "film.h"
 #include "light.h"
+#include "light_tree.h"
 #include "mesh.h"
 #include "object.h"
 #include "scene.h"
@@ -148,6 +149,68 @@ LightManager::~LightManager()
 {
 }
 
+static LightTreeEmitter light_tree_triangle(const float3& p1,
+                                            const float3& p2,
+                                            const float3& p3,
+                                            int index)
+{
+	LightTreeEmitter emitter;
+
+	emitter.bounds = BoundBox(p1);
+	emitter.bounds.grow(p2);
+	emitter.bounds.grow(p3);
+
+	/* mesh lights emit from both sides */
+	float3 N = cross(p2 - p1, p3 - p1);
+	emitter.axis = (len_squared(N) > 0.0f)? normalize(N): make_float3(0.0f, 0.0f, 1.0f);
+	emitter.theta_o = 0.0f;
+	emitter.theta_e = M_PI_2_F;
+	emitter.two_sided = true;
+	emitter.energy = triangle_area(p1, p2, p3);
+	emitter.index = index;
+
+	return emitter;
+}
+
+static LightTreeEmitter light_tree_lamp(const Light *light, int index)
+{
+	LightTreeEmitter emitter;
+
+	emitter.bounds = BoundBox(light->co);
+	emitter.axis = make_float3(0.0f, 0.0f, 1.0f);
+	emitter.theta_o = M_PI_F;
+	emitter.theta_e = M_PI_2_F;
+	emitter.two_sided = false;
+	/* no estimate of shader strength, same share for each lamp as the
+	 * flat distribution */
+	emitter.energy = 1.0f;
+	emitter.index = index;
+
+	if(light->type == LIGHT_AREA) {
+		float3 axisu = light->axisu*(light->sizeu*light->size);
+		float3 axisv = light->axisv*(light->sizev*light->size);
+		float3 corner = light->co - axisu*0.5f - axisv*0.5f;
+
+		emitter.bounds = BoundBox(corner);
+		emitter.bounds.grow(corner + axisu);
+		emitter.bounds.grow(corner + axisv);
+		emitter.bounds.grow(corner + axisu + axisv);
+		emitter.axis = safe_normalize(light->dir);
+		emitter.theta_o = 0.0f;
+	}
+	else {
+		emitter.bounds.grow(light->co, light->size);
+
+		if(light->type == LIGHT_SPOT) {
+			emitter.axis = safe_normalize(light->dir);
+			emitter.theta_o = 0.0f;
+			emitter.theta_e = min(light->spot_angle*0.5f, M_PI_F);
+		}
+	}
+
+	return emitter;
+}
+
 void LightManager::device_update_distribution(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
 {
 	progress.set_status("Updating Lights", "Computing distribution");
@@ -196,6 +259,19 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 	float4 *distribution = dscene->light_distribution.resize(num_distribution + 1);
 	float totarea = 0.0f;
 
+	/* light tree emitters, and per object the offset of a map from its
+	 * triangles to their distribution index and the mesh triangle offset */
+	bool use_light_tree = scene->integrator->use_light_tree;
+	vector<LightTreeEmitter> tree_triangles;
+	vector<LightTreeEmitter> tree_lamps;
+	vector<LightTreeEmitter> tree_distant_lamps;
+	vector<uint> tree_map;
+
+	if(use_light_tree) {
+		tree_triangles.reserve(num_triangles);
+		tree_map.resize(2*scene->objects.size(), 0);
+	}
+
 	/* triangles */
 	size_t offset = 0;
 	int j = 0;
@@ -253,6 +329,14 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 				use_light_visibility = true;
 			}
 
+			size_t map_offset = tree_map.size();
+
+			if(use_light_tree) {
+				tree_map[2*j + 0] = map_offset;
+				tree_map[2*j + 1] = mesh->tri_offset;
+				tree_map.resize(map_offset + mesh->triangles.size(), ~0u);
+			}
+
 			for(size_t i = 0; i < mesh->triangles.size(); i++) {
 				Shader *shader = scene->shaders[mesh->shader[i]];
 
@@ -261,7 +345,6 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 					distribution[offset].y = __int_as_float(i + mesh->tri_offset);
 					distribution[offset].z = __int_as_float(shader_flag);
 					distribution[offset].w = __int_as_float(object_id);
-					offset++;
 
 					Mesh::Triangle t = mesh->triangles[i];
 					float3 p1 = mesh->verts[t.v[0]];
@@ -275,6 +358,13 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 					}
 
 					totarea += triangle_area(p1, p2, p3);
+
+					if(use_light_tree) {
+						tree_map[map_offset + i] = offset;
+						tree_triangles.push_back(light_tree_triangle(p1, p2, p3, offset));
+					}
+
+					offset++;
 				}
 			}
 		}
@@ -303,6 +393,13 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 			use_lamp_mis = true;
 		if(light->type == LIGHT_BACKGROUND)
 			num_background_lights++;
+
+		if(use_light_tree) {
+			if(light->type == LIGHT_DISTANT || light->type == LIGHT_BACKGROUND)
+				tree_distant_lamps.push_back(light_tree_lamp(light, offset));
+			else
+				tree_lamps.push_back(light_tree_lamp(light, offset));
+		}
 	}
 
 	/* normalize cumulative distribution functions */
@@ -364,6 +461,33 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 
 		/* CDF */
 		device->tex_alloc("__light_distribution", dscene->light_distribution);
+
+		/* light tree */
+		kintegrator->use_light_tree = use_light_tree;
+
+		if(use_light_tree) {
+			progress.set_status("Updating Lights", "Building light tree");
+
+			LightTree tree(tree_triangles,
+			               tree_lamps,
+			               tree_distant_lamps,
+			               trianglearea/totarea);
+
+			float4 *tree_nodes = dscene->light_tree_nodes.resize(tree.num_nodes()*LIGHT_TREE_NODE_SIZE);
+			tree.pack(tree_nodes);
+
+			/* map triangles to their leaf nodes */
+			for(size_t i = 2*scene->objects.size(); i < tree_map.size(); i++)
+				if(tree_map[i] != ~0u)
+					tree_map[i] = tree.leaf_node(tree_map[i]);
+			if(tree_map.size() == 0)
+				tree_map.push_back(0);
+
+			dscene->light_tree_map.copy(&tree_map[0], tree_map.size());
+
+			device->tex_alloc("__light_tree_nodes", dscene->light_tree_nodes);
+			device->tex_alloc("__light_tree_map", dscene->light_tree_map);
+		}
 	}
 	else {
 		dscene->light_distribution.clear();
@@ -374,6 +498,7 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 		kintegrator->pdf_lights = 0.0f;
 		kintegrator->inv_pdf_lights = 0.0f;
 		kintegrator->use_lamp_mis = false;
+		kintegrator->use_light_tree = false;
 		kfilm->pass_shadow_scale = 1.0f;
 	}
 }
@@ -692,11 +817,15 @@ void LightManager::device_free(Device *device, DeviceScene *dscene)
 	device->tex_free(dscene->light_data);
 	device->tex_free(dscene->light_background_marginal_cdf);
 	device->tex_free(dscene->light_background_conditional_cdf);
+	device->tex_free(dscene->light_tree_nodes);
+	device->tex_free(dscene->light_tree_map);
 
 	dscene->light_distribution.clear();
 	dscene->light_data.clear();
 	dscene->light_background_marginal_cdf.clear();
 	dscene->light_background_conditional_cdf.clear();
+	dscene->light_tree_nodes.clear();
+	dscene->light_tree_map.clear();
 }
 
 void LightManager::tag_update(Scene * /*scene*/)
@@ -0,0 +1,418 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kernel_types.h"
+
+#include "light_tree.h"
+
+#include "util_algorithm.h"
+#include "util_math.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Orientation Cone
+ *
+ * Directional bounds of a set of emitters, merged as in "Importance Sampling
+ * of Many Lights with Adaptive Tree Splitting", Conty Estevez and Kulla. */
+
+struct LightTreeCone {
+	LightTreeCone()
+	: axis(make_float3(0.0f, 0.0f, 1.0f)), theta_o(0.0f), theta_e(0.0f),
+	  two_sided(false), empty(true) {}
+
+	LightTreeCone(const LightTreeEmitter& emitter)
+	: axis(emitter.axis), theta_o(emitter.theta_o), theta_e(emitter.theta_e),
+	  two_sided(emitter.two_sided), empty(false) {}
+
+	float3 axis;
+	float theta_o;
+	float theta_e;
+	bool two_sided;
+	bool empty;
+
+	void grow(const LightTreeCone& other)
+	{
+		if(other.empty)
+			return;
+		if(empty) {
+			*this = other;
+			return;
+		}
+
+		float3 other_axis = other.axis;
+		two_sided = two_sided || other.two_sided;
+
+		/* two sided emitters are symmetric, pick the closest orientation */
+		if(two_sided && dot(axis, other_axis) < 0.0f)
+			other_axis = -other_axis;
+
+		theta_e = max(theta_e, other.theta_e);
+
+		/* make sure this cone is the wider one */
+		float3 a_axis = axis, b_axis = other_axis;
+		float a_theta = theta_o, b_theta = other.theta_o;
+
+		if(b_theta > a_theta) {
+			swap(a_axis, b_axis);
+			swap(a_theta, b_theta);
+		}
+
+		float theta_d = safe_acosf(dot(a_axis, b_axis));
+
+		/* wider cone already contains the other one */
+		if(min(theta_d + b_theta, M_PI_F) <= a_theta) {
+			axis = a_axis;
+			theta_o = a_theta;
+			return;
+		}
+
+		float new_theta = (a_theta + theta_d + b_theta)*0.5f;
+
+		if(new_theta >= M_PI_F) {
+			axis = a_axis;
+			theta_o = M_PI_F;
+			return;
+		}
+
+		/* rotate axis of the wider cone towards the other one */
+		float theta_r = new_theta - a_theta;
+		float3 perp = b_axis - a_axis*dot(a_axis, b_axis);
+		float perp_len = len(perp);
+
+		if(perp_len < 1e-6f) {
+			float3 u, v;
+			make_orthonormals(a_axis, &u, &v);
+			perp = u;
+		}
+		else
+			perp /= perp_len;
+
+		axis = safe_normalize(a_axis*cosf(theta_r) + perp*sinf(theta_r));
+		theta_o = new_theta;
+	}
+
+	/* solid angle measure of emitted directions */
+	float measure() const
+	{
+		if(empty)
+			return 0.0f;
+
+		float theta_w = min(theta_o + theta_e, M_PI_F);
+		float cos_o = cosf(theta_o);
+		float sin_o = sinf(theta_o);
+		float m = M_2PI_F*(1.0f - cos_o) +
+		          M_PI_2_F*(2.0f*theta_w*sin_o - cosf(theta_o - 2.0f*theta_w) -
+		                    2.0f*theta_o*sin_o + cos_o);
+
+		return (two_sided)? min(2.0f*m, M_4PI_F): m;
+	}
+};
+
+/* Bin for finding splits. */
+
+struct LightTreeBin {
+	LightTreeBin() : bounds(BoundBox::empty), energy(0.0f), num(0) {}
+
+	BoundBox bounds;
+	LightTreeCone cone;
+	float energy;
+	int num;
+
+	void grow(const LightTreeBin& other)
+	{
+		bounds.grow(other.bounds);
+		cone.grow(other.cone);
+		energy += other.energy;
+		num += other.num;
+	}
+
+	float cost() const
+	{
+		return (num)? energy*bounds.half_area()*cone.measure(): 0.0f;
+	}
+};
+
+/* Orders emitters by bin of their centroid along one axis. */
+
+struct LightTreeBinPredicate {
+	LightTreeBinPredicate(int dim, float min, float scale, int split)
+	: dim(dim), min(min), scale(scale), split(split) {}
+
+	bool operator()(const LightTreeEmitter& emitter) const
+	{
+		return bin(emitter) < split;
+	}
+
+	int bin(const LightTreeEmitter& emitter) const
+	{
+		float c = emitter.bounds.center()[dim];
+		return clamp((int)((c - min)*scale), 0, NUM_BINS-1);
+	}
+
+	enum { NUM_BINS = 12 };
+
+	int dim;
+	float min;
+	float scale;
+	int split;
+};
+
+/* Light Tree */
+
+LightTree::LightTree(vector<LightTreeEmitter>& triangles,
+                     vector<LightTreeEmitter>& lamps,
+                     vector<LightTreeEmitter>& distant_lamps,
+                     float triangle_fraction)
+{
+	const size_t num_lamps = lamps.size() + distant_lamps.size();
+
+	/* emitters are indexed by their position in the light distribution */
+	nodes.reserve(2*(triangles.size() + num_lamps));
+	leaf_nodes.resize(triangles.size() + num_lamps, -1);
+
+	int root = add_node(-1);
+	int lamp_root = root;
+
+	if(triangles.size() && num_lamps) {
+		split_fixed(root, triangle_fraction);
+		build_importance(nodes[root].child[0], triangles);
+		lamp_root = nodes[root].child[1];
+	}
+	else if(triangles.size()) {
+		build_importance(root, triangles);
+	}
+
+	if(lamps.size() && distant_lamps.size()) {
+		split_fixed(lamp_root, (float)lamps.size()/(float)num_lamps);
+		build_importance(nodes[lamp_root].child[0], lamps);
+		build_uniform(nodes[lamp_root].child[1], distant_lamps);
+	}
+	else if(lamps.size()) {
+		build_importance(lamp_root, lamps);
+	}
+	else if(distant_lamps.size()) {
+		build_uniform(lamp_root, distant_lamps);
+	}
+}
+
+int LightTree::leaf_node(int index) const
+{
+	return leaf_nodes[index];
+}
+
+int LightTree::add_node(int parent)
+{
+	Node node;
+
+	node.bounds = BoundBox::empty;
+	node.axis = make_float3(0.0f, 0.0f, 1.0f);
+	node.theta_o = 0.0f;
+	node.theta_e = 0.0f;
+	node.two_sided = false;
+	node.energy = 0.0f;
+	node.fixed_split = false;
+	node.split_prob = 0.0f;
+	node.child[0] = -1;
+	node.child[1] = -1;
+	node.parent = parent;
+	node.emitter = -1;
+
+	nodes.push_back(node);
+	return nodes.size() - 1;
+}
+
+void LightTree::split_fixed(int node, float prob0)
+{
+	int child0 = add_node(node);
+	int child1 = add_node(node);
+
+	nodes[node].fixed_split = true;
+	nodes[node].split_prob = prob0;
+	nodes[node].child[0] = child0;
+	nodes[node].child[1] = child1;
+}
+
+void LightTree::make_leaf(int node, const LightTreeEmitter& emitter)
+{
+	nodes[node].emitter = emitter.index;
+	leaf_nodes[emitter.index] = node;
+}
+
+void LightTree::build_uniform(int root, const vector<LightTreeEmitter>& emitters)
+{
+	/* distant lights have no position, pick them with equal probability */
+	vector<int3> stack;
+	stack.push_back(make_int3(root, 0, emitters.size()));
+
+	while(!stack.empty()) {
+		int3 item = stack.back();
+		stack.pop_back();
+
+		int node = item.x, start = item.y, end = item.z;
+
+		if(end - start == 1) {
+			make_leaf(node, emitters[start]);
+			continue;
+		}
+
+		int mid = (start + end)/2;
+		split_fixed(node, (float)(mid - start)/(float)(end - start));
+
+		stack.push_back(make_int3(nodes[node].child[0], start, mid));
+		stack.push_back(make_int3(nodes[node].child[1], mid, end));
+	}
+}
+
+void LightTree::build_importance(int root, vector<LightTreeEmitter>& emitters)
+{
+	vector<int3> stack;
+	stack.push_back(make_int3(root, 0, emitters.size()));
+
+	while(!stack.empty()) {
+		int3 item = stack.back();
+		stack.pop_back();
+
+		int node = item.x, start = item.y, end = item.z;
+
+		/* bounds of node */
+		LightTreeBin all;
+		BoundBox centroid_bounds = BoundBox::empty;
+
+		for(int i = start; i < end; i++) {
+			all.bounds.grow(emitters[i].bounds);
+			all.cone.grow(LightTreeCone(emitters[i]));
+			all.energy += emitters[i].energy;
+			centroid_bounds.grow(emitters[i].bounds.center());
+		}
+
+		Node& n = nodes[node];
+		n.bounds = all.bounds;
+		n.axis = all.cone.axis;
+		n.theta_o = all.cone.theta_o;
+		n.theta_e = all.cone.theta_e;
+		n.two_sided = all.cone.two_sided;
+		n.energy = all.energy;
+
+		if(end - start == 1) {
+			make_leaf(node, emitters[start]);
+			continue;
+		}
+
+		/* find split with lowest surface area orientation heuristic */
+		const int num_bins = LightTreeBinPredicate::NUM_BINS;
+		float3 extent = centroid_bounds.size();
+		float max_extent = max(max(extent.x, extent.y), extent.z);
+		float best_cost = FLT_MAX;
+		int best_dim = -1, best_split = 0;
+
+		for(int dim = 0; dim < 3; dim++) {
+			if(extent[dim] <= 0.0f)
+				continue;
+
+			LightTreeBinPredicate pred(dim, centroid_bounds.min[dim],
+			                           num_bins*0.99999f/extent[dim], 0);
+			LightTreeBin bins[num_bins];
+
+			for(int i = start; i < end; i++) {
+				LightTreeBin& bin = bins[pred.bin(emitters[i])];
+
+				bin.bounds.grow(emitters[i].bounds);
+				bin.cone.grow(LightTreeCone(emitters[i]));
+				bin.energy += emitters[i].energy;
+				bin.num++;
+			}
+
+			/* sweep from right to left, then from left to right */
+			LightTreeBin right[num_bins];
+			right[num_bins-1] = bins[num_bins-1];
+			for(int i = num_bins-2; i > 0; i--) {
+				right[i] = right[i+1];
+				right[i].grow(bins[i]);
+			}
+
+			/* favor splitting along the longest axis */
+			float regularization = max_extent/extent[dim];
+			LightTreeBin left;
+
+			for(int split = 1; split < num_bins; split++) {
+				left.grow(bins[split-1]);
+
+				if(left.num == 0 || right[split].num == 0)
+					continue;
+
+				float cost = regularization*(left.cost() + right[split].cost());
+
+				if(cost < best_cost) {
+					best_cost = cost;
+					best_dim = dim;
+					best_split = split;
+				}
+			}
+		}
+
+		int mid;
+
+		if(best_dim != -1) {
+			LightTreeBinPredicate pred(best_dim, centroid_bounds.min[best_dim],
+			                           num_bins*0.99999f/extent[best_dim], best_split);
+			mid = std::partition(emitters.begin() + start, emitters.begin() + end, pred) -
+			      emitters.begin();
+		}
+		else {
+			/* coincident centroids, split in the middle */
+			mid = (start + end)/2;
+		}
+
+		int child0 = add_node(node);
+		int child1 = add_node(node);
+
+		nodes[node].child[0] = child0;
+		nodes[node].child[1] = child1;
+
+		stack.push_back(make_int3(child0, start, mid));
+		stack.push_back(make_int3(child1, mid, end));
+	}
+}
+
+void LightTree::pack(float4 *data) const
+{
+	for(size_t i = 0; i < nodes.size(); i++) {
+		const Node& node = nodes[i];
+		float4 *d = data + i*LIGHT_TREE_NODE_SIZE;
+
+		int child0 = (node.emitter != -1)? ~node.emitter: node.child[0];
+		int flag = 0;
+
+		if(node.two_sided)
+			flag |= LIGHT_TREE_TWO_SIDED;
+		if(node.fixed_split)
+			flag |= LIGHT_TREE_FIXED_SPLIT;
+
+		float energy = (node.fixed_split)? node.split_prob: node.energy;
+		float3 bmin = (node.bounds.valid())? node.bounds.min: make_float3(0.0f, 0.0f, 0.0f);
+		float3 bmax = (node.bounds.valid())? node.bounds.max: make_float3(0.0f, 0.0f, 0.0f);
+
+		d[0] = make_float4(bmin.x, bmin.y, bmin.z, energy);
+		d[1] = make_float4(bmax.x, bmax.y, bmax.z, cosf(node.theta_o));
+		d[2] = make_float4(node.axis.x, node.axis.y, node.axis.z, cosf(node.theta_e));
+		d[3] = make_float4(__int_as_float(child0),
+		                   __int_as_float(node.child[1]),
+		                   __int_as_float(node.parent),
+		                   __int_as_float(flag));
+	}
+}
+
+CCL_NAMESPACE_END
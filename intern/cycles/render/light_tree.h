@@ -0,0 +1,94 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LIGHT_TREE_H__
+#define __LIGHT_TREE_H__
+
+#include "util_boundbox.h"
+#include "util_types.h"
+#include "util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Light Tree Emitter
+ *
+ * Spatial and directional bounds of an emitter, with emission around the
+ * normals within theta_o of axis, each spreading over theta_e. */
+
+struct LightTreeEmitter {
+	BoundBox bounds;
+	float3 axis;
+	float theta_o;
+	float theta_e;
+	bool two_sided;
+	float energy;
+
+	/* index in the light distribution */
+	int index;
+};
+
+/* Light Tree
+ *
+ * Hierarchy over the emitters of the light distribution, to pick emitters
+ * proportional to their estimated contribution to a shading point instead of
+ * their area. The top of the tree splits between triangles, local lamps and
+ * distant lamps with fixed probabilities, like the flat distribution. */
+
+class LightTree {
+public:
+	LightTree(vector<LightTreeEmitter>& triangles,
+	          vector<LightTreeEmitter>& lamps,
+	          vector<LightTreeEmitter>& distant_lamps,
+	          float triangle_fraction);
+
+	size_t num_nodes() const { return nodes.size(); }
+
+	/* node of the leaf with the given distribution index */
+	int leaf_node(int index) const;
+
+	/* pack into LIGHT_TREE_NODE_SIZE float4 per node */
+	void pack(float4 *data) const;
+
+protected:
+	struct Node {
+		BoundBox bounds;
+		float3 axis;
+		float theta_o;
+		float theta_e;
+		bool two_sided;
+		float energy;
+
+		bool fixed_split;
+		float split_prob;
+
+		int child[2];
+		int parent;
+		int emitter;
+	};
+
+	int add_node(int parent);
+	void split_fixed(int node, float prob0);
+	void make_leaf(int node, const LightTreeEmitter& emitter);
+	void build_uniform(int root, const vector<LightTreeEmitter>& emitters);
+	void build_importance(int root, vector<LightTreeEmitter>& emitters);
+
+	vector<Node> nodes;
+	vector<int> leaf_nodes;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __LIGHT_TREE_H__ */
@@ -31,8 +31,10 @@
 #include "util_cache.h"
 #include "util_foreach.h"
 #include "util_logging.h"
+#include "util_md5.h"
 #include "util_progress.h"
 #include "util_set.h"
+#include "util_time.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -514,6 +516,7 @@ void Mesh::compute_bvh(SceneParams *params, Progress *progress, int n, int total
 			bparams.use_cache = params->use_bvh_cache;
 			bparams.use_spatial_split = params->use_bvh_spatial_split;
 			bparams.use_qbvh = params->use_qbvh;
+			bparams.use_obvh = params->use_obvh;
 
 			delete bvh;
 			bvh = BVH::create(bparams, objects);
@@ -525,6 +528,24 @@ void Mesh::compute_bvh(SceneParams *params, Progress *progress, int n, int total
 	need_update_rebuild = false;
 }
 
+string Mesh::bvh_topology_key(const SceneParams *params) const
+{
+	/* everything a BVH refit relies on besides vertex and curve key positions */
+	MD5Hash md5;
+	int sizes[4] = {(int)verts.size(), (int)curve_keys.size(),
+	                (int)triangles.size(), (int)curves.size()};
+	bool flags[3] = {params->use_qbvh, params->use_obvh, params->use_bvh_spatial_split};
+
+	md5.append((uint8_t*)sizes, sizeof(sizes));
+	md5.append((uint8_t*)flags, sizeof(flags));
+	if(triangles.size())
+		md5.append((uint8_t*)&triangles[0], sizeof(Triangle)*triangles.size());
+	if(curves.size())
+		md5.append((uint8_t*)&curves[0], sizeof(Curve)*curves.size());
+
+	return md5.get_hex();
+}
+
 void Mesh::tag_update(Scene *scene, bool rebuild)
 {
 	need_update = true;
@@ -562,6 +583,53 @@ MeshManager::MeshManager()
 MeshManager::~MeshManager()
 {
 	delete bvh;
+	bvh_pool_free();
+}
+
+void MeshManager::bvh_pool_add(Scene *scene)
+{
+	/* only keep BVHs of the last reset */
+	bvh_pool_free();
+
+	foreach(Mesh *mesh, scene->meshes) {
+		if(mesh->bvh && !mesh->transform_applied) {
+			bvh_pool[mesh->bvh_topology_key(&scene->params)].push_back(mesh->bvh);
+			mesh->bvh = NULL;
+		}
+	}
+}
+
+void MeshManager::bvh_pool_take(Scene *scene)
+{
+	if(bvh_pool.size()) {
+		foreach(Mesh *mesh, scene->meshes) {
+			if(!mesh->need_update || mesh->bvh || mesh->transform_applied)
+				continue;
+
+			map<string, vector<BVH*> >::iterator it = bvh_pool.find(mesh->bvh_topology_key(&scene->params));
+
+			if(it != bvh_pool.end() && it->second.size()) {
+				/* same topology, so refitting is enough */
+				mesh->bvh = it->second.back();
+				mesh->need_update_rebuild = false;
+				it->second.pop_back();
+			}
+		}
+	}
+
+	/* meshes that are gone or changed topology */
+	bvh_pool_free();
+}
+
+void MeshManager::bvh_pool_free()
+{
+	map<string, vector<BVH*> >::iterator it;
+
+	for(it = bvh_pool.begin(); it != bvh_pool.end(); it++)
+		foreach(BVH *pool_bvh, it->second)
+			delete pool_bvh;
+
+	bvh_pool.clear();
 }
 
 void MeshManager::update_osl_attributes(Device *device, Scene *scene, vector<AttributeRequestSet>& mesh_attributes)
@@ -1075,12 +1143,14 @@ void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *
 	/* bvh build */
 	progress.set_status("Updating Scene BVH", "Building");
 
-	VLOG(1) << (scene->params.use_qbvh ? "Using QBVH optimization structure"
-	                                   : "Using regular BVH optimization structure");
+	VLOG(1) << (scene->params.use_obvh ? "Using OBVH optimization structure" :
+	            scene->params.use_qbvh ? "Using QBVH optimization structure" :
+	                                     "Using regular BVH optimization structure");
 
 	BVHParams bparams;
 	bparams.top_level = true;
 	bparams.use_qbvh = scene->params.use_qbvh;
+	bparams.use_obvh = scene->params.use_obvh;
 	bparams.use_spatial_split = scene->params.use_bvh_spatial_split;
 	bparams.use_cache = scene->params.use_bvh_cache;
 
@@ -1126,6 +1196,7 @@ void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *
 
 	dscene->data.bvh.root = pack.root_index;
 	dscene->data.bvh.use_qbvh = scene->params.use_qbvh;
+	dscene->data.bvh.use_obvh = scene->params.use_obvh;
 }
 
 void MeshManager::device_update_flags(Device * /*device*/,
@@ -1199,11 +1270,18 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 	}
 
 	/* update bvh */
-	size_t i = 0, num_bvh = 0;
+	double time_start = time_dt();
+	size_t i = 0, num_bvh = 0, num_refit = 0;
 
-	foreach(Mesh *mesh, scene->meshes)
-		if(mesh->need_update && !mesh->transform_applied)
+	bvh_pool_take(scene);
+
+	foreach(Mesh *mesh, scene->meshes) {
+		if(mesh->need_update && !mesh->transform_applied) {
 			num_bvh++;
+			if(mesh->bvh && !mesh->need_update_rebuild)
+				num_refit++;
+		}
+	}
 
 	TaskPool pool;
 
@@ -1223,6 +1301,8 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 	foreach(Shader *shader, scene->shaders)
 		shader->need_update_attributes = false;
 
+	double time_mesh_bvh = time_dt() - time_start;
+
 #ifdef __OBJECT_MOTION__
 	Scene::MotionType need_motion = scene->need_motion(device->info.advanced_shading);
 	bool motion_blur = need_motion == Scene::MOTION_BLUR;
@@ -1237,8 +1317,13 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 
 	if(progress.get_cancel()) return;
 
+	time_start = time_dt();
 	device_update_bvh(device, dscene, scene, progress);
 
+	VLOG(1) << "Mesh BVH sync: " << num_bvh - num_refit << " built, "
+	        << num_refit << " refit in " << time_mesh_bvh << "s, "
+	        << "scene BVH built in " << time_dt() - time_start << "s.";
+
 	need_update = false;
 }
 
@@ -129,6 +129,7 @@ public:
 	void pack_verts(float4 *tri_verts, float4 *tri_vindex, size_t vert_offset);
 	void pack_curves(Scene *scene, float4 *curve_key_co, float4 *curve_data, size_t curvekey_offset);
 	void compute_bvh(SceneParams *params, Progress *progress, int n, int total);
+	string bvh_topology_key(const SceneParams *params) const;
 
 	bool need_attribute(Scene *scene, AttributeStandard std);
 	bool need_attribute(Scene *scene, ustring name);
@@ -144,6 +145,10 @@ class MeshManager {
 public:
 	BVH *bvh;
 
+	/* BVHs of meshes freed on scene reset, by topology key. A mesh synced
+	 * again with unchanged topology refits one instead of building a BVH. */
+	map<string, vector<BVH*> > bvh_pool;
+
 	bool need_update;
 	bool need_flags_update;
 
@@ -164,6 +169,10 @@ public:
 	void device_update_flags(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
 	void device_free(Device *device, DeviceScene *dscene);
 
+	void bvh_pool_add(Scene *scene);
+	void bvh_pool_take(Scene *scene);
+	void bvh_pool_free();
+
 	void tag_update(Scene *scene);
 };
 
@@ -237,6 +237,26 @@ void ImageTextureNode::attributes(Shader *shader, AttributeRequestSet *attribute
 	ShaderNode::attributes(shader, attributes);
 }
 
+/* Mip selection for the texture cache estimates texture space derivatives from
+ * the default UV map, which is only valid when the image reads that map
+ * unmodified. */
+static bool image_texture_uses_default_uv(ShaderInput *vector_in)
+{
+	ShaderOutput *link = vector_in->link;
+
+	if(!link)
+		return false;
+
+	ShaderNode *node = link->parent;
+
+	if(node->name == ustring("texture_coordinate") && link == node->output("UV"))
+		return !((TextureCoordinateNode*)node)->from_dupli;
+	if(node->name == ustring("uvmap"))
+		return !((UVMapNode*)node)->from_dupli && ((UVMapNode*)node)->attribute == "";
+
+	return false;
+}
+
 void ImageTextureNode::compile(SVMCompiler& compiler)
 {
 	ShaderInput *vector_in = input("Vector");
@@ -260,7 +280,7 @@ void ImageTextureNode::compile(SVMCompiler& compiler)
 	if(slot != -1) {
 		compiler.stack_assign(vector_in);
 
-		int srgb = (is_linear || color_space != "Color")? 0: 1;
+		int srgb = (is_linear || color_space != "Color")? 0: NODE_IMAGE_SRGB;
 		int vector_offset = vector_in->stack_offset;
 
 		if(!tex_mapping.skip()) {
@@ -269,13 +289,18 @@ void ImageTextureNode::compile(SVMCompiler& compiler)
 		}
 
 		if(projection != "Box") {
+			int flags = srgb;
+
+			if(projection == "Flat" && tex_mapping.skip() && image_texture_uses_default_uv(vector_in))
+				flags |= NODE_IMAGE_UV_DIFFERENTIALS;
+
 			compiler.add_node(NODE_TEX_IMAGE,
 				slot,
 				compiler.encode_uchar4(
 					vector_offset,
 					color_out->stack_offset,
 					alpha_out->stack_offset,
-					srgb),
+					flags),
 				projection_enum[projection]);
 		}
 		else {
@@ -34,11 +34,12 @@
 #include "tables.h"
 
 #include "util_foreach.h"
+#include "util_logging.h"
 #include "util_progress.h"
+#include "util_time.h"
 
 #ifdef WITH_CYCLES_DEBUG
 #  include "util_guarded_allocator.h"
-#  include "util_logging.h"
 #endif
 
 CCL_NAMESPACE_BEGIN
@@ -70,6 +71,10 @@ Scene::Scene(const SceneParams& params_, const DeviceInfo& device_info_)
 
 	/* Extended image limits for CPU and GPUs */
 	image_manager->set_extended_image_limits(device_info_);
+
+	/* Texture cache only works on the CPU, OSL has its own */
+	if(device_info_.type == DEVICE_CPU && params.shadingsystem == SHADINGSYSTEM_SVM)
+		image_manager->set_texture_cache(params.use_texture_cache, params.texture_cache_size);
 }
 
 Scene::~Scene()
@@ -79,6 +84,10 @@ Scene::~Scene()
 
 void Scene::free_memory(bool final)
 {
+	/* keep mesh BVHs around for refitting in the next sync */
+	if(!final && params.persistent_data)
+		mesh_manager->bvh_pool_add(this);
+
 	foreach(Shader *s, shaders)
 		delete s;
 	foreach(Mesh *m, meshes)
@@ -141,6 +150,8 @@ void Scene::device_update(Device *device_, Progress& progress)
 {
 	if(!device)
 		device = device_;
+
+	double time_start = time_dt();
 	
 	/* The order of updates is important, because there's dependencies between
 	 * the different managers, using data computed by previous managers.
@@ -245,6 +256,8 @@ void Scene::device_update(Device *device_, Progress& progress)
 		device->const_copy_to("__data", &dscene.data, sizeof(dscene.data));
 	}
 
+	VLOG(1) << "Scene device update done in " << time_dt() - time_start << "s.";
+
 #ifdef WITH_CYCLES_DEBUG
 	VLOG(1) << "System memory statistics after full device sync:\n"
 	        << "  Usage: " << util_guarded_get_mem_used() << "\n"
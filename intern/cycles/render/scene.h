@@ -93,6 +93,8 @@ public:
 	device_vector<float4> light_data;
 	device_vector<float2> light_background_marginal_cdf;
 	device_vector<float2> light_background_conditional_cdf;
+	device_vector<float4> light_tree_nodes;
+	device_vector<uint> light_tree_map;
 
 	/* particles */
 	device_vector<float4> particles;
@@ -111,6 +113,10 @@ public:
 	/* cpu images */
 	device_vector<uchar4> tex_image[TEX_EXTENDED_NUM_IMAGES_CPU];
 	device_vector<float4> tex_float_image[TEX_EXTENDED_NUM_FLOAT_IMAGES];
+	device_vector<half4> tex_half4_image[TEX_EXTENDED_NUM_HALF4_IMAGES];
+	device_vector<float> tex_float1_image[TEX_EXTENDED_NUM_FLOAT1_IMAGES];
+	device_vector<uchar> tex_byte1_image[TEX_EXTENDED_NUM_BYTE1_IMAGES];
+	device_vector<half> tex_half1_image[TEX_EXTENDED_NUM_HALF1_IMAGES];
 
 	/* opencl images */
 	device_vector<uchar4> tex_image_packed;
@@ -128,7 +134,10 @@ public:
 	bool use_bvh_cache;
 	bool use_bvh_spatial_split;
 	bool use_qbvh;
+	bool use_obvh;
 	bool persistent_data;
+	bool use_texture_cache;
+	int texture_cache_size;
 
 	SceneParams()
 	{
@@ -137,7 +146,10 @@ public:
 		use_bvh_cache = false;
 		use_bvh_spatial_split = false;
 		use_qbvh = false;
+		use_obvh = false;
 		persistent_data = false;
+		use_texture_cache = false;
+		texture_cache_size = 1024;
 	}
 
 	bool modified(const SceneParams& params)
@@ -146,7 +158,10 @@ public:
 		&& use_bvh_cache == params.use_bvh_cache
 		&& use_bvh_spatial_split == params.use_bvh_spatial_split
 		&& use_qbvh == params.use_qbvh
-		&& persistent_data == params.persistent_data); }
+		&& use_obvh == params.use_obvh
+		&& persistent_data == params.persistent_data
+		&& use_texture_cache == params.use_texture_cache
+		&& texture_cache_size == params.texture_cache_size); }
 };
 
 /* Scene */
@@ -852,6 +852,7 @@ void Session::path_trace()
 	task.update_progress_sample = function_bind(&Session::update_progress_sample, this);
 	task.need_finish_queue = params.progressive_refine;
 	task.integrator_branched = scene->integrator->method == Integrator::BRANCHED_PATH;
+	task.adaptive_sampling = scene->integrator->use_adaptive_sampling;
 
 	device->task_add(task);
 }
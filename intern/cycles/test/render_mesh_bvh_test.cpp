@@ -0,0 +1,323 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "bvh.h"
+#include "device.h"
+#include "mesh.h"
+#include "scene.h"
+
+#include "util_foreach.h"
+#include "util_math.h"
+#include "util_progress.h"
+#include "util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Mesh BVHs pooled on scene reset with persistent data, see
+ * MeshManager::bvh_pool_add() and bvh_pool_take(). */
+
+namespace {
+
+Mesh *add_grid(Scene *scene, int res, float time)
+{
+	Mesh *mesh = new Mesh();
+
+	for(int y = 0; y <= res; y++) {
+		for(int x = 0; x <= res; x++) {
+			float u = (float)x/(float)res, v = (float)y/(float)res;
+			float z = 0.3f*sinf(6.0f*u + time)*cosf(5.0f*v - 2.0f*time);
+			mesh->verts.push_back(make_float3(u, v, z));
+		}
+	}
+
+	for(int y = 0; y < res; y++) {
+		for(int x = 0; x < res; x++) {
+			int v0 = y*(res + 1) + x;
+			int v1 = v0 + 1;
+			int v2 = v0 + res + 1;
+			int v3 = v2 + 1;
+
+			mesh->add_triangle(v0, v1, v3, 0, false);
+			mesh->add_triangle(v0, v3, v2, 0, false);
+		}
+	}
+
+	scene->meshes.push_back(mesh);
+	return mesh;
+}
+
+SceneParams bvh_scene_params()
+{
+	SceneParams params;
+
+	params.bvh_type = SceneParams::BVH_DYNAMIC;
+	params.persistent_data = true;
+	params.use_qbvh = false;
+	params.use_bvh_spatial_split = false;
+
+	return params;
+}
+
+/* Frees the scene meshes and pools their BVHs, as a reset between frames does */
+void reset_scene(Scene *scene)
+{
+	scene->mesh_manager->bvh_pool_add(scene);
+
+	foreach(Mesh *mesh, scene->meshes)
+		delete mesh;
+	scene->meshes.clear();
+}
+
+bool ray_triangle(const Mesh *mesh, int prim, float3 P, float3 D, float *t)
+{
+	const Mesh::Triangle& tri = mesh->triangles[prim];
+	float3 v0 = mesh->verts[tri.v[0]];
+	float3 e1 = mesh->verts[tri.v[1]] - v0;
+	float3 e2 = mesh->verts[tri.v[2]] - v0;
+
+	float3 p = cross(D, e2);
+	float det = dot(e1, p);
+	if(fabsf(det) < 1e-12f)
+		return false;
+
+	float inv_det = 1.0f/det;
+	float3 s = P - v0;
+	float u = dot(s, p)*inv_det;
+	if(u < 0.0f || u > 1.0f)
+		return false;
+
+	float3 q = cross(s, e1);
+	float v = dot(D, q)*inv_det;
+	if(v < 0.0f || u + v > 1.0f)
+		return false;
+
+	float dist = dot(e2, q)*inv_det;
+	if(dist <= 0.0f || dist >= *t)
+		return false;
+
+	*t = dist;
+	return true;
+}
+
+/* Slab test, padded so hits on the box faces are never culled */
+bool ray_box(const int4 *node, int child, float3 P, float3 idir, float tmax)
+{
+	float3 bmin = make_float3(__int_as_float(node[0][child]),
+	                          __int_as_float(node[1][child]),
+	                          __int_as_float(node[2][child]));
+	float3 bmax = make_float3(__int_as_float(node[0][child + 2]),
+	                          __int_as_float(node[1][child + 2]),
+	                          __int_as_float(node[2][child + 2]));
+	float3 pad = make_float3(1e-5f, 1e-5f, 1e-5f);
+	float3 t0 = (bmin - pad - P)*idir;
+	float3 t1 = (bmax + pad - P)*idir;
+	float3 tn = min(t0, t1), tf = max(t0, t1);
+
+	float tnear = max(max(tn.x, tn.y), max(tn.z, 0.0f));
+	float tfar = min(min(tf.x, tf.y), min(tf.z, tmax));
+
+	return tnear <= tfar;
+}
+
+/* Closest hit through the packed two wide BVH, the way the kernel walks it */
+float bvh_intersect(const BVH *bvh, const Mesh *mesh, float3 P, float3 D)
+{
+	const PackedBVH& pack = bvh->pack;
+	float3 idir = make_float3(1.0f/D.x, 1.0f/D.y, 1.0f/D.z);
+	float t = FLT_MAX;
+
+	/* node index, leaves are encoded as ~index */
+	vector<int> stack;
+	stack.push_back((pack.root_index == -1)? ~0: 0);
+
+	while(stack.size()) {
+		int idx = stack.back();
+		stack.pop_back();
+
+		if(idx < 0) {
+			const int4 *leaf = &pack.nodes[(~idx)*BVH_NODE_SIZE];
+			for(int prim = leaf[3].x; prim < leaf[3].y; prim++)
+				ray_triangle(mesh, pack.prim_index[prim], P, D, &t);
+		}
+		else {
+			const int4 *node = &pack.nodes[idx*BVH_NODE_SIZE];
+			for(int child = 0; child < 2; child++)
+				if(ray_box(node, child, P, idir, t))
+					stack.push_back(node[3][child]);
+		}
+	}
+
+	return t;
+}
+
+float brute_force_intersect(const Mesh *mesh, float3 P, float3 D)
+{
+	float t = FLT_MAX;
+
+	for(size_t prim = 0; prim < mesh->triangles.size(); prim++)
+		ray_triangle(mesh, (int)prim, P, D, &t);
+
+	return t;
+}
+
+BoundBox bvh_root_bounds(const BVH *bvh)
+{
+	const int4 *node = &bvh->pack.nodes[0];
+	BoundBox bounds = BoundBox::empty;
+
+	for(int child = 0; child < 2; child++) {
+		bounds.grow(make_float3(__int_as_float(node[0][child]),
+		                        __int_as_float(node[1][child]),
+		                        __int_as_float(node[2][child])));
+		bounds.grow(make_float3(__int_as_float(node[0][child + 2]),
+		                        __int_as_float(node[1][child + 2]),
+		                        __int_as_float(node[2][child + 2])));
+	}
+
+	return bounds;
+}
+
+void expect_float3_eq(float3 a, float3 b)
+{
+	EXPECT_EQ(a.x, b.x);
+	EXPECT_EQ(a.y, b.y);
+	EXPECT_EQ(a.z, b.z);
+}
+
+/* Rays from above at random points, in random directions, compared against
+ * testing every triangle. Returns the number of rays that hit the mesh. */
+int expect_hits_match(const BVH *bvh, const Mesh *mesh)
+{
+	uint seed = 12345;
+	int num_hits = 0;
+
+	for(int i = 0; i < 2000; i++) {
+		float r[4];
+		for(int j = 0; j < 4; j++) {
+			seed = seed*1664525u + 1013904223u;
+			r[j] = (float)(seed >> 8)*(1.0f/16777216.0f);
+		}
+
+		float3 P = make_float3(r[0]*1.2f - 0.1f, r[1]*1.2f - 0.1f, 1.0f);
+		float3 D = normalize(make_float3(r[2] - 0.5f, r[3] - 0.5f, -1.0f));
+
+		float t_bvh = bvh_intersect(bvh, mesh, P, D);
+		float t_ref = brute_force_intersect(mesh, P, D);
+
+		EXPECT_EQ(t_ref, t_bvh) << "ray " << i;
+		if(t_ref != FLT_MAX)
+			num_hits++;
+	}
+
+	return num_hits;
+}
+
+}  /* namespace */
+
+TEST(render_mesh_bvh, refit_same_topology)
+{
+	DeviceInfo device_info;
+	Scene scene(bvh_scene_params(), device_info);
+	Progress progress;
+
+	/* first frame builds */
+	Mesh *mesh = add_grid(&scene, 40, 0.0f);
+	mesh->compute_bvh(&scene.params, &progress, 0, 1);
+	BVH *first_bvh = mesh->bvh;
+	ASSERT_TRUE(first_bvh != NULL);
+
+	reset_scene(&scene);
+	EXPECT_EQ(1, (int)scene.mesh_manager->bvh_pool.size());
+
+	/* second frame deforms the mesh and refits the pooled BVH */
+	mesh = add_grid(&scene, 40, 1.5f);
+	mesh->need_update_rebuild = true;
+	scene.mesh_manager->bvh_pool_take(&scene);
+
+	EXPECT_EQ(first_bvh, mesh->bvh);
+	EXPECT_FALSE(mesh->need_update_rebuild);
+	EXPECT_EQ(0, (int)scene.mesh_manager->bvh_pool.size());
+
+	mesh->compute_bvh(&scene.params, &progress, 0, 1);
+	EXPECT_EQ(first_bvh, mesh->bvh);
+
+	/* full build of the same deformed mesh */
+	Mesh *rebuilt = add_grid(&scene, 40, 1.5f);
+	rebuilt->compute_bvh(&scene.params, &progress, 0, 1);
+
+	BoundBox refit_bounds = bvh_root_bounds(mesh->bvh);
+	BoundBox rebuilt_bounds = bvh_root_bounds(rebuilt->bvh);
+	expect_float3_eq(rebuilt_bounds.min, refit_bounds.min);
+	expect_float3_eq(rebuilt_bounds.max, refit_bounds.max);
+	expect_float3_eq(mesh->bounds.min, refit_bounds.min);
+	expect_float3_eq(mesh->bounds.max, refit_bounds.max);
+
+	int refit_hits = expect_hits_match(mesh->bvh, mesh);
+	int rebuilt_hits = expect_hits_match(rebuilt->bvh, rebuilt);
+	EXPECT_EQ(rebuilt_hits, refit_hits);
+	EXPECT_GT(refit_hits, 500);
+}
+
+TEST(render_mesh_bvh, rebuild_changed_topology)
+{
+	DeviceInfo device_info;
+	Scene scene(bvh_scene_params(), device_info);
+	Progress progress;
+
+	Mesh *mesh = add_grid(&scene, 40, 0.0f);
+	mesh->compute_bvh(&scene.params, &progress, 0, 1);
+
+	reset_scene(&scene);
+	EXPECT_EQ(1, (int)scene.mesh_manager->bvh_pool.size());
+
+	/* different resolution, the pooled BVH must not be used */
+	mesh = add_grid(&scene, 41, 0.0f);
+	mesh->need_update_rebuild = true;
+	scene.mesh_manager->bvh_pool_take(&scene);
+
+	EXPECT_TRUE(mesh->bvh == NULL);
+	EXPECT_TRUE(mesh->need_update_rebuild);
+	EXPECT_EQ(0, (int)scene.mesh_manager->bvh_pool.size());
+
+	mesh->compute_bvh(&scene.params, &progress, 0, 1);
+	ASSERT_TRUE(mesh->bvh != NULL);
+	EXPECT_GT(expect_hits_match(mesh->bvh, mesh), 500);
+}
+
+TEST(render_mesh_bvh, rebuild_changed_params)
+{
+	DeviceInfo device_info;
+	Scene scene(bvh_scene_params(), device_info);
+	Progress progress;
+
+	Mesh *mesh = add_grid(&scene, 40, 0.0f);
+	mesh->compute_bvh(&scene.params, &progress, 0, 1);
+
+	reset_scene(&scene);
+
+	/* same topology, but a BVH built with other settings */
+	scene.params.use_bvh_spatial_split = true;
+	mesh = add_grid(&scene, 40, 0.0f);
+	mesh->need_update_rebuild = true;
+	scene.mesh_manager->bvh_pool_take(&scene);
+
+	EXPECT_TRUE(mesh->bvh == NULL);
+	EXPECT_EQ(0, (int)scene.mesh_manager->bvh_pool.size());
+}
+
+CCL_NAMESPACE_END
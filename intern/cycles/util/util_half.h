@@ -85,6 +85,35 @@ ccl_device_inline void float4_store_half(half *h, float4 f, float scale)
 #endif
 }
 
+/* half to float for image textures */
+ccl_device_inline float half_to_float(half h)
+{
+	union { uint i; float f; } out;
+	uint sign = (h & 0x8000) << 16;
+	uint exponent = h & 0x7C00;
+	uint mantissa = h & 0x03FF;
+
+	if(exponent == 0x7C00) {
+		/* inf and nan */
+		out.i = sign | 0x7F800000 | (mantissa << 13);
+	}
+	else if(exponent == 0) {
+		/* zero and denormals, mantissa * 2^-24 */
+		out.f = (float)mantissa * (1.0f/16777216.0f);
+		out.i |= sign;
+	}
+	else {
+		out.i = sign | ((exponent + 0x1C000) << 13) | (mantissa << 13);
+	}
+
+	return out.f;
+}
+
+ccl_device_inline float4 half4_to_float4(half4 h)
+{
+	return make_float4(half_to_float(h.x), half_to_float(h.y), half_to_float(h.z), half_to_float(h.w));
+}
+
 #endif
 
 #endif
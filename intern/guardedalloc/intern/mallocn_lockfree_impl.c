@@ -26,12 +26,22 @@
  *  \ingroup MEM
  *
  * Memory allocation which keeps track on allocated memory counters
+ *
+ * Each thread keeps its own cache of freed small blocks, and its own changes to the counters
+ * which are only added to the global ones when reading statistics or once they grew large,
+ * so threads allocating in parallel don't keep bouncing the same cache lines.
  */
 
 #include <stdlib.h>
 #include <string.h> /* memcpy */
 #include <stdarg.h>
 #include <sys/types.h>
+#include <pthread.h>
+#include <sched.h>  /* sched_yield */
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>  /* _mm_pause */
+#endif
 
 #include "MEM_guardedalloc.h"
 
@@ -73,6 +83,10 @@ enum {
 /* Uncomment this to have proper peak counter. */
 #define USE_ATOMIC_MAX
 
+/* Comment this to have all blocks going straight to the system allocator (e.g. for valgrind),
+ * and counters updated atomically on each allocation. */
+#define USE_THREAD_CACHE
+
 MEM_INLINE void update_maximum(size_t *maximum_value, size_t value)
 {
 #ifdef USE_ATOMIC_MAX
@@ -87,6 +101,300 @@ MEM_INLINE void update_maximum(size_t *maximum_value, size_t value)
 #endif
 }
 
+#ifdef USE_THREAD_CACHE
+
+/* Blocks up to this length are cached, block lengths are rounded up to a multiple of the class step
+ * so a freed block can be reused by any allocation of the same class. */
+#define MEM_CACHE_CLASS_SHIFT 4
+#define MEM_CACHE_MAX_LEN 512
+#define MEM_CACHE_NUM_CLASSES ((MEM_CACHE_MAX_LEN >> MEM_CACHE_CLASS_SHIFT) + 1)
+/* Maximum number of free blocks kept by a thread for each class. */
+#define MEM_CACHE_CLASS_MAX_BLOCKS 64
+
+/* Thread counters are added to the global ones once they get that far from zero,
+ * this keeps the peak memory counter reasonably accurate: it can miss at most
+ * MEM_CACHE_FLUSH_LEN per thread, current memory usage is always exact. */
+#define MEM_CACHE_FLUSH_LEN ((ptrdiff_t)1 << 20)
+#define MEM_CACHE_FLUSH_BLOCKS 4096
+
+#define MEM_CACHE_CLASS(len) (((len) + ((size_t)1 << MEM_CACHE_CLASS_SHIFT) - 1) >> MEM_CACHE_CLASS_SHIFT)
+
+typedef struct MemThreadCache {
+	struct MemThreadCache *next, *prev;
+
+	/* Freed blocks, linked through their MemHead. */
+	MemHead *free_blocks[MEM_CACHE_NUM_CLASSES];
+	unsigned int free_blocks_len[MEM_CACHE_NUM_CLASSES];
+
+	/* Changes to totblock and mem_in_use not applied to the global counters yet,
+	 * wrapping around when negative. Only the owning thread writes them, with plain
+	 * (not locked read-modify-write) stores, that's what keeps allocation cheap.
+	 * Other threads only read them while summing: volatile, since word sized aligned
+	 * loads and stores can't tear, a sum sees either the old or the new value. */
+	volatile unsigned int totblock;
+	volatile size_t mem_in_use;
+} MemThreadCache;
+
+static pthread_key_t thread_cache_key;
+static pthread_once_t thread_cache_key_once = PTHREAD_ONCE_INIT;
+
+/* All thread caches, statistics have to add their counters to the global ones.
+ * The lock also protects the global counters, so they never miss or count twice a thread's changes. */
+static MemThreadCache *thread_cache_first = NULL;
+static size_t thread_cache_lock = 0;
+
+/* Spins before yielding the CPU to a (possibly preempted) lock holder. */
+#define MEM_CACHE_LOCK_SPIN_COUNT 64
+
+MEM_INLINE void mem_cpu_pause(void)
+{
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	_mm_pause();
+#endif
+}
+
+static void mem_thread_cache_lock(void)
+{
+	while (atomic_cas_z(&thread_cache_lock, 0, 1) != 0) {
+		int spin;
+		/* wait with plain loads, so waiting threads don't keep taking the cache line away from the holder */
+		for (spin = 0; *(volatile size_t *)&thread_cache_lock != 0; spin++) {
+			if (spin < MEM_CACHE_LOCK_SPIN_COUNT) {
+				mem_cpu_pause();
+			}
+			else {
+				sched_yield();
+			}
+		}
+	}
+}
+
+static void mem_thread_cache_unlock(void)
+{
+	atomic_cas_z(&thread_cache_lock, 1, 0);
+}
+
+/* Call with the lock held. */
+static void mem_counters_sum(unsigned int *r_totblock, size_t *r_mem_in_use)
+{
+	MemThreadCache *cache;
+
+	*r_totblock = totblock;
+	*r_mem_in_use = mem_in_use;
+
+	for (cache = thread_cache_first; cache; cache = cache->next) {
+		*r_totblock += cache->totblock;
+		*r_mem_in_use += cache->mem_in_use;
+	}
+}
+
+/* Call with the lock held. */
+static void mem_counters_update_peak(void)
+{
+	unsigned int totblock_sum;
+	size_t mem_in_use_sum;
+
+	mem_counters_sum(&totblock_sum, &mem_in_use_sum);
+	update_maximum(&peak_mem, mem_in_use_sum);
+}
+
+/* Call with the lock held, from the thread owning \a cache. */
+static void mem_thread_cache_flush_counters(MemThreadCache *cache)
+{
+	/* no other thread changes the cache counters, and summing needs the lock,
+	 * so the change moves to the global counters as a whole */
+	totblock += cache->totblock;
+	mem_in_use += cache->mem_in_use;
+	cache->totblock = 0;
+	cache->mem_in_use = 0;
+
+	mem_counters_update_peak();
+}
+
+/* Thread exit, release cached blocks and hand counters over to the global ones. */
+static void mem_thread_cache_free(void *cache_v)
+{
+	MemThreadCache *cache = cache_v;
+	int i;
+
+	for (i = 0; i < MEM_CACHE_NUM_CLASSES; i++) {
+		MemHead *memh;
+		while ((memh = cache->free_blocks[i])) {
+			cache->free_blocks[i] = *(MemHead **)memh;
+			free(memh);
+		}
+	}
+
+	mem_thread_cache_lock();
+	mem_thread_cache_flush_counters(cache);
+	if (cache->prev) {
+		cache->prev->next = cache->next;
+	}
+	else {
+		thread_cache_first = cache->next;
+	}
+	if (cache->next) {
+		cache->next->prev = cache->prev;
+	}
+	mem_thread_cache_unlock();
+
+	free(cache);
+}
+
+static void mem_thread_cache_key_create(void)
+{
+	pthread_key_create(&thread_cache_key, mem_thread_cache_free);
+}
+
+static MemThreadCache *mem_thread_cache_create(void)
+{
+	MemThreadCache *cache = calloc(1, sizeof(*cache));
+
+	if (LIKELY(cache)) {
+		mem_thread_cache_lock();
+		cache->next = thread_cache_first;
+		if (thread_cache_first) {
+			thread_cache_first->prev = cache;
+		}
+		thread_cache_first = cache;
+		mem_thread_cache_unlock();
+
+		pthread_setspecific(thread_cache_key, cache);
+	}
+
+	return cache;
+}
+
+/**
+ * \return the cache of the calling thread, NULL in the unlikely case it can't be allocated.
+ */
+MEM_INLINE MemThreadCache *mem_thread_cache_get(void)
+{
+	MemThreadCache *cache;
+
+	pthread_once(&thread_cache_key_once, mem_thread_cache_key_create);
+	cache = pthread_getspecific(thread_cache_key);
+	if (UNLIKELY(cache == NULL)) {
+		cache = mem_thread_cache_create();
+	}
+
+	return cache;
+}
+
+/**
+ * Add \a blocks and \a len to the counters, negative changes are passed wrapped around.
+ */
+MEM_INLINE void mem_counters_add(MemThreadCache *cache, unsigned int blocks, size_t len)
+{
+	if (LIKELY(cache)) {
+		const unsigned int cache_totblock = cache->totblock + blocks;
+		const size_t cache_mem_in_use = cache->mem_in_use + len;
+
+		cache->totblock = cache_totblock;
+		cache->mem_in_use = cache_mem_in_use;
+
+		if (UNLIKELY(((ptrdiff_t)cache_mem_in_use > MEM_CACHE_FLUSH_LEN) ||
+		             ((ptrdiff_t)cache_mem_in_use < -MEM_CACHE_FLUSH_LEN) ||
+		             ((int)cache_totblock > MEM_CACHE_FLUSH_BLOCKS) ||
+		             ((int)cache_totblock < -MEM_CACHE_FLUSH_BLOCKS)))
+		{
+			mem_thread_cache_lock();
+			mem_thread_cache_flush_counters(cache);
+			mem_thread_cache_unlock();
+		}
+	}
+	else {
+		mem_thread_cache_lock();
+		totblock += blocks;
+		mem_in_use += len;
+		mem_counters_update_peak();
+		mem_thread_cache_unlock();
+	}
+}
+
+/**
+ * Allocate a block with room for \a len bytes after its MemHead, reusing a cached block when possible.
+ */
+MEM_INLINE MemHead *mem_block_alloc(MemThreadCache *cache, size_t len, const bool clear)
+{
+	if (len <= MEM_CACHE_MAX_LEN) {
+		const size_t class = MEM_CACHE_CLASS(len);
+		MemHead *memh = cache ? cache->free_blocks[class] : NULL;
+
+		if (memh) {
+			cache->free_blocks[class] = *(MemHead **)memh;
+			cache->free_blocks_len[class]--;
+			if (clear) {
+				memset(memh, 0, len + sizeof(MemHead));
+			}
+			return memh;
+		}
+
+		/* Always allocate the whole class, the block may end up in any cache once freed. */
+		len = class << MEM_CACHE_CLASS_SHIFT;
+	}
+
+	return clear ? calloc(1, len + sizeof(MemHead)) : malloc(len + sizeof(MemHead));
+}
+
+MEM_INLINE void mem_block_free(MemThreadCache *cache, MemHead *memh, size_t len)
+{
+	if (cache && len <= MEM_CACHE_MAX_LEN) {
+		const size_t class = MEM_CACHE_CLASS(len);
+
+		if (cache->free_blocks_len[class] < MEM_CACHE_CLASS_MAX_BLOCKS) {
+			*(MemHead **)memh = cache->free_blocks[class];
+			cache->free_blocks[class] = memh;
+			cache->free_blocks_len[class]++;
+			return;
+		}
+	}
+
+	free(memh);
+}
+
+#else  /* USE_THREAD_CACHE */
+
+typedef void MemThreadCache;
+
+#define mem_thread_cache_get() NULL
+
+MEM_INLINE void mem_counters_add(MemThreadCache *UNUSED(cache), unsigned int blocks, size_t len)
+{
+	atomic_add_u(&totblock, blocks);
+	update_maximum(&peak_mem, atomic_add_z(&mem_in_use, len));
+}
+
+MEM_INLINE MemHead *mem_block_alloc(MemThreadCache *UNUSED(cache), size_t len, const bool clear)
+{
+	return clear ? calloc(1, len + sizeof(MemHead)) : malloc(len + sizeof(MemHead));
+}
+
+#define mem_block_free(cache, memh, len) free(memh)
+
+#endif  /* USE_THREAD_CACHE */
+
+MEM_INLINE void mem_counters_get(unsigned int *r_totblock, size_t *r_mem_in_use)
+{
+#ifdef USE_THREAD_CACHE
+	mem_thread_cache_lock();
+	mem_counters_sum(r_totblock, r_mem_in_use);
+	mem_thread_cache_unlock();
+	update_maximum(&peak_mem, *r_mem_in_use);
+#else
+	*r_totblock = totblock;
+	*r_mem_in_use = mem_in_use;
+#endif
+}
+
+static size_t mem_in_use_get(void)
+{
+	unsigned int totblock_sum;
+	size_t mem_in_use_sum;
+	mem_counters_get(&totblock_sum, &mem_in_use_sum);
+	return mem_in_use_sum;
+}
+
 #ifdef __GNUC__
 __attribute__ ((format(printf, 1, 2)))
 #endif
@@ -133,6 +441,7 @@ void MEM_lockfree_freeN(void *vmemh)
 {
 	MemHead *memh = MEMHEAD_FROM_PTR(vmemh);
 	size_t len = MEM_lockfree_allocN_len(vmemh);
+	MemThreadCache *cache;
 
 	if (vmemh == NULL) {
 		print_error("Attempt to free NULL pointer\n");
@@ -142,8 +451,8 @@ void MEM_lockfree_freeN(void *vmemh)
 		return;
 	}
 
-	atomic_sub_u(&totblock, 1);
-	atomic_sub_z(&mem_in_use, len);
+	cache = mem_thread_cache_get();
+	mem_counters_add(cache, (unsigned int)-1, (size_t)0 - len);
 
 	if (MEMHEAD_IS_MMAP(memh)) {
 		atomic_sub_z(&mmap_in_use, len);
@@ -166,7 +475,7 @@ void MEM_lockfree_freeN(void *vmemh)
 			aligned_free(MEMHEAD_REAL_PTR(memh_aligned));
 		}
 		else {
-			free(memh);
+			mem_block_free(cache, memh, len);
 		}
 	}
 }
@@ -279,32 +588,32 @@ void *MEM_lockfree_recallocN_id(void *vmemh, size_t len, const char *str)
 
 void *MEM_lockfree_callocN(size_t len, const char *str)
 {
+	MemThreadCache *cache = mem_thread_cache_get();
 	MemHead *memh;
 
 	len = SIZET_ALIGN_4(len);
 
-	memh = (MemHead *)calloc(1, len + sizeof(MemHead));
+	memh = mem_block_alloc(cache, len, true);
 
 	if (LIKELY(memh)) {
 		memh->len = len;
-		atomic_add_u(&totblock, 1);
-		atomic_add_z(&mem_in_use, len);
-		update_maximum(&peak_mem, mem_in_use);
+		mem_counters_add(cache, 1, len);
 
 		return PTR_FROM_MEMHEAD(memh);
 	}
 	print_error("Calloc returns null: len=" SIZET_FORMAT " in %s, total %u\n",
-	            SIZET_ARG(len), str, (unsigned int) mem_in_use);
+	            SIZET_ARG(len), str, (unsigned int) mem_in_use_get());
 	return NULL;
 }
 
 void *MEM_lockfree_mallocN(size_t len, const char *str)
 {
+	MemThreadCache *cache = mem_thread_cache_get();
 	MemHead *memh;
 
 	len = SIZET_ALIGN_4(len);
 
-	memh = (MemHead *)malloc(len + sizeof(MemHead));
+	memh = mem_block_alloc(cache, len, false);
 
 	if (LIKELY(memh)) {
 		if (UNLIKELY(malloc_debug_memset && len)) {
@@ -312,14 +621,12 @@ void *MEM_lockfree_mallocN(size_t len, const char *str)
 		}
 
 		memh->len = len;
-		atomic_add_u(&totblock, 1);
-		atomic_add_z(&mem_in_use, len);
-		update_maximum(&peak_mem, mem_in_use);
+		mem_counters_add(cache, 1, len);
 
 		return PTR_FROM_MEMHEAD(memh);
 	}
 	print_error("Malloc returns null: len=" SIZET_FORMAT " in %s, total %u\n",
-	            SIZET_ARG(len), str, (unsigned int) mem_in_use);
+	            SIZET_ARG(len), str, (unsigned int) mem_in_use_get());
 	return NULL;
 }
 
@@ -361,14 +668,12 @@ void *MEM_lockfree_mallocN_aligned(size_t len, size_t alignment, const char *str
 
 		memh->len = len | (size_t) MEMHEAD_ALIGN_FLAG;
 		memh->alignment = (short) alignment;
-		atomic_add_u(&totblock, 1);
-		atomic_add_z(&mem_in_use, len);
-		update_maximum(&peak_mem, mem_in_use);
+		mem_counters_add(mem_thread_cache_get(), 1, len);
 
 		return PTR_FROM_MEMHEAD(memh);
 	}
 	print_error("Malloc returns null: len=" SIZET_FORMAT " in %s, total %u\n",
-	            SIZET_ARG(len), str, (unsigned int) mem_in_use);
+	            SIZET_ARG(len), str, (unsigned int) mem_in_use_get());
 	return NULL;
 }
 
@@ -396,11 +701,9 @@ void *MEM_lockfree_mapallocN(size_t len, const char *str)
 
 	if (memh != (MemHead *)-1) {
 		memh->len = len | (size_t) MEMHEAD_MMAP_FLAG;
-		atomic_add_u(&totblock, 1);
-		atomic_add_z(&mem_in_use, len);
+		mem_counters_add(mem_thread_cache_get(), 1, len);
 		atomic_add_z(&mmap_in_use, len);
 
-		update_maximum(&peak_mem, mem_in_use);
 		update_maximum(&peak_mem, mmap_in_use);
 
 		return PTR_FROM_MEMHEAD(memh);
@@ -428,7 +731,7 @@ void MEM_lockfree_callbackmemlist(void (*func)(void *))
 void MEM_lockfree_printmemlist_stats(void)
 {
 	printf("\ntotal memory len: %.3f MB\n",
-	       (double)mem_in_use / (double)(1024 * 1024));
+	       (double)mem_in_use_get() / (double)(1024 * 1024));
 	printf("peak memory len: %.3f MB\n",
 	       (double)peak_mem / (double)(1024 * 1024));
 	printf("\nFor more detailed per-block statistics run Blender with memory debugging command line argument.\n");
@@ -462,7 +765,7 @@ void MEM_lockfree_set_memory_debug(void)
 
 size_t MEM_lockfree_get_memory_in_use(void)
 {
-	return mem_in_use;
+	return mem_in_use_get();
 }
 
 size_t MEM_lockfree_get_mapped_memory_in_use(void)
@@ -472,17 +775,22 @@ size_t MEM_lockfree_get_mapped_memory_in_use(void)
 
 unsigned int MEM_lockfree_get_memory_blocks_in_use(void)
 {
-	return totblock;
+	unsigned int totblock_sum;
+	size_t mem_in_use_sum;
+	mem_counters_get(&totblock_sum, &mem_in_use_sum);
+	return totblock_sum;
 }
 
 /* dummy */
 void MEM_lockfree_reset_peak_memory(void)
 {
-	peak_mem = mem_in_use;
+	peak_mem = mem_in_use_get();
 }
 
 size_t MEM_lockfree_get_peak_memory(void)
 {
+	/* Make sure counters not flushed yet are accounted for. */
+	mem_in_use_get();
 	return peak_mem;
 }
 
@@ -32,6 +32,151 @@
 # } BHead;
 
 
+def lzo1x_decompress(data, size_max):
+    """
+    Decompress LZO1X data, stopping once at least size_max bytes are out.
+    """
+    out = bytearray()
+    ip = 0
+
+    # after a match without literals, a small code is a literal run (0),
+    # after a few literals a 2 byte match (1), after a literal run a 3 byte match (2)
+    state = 0
+    if data[0] > 17:
+        t = data[0] - 17
+        out += data[1:1 + t]
+        ip = 1 + t
+        state = 1 if t < 4 else 2
+
+    while len(out) < size_max:
+        t = data[ip]
+        ip += 1
+
+        if t < 16:
+            if state == 0:
+                if t == 0:
+                    while data[ip] == 0:
+                        t += 255
+                        ip += 1
+                    t += 15 + data[ip]
+                    ip += 1
+                out += data[ip:ip + t + 3]
+                ip += t + 3
+                state = 2
+                continue
+
+            dist = 1 + (t >> 2) + (data[ip] << 2)
+            ip += 1
+            if state == 2:
+                dist += 0x800
+                length = 3
+            else:
+                length = 2
+        elif t >= 64:
+            dist = 1 + ((t >> 2) & 7) + (data[ip] << 3)
+            ip += 1
+            length = (t >> 5) + 1
+        else:
+            length = t & (31 if t >= 32 else 7)
+            if length == 0:
+                while data[ip] == 0:
+                    length += 255
+                    ip += 1
+                length += (31 if t >= 32 else 7) + data[ip]
+                ip += 1
+            length += 2
+
+            dist = (data[ip] >> 2) + (data[ip + 1] << 6)
+            ip += 2
+            if t >= 32:
+                dist += 1
+            else:
+                dist += (t & 8) << 11
+                if dist == 0:
+                    break  # end of stream
+                dist += 0x4000
+
+        if dist > len(out):
+            raise ValueError("damaged LZO data")
+
+        if dist >= length:
+            out += out[-dist:len(out) - dist + length]
+        else:
+            # overlapping, repeats what's being copied
+            for _ in range(length):
+                out.append(out[-dist])
+
+        # up to 3 literals follow, in the low bits of the byte before the last one read
+        t = data[ip - 2] & 3
+        out += data[ip:ip + t]
+        ip += t
+        state = 1 if t else 0
+
+    return out
+
+
+class BlendLZOFile:
+    """
+    Reads the start of a block compressed blend file (see BLO_blend_defs.h),
+    chunks are decompressed as far as they are read, everything read is kept.
+    """
+
+    def __init__(self, path):
+        import struct
+
+        self._file = open(path, "rb")
+        self._file.seek(-32, 2)
+        (self._index_offset, _size_raw, self._chunks_num,
+         _chunk_size, magic) = struct.unpack('<QQII8s', self._file.read(32))
+        if magic != b'BLENDLZO':
+            self._chunks_num = 0
+
+        self._chunk_next = 0
+        # (data, size_raw, start in buf) of the chunk being decompressed
+        self._chunk = None
+        self._buf = bytearray()
+        self._seek = 0
+
+    def _read_more(self, size_min):
+        import struct
+
+        if self._chunk is not None:
+            data, size_raw, start = self._chunk
+            size_max = max(size_min - start, (len(self._buf) - start) * 2, 4096)
+            out = lzo1x_decompress(data, size_max)
+            del self._buf[start:]
+            self._buf += out[:size_raw]
+            if len(out) >= size_raw or len(out) < size_max:
+                self._chunk = None
+            return True
+
+        if self._chunk_next == self._chunks_num:
+            return False
+
+        self._file.seek(self._index_offset + 16 * self._chunk_next)
+        offset, size, size_raw = struct.unpack('<QII', self._file.read(16))
+        self._file.seek(offset)
+        data = self._file.read(size)
+        self._chunk_next += 1
+
+        if size == size_raw:
+            self._buf += data
+        else:
+            self._chunk = (data, size_raw, len(self._buf))
+        return True
+
+    def read(self, size):
+        while len(self._buf) < self._seek + size:
+            if not self._read_more(self._seek + size):
+                break
+        data = bytes(self._buf[self._seek:self._seek + size])
+        self._seek += len(data)
+        return data
+
+    def close(self):
+        self._file.close()
+
+
 def read_blend_rend_chunk(path):
 
     import struct
@@ -45,6 +190,10 @@ def read_blend_rend_chunk(path):
         blendfile.close()
         blendfile = gzip.open(path, "rb")
         head = blendfile.read(7)
+    elif head == b'BLENDLZ' and blendfile.read(1) == b'O':  # block compressed
+        blendfile.close()
+        blendfile = BlendLZOFile(path)
+        head = blendfile.read(7)
 
     if head != b'BLENDER':
         print("not a blend file:", path)
@@ -252,6 +252,8 @@ void BKE_mesh_poly_edgebitmap_insert(
         const struct MPoly *mp, const struct MLoop *mloop);
 
 
+void BKE_mesh_calc_verts_minmax(const struct MVert *mverts, const int numVerts, float r_min[3], float r_max[3]);
+
 bool BKE_mesh_center_median(struct Mesh *me, float cent[3]);
 bool BKE_mesh_center_bounds(struct Mesh *me, float cent[3]);
 bool BKE_mesh_center_centroid(struct Mesh *me, float cent[3]);
@@ -89,6 +89,8 @@
 #include "BLO_readfile.h" 
 #include "BLO_writefile.h" 
 
+#include "PIL_time.h"
+
 #include "RNA_access.h"
 
 #include "WM_api.h" // XXXXX BAD, very BAD dependency (bad level call) - remove asap, elubie
@@ -649,6 +651,7 @@ typedef struct UndoElem {
 	char name[BKE_UNDO_STR_MAX];
 	MemFile memfile;
 	uintptr_t undosize;
+	double undotime;  /* seconds the push took */
 } UndoElem;
 
 static ListBase undobase = {NULL, NULL};
@@ -752,12 +755,18 @@ void BKE_write_undo(bContext *C, const char *name)
 	}
 	else {
 		MemFile *prevfile = NULL;
+		const double time_start = PIL_check_seconds_timer();
 		
 		if (curundo->prev) prevfile = &(curundo->prev->memfile);
 		
 		memused = MEM_get_memory_in_use();
 		/* success = */ /* UNUSED */ BLO_write_file_mem(CTX_data_main(C), prevfile, &curundo->memfile, G.fileflags);
 		curundo->undosize = MEM_get_memory_in_use() - memused;
+		curundo->undotime = PIL_check_seconds_timer() - time_start;
+		
+		if (G.debug & G_DEBUG) {
+			BKE_undo_print_stats();
+		}
 	}
 
 	if (U.undomemory != 0) {
@@ -852,6 +861,31 @@ void BKE_undo_name(bContext *C, const char *name)
 	}
 }
 
+/**
+ * Print the memory used by the undo steps and the time the last push took.
+ */
+void BKE_undo_print_stats(void)
+{
+	UndoElem *uel;
+	uintptr_t totmem = 0;
+	int totsteps = 0;
+	
+	for (uel = undobase.first; uel; uel = uel->next) {
+		totmem += uel->undosize;
+		totsteps++;
+	}
+	
+	if (curundo) {
+		printf("undo push '%s': %.2f ms, %.2f of %.2f MB new (%d%% shared)\n",
+		       curundo->name, curundo->undotime * 1000.0,
+		       (double)curundo->memfile.size / (1024.0 * 1024.0),
+		       (double)curundo->memfile.size_total / (1024.0 * 1024.0),
+		       curundo->memfile.size_total ?
+		       (int)(100 - ((uint64_t)curundo->memfile.size * 100) / curundo->memfile.size_total) : 0);
+	}
+	printf("undo memory: %.2f MB in %d steps\n", (double)totmem / (1024.0 * 1024.0), totsteps);
+}
+
 /* name optional */
 int BKE_undo_valid(const char *name)
 {
@@ -170,12 +170,9 @@ static void cdDM_copyPolyArray(DerivedMesh *dm, MPoly *r_poly)
 static void cdDM_getMinMax(DerivedMesh *dm, float r_min[3], float r_max[3])
 {
 	CDDerivedMesh *cddm = (CDDerivedMesh *) dm;
-	int i;
 
 	if (dm->numVertData) {
-		for (i = 0; i < dm->numVertData; i++) {
-			minmax_v3v3_v3(r_min, r_max, cddm->mvert[i].co);
-		}
+		BKE_mesh_calc_verts_minmax(cddm->mvert, dm->numVertData, r_min, r_max);
 	}
 	else {
 		zero_v3(r_min);
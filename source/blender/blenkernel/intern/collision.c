@@ -702,6 +702,33 @@ static int cloth_bvh_objcollisions_resolve ( ClothModifierData * clmd, Collision
 }
 
 // cloth - object collisions
+/* Filter self collision pairs which are never resolved (only reads cloth data, so it's thread-safe). */
+static bool cloth_bvh_self_overlap_cb(void *userdata, int index_a, int index_b, int UNUSED(thread))
+{
+	ClothModifierData *clmd = userdata;
+	Cloth *cloth = clmd->clothObject;
+
+	if (clmd->sim_parms->flags & CLOTH_SIMSETTINGS_FLAG_GOAL) {
+		if ((cloth->verts[index_a].flags & CLOTH_VERT_FLAG_PINNED) &&
+		    (cloth->verts[index_b].flags & CLOTH_VERT_FLAG_PINNED))
+		{
+			return false;
+		}
+	}
+
+	if ((cloth->verts[index_a].flags & CLOTH_VERT_FLAG_NOSELFCOLL) ||
+	    (cloth->verts[index_b].flags & CLOTH_VERT_FLAG_NOSELFCOLL))
+	{
+		return false;
+	}
+
+	if (BLI_edgeset_haskey(cloth->edgeset, index_a, index_b)) {
+		return false;
+	}
+
+	return true;
+}
+
 int cloth_bvh_objcollision(Object *ob, ClothModifierData *clmd, float step, float dt )
 {
 	Cloth *cloth= clmd->clothObject;
@@ -764,7 +791,7 @@ int cloth_bvh_objcollision(Object *ob, ClothModifierData *clmd, float step, floa
 				continue;
 			
 			/* search for overlapping collision pairs */
-			overlap = BLI_bvhtree_overlap ( cloth_bvh, collmd->bvhtree, &result );
+			overlap = BLI_bvhtree_overlap ( cloth_bvh, collmd->bvhtree, &result, NULL, NULL );
 				
 			// go to next object if no overlap is there
 			if ( result && overlap ) {
@@ -826,7 +853,9 @@ int cloth_bvh_objcollision(Object *ob, ClothModifierData *clmd, float step, floa
 	
 				if ( cloth->bvhselftree ) {
 					// search for overlapping collision pairs
-					overlap = BLI_bvhtree_overlap ( cloth->bvhselftree, cloth->bvhselftree, &result );
+					/* pairs which never collide are skipped while traversing */
+					overlap = BLI_bvhtree_overlap(cloth->bvhselftree, cloth->bvhselftree, &result,
+					                              cloth_bvh_self_overlap_cb, clmd);
 	
 	// #pragma omp parallel for private(k, i, j) schedule(static)
 					for ( k = 0; k < result; k++ ) {
@@ -839,28 +868,10 @@ int cloth_bvh_objcollision(Object *ob, ClothModifierData *clmd, float step, floa
 	
 						mindistance = clmd->coll_parms->selfepsilon* ( cloth->verts[i].avg_spring_len + cloth->verts[j].avg_spring_len );
 	
-						if ( clmd->sim_parms->flags & CLOTH_SIMSETTINGS_FLAG_GOAL ) {
-							if ( ( cloth->verts [i].flags & CLOTH_VERT_FLAG_PINNED ) &&
-							     ( cloth->verts [j].flags & CLOTH_VERT_FLAG_PINNED ) )
-							{
-								continue;
-							}
-						}
-
-						if ((cloth->verts[i].flags & CLOTH_VERT_FLAG_NOSELFCOLL) ||
-						    (cloth->verts[j].flags & CLOTH_VERT_FLAG_NOSELFCOLL))
-						{
-							continue;
-						}
-	
 						sub_v3_v3v3(temp, verts[i].tx, verts[j].tx);
 	
 						if ( ( ABS ( temp[0] ) > mindistance ) || ( ABS ( temp[1] ) > mindistance ) || ( ABS ( temp[2] ) > mindistance ) ) continue;
 	
-						if (BLI_edgeset_haskey(cloth->edgeset, i, j)) {
-							continue;
-						}
-	
 						length = normalize_v3(temp );
 	
 						if ( length < mindistance ) {
@@ -1285,7 +1296,7 @@ int cloth_points_objcollision(Object *ob, ClothModifierData *clmd, float step, f
 				continue;
 			
 			/* search for overlapping collision pairs */
-			overlap = BLI_bvhtree_overlap ( cloth_bvh, collmd->bvhtree, &result );
+			overlap = BLI_bvhtree_overlap ( cloth_bvh, collmd->bvhtree, &result, NULL, NULL );
 			epsilon = BLI_bvhtree_getepsilon(collmd->bvhtree);
 			
 			// go to next object if no overlap is there
@@ -1411,7 +1422,7 @@ void cloth_find_point_contacts(Object *ob, ClothModifierData *clmd, float step,
 			continue;
 		
 		/* search for overlapping collision pairs */
-		overlap = BLI_bvhtree_overlap(cloth_bvh, collmd->bvhtree, &result);
+		overlap = BLI_bvhtree_overlap(cloth_bvh, collmd->bvhtree, &result, NULL, NULL);
 		epsilon = BLI_bvhtree_getepsilon(collmd->bvhtree);
 		
 		// go to next object if no overlap is there
@@ -1047,8 +1047,12 @@ DagNode *dag_add_node(DagForest *forest, void *fob)
 			forest->numNodes = 1;
 		}
 
-		if (!forest->nodeHash)
-			forest->nodeHash = BLI_ghash_ptr_new("dag_add_node gh");
+		if (!forest->nodeHash) {
+			/* only inserted into and looked up, no pointers to values are kept */
+			forest->nodeHash = BLI_ghash_new_flag(
+			        BLI_ghashutil_ptrhash, BLI_ghashutil_ptrcmp, "dag_add_node gh",
+			        0, GHASH_FLAG_OPEN_ADDRESSING);
+		}
 		BLI_ghash_insert(forest->nodeHash, fob, node);
 	}
 
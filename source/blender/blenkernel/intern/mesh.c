@@ -1874,12 +1874,8 @@ int BKE_mesh_edge_other_vert(const MEdge *e, int v)
 /* basic vertex data functions */
 bool BKE_mesh_minmax(Mesh *me, float r_min[3], float r_max[3])
 {
-	int i = me->totvert;
-	MVert *mvert;
-	for (mvert = me->mvert; i--; mvert++) {
-		minmax_v3v3_v3(r_min, r_max, mvert->co);
-	}
-	
+	BKE_mesh_calc_verts_minmax(me->mvert, me->totvert, r_min, r_max);
+
 	return (me->totvert != 0);
 }
 
@@ -164,9 +164,38 @@ void BKE_mesh_calc_normals_mapping_ex(
 	
 }
 
-static void mesh_calc_normals_poly_accum(MPoly *mp, MLoop *ml,
-                                         MVert *mvert, float polyno[3], float (*tnorms)[3])
+typedef struct MeshCalcNormalsData {
+	MPoly *mpolys;
+	MLoop *mloop;
+	MVert *mverts;
+	float (*pnors)[3];
+	float (*lnors_weighted)[3];
+	float (*vnors)[3];
+} MeshCalcNormalsData;
+
+static void mesh_calc_normals_poly_cb(void *userdata, int pidx)
+{
+	MeshCalcNormalsData *data = userdata;
+	MPoly *mp = &data->mpolys[pidx];
+
+	BKE_mesh_calc_poly_normal(mp, data->mloop + mp->loopstart, data->mverts, data->pnors[pidx]);
+}
+
+/**
+ * Compute the poly normal, and the angle weighted normal of each of its loops,
+ * accumulating these into vertices is done afterwards, without threading.
+ */
+static void mesh_calc_normals_poly_prepare_cb(void *userdata, int pidx)
 {
+	MeshCalcNormalsData *data = userdata;
+	const MPoly *mp = &data->mpolys[pidx];
+	const MLoop *ml = &data->mloop[mp->loopstart];
+	const MVert *mverts = data->mverts;
+
+	float pnor_temp[3];
+	float *pnor = data->pnors ? data->pnors[pidx] : pnor_temp;
+	float (*lnors_weighted)[3] = &data->lnors_weighted[mp->loopstart];
+
 	const int nverts = mp->totloop;
 	float (*edgevecbuf)[3] = BLI_array_alloca(edgevecbuf, (size_t)nverts);
 	int i;
@@ -175,14 +204,14 @@ static void mesh_calc_normals_poly_accum(MPoly *mp, MLoop *ml,
 	/* inline version of #BKE_mesh_calc_poly_normal, also does edge-vectors */
 	{
 		int i_prev = nverts - 1;
-		const float *v_prev = mvert[ml[i_prev].v].co;
+		const float *v_prev = mverts[ml[i_prev].v].co;
 		const float *v_curr;
 
-		zero_v3(polyno);
+		zero_v3(pnor);
 		/* Newell's Method */
 		for (i = 0; i < nverts; i++) {
-			v_curr = mvert[ml[i].v].co;
-			add_newell_cross_v3_v3v3(polyno, v_prev, v_curr);
+			v_curr = mverts[ml[i].v].co;
+			add_newell_cross_v3_v3v3(pnor, v_prev, v_curr);
 
 			/* Unrelated to normalize, calculate edge-vector */
 			sub_v3_v3v3(edgevecbuf[i_prev], v_prev, v_curr);
@@ -191,12 +220,12 @@ static void mesh_calc_normals_poly_accum(MPoly *mp, MLoop *ml,
 
 			v_prev = v_curr;
 		}
-		if (UNLIKELY(normalize_v3(polyno) == 0.0f)) {
-			polyno[2] = 1.0f; /* other axis set to 0.0 */
+		if (UNLIKELY(normalize_v3(pnor) == 0.0f)) {
+			pnor[2] = 1.0f; /* other axis set to 0.0 */
 		}
 	}
 
-	/* accumulate angle weighted face normal */
+	/* angle weighted face normal of each loop */
 	/* inline version of #accumulate_vertex_normals_poly */
 	{
 		const float *prev_edge = edgevecbuf[nverts - 1];
@@ -208,63 +237,83 @@ static void mesh_calc_normals_poly_accum(MPoly *mp, MLoop *ml,
 			 * this vertex */
 			const float fac = saacos(-dot_v3v3(cur_edge, prev_edge));
 
-			/* accumulate */
-			madd_v3_v3fl(tnorms[ml[i].v], polyno, fac);
+			mul_v3_v3fl(lnors_weighted[i], pnor, fac);
 			prev_edge = cur_edge;
 		}
 	}
+}
+
+static void mesh_calc_normals_poly_finalize_cb(
+        void *userdata, void *UNUSED(userdata_chunk), int vidx_start, int vidx_stop)
+{
+	MeshCalcNormalsData *data = userdata;
+	int vidx;
+
+	for (vidx = vidx_start; vidx < vidx_stop; vidx++) {
+		MVert *mv = &data->mverts[vidx];
+		float *no = data->vnors[vidx];
+
+		if (UNLIKELY(normalize_v3(no) == 0.0f)) {
+			/* following Mesh convention; we use vertex coordinate itself for normal in this case */
+			normalize_v3_v3(no, mv->co);
+		}
 
+		normal_float_to_short_v3(mv->no, no);
+	}
 }
 
 void BKE_mesh_calc_normals_poly(MVert *mverts, int numVerts, MLoop *mloop, MPoly *mpolys,
-                                int UNUSED(numLoops), int numPolys, float (*r_polynors)[3],
+                                int numLoops, int numPolys, float (*r_polynors)[3],
                                 const bool only_face_normals)
 {
-	float (*pnors)[3] = r_polynors;
-	float (*tnorms)[3];
+	MeshCalcNormalsData data;
 	int i;
-	MPoly *mp;
+
+	data.mpolys = mpolys;
+	data.mloop = mloop;
+	data.mverts = mverts;
+	data.pnors = r_polynors;
+	data.lnors_weighted = NULL;
+	data.vnors = NULL;
 
 	if (only_face_normals) {
-		BLI_assert((pnors != NULL) || (numPolys == 0));
+		BLI_assert((r_polynors != NULL) || (numPolys == 0));
 
-#pragma omp parallel for if (numPolys > BKE_MESH_OMP_LIMIT)
-		for (i = 0; i < numPolys; i++) {
-			BKE_mesh_calc_poly_normal(&mpolys[i], mloop + mpolys[i].loopstart, mverts, pnors[i]);
+		if (numPolys) {
+			BLI_task_parallel_range_ex(0, numPolys, &data, mesh_calc_normals_poly_cb,
+			                           BKE_MESH_OMP_LIMIT, false);
 		}
 		return;
 	}
 
 	/* first go through and calculate normals for all the polys */
-	tnorms = MEM_callocN(sizeof(*tnorms) * (size_t)numVerts, __func__);
+	data.lnors_weighted = MEM_mallocN(sizeof(*data.lnors_weighted) * (size_t)numLoops, __func__);
+	data.vnors = MEM_callocN(sizeof(*data.vnors) * (size_t)numVerts, __func__);
 
-	if (pnors) {
-		mp = mpolys;
-		for (i = 0; i < numPolys; i++, mp++) {
-			mesh_calc_normals_poly_accum(mp, mloop + mp->loopstart, mverts, pnors[i], tnorms);
-		}
-	}
-	else {
-		float tpnor[3];  /* temp poly normal */
-		mp = mpolys;
-		for (i = 0; i < numPolys; i++, mp++) {
-			mesh_calc_normals_poly_accum(mp, mloop + mp->loopstart, mverts, tpnor, tnorms);
-		}
+	if (numPolys) {
+		BLI_task_parallel_range_ex(0, numPolys, &data, mesh_calc_normals_poly_prepare_cb,
+		                           BKE_MESH_OMP_LIMIT, false);
 	}
 
-	for (i = 0; i < numVerts; i++) {
-		MVert *mv = &mverts[i];
-		float *no = tnorms[i];
+	/* accumulate in poly order, gives the same result as doing it all in one pass */
+	for (i = 0; i < numPolys; i++) {
+		const MPoly *mp = &mpolys[i];
+		const MLoop *ml = &mloop[mp->loopstart];
+		float (*lnors_weighted)[3] = &data.lnors_weighted[mp->loopstart];
+		int j;
 
-		if (UNLIKELY(normalize_v3(no) == 0.0f)) {
-			/* following Mesh convention; we use vertex coordinate itself for normal in this case */
-			normalize_v3_v3(no, mv->co);
+		for (j = 0; j < mp->totloop; j++) {
+			add_v3_v3(data.vnors[ml[j].v], lnors_weighted[j]);
 		}
+	}
 
-		normal_float_to_short_v3(mv->no, no);
+	if (numVerts) {
+		BLI_task_parallel_range_chunk(0, numVerts, &data, NULL, 0, mesh_calc_normals_poly_finalize_cb, NULL,
+		                              BKE_MESH_OMP_LIMIT, false);
 	}
 
-	MEM_freeN(tnorms);
+	MEM_freeN(data.lnors_weighted);
+	MEM_freeN(data.vnors);
 }
 
 void BKE_mesh_calc_normals(Mesh *mesh)
@@ -1895,6 +1944,65 @@ void BKE_mesh_poly_edgebitmap_insert(unsigned int *edge_bitmap, const MPoly *mp,
 /** \} */
 
 
+/* -------------------------------------------------------------------- */
+
+/** \name Mesh Bounds Calculation
+ * \{ */
+
+typedef struct MeshMinMaxData {
+	const MVert *mverts;
+	float *r_min, *r_max;
+} MeshMinMaxData;
+
+typedef struct MeshMinMaxChunk {
+	float min[3], max[3];
+} MeshMinMaxChunk;
+
+static void mesh_calc_verts_minmax_cb(void *userdata, void *userdata_chunk, int vidx_start, int vidx_stop)
+{
+	MeshMinMaxData *data = userdata;
+	MeshMinMaxChunk *chunk = userdata_chunk;
+	int vidx;
+
+	for (vidx = vidx_start; vidx < vidx_stop; vidx++) {
+		minmax_v3v3_v3(chunk->min, chunk->max, data->mverts[vidx].co);
+	}
+}
+
+static void mesh_calc_verts_minmax_finalize(void *userdata, void *userdata_chunk)
+{
+	MeshMinMaxData *data = userdata;
+	MeshMinMaxChunk *chunk = userdata_chunk;
+
+	/* skip chunks which got no vertices at all */
+	if (chunk->min[0] <= chunk->max[0]) {
+		minmax_v3v3_v3(data->r_min, data->r_max, chunk->min);
+		minmax_v3v3_v3(data->r_min, data->r_max, chunk->max);
+	}
+}
+
+/**
+ * Expand \a r_min and \a r_max by the coordinates of given vertices, threaded for big meshes.
+ */
+void BKE_mesh_calc_verts_minmax(const MVert *mverts, const int numVerts, float r_min[3], float r_max[3])
+{
+	MeshMinMaxData data = {mverts, r_min, r_max};
+	MeshMinMaxChunk chunk;
+
+	if (numVerts == 0) {
+		return;
+	}
+
+	INIT_MINMAX(chunk.min, chunk.max);
+
+	BLI_task_parallel_range_chunk(0, numVerts, &data, &chunk, sizeof(chunk),
+	                              mesh_calc_verts_minmax_cb, mesh_calc_verts_minmax_finalize,
+	                              BKE_MESH_OMP_LIMIT, false);
+}
+
+/** \} */
+
+
 /* -------------------------------------------------------------------- */
 
 /** \name Mesh Center Calculation
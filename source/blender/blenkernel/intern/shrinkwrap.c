@@ -37,6 +37,8 @@
 #include <time.h>
 #include <assert.h>
 
+#include "MEM_guardedalloc.h"
+
 #include "DNA_object_types.h"
 #include "DNA_modifier_types.h"
 #include "DNA_meshdata_types.h"
@@ -143,64 +145,54 @@ static void shrinkwrap_calc_nearest_vertex(ShrinkwrapCalcData *calc)
 }
 
 
-/*
- * This function raycast a single vertex and updates the hit if the "hit" is considered valid.
- * Returns true if "hit" was updated.
- * Opts control whether an hit is valid or not
- * Supported options are:
- *	MOD_SHRINKWRAP_CULL_TARGET_FRONTFACE (front faces hits are ignored)
- *	MOD_SHRINKWRAP_CULL_TARGET_BACKFACE (back faces hits are ignored)
- */
-bool BKE_shrinkwrap_project_normal(
-        char options, const float vert[3],
-        const float dir[3], const SpaceTransform *transf,
-        BVHTree *tree, BVHTreeRayHit *hit,
-        BVHTree_RayCastCallback callback, void *userdata)
-{
-	/* don't use this because this dist value could be incompatible
-	 * this value used by the callback for comparing prev/new dist values.
-	 * also, at the moment there is no need to have a corrected 'dist' value */
+/* don't use this because this dist value could be incompatible
+ * this value used by the callback for comparing prev/new dist values.
+ * also, at the moment there is no need to have a corrected 'dist' value */
 // #define USE_DIST_CORRECT
 
-	float tmp_co[3], tmp_no[3];
-	const float *co, *no;
-	BVHTreeRayHit hit_tmp;
-
+/* Setup the ray of #BKE_shrinkwrap_project_normal in the targets space, and the hit to cast it with. */
+static void shrinkwrap_project_normal_ray_init(
+        const float vert[3], const float dir[3], const SpaceTransform *transf,
+        const BVHTreeRayHit *hit, BVHTreeRay *r_ray, BVHTreeRayHit *r_hit_tmp)
+{
 	/* Copy from hit (we need to convert hit rays from one space coordinates to the other */
-	memcpy(&hit_tmp, hit, sizeof(hit_tmp));
+	memcpy(r_hit_tmp, hit, sizeof(*r_hit_tmp));
+
+	copy_v3_v3(r_ray->origin, vert);
+	copy_v3_v3(r_ray->direction, dir);
+	r_ray->radius = 0.0f;
 
 	/* Apply space transform (TODO readjust dist) */
 	if (transf) {
-		copy_v3_v3(tmp_co, vert);
-		BLI_space_transform_apply(transf, tmp_co);
-		co = tmp_co;
-
-		copy_v3_v3(tmp_no, dir);
-		BLI_space_transform_apply_normal(transf, tmp_no);
-		no = tmp_no;
+		BLI_space_transform_apply(transf, r_ray->origin);
+		BLI_space_transform_apply_normal(transf, r_ray->direction);
 
 #ifdef USE_DIST_CORRECT
-		hit_tmp.dist *= mat4_to_scale(((SpaceTransform *)transf)->local2target);
+		r_hit_tmp->dist *= mat4_to_scale(((SpaceTransform *)transf)->local2target);
 #endif
 	}
-	else {
-		co = vert;
-		no = dir;
-	}
 
-	hit_tmp.index = -1;
+	r_hit_tmp->index = -1;
+}
 
-	BLI_bvhtree_ray_cast(tree, co, no, 0.0f, &hit_tmp, callback, userdata);
+/* Check the result of the ray cast of #BKE_shrinkwrap_project_normal, and copy it to \a hit when valid. */
+static bool shrinkwrap_project_normal_hit_apply(
+        char options, const float vert[3], const float dir[3], const SpaceTransform *transf,
+        BVHTreeRayHit *hit_tmp, BVHTreeRayHit *hit)
+{
+#ifndef USE_DIST_CORRECT
+	UNUSED_VARS(vert);
+#endif
 
-	if (hit_tmp.index != -1) {
+	if (hit_tmp->index != -1) {
 		/* invert the normal first so face culling works on rotated objects */
 		if (transf) {
-			BLI_space_transform_invert_normal(transf, hit_tmp.no);
+			BLI_space_transform_invert_normal(transf, hit_tmp->no);
 		}
 
 		if (options & (MOD_SHRINKWRAP_CULL_TARGET_FRONTFACE | MOD_SHRINKWRAP_CULL_TARGET_BACKFACE)) {
 			/* apply backface */
-			const float dot = dot_v3v3(dir, hit_tmp.no);
+			const float dot = dot_v3v3(dir, hit_tmp->no);
 			if (((options & MOD_SHRINKWRAP_CULL_TARGET_FRONTFACE) && dot <= 0.0f) ||
 			    ((options & MOD_SHRINKWRAP_CULL_TARGET_BACKFACE)  && dot >= 0.0f))
 			{
@@ -210,20 +202,85 @@ bool BKE_shrinkwrap_project_normal(
 
 		if (transf) {
 			/* Inverting space transform (TODO make coeherent with the initial dist readjust) */
-			BLI_space_transform_invert(transf, hit_tmp.co);
+			BLI_space_transform_invert(transf, hit_tmp->co);
 #ifdef USE_DIST_CORRECT
-			hit_tmp.dist = len_v3v3(vert, hit_tmp.co);
+			hit_tmp->dist = len_v3v3(vert, hit_tmp->co);
 #endif
 		}
 
-		BLI_assert(hit_tmp.dist <= hit->dist);
+		BLI_assert(hit_tmp->dist <= hit->dist);
 
-		memcpy(hit, &hit_tmp, sizeof(hit_tmp));
+		memcpy(hit, hit_tmp, sizeof(*hit));
 		return true;
 	}
+
 	return false;
 }
 
+/*
+ * This function raycast a single vertex and updates the hit if the "hit" is considered valid.
+ * Returns true if "hit" was updated.
+ * Opts control whether an hit is valid or not
+ * Supported options are:
+ *	MOD_SHRINKWRAP_CULL_TARGET_FRONTFACE (front faces hits are ignored)
+ *	MOD_SHRINKWRAP_CULL_TARGET_BACKFACE (back faces hits are ignored)
+ */
+bool BKE_shrinkwrap_project_normal(
+        char options, const float vert[3],
+        const float dir[3], const SpaceTransform *transf,
+        BVHTree *tree, BVHTreeRayHit *hit,
+        BVHTree_RayCastCallback callback, void *userdata)
+{
+	BVHTreeRay ray;
+	BVHTreeRayHit hit_tmp;
+
+	shrinkwrap_project_normal_ray_init(vert, dir, transf, hit, &ray, &hit_tmp);
+
+	BLI_bvhtree_ray_cast(tree, ray.origin, ray.direction, 0.0f, &hit_tmp, callback, userdata);
+
+	return shrinkwrap_project_normal_hit_apply(options, vert, dir, transf, &hit_tmp, hit);
+}
+
+/**
+ * Project all vertices in \a verts over one direction with #BKE_shrinkwrap_project_normal,
+ * casting the rays of all vertices at once.
+ */
+static void shrinkwrap_project_normal_batch(
+        char options, const int *verts, const int verts_num,
+        const float (*vert_cos)[3], const float (*vert_dirs)[3], const bool negate,
+        const SpaceTransform *transf, BVHTreeFromMesh *treeData,
+        BVHTreeRay *rays, BVHTreeRayHit *hits_tmp, BVHTreeRayHit *hits)
+{
+	int i;
+
+	for (i = 0; i < verts_num; i++) {
+		const int v = verts[i];
+		float dir[3];
+
+		if (negate) {
+			negate_v3_v3(dir, vert_dirs[v]);
+		}
+		else {
+			copy_v3_v3(dir, vert_dirs[v]);
+		}
+		shrinkwrap_project_normal_ray_init(vert_cos[v], dir, transf, &hits[v], &rays[i], &hits_tmp[i]);
+	}
+
+	BLI_bvhtree_ray_cast_batch(treeData->tree, rays, verts_num, hits_tmp, treeData->raycast_callback, treeData);
+
+	for (i = 0; i < verts_num; i++) {
+		const int v = verts[i];
+		float dir[3];
+
+		if (negate) {
+			negate_v3_v3(dir, vert_dirs[v]);
+		}
+		else {
+			copy_v3_v3(dir, vert_dirs[v]);
+		}
+		shrinkwrap_project_normal_hit_apply(options, vert_cos[v], dir, transf, &hits_tmp[i], &hits[v]);
+	}
+}
 
 static void shrinkwrap_calc_normal_projection(ShrinkwrapCalcData *calc, bool for_render)
 {
@@ -235,10 +292,9 @@ static void shrinkwrap_calc_normal_projection(ShrinkwrapCalcData *calc, bool for
 
 	/* Raycast and tree stuff */
 
-	/** \note 'hit.dist' is kept in the targets space, this is only used
+	/** \note 'hits[i].dist' is kept in the targets space, this is only used
 	 * for finding the best hit, to get the real dist,
 	 * measure the len_v3v3() from the input coord to hit.co */
-	BVHTreeRayHit hit;
 	BVHTreeFromMesh treeData = NULL_BVHTreeFromMesh;
 
 	/* auxiliary target */
@@ -282,13 +338,16 @@ static void shrinkwrap_calc_normal_projection(ShrinkwrapCalcData *calc, bool for
 	if (bvhtree_from_mesh_faces(&treeData, calc->target, 0.0, 4, 6) &&
 	    (auxMesh == NULL || bvhtree_from_mesh_faces(&auxData, auxMesh, 0.0, 4, 6)))
 	{
+		/* rays of all vertices are cast at once, per target and direction */
+		float (*vert_cos)[3] = MEM_mallocN(sizeof(*vert_cos) * (size_t)calc->numVerts, __func__);
+		float (*vert_dirs)[3] = MEM_mallocN(sizeof(*vert_dirs) * (size_t)calc->numVerts, __func__);
+		BVHTreeRayHit *hits = MEM_mallocN(sizeof(*hits) * (size_t)calc->numVerts, __func__);
+		BVHTreeRayHit *hits_tmp = MEM_mallocN(sizeof(*hits_tmp) * (size_t)calc->numVerts, __func__);
+		BVHTreeRay *rays = MEM_mallocN(sizeof(*rays) * (size_t)calc->numVerts, __func__);
+		int *verts = MEM_mallocN(sizeof(*verts) * (size_t)calc->numVerts, __func__);
+		int verts_num = 0;
 
-#ifndef __APPLE__
-#pragma omp parallel for private(i, hit) schedule(static) if (calc->numVerts > BKE_MESH_OMP_LIMIT)
-#endif
 		for (i = 0; i < calc->numVerts; ++i) {
-			float *co = calc->vertexCos[i];
-			float tmp_co[3], tmp_no[3];
 			const float weight = defvert_array_find_weight_safe(calc->dvert, i, calc->vgroup);
 
 			if (weight == 0.0f) {
@@ -300,66 +359,73 @@ static void shrinkwrap_calc_normal_projection(ShrinkwrapCalcData *calc, bool for
 				/* this coordinated are deformed by vertexCos only for normal projection (to get correct normals) */
 				/* for other cases calc->varts contains undeformed coordinates and vertexCos should be used */
 				if (calc->smd->projAxis == MOD_SHRINKWRAP_PROJECT_OVER_NORMAL) {
-					copy_v3_v3(tmp_co, calc->vert[i].co);
-					normal_short_to_float_v3(tmp_no, calc->vert[i].no);
+					copy_v3_v3(vert_cos[i], calc->vert[i].co);
+					normal_short_to_float_v3(vert_dirs[i], calc->vert[i].no);
 				}
 				else {
-					copy_v3_v3(tmp_co, co);
-					copy_v3_v3(tmp_no, proj_axis);
+					copy_v3_v3(vert_cos[i], calc->vertexCos[i]);
+					copy_v3_v3(vert_dirs[i], proj_axis);
 				}
 			}
 			else {
-				copy_v3_v3(tmp_co, co);
-				copy_v3_v3(tmp_no, proj_axis);
+				copy_v3_v3(vert_cos[i], calc->vertexCos[i]);
+				copy_v3_v3(vert_dirs[i], proj_axis);
 			}
 
+			hits[i].index = -1;
+			hits[i].dist = 10000.0f; /* TODO: we should use FLT_MAX here, but sweepsphere code isn't prepared for that */
 
-			hit.index = -1;
-			hit.dist = 10000.0f; /* TODO: we should use FLT_MAX here, but sweepsphere code isn't prepared for that */
+			verts[verts_num++] = i;
+		}
 
-			/* Project over positive direction of axis */
-			if (calc->smd->shrinkOpts & MOD_SHRINKWRAP_PROJECT_ALLOW_POS_DIR) {
+		/* Project over positive direction of axis */
+		if (calc->smd->shrinkOpts & MOD_SHRINKWRAP_PROJECT_ALLOW_POS_DIR) {
+			if (auxData.tree) {
+				shrinkwrap_project_normal_batch(0, verts, verts_num, vert_cos, vert_dirs, false,
+				                                &local2aux, &auxData, rays, hits_tmp, hits);
+			}
 
-				if (auxData.tree) {
-					BKE_shrinkwrap_project_normal(0, tmp_co, tmp_no,
-					                              &local2aux, auxData.tree, &hit,
-					                              auxData.raycast_callback, &auxData);
-				}
+			shrinkwrap_project_normal_batch(calc->smd->shrinkOpts, verts, verts_num, vert_cos, vert_dirs, false,
+			                                &calc->local2target, &treeData, rays, hits_tmp, hits);
+		}
 
-				BKE_shrinkwrap_project_normal(calc->smd->shrinkOpts, tmp_co, tmp_no,
-				                              &calc->local2target, treeData.tree, &hit,
-				                              treeData.raycast_callback, &treeData);
+		/* Project over negative direction of axis */
+		if (calc->smd->shrinkOpts & MOD_SHRINKWRAP_PROJECT_ALLOW_NEG_DIR) {
+			if (auxData.tree) {
+				shrinkwrap_project_normal_batch(0, verts, verts_num, vert_cos, vert_dirs, true,
+				                                &local2aux, &auxData, rays, hits_tmp, hits);
 			}
 
-			/* Project over negative direction of axis */
-			if (calc->smd->shrinkOpts & MOD_SHRINKWRAP_PROJECT_ALLOW_NEG_DIR) {
-				float inv_no[3];
-				negate_v3_v3(inv_no, tmp_no);
-
-				if (auxData.tree) {
-					BKE_shrinkwrap_project_normal(0, tmp_co, inv_no,
-					                              &local2aux, auxData.tree, &hit,
-					                              auxData.raycast_callback, &auxData);
-				}
+			shrinkwrap_project_normal_batch(calc->smd->shrinkOpts, verts, verts_num, vert_cos, vert_dirs, true,
+			                                &calc->local2target, &treeData, rays, hits_tmp, hits);
+		}
 
-				BKE_shrinkwrap_project_normal(calc->smd->shrinkOpts, tmp_co, inv_no,
-				                              &calc->local2target, treeData.tree, &hit,
-				                              treeData.raycast_callback, &treeData);
-			}
+		for (i = 0; i < verts_num; i++) {
+			const int v = verts[i];
+			float *co = calc->vertexCos[v];
+			BVHTreeRayHit *hit = &hits[v];
 
 			/* don't set the initial dist (which is more efficient),
 			 * because its calculated in the targets space, we want the dist in our own space */
 			if (proj_limit_squared != 0.0f) {
-				if (len_squared_v3v3(hit.co, co) > proj_limit_squared) {
-					hit.index = -1;
+				if (len_squared_v3v3(hit->co, co) > proj_limit_squared) {
+					hit->index = -1;
 				}
 			}
 
-			if (hit.index != -1) {
-				madd_v3_v3v3fl(hit.co, hit.co, tmp_no, calc->keepDist);
-				interp_v3_v3v3(co, co, hit.co, weight);
+			if (hit->index != -1) {
+				const float weight = defvert_array_find_weight_safe(calc->dvert, v, calc->vgroup);
+				madd_v3_v3v3fl(hit->co, hit->co, vert_dirs[v], calc->keepDist);
+				interp_v3_v3v3(co, co, hit->co, weight);
 			}
 		}
+
+		MEM_freeN(vert_cos);
+		MEM_freeN(vert_dirs);
+		MEM_freeN(hits);
+		MEM_freeN(hits_tmp);
+		MEM_freeN(rays);
+		MEM_freeN(verts);
 	}
 
 	/* free data structures */
@@ -0,0 +1,72 @@
+/*
+ * ***** BEGIN GPL LICENSE BLOCK *****
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * ***** END GPL LICENSE BLOCK *****
+ */
+
+#ifndef __BLI_CONCURRENT_GHASH_H__
+#define __BLI_CONCURRENT_GHASH_H__
+
+/** \file BLI_concurrent_ghash.h
+ *  \ingroup bli
+ *
+ * A (pointer -> pointer) hash table which can be used from several threads at once,
+ * using the same hash & comparison callbacks as #GHash.
+ */
+
+#include "BLI_sys_types.h" /* for bool */
+#include "BLI_compiler_attrs.h"
+#include "BLI_ghash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ConcurrentGHash ConcurrentGHash;
+
+typedef void (*ConcurrentGHashForeachFP)(void *key, void *val, void *userdata);
+
+ConcurrentGHash *BLI_concurrent_ghash_new_ex(
+        GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info,
+        const unsigned int nentries_reserve) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
+ConcurrentGHash *BLI_concurrent_ghash_new(
+        GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
+void  BLI_concurrent_ghash_free(ConcurrentGHash *cgh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp);
+
+/* Thread-safe functions. */
+void  BLI_concurrent_ghash_insert(ConcurrentGHash *cgh, void *key, void *val);
+bool  BLI_concurrent_ghash_add(ConcurrentGHash *cgh, void *key, void *val);
+bool  BLI_concurrent_ghash_reinsert(
+        ConcurrentGHash *cgh, void *key, void *val, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp);
+bool  BLI_concurrent_ghash_ensure(ConcurrentGHash *cgh, void *key, void *val, void **r_val);
+void *BLI_concurrent_ghash_lookup(ConcurrentGHash *cgh, const void *key) ATTR_WARN_UNUSED_RESULT;
+void *BLI_concurrent_ghash_lookup_default(
+        ConcurrentGHash *cgh, const void *key, void *val_default) ATTR_WARN_UNUSED_RESULT;
+bool  BLI_concurrent_ghash_haskey(ConcurrentGHash *cgh, const void *key) ATTR_WARN_UNUSED_RESULT;
+bool  BLI_concurrent_ghash_remove(
+        ConcurrentGHash *cgh, void *key, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp);
+void *BLI_concurrent_ghash_popkey(ConcurrentGHash *cgh, void *key, GHashKeyFreeFP keyfreefp);
+int   BLI_concurrent_ghash_size(ConcurrentGHash *cgh) ATTR_WARN_UNUSED_RESULT;
+
+/* Not thread-safe, no other thread may modify the hash meanwhile. */
+void  BLI_concurrent_ghash_foreach(ConcurrentGHash *cgh, ConcurrentGHashForeachFP func, void *userdata);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* __BLI_CONCURRENT_GHASH_H__ */
@@ -78,6 +78,10 @@ typedef void (*BVHTree_NearestPointCallback)(void *userdata, int index, const fl
 /* callback must update hit in case it finds a nearest successful hit */
 typedef void (*BVHTree_RayCastCallback)(void *userdata, int index, const BVHTreeRay *ray, BVHTreeRayHit *hit);
 
+/* callback to filter overlapping leafs, return true to add the pair to the result
+ * (called from multiple threads, thread is below BLI_bvhtree_overlap_thread_num()) */
+typedef bool (*BVHTree_OverlapCallback)(void *userdata, int index_a, int index_b, int thread);
+
 /* callback to range search query */
 typedef void (*BVHTree_RangeQuery)(void *userdata, int index, float dist_sq);
 
@@ -93,7 +97,9 @@ bool BLI_bvhtree_update_node(BVHTree *tree, int index, const float co[3], const
 void BLI_bvhtree_update_tree(BVHTree *tree);
 
 /* collision/overlap: check two trees if they overlap, alloc's *overlap with length of the int return value */
-BVHTreeOverlap *BLI_bvhtree_overlap(BVHTree *tree1, BVHTree *tree2, unsigned int *r_overlap_tot);
+BVHTreeOverlap *BLI_bvhtree_overlap(const BVHTree *tree1, const BVHTree *tree2, unsigned int *r_overlap_tot,
+                                    BVHTree_OverlapCallback callback, void *userdata);
+int BLI_bvhtree_overlap_thread_num(void);
 
 float BLI_bvhtree_getepsilon(const BVHTree *tree);
 
@@ -105,6 +111,11 @@ int BLI_bvhtree_find_nearest(BVHTree *tree, const float co[3], BVHTreeNearest *n
 int BLI_bvhtree_ray_cast(BVHTree *tree, const float co[3], const float dir[3], float radius, BVHTreeRayHit *hit,
                          BVHTree_RayCastCallback callback, void *userdata);
 
+/* Casts an array of rays using multiple threads (callback must be thread-safe),
+ * neighbor rays are traced together so they should be coherent */
+void BLI_bvhtree_ray_cast_batch(BVHTree *tree, const BVHTreeRay *rays, int rays_num, BVHTreeRayHit *hits,
+                                BVHTree_RayCastCallback callback, void *userdata);
+
 /* Calls the callback for every ray intersection */
 int BLI_bvhtree_ray_cast_all(BVHTree *tree, const float co[3], const float dir[3], float radius,
                              BVHTree_RayCastCallback callback, void *userdata);
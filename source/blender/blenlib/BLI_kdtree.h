@@ -69,4 +69,13 @@ int BLI_kdtree_range_search__normal(
         KDTreeNearest **r_nearest,
         float range) ATTR_NONNULL(1, 2, 4) ATTR_WARN_UNUSED_RESULT;
 
+/* Batch queries, run using multiple threads */
+void BLI_kdtree_find_nearest_batch(
+        KDTree *tree, const float (*co)[3], unsigned int co_num,
+        int *r_index, KDTreeNearest *r_nearest) ATTR_NONNULL(1, 2);
+void BLI_kdtree_find_nearest_n_batch(
+        KDTree *tree, const float (*co)[3], unsigned int co_num,
+        KDTreeNearest *r_nearest, int *r_found,
+        unsigned int n) ATTR_NONNULL(1, 2, 4);
+
 #endif  /* __BLI_KDTREE_H__ */
@@ -48,7 +48,10 @@ typedef struct BLI_mempool BLI_mempool;
 
 /* allow_iter allows iteration on this mempool.  note: this requires that the
  * first four bytes of the elements never contain the character string
- * 'free'.  use with care.*/
+ * 'free'.  use with care.
+ *
+ * threadsafe allows allocating and freeing from several threads at once,
+ * other functions (iteration, clearing...) must not run meanwhile. */
 
 BLI_mempool *BLI_mempool_create(unsigned int esize, unsigned int totelem,
                                 unsigned int pchunk, unsigned int flag) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
@@ -77,17 +80,23 @@ typedef struct BLI_mempool_iter {
 	BLI_mempool *pool;
 	struct BLI_mempool_chunk *curchunk;
 	unsigned int curindex;
+
+	struct BLI_mempool_chunk **curchunk_threaded_shared;  /* only set for threadsafe iterators */
 } BLI_mempool_iter;
 
 /* flag */
 enum {
 	BLI_MEMPOOL_NOP = 0,
 	BLI_MEMPOOL_ALLOW_ITER = (1 << 0),
+	BLI_MEMPOOL_THREADSAFE = (1 << 1),
 };
 
 void  BLI_mempool_iternew(BLI_mempool *pool, BLI_mempool_iter *iter) ATTR_NONNULL();
 void *BLI_mempool_iterstep(BLI_mempool_iter *iter) ATTR_WARN_UNUSED_RESULT ATTR_NONNULL();
 
+BLI_mempool_iter *BLI_mempool_iter_threadsafe_create(BLI_mempool *pool, const size_t num_iter) ATTR_WARN_UNUSED_RESULT ATTR_NONNULL();
+void BLI_mempool_iter_threadsafe_free(BLI_mempool_iter *iter_arr) ATTR_NONNULL();
+
 #ifdef __cplusplus
 }
 #endif
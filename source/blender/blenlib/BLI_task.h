@@ -32,10 +32,15 @@ extern "C" {
 #include "BLI_threads.h"
 #include "BLI_utildefines.h"
 
+struct BLI_mempool;
+struct Link;
+struct ListBase;
+
 /* Task Scheduler
  * 
- * Central scheduler that holds running threads ready to execute tasks. A single
- * queue holds the task from all pools.
+ * Central scheduler that holds running threads ready to execute tasks. Each
+ * thread has its own queue holding the tasks it pushed, idle threads steal
+ * tasks from the queues of other threads.
  *
  * Init/exit must be called before/after any task pools are created/freed, and
  * must be called from the main threads. All other scheduler and pool functions
@@ -116,6 +121,44 @@ void BLI_task_parallel_range(
         void *userdata,
         TaskParallelRangeFunc func);
 
+/* Parallel for routines with per-task copies of userdata_chunk, reduced by func_finalize */
+typedef void (*TaskParallelRangeReduceFunc)(void *userdata, void *userdata_chunk, int iter);
+typedef void (*TaskParallelRangeChunkFunc)(void *userdata, void *userdata_chunk, int iter_start, int iter_stop);
+typedef void (*TaskParallelRangeFinalizeFunc)(void *userdata, void *userdata_chunk);
+void BLI_task_parallel_range_reduce(
+        int start, int stop,
+        void *userdata,
+        void *userdata_chunk,
+        const size_t userdata_chunk_size,
+        TaskParallelRangeReduceFunc func,
+        TaskParallelRangeFinalizeFunc func_finalize,
+        const int range_threshold,
+        const bool use_dynamic_scheduling);
+void BLI_task_parallel_range_chunk(
+        int start, int stop,
+        void *userdata,
+        void *userdata_chunk,
+        const size_t userdata_chunk_size,
+        TaskParallelRangeChunkFunc func,
+        TaskParallelRangeFinalizeFunc func_finalize,
+        const int range_threshold,
+        const bool use_dynamic_scheduling);
+
+/* Parallel loops over double linked lists and mempools (items must not be added or removed meanwhile) */
+typedef void (*TaskParallelListbaseFunc)(void *userdata, struct Link *iter, int index);
+void BLI_task_parallel_listbase(
+        struct ListBase *listbase,
+        void *userdata,
+        TaskParallelListbaseFunc func,
+        const bool use_threading);
+
+typedef void (*TaskParallelMempoolFunc)(void *userdata, void *iter);
+void BLI_task_parallel_mempool(
+        struct BLI_mempool *mempool,
+        void *userdata,
+        TaskParallelMempoolFunc func,
+        const bool use_threading);
+
 #ifdef __cplusplus
 }
 #endif
@@ -31,6 +31,9 @@
  * A general (pointer -> pointer) chaining hash table
  * for 'Abstract Data Types' (known as an ADT Hash Table).
  *
+ * An open addressing storage can be used instead of chaining,
+ * see #GHASH_FLAG_OPEN_ADDRESSING.
+ *
  * \note edgehash.c is based on this, make sure they stay in sync.
  */
 
@@ -46,6 +49,10 @@
 #include "BLI_hash_mm2a.h"
 #include "BLI_mempool.h"
 
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
 #define GHASH_INTERNAL_API
 #include "BLI_ghash.h"
 #include "BLI_strict_flags.h"
@@ -97,6 +104,24 @@ typedef Entry GSetEntry;
 #define GHASH_ENTRY_SIZE(_is_gset) \
 	((_is_gset) ? sizeof(GSetEntry) : sizeof(GHashEntry))
 
+/* Inline slot of open addressing storage.
+ * WARNING! Layout must match #Entry and #GHashEntry (\a hash taking the place of \a next),
+ * so iterators and value lookups work the same on both storages. */
+typedef struct SlotEntry {
+	unsigned int hash;  /* already mixed, see #ghash_oa_hash */
+
+	void *key;
+} SlotEntry;
+
+typedef struct GHashSlotEntry {
+	SlotEntry e;
+
+	void *val;
+} GHashSlotEntry;
+
+#define GHASH_SLOT_SIZE(_is_gset) \
+	((_is_gset) ? sizeof(SlotEntry) : sizeof(GHashSlotEntry))
+
 struct GHash {
 	GHashHashFP hashfp;
 	GHashCmpFP cmpfp;
@@ -113,6 +138,15 @@ struct GHash {
 
 	unsigned int nentries;
 	unsigned int flag;
+
+	/* Open addressing storage, only used with #GHASH_FLAG_OPEN_ADDRESSING,
+	 * replaces buckets and entrypool (nbuckets is then the number of slots). */
+	unsigned char *ctrl;  /* one metadata byte per slot */
+	char *slots;
+	size_t slot_size;
+	unsigned int group_mask;
+	unsigned int nslots_min;
+	unsigned int ndeleted;
 };
 
 
@@ -132,6 +166,465 @@ BLI_INLINE void ghash_entry_copy(
 	}
 }
 
+/* -------------------------------------------------------------------- */
+/* GHash Open Addressing */
+
+/** \name Open Addressing Internal API
+ *
+ * Storage used instead of buckets when the GHash is created with #GHASH_FLAG_OPEN_ADDRESSING.
+ *
+ * Keys and values are stored inline in a flat array of slots, so lookups do not chase pointers.
+ * Each slot also has a metadata byte, either #GHASH_OA_EMPTY, #GHASH_OA_DELETED, or the 7 top bits
+ * of its key's hash. Slots are probed by groups of #GHASH_OA_GROUP_SIZE, metadata of a whole group
+ * being compared at once (using SSE2 when available), so the comparison callback is
+ * almost only called for the matching key.
+ *
+ * Full hashes are stored in the slots, resizing never calls the hash callback.
+ *
+ * \warning Unlike with chaining, pointers returned by #BLI_ghash_lookup_p and #BLI_ghash_ensure_p
+ * are only valid until the next insertion or removal.
+ * \{ */
+
+#define GHASH_OA_GROUP_SIZE 16
+#define GHASH_OA_NSLOTS_MIN GHASH_OA_GROUP_SIZE
+#define GHASH_OA_NSLOTS_MAX (1u << 30)
+
+#define GHASH_OA_EMPTY   ((unsigned char)0x80)
+#define GHASH_OA_DELETED ((unsigned char)0xfe)
+/* Both empty and deleted slots have their high bit set, used ones never. */
+#define GHASH_OA_IS_USED(_c) (((_c) & 0x80) == 0)
+
+/* Max load (used and deleted slots) is higher than with chaining,
+ * probing whole groups keeps lookups short. */
+#define GHASH_OA_LIMIT_GROW(_nslots) (((_nslots) / 8) * 7)
+
+BLI_INLINE unsigned int ghash_oa_ctz(const unsigned int mask)
+{
+	BLI_assert(mask != 0);
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned int)__builtin_ctz(mask);
+#else
+	unsigned int i = 0;
+	while (!(mask & (1u << i))) {
+		i++;
+	}
+	return i;
+#endif
+}
+
+/**
+ * Mix the user hash, many of our hash functions (pointers...) have weak low bits,
+ * which are used to pick the first group.
+ */
+BLI_INLINE unsigned int ghash_oa_hash(GHash *gh, const void *key)
+{
+	unsigned int hash = gh->hashfp(key);
+
+	/* MurmurHash3 finalizer. */
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+BLI_INLINE unsigned char ghash_oa_hash_meta(const unsigned int hash)
+{
+	return (unsigned char)(hash >> 25);
+}
+
+BLI_INLINE SlotEntry *ghash_oa_slot(GHash *gh, const unsigned int index)
+{
+	return (SlotEntry *)(gh->slots + gh->slot_size * (size_t)index);
+}
+
+/**
+ * \return a bit-mask of the slots of the group which metadata is \a meta.
+ */
+BLI_INLINE unsigned int ghash_oa_group_match(const unsigned char *ctrl, const unsigned char meta)
+{
+#ifdef __SSE2__
+	const __m128i group = _mm_load_si128((const __m128i *)ctrl);
+	return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)meta)));
+#else
+	unsigned int i, mask = 0;
+	for (i = 0; i < GHASH_OA_GROUP_SIZE; i++) {
+		if (ctrl[i] == meta) {
+			mask |= 1u << i;
+		}
+	}
+	return mask;
+#endif
+}
+
+/**
+ * \return a bit-mask of the empty or deleted slots of the group.
+ */
+BLI_INLINE unsigned int ghash_oa_group_match_free(const unsigned char *ctrl)
+{
+#ifdef __SSE2__
+	return (unsigned int)_mm_movemask_epi8(_mm_load_si128((const __m128i *)ctrl));
+#else
+	unsigned int i, mask = 0;
+	for (i = 0; i < GHASH_OA_GROUP_SIZE; i++) {
+		if (!GHASH_OA_IS_USED(ctrl[i])) {
+			mask |= 1u << i;
+		}
+	}
+	return mask;
+#endif
+}
+
+/**
+ * Groups are probed in triangular steps, which visits all of them since their number is a power of two.
+ */
+BLI_INLINE unsigned int ghash_oa_group_next(GHash *gh, const unsigned int group, unsigned int *step)
+{
+	return (group + ++(*step)) & gh->group_mask;
+}
+
+/**
+ * Find the first free slot for \a hash (the table always has some).
+ */
+BLI_INLINE unsigned int ghash_oa_slot_free_find(GHash *gh, const unsigned int hash)
+{
+	unsigned int group = hash & gh->group_mask;
+	unsigned int step = 0;
+
+	while (true) {
+		const unsigned int mask = ghash_oa_group_match_free(gh->ctrl + group * GHASH_OA_GROUP_SIZE);
+		if (mask) {
+			return group * GHASH_OA_GROUP_SIZE + ghash_oa_ctz(mask);
+		}
+		group = ghash_oa_group_next(gh, group, &step);
+	}
+}
+
+/**
+ * Internal lookup function, \a r_index is set to the index of the returned slot.
+ */
+BLI_INLINE SlotEntry *ghash_oa_lookup_slot(
+        GHash *gh, const void *key, const unsigned int hash, unsigned int *r_index)
+{
+	const unsigned char meta = ghash_oa_hash_meta(hash);
+	unsigned int group = hash & gh->group_mask;
+	unsigned int step = 0;
+
+	while (true) {
+		const unsigned char *ctrl = gh->ctrl + group * GHASH_OA_GROUP_SIZE;
+		unsigned int mask = ghash_oa_group_match(ctrl, meta);
+
+		while (mask) {
+			const unsigned int index = group * GHASH_OA_GROUP_SIZE + ghash_oa_ctz(mask);
+			SlotEntry *e = ghash_oa_slot(gh, index);
+			if ((e->hash == hash) && (gh->cmpfp(key, e->key) == false)) {
+				*r_index = index;
+				return e;
+			}
+			mask &= mask - 1;
+		}
+
+		/* Insertion always takes the first free slot, so the key can't be further. */
+		if (ghash_oa_group_match(ctrl, GHASH_OA_EMPTY)) {
+			return NULL;
+		}
+		group = ghash_oa_group_next(gh, group, &step);
+	}
+}
+
+/**
+ * Reallocate slots to \a nslots, moving all used ones (deleted slots are dropped).
+ */
+static void ghash_oa_resize(GHash *gh, const unsigned int nslots)
+{
+	unsigned char *ctrl_old = gh->ctrl;
+	char *slots_old = gh->slots;
+	const unsigned int nslots_old = gh->nbuckets;
+	unsigned int i;
+
+	BLI_assert((nslots % GHASH_OA_GROUP_SIZE) == 0 && ((nslots & (nslots - 1)) == 0));
+	BLI_assert(gh->nentries <= GHASH_OA_LIMIT_GROW(nslots));
+
+	gh->nbuckets = nslots;
+	gh->group_mask = nslots / GHASH_OA_GROUP_SIZE - 1;
+	gh->limit_grow = GHASH_OA_LIMIT_GROW(nslots);
+	gh->limit_shrink = GHASH_LIMIT_SHRINK(nslots);
+	gh->ndeleted = 0;
+
+	/* aligned for group loads */
+	gh->ctrl = MEM_mallocN_aligned((size_t)nslots, GHASH_OA_GROUP_SIZE, "GHash ctrl");
+	gh->slots = MEM_mallocN(gh->slot_size * (size_t)nslots, "GHash slots");
+	memset(gh->ctrl, GHASH_OA_EMPTY, (size_t)nslots);
+
+	if (ctrl_old) {
+		const bool is_gset = (gh->flag & GHASH_FLAG_IS_GSET) != 0;
+		for (i = 0; i < nslots_old; i++) {
+			if (GHASH_OA_IS_USED(ctrl_old[i])) {
+				const SlotEntry *e_old = (const SlotEntry *)(slots_old + gh->slot_size * (size_t)i);
+				const unsigned int index = ghash_oa_slot_free_find(gh, e_old->hash);
+				gh->ctrl[index] = ctrl_old[i];
+				if (is_gset) {
+					*ghash_oa_slot(gh, index) = *e_old;
+				}
+				else {
+					*(GHashSlotEntry *)ghash_oa_slot(gh, index) = *(const GHashSlotEntry *)e_old;
+				}
+			}
+		}
+		MEM_freeN(ctrl_old);
+		MEM_freeN(slots_old);
+	}
+}
+
+/**
+ * Make room for \a nentries, growing or just rehashing to get rid of deleted slots.
+ */
+static void ghash_oa_expand(GHash *gh, const unsigned int nentries, const bool user_defined)
+{
+	unsigned int nslots;
+
+	if (LIKELY(gh->ctrl && (nentries + gh->ndeleted <= gh->limit_grow))) {
+		return;
+	}
+
+	nslots = gh->nbuckets;
+	while ((nentries > GHASH_OA_LIMIT_GROW(nslots)) && (nslots < GHASH_OA_NSLOTS_MAX)) {
+		nslots <<= 1;
+	}
+
+	/* Only deleted slots are in the way. Rehashing at same size would be done again soon
+	 * if the table is quite full, grow it instead. */
+	if (gh->ctrl && (nslots == gh->nbuckets) && !user_defined &&
+	    (nentries > GHASH_OA_LIMIT_GROW(nslots) / 2) && (nslots < GHASH_OA_NSLOTS_MAX))
+	{
+		nslots <<= 1;
+	}
+
+	if (user_defined) {
+		gh->nslots_min = nslots;
+	}
+
+	ghash_oa_resize(gh, nslots);
+}
+
+static void ghash_oa_contract(
+        GHash *gh, const unsigned int nentries, const bool user_defined, const bool force_shrink)
+{
+	unsigned int nslots;
+
+	if (!(force_shrink || (gh->flag & GHASH_FLAG_ALLOW_SHRINK))) {
+		return;
+	}
+
+	if (LIKELY(nentries > gh->limit_shrink)) {
+		return;
+	}
+
+	nslots = gh->nbuckets;
+	while ((nentries < GHASH_LIMIT_SHRINK(nslots)) && (nslots > gh->nslots_min)) {
+		nslots >>= 1;
+	}
+
+	if (user_defined) {
+		gh->nslots_min = nslots;
+	}
+
+	if (nslots == gh->nbuckets) {
+		return;
+	}
+
+	ghash_oa_resize(gh, nslots);
+}
+
+/**
+ * Clear and reset \a gh slots, reserve again slots for given number of entries.
+ */
+static void ghash_oa_reset(GHash *gh, const unsigned int nentries)
+{
+	if (gh->ctrl) {
+		MEM_freeN(gh->ctrl);
+		MEM_freeN(gh->slots);
+		gh->ctrl = NULL;
+		gh->slots = NULL;
+	}
+
+	gh->nbuckets = GHASH_OA_NSLOTS_MIN;
+	gh->nslots_min = GHASH_OA_NSLOTS_MIN;
+	gh->nentries = 0;
+	gh->ndeleted = 0;
+
+	ghash_oa_expand(gh, nentries, (nentries != 0));
+}
+
+/**
+ * Insert function (no check for existing key), returns the new slot.
+ */
+BLI_INLINE SlotEntry *ghash_oa_insert_ex(GHash *gh, void *key, const unsigned int hash)
+{
+	unsigned int index;
+	SlotEntry *e;
+
+	ghash_oa_expand(gh, gh->nentries + 1, false);
+
+	index = ghash_oa_slot_free_find(gh, hash);
+	if (gh->ctrl[index] == GHASH_OA_DELETED) {
+		gh->ndeleted--;
+	}
+	gh->ctrl[index] = ghash_oa_hash_meta(hash);
+	gh->nentries++;
+
+	e = ghash_oa_slot(gh, index);
+	e->hash = hash;
+	e->key = key;
+	return e;
+}
+
+BLI_INLINE void ghash_oa_insert(GHash *gh, void *key, void *val)
+{
+	SlotEntry *e;
+
+	BLI_assert((gh->flag & GHASH_FLAG_ALLOW_DUPES) || (BLI_ghash_haskey(gh, key) == 0));
+
+	e = ghash_oa_insert_ex(gh, key, ghash_oa_hash(gh, key));
+	if ((gh->flag & GHASH_FLAG_IS_GSET) == 0) {
+		((GHashSlotEntry *)e)->val = val;
+	}
+}
+
+BLI_INLINE bool ghash_oa_insert_safe(
+        GHash *gh, void *key, void *val, const bool override, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	const unsigned int hash = ghash_oa_hash(gh, key);
+	const bool is_gset = (gh->flag & GHASH_FLAG_IS_GSET) != 0;
+	unsigned int index;
+	SlotEntry *e = ghash_oa_lookup_slot(gh, key, hash, &index);
+
+	BLI_assert(!valfreefp || !is_gset);
+
+	if (e) {
+		if (override) {
+			if (keyfreefp) keyfreefp(e->key);
+			if (valfreefp) valfreefp(((GHashSlotEntry *)e)->val);
+			e->key = key;
+			if (!is_gset) {
+				((GHashSlotEntry *)e)->val = val;
+			}
+		}
+		return false;
+	}
+	else {
+		e = ghash_oa_insert_ex(gh, key, hash);
+		if (!is_gset) {
+			((GHashSlotEntry *)e)->val = val;
+		}
+		return true;
+	}
+}
+
+/**
+ * Remove the slot at \a index. May resize \a gh, so slot pointers are invalid afterwards.
+ */
+static void ghash_oa_remove_index(GHash *gh, const unsigned int index)
+{
+	const unsigned char *ctrl_group = gh->ctrl + (index - (index % GHASH_OA_GROUP_SIZE));
+
+	/* When the group already has an empty slot no probe ever went past it,
+	 * so this slot can be made empty too instead of a tombstone. */
+	if (ghash_oa_group_match(ctrl_group, GHASH_OA_EMPTY)) {
+		gh->ctrl[index] = GHASH_OA_EMPTY;
+	}
+	else {
+		gh->ctrl[index] = GHASH_OA_DELETED;
+		gh->ndeleted++;
+	}
+
+	ghash_oa_contract(gh, --gh->nentries, false, false);
+}
+
+/**
+ * Remove \a key, returning its value in \a r_val (if not NULL).
+ */
+static bool ghash_oa_remove(
+        GHash *gh, const void *key, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp, void **r_val)
+{
+	unsigned int index;
+	SlotEntry *e = ghash_oa_lookup_slot(gh, key, ghash_oa_hash(gh, key), &index);
+
+	BLI_assert(!(valfreefp || r_val) || !(gh->flag & GHASH_FLAG_IS_GSET));
+
+	if (e) {
+		if (keyfreefp) keyfreefp(e->key);
+		if (valfreefp) valfreefp(((GHashSlotEntry *)e)->val);
+		if (r_val) *r_val = ((GHashSlotEntry *)e)->val;
+
+		ghash_oa_remove_index(gh, index);
+		return true;
+	}
+
+	return false;
+}
+
+static void ghash_oa_free_cb(GHash *gh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	unsigned int i;
+
+	BLI_assert(keyfreefp  || valfreefp);
+	BLI_assert(!valfreefp || !(gh->flag & GHASH_FLAG_IS_GSET));
+
+	for (i = 0; i < gh->nbuckets; i++) {
+		if (GHASH_OA_IS_USED(gh->ctrl[i])) {
+			SlotEntry *e = ghash_oa_slot(gh, i);
+			if (keyfreefp) keyfreefp(e->key);
+			if (valfreefp) valfreefp(((GHashSlotEntry *)e)->val);
+		}
+	}
+}
+
+/**
+ * Copy slots of \a gh into (empty) \a gh_new, keeping the exact same layout.
+ */
+static void ghash_oa_copy(GHash *gh_new, GHash *gh, GHashKeyCopyFP keycopyfp, GHashValCopyFP valcopyfp)
+{
+	ghash_oa_resize(gh_new, gh->nbuckets);
+
+	memcpy(gh_new->ctrl, gh->ctrl, (size_t)gh->nbuckets);
+	memcpy(gh_new->slots, gh->slots, gh->slot_size * (size_t)gh->nbuckets);
+	gh_new->nentries = gh->nentries;
+	gh_new->ndeleted = gh->ndeleted;
+
+	if (keycopyfp || valcopyfp) {
+		unsigned int i;
+		for (i = 0; i < gh_new->nbuckets; i++) {
+			if (GHASH_OA_IS_USED(gh_new->ctrl[i])) {
+				SlotEntry *e = ghash_oa_slot(gh_new, i);
+				if (keycopyfp) e->key = keycopyfp(e->key);
+				if (valcopyfp) ((GHashSlotEntry *)e)->val = valcopyfp(((GHashSlotEntry *)e)->val);
+			}
+		}
+	}
+}
+
+/**
+ * Set iterator on the next used slot (starting after current one).
+ */
+static void ghash_oa_iterator_next(GHashIterator *ghi)
+{
+	GHash *gh = ghi->gh;
+
+	ghi->curEntry = NULL;
+	while (++ghi->curBucket < gh->nbuckets) {
+		if (GHASH_OA_IS_USED(gh->ctrl[ghi->curBucket])) {
+			ghi->curEntry = (Entry *)ghash_oa_slot(gh, ghi->curBucket);
+			break;
+		}
+	}
+}
+
+/** \} */
+
+
 /* -------------------------------------------------------------------- */
 /* GHash API */
 
@@ -402,9 +895,15 @@ BLI_INLINE Entry *ghash_lookup_entry_prev_ex(
  */
 BLI_INLINE Entry *ghash_lookup_entry(GHash *gh, const void *key)
 {
-	const unsigned int hash = ghash_keyhash(gh, key);
-	const unsigned int bucket_index = ghash_bucket_index(gh, hash);
-	return ghash_lookup_entry_ex(gh, key, bucket_index);
+	if (gh->flag & GHASH_FLAG_OPEN_ADDRESSING) {
+		unsigned int index;
+		return (Entry *)ghash_oa_lookup_slot(gh, key, ghash_oa_hash(gh, key), &index);
+	}
+	else {
+		const unsigned int hash = ghash_keyhash(gh, key);
+		const unsigned int bucket_index = ghash_bucket_index(gh, hash);
+		return ghash_lookup_entry_ex(gh, key, bucket_index);
+	}
 }
 
 static GHash *ghash_new(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info,
@@ -418,8 +917,19 @@ static GHash *ghash_new(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info,
 	gh->buckets = NULL;
 	gh->flag = flag;
 
-	ghash_buckets_reset(gh, nentries_reserve);
-	gh->entrypool = BLI_mempool_create(GHASH_ENTRY_SIZE(flag & GHASH_FLAG_IS_GSET), 64, 64, BLI_MEMPOOL_NOP);
+	gh->ctrl = NULL;
+	gh->slots = NULL;
+
+	if (flag & GHASH_FLAG_OPEN_ADDRESSING) {
+		gh->slot_size = GHASH_SLOT_SIZE(flag & GHASH_FLAG_IS_GSET);
+		gh->entrypool = NULL;
+		ghash_oa_reset(gh, nentries_reserve);
+	}
+	else {
+		gh->slot_size = 0;
+		ghash_buckets_reset(gh, nentries_reserve);
+		gh->entrypool = BLI_mempool_create(GHASH_ENTRY_SIZE(flag & GHASH_FLAG_IS_GSET), 64, 64, BLI_MEMPOOL_NOP);
+	}
 
 	return gh;
 }
@@ -480,21 +990,33 @@ BLI_INLINE void ghash_insert_ex_keyonly(
 
 BLI_INLINE void ghash_insert(GHash *gh, void *key, void *val)
 {
-	const unsigned int hash = ghash_keyhash(gh, key);
-	const unsigned int bucket_index = ghash_bucket_index(gh, hash);
+	if (gh->flag & GHASH_FLAG_OPEN_ADDRESSING) {
+		ghash_oa_insert(gh, key, val);
+	}
+	else {
+		const unsigned int hash = ghash_keyhash(gh, key);
+		const unsigned int bucket_index = ghash_bucket_index(gh, hash);
 
-	ghash_insert_ex(gh, key, val, bucket_index);
+		ghash_insert_ex(gh, key, val, bucket_index);
+	}
 }
 
 BLI_INLINE bool ghash_insert_safe(
         GHash *gh, void *key, void *val, const bool override, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
 {
-	const unsigned int hash = ghash_keyhash(gh, key);
-	const unsigned int bucket_index = ghash_bucket_index(gh, hash);
-	GHashEntry *e = (GHashEntry *)ghash_lookup_entry_ex(gh, key, bucket_index);
+	unsigned int hash, bucket_index;
+	GHashEntry *e;
 
 	BLI_assert(!(gh->flag & GHASH_FLAG_IS_GSET));
 
+	if (gh->flag & GHASH_FLAG_OPEN_ADDRESSING) {
+		return ghash_oa_insert_safe(gh, key, val, override, keyfreefp, valfreefp);
+	}
+
+	hash = ghash_keyhash(gh, key);
+	bucket_index = ghash_bucket_index(gh, hash);
+	e = (GHashEntry *)ghash_lookup_entry_ex(gh, key, bucket_index);
+
 	if (e) {
 		if (override) {
 			if (keyfreefp) keyfreefp(e->e.key);
@@ -512,12 +1034,19 @@ BLI_INLINE bool ghash_insert_safe(
 
 BLI_INLINE bool ghash_insert_safe_keyonly(GHash *gh, void *key, const bool override, GHashKeyFreeFP keyfreefp)
 {
-	const unsigned int hash = ghash_keyhash(gh, key);
-	const unsigned int bucket_index = ghash_bucket_index(gh, hash);
-	Entry *e = ghash_lookup_entry_ex(gh, key, bucket_index);
+	unsigned int hash, bucket_index;
+	Entry *e;
 
 	BLI_assert((gh->flag & GHASH_FLAG_IS_GSET) != 0);
 
+	if (gh->flag & GHASH_FLAG_OPEN_ADDRESSING) {
+		return ghash_oa_insert_safe(gh, key, NULL, override, keyfreefp, NULL);
+	}
+
+	hash = ghash_keyhash(gh, key);
+	bucket_index = ghash_bucket_index(gh, hash);
+	e = ghash_lookup_entry_ex(gh, key, bucket_index);
+
 	if (e) {
 		if (override) {
 			if (keyfreefp) keyfreefp(e->key);
@@ -566,6 +1095,11 @@ static void ghash_free_cb(GHash *gh, GHashKeyFreeFP keyfreefp, GHashValFreeFP va
 	BLI_assert(keyfreefp  || valfreefp);
 	BLI_assert(!valfreefp || !(gh->flag & GHASH_FLAG_IS_GSET));
 
+	if (gh->flag & GHASH_FLAG_OPEN_ADDRESSING) {
+		ghash_oa_free_cb(gh, keyfreefp, valfreefp);
+		return;
+	}
+
 	for (i = 0; i < gh->nbuckets; i++) {
 		Entry *e;
 
@@ -589,6 +1123,12 @@ static GHash *ghash_copy(GHash *gh, GHashKeyCopyFP keycopyfp, GHashValCopyFP val
 	BLI_assert(!valcopyfp || !(gh->flag & GHASH_FLAG_IS_GSET));
 
 	gh_new = ghash_new(gh->hashfp, gh->cmpfp, __func__, 0, gh->flag);
+
+	if (gh->flag & GHASH_FLAG_OPEN_ADDRESSING) {
+		ghash_oa_copy(gh_new, gh, keycopyfp, valcopyfp);
+		return gh_new;
+	}
+
 	ghash_buckets_expand(gh_new, reserve_nentries_new, false);
 
 	BLI_assert(gh_new->nbuckets == gh->nbuckets);
@@ -644,6 +1184,17 @@ GHash *BLI_ghash_new(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info)
 	return BLI_ghash_new_ex(hashfp, cmpfp, info, 0);
 }
 
+/**
+ * Same as #BLI_ghash_new_ex, but with initial \a flag,
+ * needed for flags which can't be changed afterwards (like #GHASH_FLAG_OPEN_ADDRESSING).
+ */
+GHash *BLI_ghash_new_flag(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info,
+                          const unsigned int nentries_reserve, const unsigned int flag)
+{
+	BLI_assert((flag & GHASH_FLAG_IS_GSET) == 0);
+	return ghash_new(hashfp, cmpfp, info, nentries_reserve, flag);
+}
+
 /**
  * Copy given GHash. Keys and values are also copied if relevant callback is provided, else pointers remain the same.
  */
@@ -657,6 +1208,12 @@ GHash *BLI_ghash_copy(GHash *gh, GHashKeyCopyFP keycopyfp, GHashValCopyFP valcop
  */
 void BLI_ghash_reserve(GHash *gh, const unsigned int nentries_reserve)
 {
+	if (gh->flag & GHASH_FLAG_OPEN_ADDRESSING) {
+		ghash_oa_expand(gh, nentries_reserve, true);
+		ghash_oa_contract(gh, nentries_reserve, true, false);
+		return;
+	}
+
 	ghash_buckets_expand(gh, nentries_reserve, true);
 	ghash_buckets_contract(gh, nentries_reserve, true, false);
 }
@@ -752,10 +1309,29 @@ void **BLI_ghash_lookup_p(GHash *gh, const void *key)
  */
 bool BLI_ghash_ensure_p(GHash *gh, void *key, void ***r_val)
 {
-	const unsigned int hash = ghash_keyhash(gh, key);
-	const unsigned int bucket_index = ghash_bucket_index(gh, hash);
-	GHashEntry *e = (GHashEntry *)ghash_lookup_entry_ex(gh, key, bucket_index);
-	const bool haskey = (e != NULL);
+	unsigned int hash, bucket_index;
+	GHashEntry *e;
+	bool haskey;
+
+	if (gh->flag & GHASH_FLAG_OPEN_ADDRESSING) {
+		unsigned int index;
+		GHashSlotEntry *e_slot;
+
+		hash = ghash_oa_hash(gh, key);
+		e_slot = (GHashSlotEntry *)ghash_oa_lookup_slot(gh, key, hash, &index);
+		haskey = (e_slot != NULL);
+		if (!haskey) {
+			e_slot = (GHashSlotEntry *)ghash_oa_insert_ex(gh, key, hash);
+		}
+
+		*r_val = &e_slot->val;
+		return haskey;
+	}
+
+	hash = ghash_keyhash(gh, key);
+	bucket_index = ghash_bucket_index(gh, hash);
+	e = (GHashEntry *)ghash_lookup_entry_ex(gh, key, bucket_index);
+	haskey = (e != NULL);
 
 	if (!haskey) {
 		e = BLI_mempool_alloc(gh->entrypool);
@@ -776,9 +1352,16 @@ bool BLI_ghash_ensure_p(GHash *gh, void *key, void ***r_val)
  */
 bool BLI_ghash_remove(GHash *gh, void *key, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
 {
-	const unsigned int hash = ghash_keyhash(gh, key);
-	const unsigned int bucket_index = ghash_bucket_index(gh, hash);
-	Entry *e = ghash_remove_ex(gh, key, keyfreefp, valfreefp, bucket_index);
+	unsigned int hash, bucket_index;
+	Entry *e;
+
+	if (gh->flag & GHASH_FLAG_OPEN_ADDRESSING) {
+		return ghash_oa_remove(gh, key, keyfreefp, valfreefp, NULL);
+	}
+
+	hash = ghash_keyhash(gh, key);
+	bucket_index = ghash_bucket_index(gh, hash);
+	e = ghash_remove_ex(gh, key, keyfreefp, valfreefp, bucket_index);
 	if (e) {
 		BLI_mempool_free(gh->entrypool, e);
 		return true;
@@ -799,10 +1382,20 @@ bool BLI_ghash_remove(GHash *gh, void *key, GHashKeyFreeFP keyfreefp, GHashValFr
  */
 void *BLI_ghash_popkey(GHash *gh, void *key, GHashKeyFreeFP keyfreefp)
 {
-	const unsigned int hash = ghash_keyhash(gh, key);
-	const unsigned int bucket_index = ghash_bucket_index(gh, hash);
-	GHashEntry *e = (GHashEntry *)ghash_remove_ex(gh, key, keyfreefp, NULL, bucket_index);
+	unsigned int hash, bucket_index;
+	GHashEntry *e;
+
 	BLI_assert(!(gh->flag & GHASH_FLAG_IS_GSET));
+
+	if (gh->flag & GHASH_FLAG_OPEN_ADDRESSING) {
+		void *val = NULL;
+		ghash_oa_remove(gh, key, keyfreefp, NULL, &val);
+		return val;
+	}
+
+	hash = ghash_keyhash(gh, key);
+	bucket_index = ghash_bucket_index(gh, hash);
+	e = (GHashEntry *)ghash_remove_ex(gh, key, keyfreefp, NULL, bucket_index);
 	if (e) {
 		void *val = e->val;
 		BLI_mempool_free(gh->entrypool, e);
@@ -834,6 +1427,11 @@ void BLI_ghash_clear_ex(GHash *gh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valf
 	if (keyfreefp || valfreefp)
 		ghash_free_cb(gh, keyfreefp, valfreefp);
 
+	if (gh->flag & GHASH_FLAG_OPEN_ADDRESSING) {
+		ghash_oa_reset(gh, nentries_reserve);
+		return;
+	}
+
 	ghash_buckets_reset(gh, nentries_reserve);
 	BLI_mempool_clear_ex(gh->entrypool, nentries_reserve ? (int)nentries_reserve : -1);
 }
@@ -855,12 +1453,18 @@ void BLI_ghash_clear(GHash *gh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfree
  */
 void BLI_ghash_free(GHash *gh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
 {
-	BLI_assert((int)gh->nentries == BLI_mempool_count(gh->entrypool));
 	if (keyfreefp || valfreefp)
 		ghash_free_cb(gh, keyfreefp, valfreefp);
 
-	MEM_freeN(gh->buckets);
-	BLI_mempool_destroy(gh->entrypool);
+	if (gh->flag & GHASH_FLAG_OPEN_ADDRESSING) {
+		MEM_freeN(gh->ctrl);
+		MEM_freeN(gh->slots);
+	}
+	else {
+		BLI_assert((int)gh->nentries == BLI_mempool_count(gh->entrypool));
+		MEM_freeN(gh->buckets);
+		BLI_mempool_destroy(gh->entrypool);
+	}
 	MEM_freeN(gh);
 }
 
@@ -869,6 +1473,8 @@ void BLI_ghash_free(GHash *gh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreef
  */
 void BLI_ghash_flag_set(GHash *gh, unsigned int flag)
 {
+	/* storage can only be chosen on creation */
+	BLI_assert((flag & GHASH_FLAG_OPEN_ADDRESSING) == 0);
 	gh->flag |= flag;
 }
 
@@ -877,6 +1483,7 @@ void BLI_ghash_flag_set(GHash *gh, unsigned int flag)
  */
 void BLI_ghash_flag_clear(GHash *gh, unsigned int flag)
 {
+	BLI_assert((flag & GHASH_FLAG_OPEN_ADDRESSING) == 0);
 	gh->flag &= ~flag;
 }
 
@@ -917,7 +1524,12 @@ void BLI_ghashIterator_init(GHashIterator *ghi, GHash *gh)
 	ghi->gh = gh;
 	ghi->curEntry = NULL;
 	ghi->curBucket = UINT_MAX;  /* wraps to zero */
-	if (gh->nentries) {
+	if (gh->flag & GHASH_FLAG_OPEN_ADDRESSING) {
+		if (gh->nentries) {
+			ghash_oa_iterator_next(ghi);
+		}
+	}
+	else if (gh->nentries) {
 		do {
 			ghi->curBucket++;
 			if (UNLIKELY(ghi->curBucket == ghi->gh->nbuckets))
@@ -935,6 +1547,10 @@ void BLI_ghashIterator_init(GHashIterator *ghi, GHash *gh)
 void BLI_ghashIterator_step(GHashIterator *ghi)
 {
 	if (ghi->curEntry) {
+		if (ghi->gh->flag & GHASH_FLAG_OPEN_ADDRESSING) {
+			ghash_oa_iterator_next(ghi);
+			return;
+		}
 		ghi->curEntry = ghi->curEntry->next;
 		while (!ghi->curEntry) {
 			ghi->curBucket++;
@@ -1230,6 +1846,15 @@ GSet *BLI_gset_new(GSetHashFP hashfp, GSetCmpFP cmpfp, const char *info)
 	return BLI_gset_new_ex(hashfp, cmpfp, info, 0);
 }
 
+/**
+ * Matching #BLI_ghash_new_flag
+ */
+GSet *BLI_gset_new_flag(GSetHashFP hashfp, GSetCmpFP cmpfp, const char *info,
+                        const unsigned int nentries_reserve, const unsigned int flag)
+{
+	return (GSet *)ghash_new(hashfp, cmpfp, info, nentries_reserve, flag | GHASH_FLAG_IS_GSET);
+}
+
 /**
  * Copy given GSet. Keys are also copied if callback is provided, else pointers remain the same.
  */
@@ -1249,9 +1874,14 @@ int BLI_gset_size(GSet *gs)
  */
 void BLI_gset_insert(GSet *gs, void *key)
 {
-	const unsigned int hash = ghash_keyhash((GHash *)gs, key);
-	const unsigned int bucket_index = ghash_bucket_index((GHash *)gs, hash);
-	ghash_insert_ex_keyonly((GHash *)gs, key, bucket_index);
+	if (((GHash *)gs)->flag & GHASH_FLAG_OPEN_ADDRESSING) {
+		ghash_oa_insert((GHash *)gs, key, NULL);
+	}
+	else {
+		const unsigned int hash = ghash_keyhash((GHash *)gs, key);
+		const unsigned int bucket_index = ghash_bucket_index((GHash *)gs, hash);
+		ghash_insert_ex_keyonly((GHash *)gs, key, bucket_index);
+	}
 }
 
 /**
@@ -1306,12 +1936,12 @@ void BLI_gset_free(GSet *gs, GSetKeyFreeFP keyfreefp)
 
 void BLI_gset_flag_set(GSet *gs, unsigned int flag)
 {
-	((GHash *)gs)->flag |= flag;
+	BLI_ghash_flag_set((GHash *)gs, flag);
 }
 
 void BLI_gset_flag_clear(GSet *gs, unsigned int flag)
 {
-	((GHash *)gs)->flag &= ~flag;
+	BLI_ghash_flag_clear((GHash *)gs, flag);
 }
 
 /** \} */
@@ -1358,10 +1988,71 @@ int BLI_gset_buckets_size(GSet *gs)
 	return BLI_ghash_buckets_size((GHash *)gs);
 }
 
+/**
+ * Open addressing version of #BLI_ghash_calc_quality_ex,
+ * here buckets are the groups probed to find each entry.
+ */
+static double ghash_oa_calc_quality_ex(
+        GHash *gh, double *r_load, double *r_variance,
+        double *r_prop_empty_buckets, double *r_prop_overloaded_buckets, int *r_biggest_bucket)
+{
+	uint64_t sum = 0, sum_sq = 0, sum_overloaded = 0, sum_empty = 0;
+	int biggest = 0;
+	double mean;
+	unsigned int i;
+
+	for (i = 0; i < gh->nbuckets; i++) {
+		if (GHASH_OA_IS_USED(gh->ctrl[i])) {
+			const SlotEntry *e = ghash_oa_slot(gh, i);
+			const unsigned int group_slot = i / GHASH_OA_GROUP_SIZE;
+			unsigned int group = e->hash & gh->group_mask;
+			unsigned int step = 0;
+			uint64_t nprobes = 1;
+
+			while (group != group_slot) {
+				group = ghash_oa_group_next(gh, group, &step);
+				nprobes++;
+			}
+
+			sum += nprobes;
+			sum_sq += nprobes * nprobes;
+			if (nprobes > 1) {
+				sum_overloaded++;
+			}
+			biggest = max_ii(biggest, (int)nprobes);
+		}
+		else if (gh->ctrl[i] == GHASH_OA_EMPTY) {
+			sum_empty++;
+		}
+	}
+
+	mean = gh->nentries ? (double)sum / (double)gh->nentries : 0.0;
+
+	if (r_load) {
+		*r_load = (double)gh->nentries / (double)gh->nbuckets;
+	}
+	if (r_variance) {
+		*r_variance = gh->nentries ? ((double)sum_sq / (double)gh->nentries) - (mean * mean) : 0.0;
+	}
+	if (r_prop_empty_buckets) {
+		*r_prop_empty_buckets = (double)sum_empty / (double)gh->nbuckets;
+	}
+	if (r_prop_overloaded_buckets) {
+		*r_prop_overloaded_buckets = gh->nentries ? (double)sum_overloaded / (double)gh->nentries : 0.0;
+	}
+	if (r_biggest_bucket) {
+		*r_biggest_bucket = biggest;
+	}
+
+	return mean;
+}
+
 /**
  * Measure how well the hash function performs (1.0 is approx as good as random distribution),
  * and return a few other stats like load, variance of the distribution of the entries in the buckets, etc.
  *
+ * With #GHASH_FLAG_OPEN_ADDRESSING, this is the average number of groups probed to find an entry.
+ *
  * Smaller is better!
  */
 double BLI_ghash_calc_quality_ex(
@@ -1371,6 +2062,11 @@ double BLI_ghash_calc_quality_ex(
 	double mean;
 	unsigned int i;
 
+	if (gh->flag & GHASH_FLAG_OPEN_ADDRESSING) {
+		return ghash_oa_calc_quality_ex(gh, r_load, r_variance,
+		                                r_prop_empty_buckets, r_prop_overloaded_buckets, r_biggest_bucket);
+	}
+
 	if (gh->nentries == 0) {
 		if (r_load) {
 			*r_load = 0.0;
@@ -37,28 +37,34 @@
 #include "BLI_stack.h"
 #include "BLI_kdopbvh.h"
 #include "BLI_math.h"
+#include "BLI_task.h"
 #include "BLI_strict_flags.h"
 
-#ifdef _OPENMP
-#include <omp.h>
+#ifdef __SSE2__
+#  include <emmintrin.h>
 #endif
 
+
 /* used for iterative_raycast */
 // #define USE_SKIP_LINKS
 
 #define MAX_TREETYPE 32
 
-/* Setting zero so we can catch bugs in OpenMP/KDOPBVH.
- * TODO(sergey): Deduplicate the limits with PBVH from BKE.
- */
-#ifdef _OPENMP
-#  ifdef DEBUG
-#    define KDOPBVH_OMP_LIMIT 0
-#  else
-#    define KDOPBVH_OMP_LIMIT 1024
-#  endif
+/* Build tree levels and cast ray batches using multiple threads above these numbers of leafs/rays
+ * (zero in debug builds, to catch threading bugs). */
+#ifdef DEBUG
+#  define KDOPBVH_THREAD_LEAF_THRESHOLD 0
+#  define KDOPBVH_THREAD_RAY_THRESHOLD 0
+#else
+#  define KDOPBVH_THREAD_LEAF_THRESHOLD 1024
+#  define KDOPBVH_THREAD_RAY_THRESHOLD 256
 #endif
 
+/* Number of node pairs (per thread) the overlap traversal is split into, to balance the threads. */
+#define KDOPBVH_OVERLAP_PAIRS_PER_THREAD 16
+
+#define KDOPBVH_CACHELINE_SIZE 64
+
 typedef unsigned char axis_t;
 
 typedef struct BVHNode {
@@ -92,12 +98,41 @@ BLI_STATIC_ASSERT((sizeof(void *) == 8 && sizeof(BVHTree) <= 48) ||
                   (sizeof(void *) == 4 && sizeof(BVHTree) <= 32),
                   "over sized")
 
+/* Overlapping leafs found by one thread, cache-line aligned since all threads write to theirs. */
+typedef union BVHOverlapBuffer {
+	struct {
+		BVHTreeOverlap *overlap;
+		unsigned int overlap_num, overlap_alloc;
+	} s;
+	char _pad[KDOPBVH_CACHELINE_SIZE];
+} BVHOverlapBuffer;
+
 typedef struct BVHOverlapData {
-	BVHTree *tree1, *tree2; 
-	struct BLI_Stack *overlap;  /* store BVHTreeOverlap */
+	const BVHTree *tree1, *tree2;
+	BVHTree_OverlapCallback callback;
+	void *userdata;
+	BVHOverlapBuffer *buffer;
+	int thread;
 	axis_t start_axis, stop_axis;
 } BVHOverlapData;
 
+typedef struct BVHOverlapPair {
+	const BVHNode *node1, *node2;
+} BVHOverlapPair;
+
+/* overlaps found traversing a pair of nodes, a range of the buffer of the thread which traversed it */
+typedef struct BVHOverlapPairResult {
+	const BVHOverlapBuffer *buffer;
+	unsigned int start, num;
+} BVHOverlapPairResult;
+
+typedef struct BVHOverlapTaskData {
+	BVHOverlapData data;  /* shared by all tasks, thread and buffer are set per task */
+	BVHOverlapPair *pairs;
+	BVHOverlapPairResult *results;
+	BVHOverlapBuffer *buffers;  /* one per thread */
+} BVHOverlapTaskData;
+
 typedef struct BVHNearestData {
 	BVHTree *tree;
 	const float *co;
@@ -712,6 +747,82 @@ static void split_leafs(BVHNode **leafs_array, int *nth, int partitions, int spl
 	}
 }
 
+typedef struct BVHDivNodesData {
+	BVHTree *tree;
+	BVHNode *branches_array;
+	BVHNode **leafs_array;
+
+	int tree_type;
+	int tree_offset;
+
+	BVHBuildHelper *data;
+
+	int depth;
+	int i;
+	int first_of_next_level;
+} BVHDivNodesData;
+
+static void non_recursive_bvh_div_nodes_task_cb(void *userdata, int j)
+{
+	BVHDivNodesData *data = userdata;
+
+	int k;
+	const int parent_level_index = j - data->i;
+	BVHNode *parent = data->branches_array + j;
+	int nth_positions[MAX_TREETYPE + 1];
+	char split_axis;
+
+	int parent_leafs_begin = implicit_leafs_index(data->data, data->depth, parent_level_index);
+	int parent_leafs_end   = implicit_leafs_index(data->data, data->depth, parent_level_index + 1);
+
+	/* This calculates the bounding box of this branch
+	 * and chooses the largest axis as the axis to divide leafs */
+	refit_kdop_hull(data->tree, parent, parent_leafs_begin, parent_leafs_end);
+	split_axis = get_largest_axis(parent->bv);
+
+	/* Save split axis (this can be used on raytracing to speedup the query time) */
+	parent->main_axis = split_axis / 2;
+
+	/* Split the childs along the split_axis, note: its not needed to sort the whole leafs array
+	 * Only to assure that the elements are partitioned on a way that each child takes the elements
+	 * it would take in case the whole array was sorted.
+	 * Split_leafs takes care of that "sort" problem. */
+	nth_positions[0] = parent_leafs_begin;
+	nth_positions[data->tree_type] = parent_leafs_end;
+	for (k = 1; k < data->tree_type; k++) {
+		const int child_index = j * data->tree_type + data->tree_offset + k;
+		const int child_level_index = child_index - data->first_of_next_level; /* child level index */
+		nth_positions[k] = implicit_leafs_index(data->data, data->depth + 1, child_level_index);
+	}
+
+	split_leafs(data->leafs_array, nth_positions, data->tree_type, split_axis);
+
+
+	/* Setup children and totnode counters
+	 * Not really needed but currently most of BVH code relies on having an explicit children structure */
+	for (k = 0; k < data->tree_type; k++) {
+		const int child_index = j * data->tree_type + data->tree_offset + k;
+		const int child_level_index = child_index - data->first_of_next_level; /* child level index */
+
+		const int child_leafs_begin = implicit_leafs_index(data->data, data->depth + 1, child_level_index);
+		const int child_leafs_end   = implicit_leafs_index(data->data, data->depth + 1, child_level_index + 1);
+
+		if (child_leafs_end - child_leafs_begin > 1) {
+			parent->children[k] = data->branches_array + child_index;
+			parent->children[k]->parent = parent;
+		}
+		else if (child_leafs_end - child_leafs_begin == 1) {
+			parent->children[k] = data->leafs_array[child_leafs_begin];
+			parent->children[k]->parent = parent;
+		}
+		else {
+			break;
+		}
+
+		parent->totnode = (char)(k + 1);
+	}
+}
+
 /**
  * This functions builds an optimal implicit tree from the given leafs.
  * Where optimal stands for:
@@ -737,6 +848,7 @@ static void non_recursive_bvh_div_nodes(BVHTree *tree, BVHNode *branches_array,
 	const int num_branches = implicit_needed_branches(tree_type, num_leafs);
 
 	BVHBuildHelper data;
+	BVHDivNodesData cb_data;
 	int depth;
 	
 	/* set parent from root node to NULL */
@@ -759,70 +871,30 @@ static void non_recursive_bvh_div_nodes(BVHTree *tree, BVHNode *branches_array,
 
 	build_implicit_tree_helper(tree, &data);
 
+	cb_data.tree = tree;
+	cb_data.branches_array = branches_array;
+	cb_data.leafs_array = leafs_array;
+	cb_data.tree_type = tree_type;
+	cb_data.tree_offset = tree_offset;
+	cb_data.data = &data;
+
 	/* Loop tree levels (log N) loops */
 	for (i = 1, depth = 1; i <= num_branches; i = i * tree_type + tree_offset, depth++) {
 		const int first_of_next_level = i * tree_type + tree_offset;
 		const int end_j = min_ii(first_of_next_level, num_branches + 1);  /* index of last branch on this level */
-		int j;
-
-		/* Loop all branches on this level */
-
-#pragma omp parallel for private(j) schedule(static) if (num_leafs > KDOPBVH_OMP_LIMIT)
-		for (j = i; j < end_j; j++) {
-			int k;
-			const int parent_level_index = j - i;
-			BVHNode *parent = branches_array + j;
-			int nth_positions[MAX_TREETYPE + 1];
-			char split_axis;
-
-			int parent_leafs_begin = implicit_leafs_index(&data, depth, parent_level_index);
-			int parent_leafs_end   = implicit_leafs_index(&data, depth, parent_level_index + 1);
-
-			/* This calculates the bounding box of this branch
-			 * and chooses the largest axis as the axis to divide leafs */
-			refit_kdop_hull(tree, parent, parent_leafs_begin, parent_leafs_end);
-			split_axis = get_largest_axis(parent->bv);
-
-			/* Save split axis (this can be used on raytracing to speedup the query time) */
-			parent->main_axis = split_axis / 2;
-
-			/* Split the childs along the split_axis, note: its not needed to sort the whole leafs array
-			 * Only to assure that the elements are partitioned on a way that each child takes the elements
-			 * it would take in case the whole array was sorted.
-			 * Split_leafs takes care of that "sort" problem. */
-			nth_positions[0] = parent_leafs_begin;
-			nth_positions[tree_type] = parent_leafs_end;
-			for (k = 1; k < tree_type; k++) {
-				int child_index = j * tree_type + tree_offset + k;
-				int child_level_index = child_index - first_of_next_level; /* child level index */
-				nth_positions[k] = implicit_leafs_index(&data, depth + 1, child_level_index);
-			}
-
-			split_leafs(leafs_array, nth_positions, tree_type, split_axis);
 
+		cb_data.depth = depth;
+		cb_data.i = i;
+		cb_data.first_of_next_level = first_of_next_level;
 
-			/* Setup children and totnode counters
-			 * Not really needed but currently most of BVH code relies on having an explicit children structure */
-			for (k = 0; k < tree_type; k++) {
-				int child_index = j * tree_type + tree_offset + k;
-				int child_level_index = child_index - first_of_next_level; /* child level index */
-
-				int child_leafs_begin = implicit_leafs_index(&data, depth + 1, child_level_index);
-				int child_leafs_end   = implicit_leafs_index(&data, depth + 1, child_level_index + 1);
-
-				if (child_leafs_end - child_leafs_begin > 1) {
-					parent->children[k] = branches_array + child_index;
-					parent->children[k]->parent = parent;
-				}
-				else if (child_leafs_end - child_leafs_begin == 1) {
-					parent->children[k] = leafs_array[child_leafs_begin];
-					parent->children[k]->parent = parent;
-				}
-				else {
-					break;
-				}
-
-				parent->totnode = (char)(k + 1);
+		/* Loop all branches on this level, branches only touch their own range of leafs */
+		if (num_leafs > KDOPBVH_THREAD_LEAF_THRESHOLD) {
+			BLI_task_parallel_range_ex(i, end_j, &cb_data, non_recursive_bvh_div_nodes_task_cb, 0, false);
+		}
+		else {
+			int j;
+			for (j = i; j < end_j; j++) {
+				non_recursive_bvh_div_nodes_task_cb(&cb_data, j);
 			}
 		}
 	}
@@ -1030,7 +1102,7 @@ float BLI_bvhtree_getepsilon(const BVHTree *tree)
 /**
  * overlap - is it possible for 2 bv's to collide ?
  */
-static int tree_overlap(BVHNode *node1, BVHNode *node2, axis_t start_axis, axis_t stop_axis)
+static int tree_overlap(const BVHNode *node1, const BVHNode *node2, axis_t start_axis, axis_t stop_axis)
 {
 	const float *bv1 = node1->bv;
 	const float *bv2 = node2->bv;
@@ -1049,7 +1121,23 @@ static int tree_overlap(BVHNode *node1, BVHNode *node2, axis_t start_axis, axis_
 	return 1;
 }
 
-static void traverse(BVHOverlapData *data, BVHNode *node1, BVHNode *node2)
+static void bvh_overlap_buffer_push(BVHOverlapBuffer *buffer, int index_a, int index_b)
+{
+	BVHTreeOverlap *overlap;
+
+	if (UNLIKELY(buffer->s.overlap_num == buffer->s.overlap_alloc)) {
+		buffer->s.overlap_alloc = buffer->s.overlap_alloc ? buffer->s.overlap_alloc * 2 : 1024;
+		buffer->s.overlap = buffer->s.overlap ?
+		        MEM_reallocN(buffer->s.overlap, sizeof(*overlap) * buffer->s.overlap_alloc) :
+		        MEM_mallocN(sizeof(*overlap) * buffer->s.overlap_alloc, __func__);
+	}
+
+	overlap = &buffer->s.overlap[buffer->s.overlap_num++];
+	overlap->indexA = index_a;
+	overlap->indexB = index_b;
+}
+
+static void traverse(BVHOverlapData *data, const BVHNode *node1, const BVHNode *node2)
 {
 	int j;
 
@@ -1058,41 +1146,144 @@ static void traverse(BVHOverlapData *data, BVHNode *node1, BVHNode *node2)
 		if (!node1->totnode) {
 			/* check if node2 is a leaf */
 			if (!node2->totnode) {
-				BVHTreeOverlap *overlap;
-
 				if (UNLIKELY(node1 == node2)) {
 					return;
 				}
 
 				/* both leafs, insert overlap! */
-				overlap = BLI_stack_push_r(data->overlap);
-				overlap->indexA = node1->index;
-				overlap->indexB = node2->index;
+				if ((data->callback == NULL) ||
+				    data->callback(data->userdata, node1->index, node2->index, data->thread))
+				{
+					bvh_overlap_buffer_push(data->buffer, node1->index, node2->index);
+				}
 			}
 			else {
-				for (j = 0; j < data->tree2->tree_type; j++) {
-					if (node2->children[j])
-						traverse(data, node1, node2->children[j]);
+				for (j = 0; j < node2->totnode; j++) {
+					traverse(data, node1, node2->children[j]);
 				}
 			}
 		}
 		else {
-			for (j = 0; j < data->tree2->tree_type; j++) {
-				if (node1->children[j])
-					traverse(data, node1->children[j], node2);
+			for (j = 0; j < node1->totnode; j++) {
+				traverse(data, node1->children[j], node2);
 			}
 		}
 	}
-	return;
 }
 
-BVHTreeOverlap *BLI_bvhtree_overlap(BVHTree *tree1, BVHTree *tree2, unsigned int *r_overlap_tot)
+/**
+ * Splits the traversal of two overlapping nodes in (at least \a pairs_num_min when possible) pairs of nodes,
+ * in the same order #traverse visits them, so traversing the pairs one after the other gives the same result.
+ */
+static BVHOverlapPair *bvh_overlap_split_pairs(
+        const BVHOverlapData *data, const BVHNode *root1, const BVHNode *root2,
+        const int pairs_num_min, int *r_pairs_num)
 {
-	int j;
-	size_t total = 0;
-	BVHTreeOverlap *overlap = NULL, *to = NULL;
-	BVHOverlapData **data;
-	
+	const int tree_type_max = max_ii(data->tree1->tree_type, data->tree2->tree_type);
+	BVHOverlapPair *pairs = MEM_mallocN(sizeof(*pairs), __func__);
+	int pairs_num = 1;
+
+	pairs[0].node1 = root1;
+	pairs[0].node2 = root2;
+
+	while (pairs_num < pairs_num_min) {
+		BVHOverlapPair *pairs_next = MEM_mallocN(sizeof(*pairs) * (size_t)(pairs_num * tree_type_max), __func__);
+		int pairs_next_num = 0;
+		bool is_split = false;
+		int i, j;
+
+		for (i = 0; i < pairs_num; i++) {
+			const BVHNode *node1 = pairs[i].node1, *node2 = pairs[i].node2;
+
+			if (!tree_overlap(node1, node2, data->start_axis, data->stop_axis)) {
+				continue;
+			}
+
+			if (node1->totnode) {
+				for (j = 0; j < node1->totnode; j++) {
+					pairs_next[pairs_next_num].node1 = node1->children[j];
+					pairs_next[pairs_next_num++].node2 = node2;
+				}
+				is_split = true;
+			}
+			else if (node2->totnode) {
+				for (j = 0; j < node2->totnode; j++) {
+					pairs_next[pairs_next_num].node1 = node1;
+					pairs_next[pairs_next_num++].node2 = node2->children[j];
+				}
+				is_split = true;
+			}
+			else {
+				pairs_next[pairs_next_num++] = pairs[i];
+			}
+		}
+
+		MEM_freeN(pairs);
+		pairs = pairs_next;
+		pairs_num = pairs_next_num;
+
+		if (!is_split) {
+			break;
+		}
+	}
+
+	*r_pairs_num = pairs_num;
+	return pairs;
+}
+
+static void bvhtree_overlap_task_cb(TaskPool *__restrict pool, void *taskdata, int threadid)
+{
+	BVHOverlapTaskData *task_data = BLI_task_pool_userdata(pool);
+	const int pair_index = GET_INT_FROM_POINTER(taskdata);
+	const BVHOverlapPair *pair = &task_data->pairs[pair_index];
+	BVHOverlapPairResult *result = &task_data->results[pair_index];
+	BVHOverlapData data = task_data->data;
+
+	data.thread = threadid;
+	data.buffer = &task_data->buffers[threadid];
+
+	result->buffer = data.buffer;
+	result->start = data.buffer->s.overlap_num;
+
+	traverse(&data, pair->node1, pair->node2);
+
+	result->num = data.buffer->s.overlap_num - result->start;
+}
+
+/**
+ * Number of threads overlap callbacks can be called from, the \a thread argument of the callback is below this.
+ */
+int BLI_bvhtree_overlap_thread_num(void)
+{
+	return BLI_task_scheduler_num_threads(BLI_task_scheduler_get());
+}
+
+/**
+ * Find all pairs of overlapping leafs of two trees.
+ *
+ * The traversal is split into many pairs of nodes at the top of the trees, traversed by multiple threads.
+ * Each thread writes into its own result buffer, these are joined in the same order a single-threaded
+ * traversal gives, so results don't depend on threading.
+ *
+ * \param callback: Optional, called (from multiple threads) for each pair of overlapping leafs,
+ * only pairs it returns true for are added to the result.
+ * \return An array of \a r_overlap_tot pairs, NULL when there are none.
+ */
+BVHTreeOverlap *BLI_bvhtree_overlap(
+        const BVHTree *tree1, const BVHTree *tree2, unsigned int *r_overlap_tot,
+        BVHTree_OverlapCallback callback, void *userdata)
+{
+	const BVHNode *root1 = tree1->nodes[tree1->totleaf];
+	const BVHNode *root2 = tree2->nodes[tree2->totleaf];
+	const bool use_threading = (tree1->totleaf > KDOPBVH_THREAD_LEAF_THRESHOLD);
+	BVHOverlapTaskData task_data;
+	BVHOverlapBuffer buffer_single;
+	BVHTreeOverlap *overlap = NULL;
+	unsigned int total = 0;
+	int i, pairs_num, threads_num;
+
+	*r_overlap_tot = 0;
+
 	/* check for compatibility of both trees (can't compare 14-DOP with 18-DOP) */
 	if (UNLIKELY((tree1->axis != tree2->axis) &&
 	             (tree1->axis == 14 || tree2->axis == 14) &&
@@ -1101,51 +1292,79 @@ BVHTreeOverlap *BLI_bvhtree_overlap(BVHTree *tree1, BVHTree *tree2, unsigned int
 		BLI_assert(0);
 		return NULL;
 	}
-	
+
+	task_data.data.tree1 = tree1;
+	task_data.data.tree2 = tree2;
+	task_data.data.callback = callback;
+	task_data.data.userdata = userdata;
+	task_data.data.buffer = NULL;
+	task_data.data.thread = 0;
+	task_data.data.start_axis = min_axis(tree1->start_axis, tree2->start_axis);
+	task_data.data.stop_axis  = min_axis(tree1->stop_axis,  tree2->stop_axis);
+
 	/* fast check root nodes for collision before doing big splitting + traversal */
-	if (!tree_overlap(tree1->nodes[tree1->totleaf], tree2->nodes[tree2->totleaf],
-	                  min_axis(tree1->start_axis, tree2->start_axis),
-	                  min_axis(tree1->stop_axis, tree2->stop_axis)))
-	{
+	if (!tree_overlap(root1, root2, task_data.data.start_axis, task_data.data.stop_axis)) {
 		return NULL;
 	}
 
-	data = MEM_mallocN(sizeof(BVHOverlapData *) * tree1->tree_type, "BVHOverlapData_star");
-	
-	for (j = 0; j < tree1->tree_type; j++) {
-		data[j] = MEM_mallocN(sizeof(BVHOverlapData), "BVHOverlapData");
-		
-		/* init BVHOverlapData */
-		data[j]->overlap = BLI_stack_new(sizeof(BVHTreeOverlap), __func__);
-		data[j]->tree1 = tree1;
-		data[j]->tree2 = tree2;
-		data[j]->start_axis = min_axis(tree1->start_axis, tree2->start_axis);
-		data[j]->stop_axis  = min_axis(tree1->stop_axis,  tree2->stop_axis);
-	}
+	if (use_threading) {
+		TaskScheduler *scheduler = BLI_task_scheduler_get();
+		TaskPool *pool;
 
-#pragma omp parallel for private(j) schedule(static)  if (tree1->totleaf > KDOPBVH_OMP_LIMIT)
-	for (j = 0; j < MIN2(tree1->tree_type, tree1->nodes[tree1->totleaf]->totnode); j++) {
-		traverse(data[j], tree1->nodes[tree1->totleaf]->children[j], tree2->nodes[tree2->totleaf]);
-	}
-	
-	for (j = 0; j < tree1->tree_type; j++)
-		total += BLI_stack_count(data[j]->overlap);
-	
-	to = overlap = MEM_mallocN(sizeof(BVHTreeOverlap) * total, "BVHTreeOverlap");
-	
-	for (j = 0; j < tree1->tree_type; j++) {
-		unsigned int count = (unsigned int)BLI_stack_count(data[j]->overlap);
-		BLI_stack_pop_n(data[j]->overlap, to, count);
-		BLI_stack_free(data[j]->overlap);
-		to += count;
+		threads_num = BLI_task_scheduler_num_threads(scheduler);
+
+		task_data.pairs = bvh_overlap_split_pairs(&task_data.data, root1, root2,
+		                                          threads_num * KDOPBVH_OVERLAP_PAIRS_PER_THREAD, &pairs_num);
+		task_data.results = MEM_mallocN(sizeof(*task_data.results) * (size_t)pairs_num, __func__);
+		task_data.buffers = MEM_mallocN_aligned(sizeof(*task_data.buffers) * (size_t)threads_num,
+		                                        KDOPBVH_CACHELINE_SIZE, __func__);
+		memset(task_data.buffers, 0, sizeof(*task_data.buffers) * (size_t)threads_num);
+
+		pool = BLI_task_pool_create(scheduler, &task_data);
+		for (i = 0; i < pairs_num; i++) {
+			BLI_task_pool_push(pool, bvhtree_overlap_task_cb, SET_INT_IN_POINTER(i), false, TASK_PRIORITY_HIGH);
+		}
+		BLI_task_pool_work_and_wait(pool);
+		BLI_task_pool_free(pool);
+
+		for (i = 0; i < pairs_num; i++) {
+			total += task_data.results[i].num;
+		}
+
+		if (total) {
+			BVHTreeOverlap *to = overlap = MEM_mallocN(sizeof(*overlap) * total, "BVHTreeOverlap");
+
+			for (i = 0; i < pairs_num; i++) {
+				const BVHOverlapPairResult *result = &task_data.results[i];
+				memcpy(to, &result->buffer->s.overlap[result->start], sizeof(*to) * result->num);
+				to += result->num;
+			}
+		}
+
+		for (i = 0; i < threads_num; i++) {
+			MEM_SAFE_FREE(task_data.buffers[i].s.overlap);
+		}
+		MEM_freeN(task_data.buffers);
+		MEM_freeN(task_data.results);
+		MEM_freeN(task_data.pairs);
 	}
-	
-	for (j = 0; j < tree1->tree_type; j++) {
-		MEM_freeN(data[j]);
+	else {
+		memset(&buffer_single, 0, sizeof(buffer_single));
+		task_data.data.buffer = &buffer_single;
+
+		traverse(&task_data.data, root1, root2);
+
+		/* the buffer is the result, shrunk to fit */
+		total = buffer_single.s.overlap_num;
+		if (total) {
+			overlap = MEM_reallocN(buffer_single.s.overlap, sizeof(*overlap) * total);
+		}
+		else {
+			MEM_SAFE_FREE(buffer_single.s.overlap);
+		}
 	}
-	MEM_freeN(data);
-	
-	*r_overlap_tot = (unsigned int)total;
+
+	*r_overlap_tot = total;
 	return overlap;
 }
 
@@ -1371,7 +1590,7 @@ int BLI_bvhtree_find_nearest(BVHTree *tree, const float co[3], BVHTreeNearest *n
 
 
 /* Determines the distance that the ray must travel to hit the bounding volume of the given node */
-static float ray_nearest_hit(BVHRayCastData *data, const float bv[6])
+static float ray_nearest_hit(const BVHRayCastData *data, const float bv[6])
 {
 	int i;
 
@@ -1433,14 +1652,97 @@ static float fast_ray_nearest_hit(const BVHRayCastData *data, const BVHNode *nod
 	}
 }
 
-static void dfs_raycast(BVHRayCastData *data, BVHNode *node)
+#ifdef __SSE2__
+/**
+ * Shared part of the SIMD ray/bounding-volume tests: given the distances to the near (\a t1)
+ * and far (\a t2) planes of each axis, return the distance to the volume of each lane,
+ * FLT_MAX when it is missed. Same tests as #fast_ray_nearest_hit (NaN's compare false in both).
+ */
+BLI_INLINE __m128 ray_nearest_hit_v4(const __m128 t1[3], const __m128 t2[3], const __m128 hit_dist)
+{
+	const __m128 zero = _mm_setzero_ps();
+	__m128 miss, dist;
+
+	miss = _mm_or_ps(
+	        _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(t1[0], t2[1]), _mm_cmplt_ps(t2[0], t1[1])),
+	                  _mm_or_ps(_mm_cmpgt_ps(t1[0], t2[2]), _mm_cmplt_ps(t2[0], t1[2]))),
+	        _mm_or_ps(_mm_cmpgt_ps(t1[1], t2[2]), _mm_cmplt_ps(t2[1], t1[2])));
+	miss = _mm_or_ps(miss, _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(t2[0], zero), _mm_cmplt_ps(t2[1], zero)),
+	                                 _mm_cmplt_ps(t2[2], zero)));
+	miss = _mm_or_ps(miss, _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(t1[0], hit_dist), _mm_cmpgt_ps(t1[1], hit_dist)),
+	                                 _mm_cmpgt_ps(t1[2], hit_dist)));
+
+	/* same operand order as max_fff() */
+	dist = _mm_max_ps(_mm_max_ps(t1[0], t1[1]), t1[2]);
+
+	return _mm_or_ps(_mm_and_ps(miss, _mm_set1_ps(FLT_MAX)), _mm_andnot_ps(miss, dist));
+}
+
+/**
+ * #fast_ray_nearest_hit for 4 nodes at once, one per lane.
+ */
+static void fast_ray_nearest_hit_v4(const BVHRayCastData *data, const BVHNode *nodes[4], float r_dist[4])
 {
+	const float *bv0 = nodes[0]->bv, *bv1 = nodes[1]->bv, *bv2 = nodes[2]->bv, *bv3 = nodes[3]->bv;
+	__m128 t1[3], t2[3];
 	int i;
 
-	/* ray-bv is really fast.. and simple tests revealed its worth to test it
-	 * before calling the ray-primitive functions */
+	for (i = 0; i < 3; i++) {
+		const int i1 = data->index[2 * i], i2 = data->index[2 * i + 1];
+		const __m128 origin = _mm_set1_ps(data->ray.origin[i]);
+		const __m128 idot = _mm_set1_ps(data->idot_axis[i]);
+
+		t1[i] = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(bv0[i1], bv1[i1], bv2[i1], bv3[i1]), origin), idot);
+		t2[i] = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(bv0[i2], bv1[i2], bv2[i2], bv3[i2]), origin), idot);
+	}
+
+	_mm_storeu_ps(r_dist, ray_nearest_hit_v4(t1, t2, _mm_set1_ps(data->hit.dist)));
+}
+#endif  /* __SSE2__ */
+
+static float ray_nearest_hit_node(const BVHRayCastData *data, const BVHNode *node)
+{
 	/* XXX: temporary solution for particles until fast_ray_nearest_hit supports ray.radius */
-	float dist = (data->ray.radius == 0.0f) ? fast_ray_nearest_hit(data, node) : ray_nearest_hit(data, node->bv);
+	return (data->ray.radius == 0.0f) ? fast_ray_nearest_hit(data, node) : ray_nearest_hit(data, node->bv);
+}
+
+/**
+ * Determines the distance the ray must travel to hit each child of \a node (FLT_MAX when missed).
+ * Children are tested together, 4 at a time when SSE2 is available.
+ */
+static void ray_nearest_hit_children(const BVHRayCastData *data, const BVHNode *node, float r_dist[MAX_TREETYPE])
+{
+	int i;
+
+#ifdef __SSE2__
+	if (data->ray.radius == 0.0f) {
+		for (i = 0; i < node->totnode; i += 4) {
+			/* repeat the last child to fill the lanes, the extra results are ignored */
+			const BVHNode *nodes[4] = {
+			    node->children[i],
+			    node->children[min_ii(i + 1, node->totnode - 1)],
+			    node->children[min_ii(i + 2, node->totnode - 1)],
+			    node->children[min_ii(i + 3, node->totnode - 1)]};
+
+			/* MAX_TREETYPE is a multiple of 4, so this stays in bounds */
+			fast_ray_nearest_hit_v4(data, nodes, &r_dist[i]);
+		}
+		return;
+	}
+#endif
+
+	for (i = 0; i != node->totnode; i++) {
+		r_dist[i] = ray_nearest_hit_node(data, node->children[i]);
+	}
+}
+
+/**
+ * \param dist: Distance to the bounding volume of \a node, computed by the caller.
+ */
+static void dfs_raycast(BVHRayCastData *data, BVHNode *node, const float dist)
+{
+	int i;
+
 	if (dist >= data->hit.dist) return;
 
 	if (node->totnode == 0) {
@@ -1454,15 +1756,22 @@ static void dfs_raycast(BVHRayCastData *data, BVHNode *node)
 		}
 	}
 	else {
+		/* ray-bv is really fast.. and simple tests revealed its worth to test it
+		 * before calling the ray-primitive functions.
+		 * Test all children at once, distances are checked again against the closest hit
+		 * when visiting them, since it may have changed meanwhile */
+		float dist_children[MAX_TREETYPE];
+		ray_nearest_hit_children(data, node, dist_children);
+
 		/* pick loop direction to dive into the tree (based on ray direction and split axis) */
 		if (data->ray_dot_axis[node->main_axis] > 0.0f) {
 			for (i = 0; i != node->totnode; i++) {
-				dfs_raycast(data, node->children[i]);
+				dfs_raycast(data, node->children[i], dist_children[i]);
 			}
 		}
 		else {
 			for (i = node->totnode - 1; i >= 0; i--) {
-				dfs_raycast(data, node->children[i]);
+				dfs_raycast(data, node->children[i], dist_children[i]);
 			}
 		}
 	}
@@ -1533,47 +1842,55 @@ static void iterative_raycast(BVHRayCastData *data, BVHNode *node)
 }
 #endif
 
-int BLI_bvhtree_ray_cast(BVHTree *tree, const float co[3], const float dir[3], float radius, BVHTreeRayHit *hit,
-                         BVHTree_RayCastCallback callback, void *userdata)
+static void bvhtree_ray_cast_data_init(
+        BVHRayCastData *data, BVHTree *tree, const float co[3], const float dir[3], float radius,
+        const BVHTreeRayHit *hit, BVHTree_RayCastCallback callback, void *userdata)
 {
 	int i;
-	BVHRayCastData data;
-	BVHNode *root = tree->nodes[tree->totleaf];
 
-	data.tree = tree;
+	data->tree = tree;
 
-	data.callback = callback;
-	data.userdata = userdata;
+	data->callback = callback;
+	data->userdata = userdata;
 
-	copy_v3_v3(data.ray.origin,    co);
-	copy_v3_v3(data.ray.direction, dir);
-	data.ray.radius = radius;
+	copy_v3_v3(data->ray.origin,    co);
+	copy_v3_v3(data->ray.direction, dir);
+	data->ray.radius = radius;
 
-	normalize_v3(data.ray.direction);
+	normalize_v3(data->ray.direction);
 
 	for (i = 0; i < 3; i++) {
-		data.ray_dot_axis[i] = dot_v3v3(data.ray.direction, KDOP_AXES[i]);
-		data.idot_axis[i] = 1.0f / data.ray_dot_axis[i];
+		data->ray_dot_axis[i] = dot_v3v3(data->ray.direction, KDOP_AXES[i]);
+		data->idot_axis[i] = 1.0f / data->ray_dot_axis[i];
 
-		if (fabsf(data.ray_dot_axis[i]) < FLT_EPSILON) {
-			data.ray_dot_axis[i] = 0.0;
+		if (fabsf(data->ray_dot_axis[i]) < FLT_EPSILON) {
+			data->ray_dot_axis[i] = 0.0;
 		}
-		data.index[2 * i] = data.idot_axis[i] < 0.0f ? 1 : 0;
-		data.index[2 * i + 1] = 1 - data.index[2 * i];
-		data.index[2 * i]   += 2 * i;
-		data.index[2 * i + 1] += 2 * i;
+		data->index[2 * i] = data->idot_axis[i] < 0.0f ? 1 : 0;
+		data->index[2 * i + 1] = 1 - data->index[2 * i];
+		data->index[2 * i]   += 2 * i;
+		data->index[2 * i + 1] += 2 * i;
 	}
 
-
-	if (hit)
-		memcpy(&data.hit, hit, sizeof(*hit));
+	if (hit) {
+		memcpy(&data->hit, hit, sizeof(*hit));
+	}
 	else {
-		data.hit.index = -1;
-		data.hit.dist = FLT_MAX;
+		data->hit.index = -1;
+		data->hit.dist = FLT_MAX;
 	}
+}
+
+int BLI_bvhtree_ray_cast(BVHTree *tree, const float co[3], const float dir[3], float radius, BVHTreeRayHit *hit,
+                         BVHTree_RayCastCallback callback, void *userdata)
+{
+	BVHRayCastData data;
+	BVHNode *root = tree->nodes[tree->totleaf];
+
+	bvhtree_ray_cast_data_init(&data, tree, co, dir, radius, hit, callback, userdata);
 
 	if (root) {
-		dfs_raycast(&data, root);
+		dfs_raycast(&data, root, ray_nearest_hit_node(&data, root));
 //		iterative_raycast(&data, root);
 	}
 
@@ -1612,43 +1929,220 @@ float BLI_bvhtree_bb_raycast(const float bv[6], const float light_start[3], cons
 int BLI_bvhtree_ray_cast_all(BVHTree *tree, const float co[3], const float dir[3], float radius,
                              BVHTree_RayCastCallback callback, void *userdata)
 {
-	int i;
 	BVHRayCastData data;
 	BVHNode *root = tree->nodes[tree->totleaf];
 
-	data.tree = tree;
+	bvhtree_ray_cast_data_init(&data, tree, co, dir, radius, NULL, callback, userdata);
 
-	data.callback = callback;
-	data.userdata = userdata;
+	if (root) {
+		dfs_raycast_all(&data, root);
+	}
 
-	copy_v3_v3(data.ray.origin,    co);
-	copy_v3_v3(data.ray.direction, dir);
-	data.ray.radius = radius;
+	return data.hit.index;
+}
 
-	normalize_v3(data.ray.direction);
+/**
+ * Batch Raycast - BLI_bvhtree_ray_cast_batch
+ *
+ * Rays are split in packets of neighbor rays, traced together through the tree using multiple threads.
+ * Each packet tests a node against all its rays at once (one ray per SIMD lane), once only
+ * a single ray of the packet still hits a node, that ray continues on its own.
+ */
+
+#define BVH_RAY_PACKET_SIZE 4
+
+#ifdef __SSE2__
+typedef struct BVHRayPacketData {
+	BVHRayCastData rays[BVH_RAY_PACKET_SIZE];
+
+	/* ray data of all rays, one per lane */
+	__m128 origin[3];
+	__m128 idot_axis[3];
+	__m128 idot_negative[3];  /* lanes for which near and far planes are swapped */
+	float hit_dist[BVH_RAY_PACKET_SIZE];
+
+	/* children are visited in this order along each main axis, the same for all rays (see #dfs_raycast) */
+	bool axis_forward[3];
+} BVHRayPacketData;
+
+/**
+ * Same as #fast_ray_nearest_hit for all rays of the packet.
+ * \return the bit-mask of rays that hit \a node closer than their current hit.
+ */
+static int ray_packet_nearest_hit(const BVHRayPacketData *data, const BVHNode *node, float r_dist[BVH_RAY_PACKET_SIZE])
+{
+	const float *bv = node->bv;
+	const __m128 hit_dist = _mm_loadu_ps(data->hit_dist);
+	__m128 t1[3], t2[3], dist;
+	int i;
 
 	for (i = 0; i < 3; i++) {
-		data.ray_dot_axis[i] = dot_v3v3(data.ray.direction, KDOP_AXES[i]);
-		data.idot_axis[i] = 1.0f / data.ray_dot_axis[i];
+		const __m128 t_min = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bv[2 * i]), data->origin[i]), data->idot_axis[i]);
+		const __m128 t_max = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bv[2 * i + 1]), data->origin[i]), data->idot_axis[i]);
 
-		if (fabsf(data.ray_dot_axis[i]) < FLT_EPSILON) {
-			data.ray_dot_axis[i] = 0.0;
+		t1[i] = _mm_or_ps(_mm_and_ps(data->idot_negative[i], t_max), _mm_andnot_ps(data->idot_negative[i], t_min));
+		t2[i] = _mm_or_ps(_mm_and_ps(data->idot_negative[i], t_min), _mm_andnot_ps(data->idot_negative[i], t_max));
+	}
+
+	dist = ray_nearest_hit_v4(t1, t2, hit_dist);
+	_mm_storeu_ps(r_dist, dist);
+
+	/* same as the (dist >= data->hit.dist) test of dfs_raycast() */
+	return _mm_movemask_ps(_mm_cmpnge_ps(dist, hit_dist));
+}
+
+static void dfs_raycast_packet(BVHRayPacketData *data, BVHNode *node, int mask)
+{
+	float dist[BVH_RAY_PACKET_SIZE];
+	int i;
+
+	mask &= ray_packet_nearest_hit(data, node, dist);
+
+	if (mask == 0) {
+		return;
+	}
+
+	if ((node->totnode == 0) || ((mask & (mask - 1)) == 0)) {
+		/* leaf, or a single ray left: continue per ray */
+		for (i = 0; i < BVH_RAY_PACKET_SIZE; i++) {
+			if (mask & (1 << i)) {
+				dfs_raycast(&data->rays[i], node, dist[i]);
+				data->hit_dist[i] = data->rays[i].hit.dist;
+			}
+		}
+	}
+	else {
+		if (data->axis_forward[node->main_axis]) {
+			for (i = 0; i != node->totnode; i++) {
+				dfs_raycast_packet(data, node->children[i], mask);
+			}
+		}
+		else {
+			for (i = node->totnode - 1; i >= 0; i--) {
+				dfs_raycast_packet(data, node->children[i], mask);
+			}
 		}
-		data.index[2 * i] = data.idot_axis[i] < 0.0f ? 1 : 0;
-		data.index[2 * i + 1] = 1 - data.index[2 * i];
-		data.index[2 * i]   += 2 * i;
-		data.index[2 * i + 1] += 2 * i;
 	}
+}
+#endif  /* __SSE2__ */
 
+typedef struct BVHRayCastBatchData {
+	BVHTree *tree;
+	const BVHTreeRay *rays;
+	int rays_num;
+	BVHTreeRayHit *hits;
+	BVHTree_RayCastCallback callback;
+	void *userdata;
+} BVHRayCastBatchData;
 
-	data.hit.index = -1;
-	data.hit.dist = FLT_MAX;
+static void bvhtree_ray_cast_batch_cb(void *userdata, int iter)
+{
+	const BVHRayCastBatchData *batch = userdata;
+	BVHTree *tree = batch->tree;
+	BVHNode *root = tree->nodes[tree->totleaf];
+	const int start = iter * BVH_RAY_PACKET_SIZE;
+	const int end = min_ii(start + BVH_RAY_PACKET_SIZE, batch->rays_num);
+	int i;
 
-	if (root) {
-		dfs_raycast_all(&data, root);
+#ifdef __SSE2__
+	/* packets only support the fast ray/bounding-volume test (without radius) */
+	for (i = start; i < end; i++) {
+		if (batch->rays[i].radius != 0.0f) {
+			break;
+		}
 	}
 
-	return data.hit.index;
+	if (root && (i == end)) {
+		BVHRayPacketData data;
+		float origin[3][BVH_RAY_PACKET_SIZE] = {{0.0f}}, idot_axis[3][BVH_RAY_PACKET_SIZE] = {{0.0f}};
+		int mask = 0, j;
+
+		for (i = 0; i < BVH_RAY_PACKET_SIZE; i++) {
+			BVHRayCastData *ray_data = &data.rays[i];
+
+			if (start + i < end) {
+				const BVHTreeRay *ray = &batch->rays[start + i];
+				bvhtree_ray_cast_data_init(ray_data, tree, ray->origin, ray->direction, 0.0f,
+				                           &batch->hits[start + i], batch->callback, batch->userdata);
+				for (j = 0; j < 3; j++) {
+					origin[j][i] = ray_data->ray.origin[j];
+					idot_axis[j][i] = ray_data->idot_axis[j];
+				}
+				data.hit_dist[i] = ray_data->hit.dist;
+				mask |= 1 << i;
+			}
+			else {
+				/* unused lane, never hits anything */
+				data.hit_dist[i] = -FLT_MAX;
+			}
+		}
+
+		for (j = 0; j < 3; j++) {
+			int negative_mask, forward_mask = 0;
+
+			data.origin[j] = _mm_loadu_ps(origin[j]);
+			data.idot_axis[j] = _mm_loadu_ps(idot_axis[j]);
+			data.idot_negative[j] = _mm_cmplt_ps(data.idot_axis[j], _mm_setzero_ps());
+
+			/* rays going in different directions rarely visit the same nodes */
+			negative_mask = _mm_movemask_ps(data.idot_negative[j]) & mask;
+			if (!ELEM(negative_mask, 0, mask)) {
+				break;
+			}
+
+			/* rays nearly perpendicular to an axis may still visit children in another order,
+			 * trace these per ray so hits and callbacks are the same as for single rays */
+			for (i = 0; i < end - start; i++) {
+				if (data.rays[i].ray_dot_axis[j] > 0.0f) {
+					forward_mask |= 1 << i;
+				}
+			}
+			if (!ELEM(forward_mask, 0, mask)) {
+				break;
+			}
+			data.axis_forward[j] = (forward_mask != 0);
+		}
+
+		if (j == 3) {
+			dfs_raycast_packet(&data, root, mask);
+
+			for (i = start; i < end; i++) {
+				memcpy(&batch->hits[i], &data.rays[i - start].hit, sizeof(*batch->hits));
+			}
+			return;
+		}
+	}
+#endif
+
+	for (i = start; i < end; i++) {
+		const BVHTreeRay *ray = &batch->rays[i];
+		BLI_bvhtree_ray_cast(tree, ray->origin, ray->direction, ray->radius, &batch->hits[i],
+		                     batch->callback, batch->userdata);
+	}
+}
+
+/**
+ * Cast \a rays_num rays using multiple threads, the result of each ray is the same as #BLI_bvhtree_ray_cast gives.
+ *
+ * \param hits: Array of \a rays_num hits, initialized by the caller like the \a hit argument of #BLI_bvhtree_ray_cast.
+ * \param callback: Called from multiple threads at once.
+ *
+ * \note Rays next to each other in \a rays are traced together, giving the best performance
+ * when they are coherent (close origins and directions), as for a grid of pixels or neighbor vertices.
+ */
+void BLI_bvhtree_ray_cast_batch(
+        BVHTree *tree, const BVHTreeRay *rays, int rays_num, BVHTreeRayHit *hits,
+        BVHTree_RayCastCallback callback, void *userdata)
+{
+	BVHRayCastBatchData data = {tree, rays, rays_num, hits, callback, userdata};
+	const int packets_num = (rays_num + BVH_RAY_PACKET_SIZE - 1) / BVH_RAY_PACKET_SIZE;
+
+	if (rays_num == 0) {
+		return;
+	}
+
+	BLI_task_parallel_range_ex(0, packets_num, &data, bvhtree_ray_cast_batch_cb,
+	                           KDOPBVH_THREAD_RAY_THRESHOLD / BVH_RAY_PACKET_SIZE, true);
 }
 
 /**
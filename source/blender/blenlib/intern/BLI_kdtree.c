@@ -23,37 +23,58 @@
 
 /** \file blender/blenlib/intern/BLI_kdtree.c
  *  \ingroup bli
+ *
+ * The tree is stored implicitly in its points array: balancing reorders the points so every subtree
+ * is a contiguous range of the array, with the splitting point in the middle of the range.
+ * This avoids storing any child links, keeps points of a subtree close in memory,
+ * and lets small subtrees (leaves of up to #KD_LEAF_SIZE points) be scanned linearly.
  */
 
 #include "MEM_guardedalloc.h"
 
 #include "BLI_math.h"
 #include "BLI_kdtree.h"
+#include "BLI_task.h"
 #include "BLI_utildefines.h"
 #include "BLI_strict_flags.h"
 
 
 typedef struct KDTreeNode {
-	struct KDTreeNode *left, *right;
 	float co[3];
 	int index;
-	unsigned int d;  /* range is only (0-2) */
 } KDTreeNode;
 
 struct KDTree {
 	KDTreeNode *nodes;
 	unsigned int totnode;
-	KDTreeNode *root;
 #ifdef DEBUG
 	bool is_balanced;  /* ensure we call balance first */
 	unsigned int maxsize;   /* max size of the tree */
 #endif
 };
 
-#define KD_STACK_INIT 100      /* initial size for array (on the stack) */
-#define KD_NEAR_ALLOC_INC 100  /* alloc increment for collecting nearest */
+/* Subtrees up to this size aren't split any further, their points are scanned linearly. */
+#define KD_LEAF_SIZE 8
+/* Subtrees larger than this are balanced in their own task. */
+#define KD_BALANCE_TASK_SIZE 16384
+/* Batch queries below this size don't use threads. */
+#define KD_BATCH_THRESHOLD 1024
+
+/* Subtrees pending in the stack are siblings of the subtrees being walked,
+ * so there are never more of them than the depth of the tree. */
+#define KD_STACK_SIZE 64
 #define KD_FOUND_ALLOC_INC 50  /* alloc increment for collecting nearest */
 
+/**
+ * A subtree waiting to be visited, \a dist_sq is a lower bound of the distance
+ * between the query point and any point of the subtree.
+ */
+typedef struct KDTreeRange {
+	unsigned int start, end;
+	unsigned int axis;
+	float dist_sq;
+} KDTreeRange;
+
 /**
  * Creates or free a kdtree
  */
@@ -64,7 +85,6 @@ KDTree *BLI_kdtree_new(unsigned int maxsize)
 	tree = MEM_mallocN(sizeof(KDTree), "KDTree");
 	tree->nodes = MEM_mallocN(sizeof(KDTreeNode) * maxsize, "KDTreeNode");
 	tree->totnode = 0;
-	tree->root = NULL;
 
 #ifdef DEBUG
 	tree->is_balanced = false;
@@ -93,30 +113,28 @@ void BLI_kdtree_insert(KDTree *tree, int index, const float co[3])
 	BLI_assert(tree->totnode <= tree->maxsize);
 #endif
 
-	/* note, array isn't calloc'd,
-	 * need to initialize all struct members */
-
-	node->left = node->right = NULL;
 	copy_v3_v3(node->co, co);
 	node->index = index;
-	node->d = 0;
 
 #ifdef DEBUG
 	tree->is_balanced = false;
 #endif
 }
 
-static KDTreeNode *kdtree_balance(KDTreeNode *nodes, unsigned int totnode, unsigned int axis)
+BLI_INLINE unsigned int kdtree_axis_next(const unsigned int axis)
+{
+	return (axis == 2) ? 0 : axis + 1;
+}
+
+/**
+ * Move the median point of \a nodes (along \a axis) to the middle of the array,
+ * points before it being lower or equal and points after it higher or equal.
+ */
+static void kdtree_partition_median(KDTreeNode *nodes, unsigned int totnode, unsigned int axis)
 {
-	KDTreeNode *node;
 	float co;
 	unsigned int left, right, median, i, j;
 
-	if (totnode <= 0)
-		return NULL;
-	else if (totnode == 1)
-		return nodes;
-	
 	/* quicksort style sorting around median */
 	left = 0;
 	right = totnode - 1;
@@ -143,19 +161,69 @@ static KDTreeNode *kdtree_balance(KDTreeNode *nodes, unsigned int totnode, unsig
 		if (i <= median)
 			left = i + 1;
 	}
+}
+
+static void kdtree_balance(KDTreeNode *nodes, unsigned int totnode, unsigned int axis)
+{
+	while (totnode > KD_LEAF_SIZE) {
+		const unsigned int median = totnode / 2;
+
+		kdtree_partition_median(nodes, totnode, axis);
+		axis = kdtree_axis_next(axis);
+
+		kdtree_balance(nodes, median, axis);
+
+		nodes += median + 1;
+		totnode -= median + 1;
+	}
+}
 
-	/* set node and sort subnodes */
-	node = &nodes[median];
-	node->d = axis;
-	node->left = kdtree_balance(nodes, median, (axis + 1) % 3);
-	node->right = kdtree_balance(nodes + median + 1, (totnode - (median + 1)), (axis + 1) % 3);
+static void kdtree_balance_task(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	KDTreeNode *nodes = BLI_task_pool_userdata(pool);
+	KDTreeRange *range = taskdata;
+	unsigned int start = range->start, end = range->end, axis = range->axis;
 
-	return node;
+	/* split in new tasks as long as subtrees are large, then balance serially */
+	while (end - start > KD_BALANCE_TASK_SIZE) {
+		const unsigned int median = start + (end - start) / 2;
+		KDTreeRange *range_left = MEM_mallocN(sizeof(*range_left), __func__);
+
+		kdtree_partition_median(&nodes[start], end - start, axis);
+		axis = kdtree_axis_next(axis);
+
+		range_left->start = start;
+		range_left->end = median;
+		range_left->axis = axis;
+		BLI_task_pool_push(pool, kdtree_balance_task, range_left, true, TASK_PRIORITY_HIGH);
+
+		start = median + 1;
+	}
+
+	kdtree_balance(&nodes[start], end - start, axis);
 }
 
+/**
+ * Reorder the points into a balanced tree, large trees are balanced using multiple threads.
+ */
 void BLI_kdtree_balance(KDTree *tree)
 {
-	tree->root = kdtree_balance(tree->nodes, tree->totnode, 0);
+	if (tree->totnode > KD_BALANCE_TASK_SIZE) {
+		TaskScheduler *scheduler = BLI_task_scheduler_get();
+		TaskPool *pool = BLI_task_pool_create(scheduler, tree->nodes);
+		KDTreeRange *range = MEM_mallocN(sizeof(*range), __func__);
+
+		range->start = 0;
+		range->end = tree->totnode;
+		range->axis = 0;
+		BLI_task_pool_push(pool, kdtree_balance_task, range, true, TASK_PRIORITY_HIGH);
+
+		BLI_task_pool_work_and_wait(pool);
+		BLI_task_pool_free(pool);
+	}
+	else {
+		kdtree_balance(tree->nodes, tree->totnode, 0);
+	}
 
 #ifdef DEBUG
 	tree->is_balanced = true;
@@ -180,15 +248,53 @@ static float squared_distance(const float v2[3], const float v1[3], const float
 	return dist;
 }
 
-static KDTreeNode **realloc_nodes(KDTreeNode **stack, unsigned int *totstack, const bool is_alloc)
+/**
+ * Walk down from \a range towards \a co until a leaf is reached, running \a TEST_POINT on each
+ * point met on the way (as \a node). Branches on the other side of split planes are pushed
+ * to \a stack when the plane is closer than \a dist_max (squared).
+ *
+ * A macro, so queries get their point test inlined.
+ */
+#define KDTREE_WALK(tree, co, range, stack, cur, dist_max, TEST_POINT) \
+{ \
+	const KDTreeNode *_nodes = (tree)->nodes; \
+	unsigned int _start = (range).start, _end = (range).end, _axis = (range).axis; \
+	while (_end - _start > KD_LEAF_SIZE) { \
+		const unsigned int _median = _start + (_end - _start) / 2; \
+		const KDTreeNode *node = &_nodes[_median]; \
+		const float _dist_axis = (co)[_axis] - node->co[_axis]; \
+		TEST_POINT; \
+		_axis = kdtree_axis_next(_axis); \
+		if (_dist_axis < 0.0f) { \
+			if (_dist_axis * _dist_axis < (dist_max)) { \
+				KDTreeRange *_far = &(stack)[(cur)++]; \
+				_far->start = _median + 1; _far->end = _end; _far->axis = _axis; \
+				_far->dist_sq = _dist_axis * _dist_axis; \
+			} \
+			_end = _median; \
+		} \
+		else { \
+			if (_dist_axis * _dist_axis < (dist_max)) { \
+				KDTreeRange *_far = &(stack)[(cur)++]; \
+				_far->start = _start; _far->end = _median; _far->axis = _axis; \
+				_far->dist_sq = _dist_axis * _dist_axis; \
+			} \
+			_start = _median + 1; \
+		} \
+	} \
+	for (; _start < _end; _start++) { \
+		const KDTreeNode *node = &_nodes[_start]; \
+		TEST_POINT; \
+	} \
+} (void)0
+
+BLI_INLINE void kdtree_stack_init(const KDTree *tree, KDTreeRange *stack, unsigned int *r_cur)
 {
-	KDTreeNode **stack_new = MEM_mallocN((*totstack + KD_NEAR_ALLOC_INC) * sizeof(KDTreeNode *), "KDTree.treestack");
-	memcpy(stack_new, stack, *totstack * sizeof(KDTreeNode *));
-	// memset(stack_new + *totstack, 0, sizeof(KDTreeNode *) * KD_NEAR_ALLOC_INC);
-	if (is_alloc)
-		MEM_freeN(stack);
-	*totstack += KD_NEAR_ALLOC_INC;
-	return stack_new;
+	stack[0].start = 0;
+	stack[0].end = tree->totnode;
+	stack[0].axis = 0;
+	stack[0].dist_sq = 0.0f;
+	*r_cur = 1;
 }
 
 /**
@@ -198,76 +304,36 @@ int BLI_kdtree_find_nearest(
         KDTree *tree, const float co[3],
         KDTreeNearest *r_nearest)
 {
-	KDTreeNode *root, *node, *min_node;
-	KDTreeNode **stack, *defaultstack[KD_STACK_INIT];
-	float min_dist, cur_dist;
-	unsigned int totstack, cur = 0;
+	KDTreeRange stack[KD_STACK_SIZE];
+	const KDTreeNode *min_node;
+	float min_dist = FLT_MAX;
+	unsigned int cur;
 
 #ifdef DEBUG
 	BLI_assert(tree->is_balanced == true);
 #endif
 
-	if (UNLIKELY(!tree->root))
+	if (UNLIKELY(tree->totnode == 0))
 		return -1;
 
-	stack = defaultstack;
-	totstack = KD_STACK_INIT;
+	kdtree_stack_init(tree, stack, &cur);
+	min_node = &tree->nodes[0];
 
-	root = tree->root;
-	min_node = root;
-	min_dist = len_squared_v3v3(root->co, co);
-
-	if (co[root->d] < root->co[root->d]) {
-		if (root->right)
-			stack[cur++] = root->right;
-		if (root->left)
-			stack[cur++] = root->left;
-	}
-	else {
-		if (root->left)
-			stack[cur++] = root->left;
-		if (root->right)
-			stack[cur++] = root->right;
-	}
-	
 	while (cur--) {
-		node = stack[cur];
-
-		cur_dist = node->co[node->d] - co[node->d];
-
-		if (cur_dist < 0.0f) {
-			cur_dist = -cur_dist * cur_dist;
+		const KDTreeRange range = stack[cur];
 
-			if (-cur_dist < min_dist) {
-				cur_dist = len_squared_v3v3(node->co, co);
-				if (cur_dist < min_dist) {
-					min_dist = cur_dist;
-					min_node = node;
-				}
-				if (node->left)
-					stack[cur++] = node->left;
-			}
-			if (node->right)
-				stack[cur++] = node->right;
-		}
-		else {
-			cur_dist = cur_dist * cur_dist;
+		if (range.dist_sq >= min_dist)
+			continue;
 
+		KDTREE_WALK(tree, co, range, stack, cur, min_dist,
+		{
+			const float cur_dist = len_squared_v3v3(node->co, co);
 			if (cur_dist < min_dist) {
-				cur_dist = len_squared_v3v3(node->co, co);
-				if (cur_dist < min_dist) {
-					min_dist = cur_dist;
-					min_node = node;
-				}
-				if (node->right)
-					stack[cur++] = node->right;
+				min_dist = cur_dist;
+				min_node = node;
 			}
-			if (node->left)
-				stack[cur++] = node->left;
-		}
-		if (UNLIKELY(cur + 3 > totstack)) {
-			stack = realloc_nodes(stack, &totstack, defaultstack != stack);
-		}
+		});
+		BLI_assert(cur < KD_STACK_SIZE);
 	}
 
 	if (r_nearest) {
@@ -276,9 +342,6 @@ int BLI_kdtree_find_nearest(
 		copy_v3_v3(r_nearest->co, min_node->co);
 	}
 
-	if (stack != defaultstack)
-		MEM_freeN(stack);
-
 	return min_node->index;
 }
 
@@ -312,85 +375,43 @@ int BLI_kdtree_find_nearest_n__normal(
         KDTreeNearest r_nearest[],
         unsigned int n)
 {
-	KDTreeNode *root, *node = NULL;
-	KDTreeNode **stack, *defaultstack[KD_STACK_INIT];
-	float cur_dist;
-	unsigned int totstack, cur = 0;
+	KDTreeRange stack[KD_STACK_SIZE];
+	float dist_max = FLT_MAX;
+	unsigned int cur;
 	unsigned int i, found = 0;
 
 #ifdef DEBUG
 	BLI_assert(tree->is_balanced == true);
 #endif
 
-	if (UNLIKELY(!tree->root || n == 0))
+	if (UNLIKELY(tree->totnode == 0 || n == 0))
 		return 0;
 
-	stack = defaultstack;
-	totstack = KD_STACK_INIT;
-
-	root = tree->root;
-
-	cur_dist = squared_distance(root->co, co, nor);
-	add_nearest(r_nearest, &found, n, root->index, cur_dist, root->co);
-	
-	if (co[root->d] < root->co[root->d]) {
-		if (root->right)
-			stack[cur++] = root->right;
-		if (root->left)
-			stack[cur++] = root->left;
-	}
-	else {
-		if (root->left)
-			stack[cur++] = root->left;
-		if (root->right)
-			stack[cur++] = root->right;
-	}
+	kdtree_stack_init(tree, stack, &cur);
 
+	/* the normal only ever makes distances larger, so the distance to split planes stays a lower bound */
 	while (cur--) {
-		node = stack[cur];
-
-		cur_dist = node->co[node->d] - co[node->d];
-
-		if (cur_dist < 0.0f) {
-			cur_dist = -cur_dist * cur_dist;
-
-			if (found < n || -cur_dist < r_nearest[found - 1].dist) {
-				cur_dist = squared_distance(node->co, co, nor);
-
-				if (found < n || cur_dist < r_nearest[found - 1].dist)
-					add_nearest(r_nearest, &found, n, node->index, cur_dist, node->co);
-
-				if (node->left)
-					stack[cur++] = node->left;
-			}
-			if (node->right)
-				stack[cur++] = node->right;
-		}
-		else {
-			cur_dist = cur_dist * cur_dist;
-
-			if (found < n || cur_dist < r_nearest[found - 1].dist) {
-				cur_dist = squared_distance(node->co, co, nor);
-				if (found < n || cur_dist < r_nearest[found - 1].dist)
-					add_nearest(r_nearest, &found, n, node->index, cur_dist, node->co);
-
-				if (node->right)
-					stack[cur++] = node->right;
+		const KDTreeRange range = stack[cur];
+
+		if (range.dist_sq >= dist_max)
+			continue;
+
+		KDTREE_WALK(tree, co, range, stack, cur, dist_max,
+		{
+			const float cur_dist = squared_distance(node->co, co, nor);
+			if (cur_dist < dist_max) {
+				add_nearest(r_nearest, &found, n, node->index, cur_dist, node->co);
+				if (found == n) {
+					dist_max = r_nearest[found - 1].dist;
+				}
 			}
-			if (node->left)
-				stack[cur++] = node->left;
-		}
-		if (UNLIKELY(cur + 3 > totstack)) {
-			stack = realloc_nodes(stack, &totstack, defaultstack != stack);
-		}
+		});
+		BLI_assert(cur < KD_STACK_SIZE);
 	}
 
 	for (i = 0; i < found; i++)
 		r_nearest[i].dist = sqrtf(r_nearest[i].dist);
 
-	if (stack != defaultstack)
-		MEM_freeN(stack);
-
 	return (int)found;
 }
 
@@ -417,7 +438,7 @@ static void add_in_range(
 	if (UNLIKELY(found >= *r_foundstack_tot_alloc)) {
 		*r_foundstack = MEM_reallocN_id(
 		        *r_foundstack,
-		        (*r_foundstack_tot_alloc += KD_FOUND_ALLOC_INC) * sizeof(KDTreeNode),
+		        (*r_foundstack_tot_alloc += KD_FOUND_ALLOC_INC) * sizeof(KDTreeNearest),
 		        __func__);
 	}
 
@@ -437,73 +458,33 @@ int BLI_kdtree_range_search__normal(
         KDTree *tree, const float co[3], const float nor[3],
         KDTreeNearest **r_nearest, float range)
 {
-	KDTreeNode *root, *node = NULL;
-	KDTreeNode **stack, *defaultstack[KD_STACK_INIT];
+	KDTreeRange stack[KD_STACK_SIZE];
 	KDTreeNearest *foundstack = NULL;
-	float range2 = range * range, dist2;
-	unsigned int totstack, cur = 0, found = 0, totfoundstack = 0;
+	/* subtrees are pushed when strictly closer than this, keep points at exactly range distance */
+	const float range2 = range * range, range2_push = nextafterf(range2, FLT_MAX);
+	unsigned int cur, found = 0, totfoundstack = 0;
 
 #ifdef DEBUG
 	BLI_assert(tree->is_balanced == true);
 #endif
 
-	if (UNLIKELY(!tree->root))
+	if (UNLIKELY(tree->totnode == 0))
 		return 0;
 
-	stack = defaultstack;
-	totstack = KD_STACK_INIT;
-
-	root = tree->root;
-
-	if (co[root->d] + range < root->co[root->d]) {
-		if (root->left)
-			stack[cur++] = root->left;
-	}
-	else if (co[root->d] - range > root->co[root->d]) {
-		if (root->right)
-			stack[cur++] = root->right;
-	}
-	else {
-		dist2 = squared_distance(root->co, co, nor);
-		if (dist2 <= range2)
-			add_in_range(&foundstack, &totfoundstack, found++, root->index, dist2, root->co);
-
-		if (root->left)
-			stack[cur++] = root->left;
-		if (root->right)
-			stack[cur++] = root->right;
-	}
+	kdtree_stack_init(tree, stack, &cur);
 
 	while (cur--) {
-		node = stack[cur];
+		const KDTreeRange subtree = stack[cur];
 
-		if (co[node->d] + range < node->co[node->d]) {
-			if (node->left)
-				stack[cur++] = node->left;
-		}
-		else if (co[node->d] - range > node->co[node->d]) {
-			if (node->right)
-				stack[cur++] = node->right;
-		}
-		else {
-			dist2 = squared_distance(node->co, co, nor);
+		KDTREE_WALK(tree, co, subtree, stack, cur, range2_push,
+		{
+			const float dist2 = squared_distance(node->co, co, nor);
 			if (dist2 <= range2)
 				add_in_range(&foundstack, &totfoundstack, found++, node->index, dist2, node->co);
-
-			if (node->left)
-				stack[cur++] = node->left;
-			if (node->right)
-				stack[cur++] = node->right;
-		}
-
-		if (UNLIKELY(cur + 3 > totstack)) {
-			stack = realloc_nodes(stack, &totstack, defaultstack != stack);
-		}
+		});
+		BLI_assert(cur < KD_STACK_SIZE);
 	}
 
-	if (stack != defaultstack)
-		MEM_freeN(stack);
-
 	if (found)
 		qsort(foundstack, found, sizeof(KDTreeNearest), range_compare);
 
@@ -511,3 +492,68 @@ int BLI_kdtree_range_search__normal(
 
 	return (int)found;
 }
+
+/* -------------------------------------------------------------------- */
+/* Batch Queries */
+
+typedef struct KDTreeBatchData {
+	KDTree *tree;
+	const float (*co)[3];
+	int *r_index;
+	KDTreeNearest *r_nearest;
+	int *r_found;
+	unsigned int n;
+} KDTreeBatchData;
+
+static void kdtree_find_nearest_batch_cb(void *userdata, int iter)
+{
+	KDTreeBatchData *data = userdata;
+	const int index = BLI_kdtree_find_nearest(data->tree, data->co[iter], data->r_nearest ? &data->r_nearest[iter] : NULL);
+
+	if (data->r_index) {
+		data->r_index[iter] = index;
+	}
+}
+
+static void kdtree_find_nearest_n_batch_cb(void *userdata, int iter)
+{
+	KDTreeBatchData *data = userdata;
+	const int found = BLI_kdtree_find_nearest_n(
+	        data->tree, data->co[iter], &data->r_nearest[(unsigned int)iter * data->n], data->n);
+
+	if (data->r_found) {
+		data->r_found[iter] = found;
+	}
+}
+
+/**
+ * Find the nearest point of each of the \a co_num points of \a co, using multiple threads.
+ *
+ * \param r_index  Optional array of \a co_num indices (-1 when the tree is empty).
+ * \param r_nearest  Optional array of \a co_num nearest.
+ */
+void BLI_kdtree_find_nearest_batch(
+        KDTree *tree, const float (*co)[3], unsigned int co_num,
+        int *r_index, KDTreeNearest *r_nearest)
+{
+	KDTreeBatchData data = {tree, co, r_index, r_nearest, NULL, 0};
+
+	BLI_task_parallel_range_ex(0, (int)co_num, &data, kdtree_find_nearest_batch_cb, KD_BATCH_THRESHOLD, false);
+}
+
+/**
+ * Find the \a n nearest points of each of the \a co_num points of \a co, using multiple threads.
+ *
+ * \param r_nearest  An array of nearest, sized at least \a co_num * \a n,
+ * results for co[i] start at r_nearest[i * n].
+ * \param r_found  Optional array of \a co_num number of points found.
+ */
+void BLI_kdtree_find_nearest_n_batch(
+        KDTree *tree, const float (*co)[3], unsigned int co_num,
+        KDTreeNearest *r_nearest, int *r_found,
+        unsigned int n)
+{
+	KDTreeBatchData data = {tree, co, NULL, r_nearest, r_found, n};
+
+	BLI_task_parallel_range_ex(0, (int)co_num, &data, kdtree_find_nearest_n_batch_cb, KD_BATCH_THRESHOLD, false);
+}
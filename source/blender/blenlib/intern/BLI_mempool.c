@@ -29,12 +29,24 @@
  *  \ingroup bli
  *
  * Simple, fast memory allocator for allocating many elements of the same size.
+ *
+ * Pools created with #BLI_MEMPOOL_THREADSAFE can be used from several threads at once:
+ * each thread allocates from and frees into its own free list (a "heap"), without any locking.
+ * Elements freed by another thread than the one which allocated them simply go to the freeing thread's heap,
+ * there is no lock-free queue handing them back to their owner.
+ * Heaps exchange elements with the pool by whole batches of a chunk worth of elements
+ * (a heap holding too many free elements moves a batch to the pool's locked list of free batches),
+ * only those exchanges (and new chunks) need to lock the pool.
  */
 
 #include <string.h>
 #include <stdlib.h>
+#include <sched.h>  /* sched_yield */
+
+#include "atomic_ops.h"
 
 #include "BLI_utildefines.h"
+#include "BLI_threads.h"
 
 #include "BLI_mempool.h" /* own include */
 
@@ -46,6 +58,10 @@
 #  include "valgrind/memcheck.h"
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>  /* _mm_pause */
+#endif
+
 /* note: copied from BLO_blend_defs.h, don't use here because we're in BLI */
 #ifdef __BIG_ENDIAN__
 /* Big Endian */
@@ -83,6 +99,34 @@ typedef struct BLI_freenode {
 	int freeword; /* used to identify this as a freed node */
 } BLI_freenode;
 
+/**
+ * A batch of free elements stored in #BLI_mempool.free_batches, for threadsafe pools only.
+ * The first element of the batch is also used to store the batch.
+ */
+typedef struct BLI_freebatch {
+	BLI_freenode node;
+	struct BLI_freebatch *next;
+	unsigned int len;
+} BLI_freebatch;
+
+/* Number of threads which can have their own heap in each pool, others share a single, locked one. */
+#define MEMPOOL_THREAD_HEAPS 64
+#define MEMPOOL_CACHELINE_SIZE 64
+
+/**
+ * Free list of a thread, for threadsafe pools only.
+ * Only ever accessed by the thread owning it, except for the shared heap.
+ */
+typedef union BLI_mempool_heap {
+	struct {
+		BLI_freenode *free;
+		unsigned int free_len;
+		/* elements allocated minus elements freed by this thread, may be negative */
+		int totused;
+	} h;
+	char _pad[MEMPOOL_CACHELINE_SIZE];
+} BLI_mempool_heap;
+
 /**
  * A chunk of memory in the mempool stored in
  * #BLI_mempool.chunks as a double linked list.
@@ -115,6 +159,12 @@ struct BLI_mempool {
 #ifdef USE_TOTALLOC
 	unsigned int totalloc;          /* number of elements allocated in total */
 #endif
+
+	/* threadsafe pools only (MEMPOOL_THREAD_HEAPS + 1 heaps, the last one being shared) */
+	BLI_mempool_heap *heaps;
+	BLI_freebatch *free_batches;
+	uint32_t lock;                  /* protects chunks, free and free_batches */
+	uint32_t heap_shared_lock;
 };
 
 #define MEMPOOL_ELEM_SIZE_MIN (sizeof(void *) * 2)
@@ -182,37 +232,16 @@ static BLI_mempool_chunk *mempool_chunk_alloc(BLI_mempool *pool)
 }
 
 /**
- * Initialize a chunk and add into \a pool->chunks
+ * Link all elements of \a mpchunk into a free list, starting at the chunk's data.
  *
- * \param pool  The pool to add the chunk into.
- * \param mpchunk  The new uninitialized chunk (can be malloc'd)
- * \param lasttail  The last element of the previous chunk
- * (used when building free chunks initially)
- * \return The last chunk,
+ * \return The last element of the chunk.
  */
-static BLI_freenode *mempool_chunk_add(BLI_mempool *pool, BLI_mempool_chunk *mpchunk,
-                                       BLI_freenode *lasttail)
+static BLI_freenode *mempool_chunk_init_nodes(BLI_mempool *pool, BLI_mempool_chunk *mpchunk)
 {
 	const unsigned int esize = pool->esize;
 	BLI_freenode *curnode = CHUNK_DATA(mpchunk);
 	unsigned int j;
 
-	/* append */
-	if (pool->chunk_tail) {
-		pool->chunk_tail->next = mpchunk;
-	}
-	else {
-		BLI_assert(pool->chunks == NULL);
-		pool->chunks = mpchunk;
-	}
-
-	mpchunk->next = NULL;
-	pool->chunk_tail = mpchunk;
-
-	if (UNLIKELY(pool->free == NULL)) {
-		pool->free = curnode;
-	}
-
 	/* loop through the allocated data, building the pointer structures */
 	j = pool->pchunk;
 	if (pool->flag & BLI_MEMPOOL_ALLOW_ITER) {
@@ -234,6 +263,45 @@ static BLI_freenode *mempool_chunk_add(BLI_mempool *pool, BLI_mempool_chunk *mpc
 	curnode = NODE_STEP_PREV(curnode);
 	curnode->next = NULL;
 
+	return curnode;
+}
+
+static void mempool_chunk_append(BLI_mempool *pool, BLI_mempool_chunk *mpchunk)
+{
+	if (pool->chunk_tail) {
+		pool->chunk_tail->next = mpchunk;
+	}
+	else {
+		BLI_assert(pool->chunks == NULL);
+		pool->chunks = mpchunk;
+	}
+
+	mpchunk->next = NULL;
+	pool->chunk_tail = mpchunk;
+}
+
+/**
+ * Initialize a chunk and add into \a pool->chunks
+ *
+ * \param pool  The pool to add the chunk into.
+ * \param mpchunk  The new uninitialized chunk (can be malloc'd)
+ * \param lasttail  The last element of the previous chunk
+ * (used when building free chunks initially)
+ * \return The last chunk,
+ */
+static BLI_freenode *mempool_chunk_add(BLI_mempool *pool, BLI_mempool_chunk *mpchunk,
+                                       BLI_freenode *lasttail)
+{
+	BLI_freenode *curnode;
+
+	mempool_chunk_append(pool, mpchunk);
+
+	if (UNLIKELY(pool->free == NULL)) {
+		pool->free = CHUNK_DATA(mpchunk);
+	}
+
+	curnode = mempool_chunk_init_nodes(pool, mpchunk);
+
 #ifdef USE_TOTALLOC
 	pool->totalloc += pool->pchunk;
 #endif
@@ -265,6 +333,232 @@ static void mempool_chunk_free_all(BLI_mempool_chunk *mpchunk)
 	}
 }
 
+/* -------------------------------------------------------------------- */
+/* Threadsafe Pools */
+
+/* Spins before yielding the CPU to a (possibly preempted) lock holder. */
+#define MEMPOOL_LOCK_SPIN_COUNT 64
+
+BLI_INLINE void mempool_cpu_pause(void)
+{
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	_mm_pause();
+#endif
+}
+
+/* Locks are only held for a few pointer swaps, spin on atomics
+ * (this file is also built into makesdna, without BLI_spin_lock). */
+static void mempool_lock(uint32_t *lock)
+{
+	while (atomic_cas_uint32(lock, 0, 1) != 0) {
+		unsigned int spin;
+		/* wait with plain loads, so waiting threads don't keep taking the cache line away from the holder */
+		for (spin = 0; *(volatile uint32_t *)lock != 0; spin++) {
+			if (spin < MEMPOOL_LOCK_SPIN_COUNT) {
+				mempool_cpu_pause();
+			}
+			else {
+				sched_yield();
+			}
+		}
+	}
+}
+
+BLI_INLINE void mempool_unlock(uint32_t *lock)
+{
+	atomic_cas_uint32(lock, 1, 0);
+}
+
+/* Each running thread claims its own slot, giving it its own heap in all threadsafe pools.
+ * Slots are released when threads exit, so they can be reused by later threads. */
+static pthread_key_t mempool_thread_key;
+static pthread_once_t mempool_thread_key_once = PTHREAD_ONCE_INIT;
+static uint32_t mempool_thread_slots[MEMPOOL_THREAD_HEAPS];
+
+static void mempool_thread_slot_release(void *slot_p)
+{
+	const unsigned int slot = GET_UINT_FROM_POINTER(slot_p) - 1;
+
+	if (slot < MEMPOOL_THREAD_HEAPS) {
+		atomic_cas_uint32(&mempool_thread_slots[slot], 1, 0);
+	}
+}
+
+static void mempool_thread_key_create(void)
+{
+	pthread_key_create(&mempool_thread_key, mempool_thread_slot_release);
+}
+
+/**
+ * \return the heap index of the calling thread, #MEMPOOL_THREAD_HEAPS for the shared heap.
+ */
+static unsigned int mempool_thread_heap_index(void)
+{
+	void *slot_p;
+	unsigned int slot;
+
+	pthread_once(&mempool_thread_key_once, mempool_thread_key_create);
+
+	slot_p = pthread_getspecific(mempool_thread_key);
+	if (LIKELY(slot_p)) {
+		return GET_UINT_FROM_POINTER(slot_p) - 1;
+	}
+
+	for (slot = 0; slot < MEMPOOL_THREAD_HEAPS; slot++) {
+		if (mempool_thread_slots[slot] == 0 && atomic_cas_uint32(&mempool_thread_slots[slot], 0, 1) == 0) {
+			break;
+		}
+	}
+
+	/* when all slots are taken, remember to use the shared heap */
+	pthread_setspecific(mempool_thread_key, SET_UINT_IN_POINTER(slot + 1));
+
+	return slot;
+}
+
+/**
+ * Give an empty heap a batch of free elements, from the pool or from a new chunk.
+ */
+static void mempool_heap_refill(BLI_mempool *pool, BLI_mempool_heap *heap)
+{
+	BLI_mempool_chunk *mpchunk;
+
+	BLI_assert(heap->h.free == NULL);
+
+	mempool_lock(&pool->lock);
+
+	if (pool->free_batches) {
+		BLI_freebatch *batch = pool->free_batches;
+		pool->free_batches = batch->next;
+		mempool_unlock(&pool->lock);
+
+		heap->h.free = &batch->node;
+		heap->h.free_len = batch->len;
+		return;
+	}
+	else if (pool->free) {
+		/* elements left by pool creation or clearing */
+		BLI_freenode *tail = pool->free;
+		unsigned int len = 1;
+
+		while (tail->next && len < pool->pchunk) {
+			tail = tail->next;
+			len++;
+		}
+
+		heap->h.free = pool->free;
+		heap->h.free_len = len;
+		pool->free = tail->next;
+		tail->next = NULL;
+
+		mempool_unlock(&pool->lock);
+		return;
+	}
+
+	mempool_unlock(&pool->lock);
+
+	/* only the chunk list needs the lock */
+	mpchunk = mempool_chunk_alloc(pool);
+	mempool_chunk_init_nodes(pool, mpchunk);
+
+	mempool_lock(&pool->lock);
+	mempool_chunk_append(pool, mpchunk);
+#ifdef USE_TOTALLOC
+	pool->totalloc += pool->pchunk;
+#endif
+	mempool_unlock(&pool->lock);
+
+	heap->h.free = CHUNK_DATA(mpchunk);
+	heap->h.free_len = pool->pchunk;
+}
+
+/**
+ * Give a batch of a chunk worth of elements back to the pool,
+ * so elements keep being reused when some threads mostly allocate and others mostly free.
+ */
+static void mempool_heap_release(BLI_mempool *pool, BLI_mempool_heap *heap)
+{
+	BLI_freebatch *batch = (BLI_freebatch *)heap->h.free;
+	BLI_freenode *tail = heap->h.free;
+	unsigned int len = pool->pchunk;
+
+	BLI_assert(heap->h.free_len > len);
+
+	while (--len) {
+		tail = tail->next;
+	}
+	heap->h.free = tail->next;
+	heap->h.free_len -= pool->pchunk;
+	tail->next = NULL;
+
+	batch->len = pool->pchunk;
+
+	mempool_lock(&pool->lock);
+	batch->next = pool->free_batches;
+	pool->free_batches = batch;
+	mempool_unlock(&pool->lock);
+}
+
+static void *mempool_alloc_threadsafe(BLI_mempool *pool)
+{
+	const unsigned int heap_index = mempool_thread_heap_index();
+	BLI_mempool_heap *heap = &pool->heaps[heap_index];
+	BLI_freenode *free_pop;
+
+	if (UNLIKELY(heap_index == MEMPOOL_THREAD_HEAPS)) {
+		mempool_lock(&pool->heap_shared_lock);
+	}
+
+	if (UNLIKELY(heap->h.free == NULL)) {
+		mempool_heap_refill(pool, heap);
+	}
+
+	free_pop = heap->h.free;
+
+	if (pool->flag & BLI_MEMPOOL_ALLOW_ITER) {
+		free_pop->freeword = USEDWORD;
+	}
+
+	heap->h.free = free_pop->next;
+	heap->h.free_len--;
+	heap->h.totused++;
+
+	if (UNLIKELY(heap_index == MEMPOOL_THREAD_HEAPS)) {
+		mempool_unlock(&pool->heap_shared_lock);
+	}
+
+	return free_pop;
+}
+
+static void mempool_free_threadsafe(BLI_mempool *pool, BLI_freenode *newhead)
+{
+	const unsigned int heap_index = mempool_thread_heap_index();
+	BLI_mempool_heap *heap = &pool->heaps[heap_index];
+
+	if (UNLIKELY(heap_index == MEMPOOL_THREAD_HEAPS)) {
+		mempool_lock(&pool->heap_shared_lock);
+	}
+
+	newhead->next = heap->h.free;
+	heap->h.free = newhead;
+	heap->h.free_len++;
+	heap->h.totused--;
+
+	if (UNLIKELY(heap->h.free_len > pool->pchunk * 2)) {
+		mempool_heap_release(pool, heap);
+	}
+
+	if (UNLIKELY(heap_index == MEMPOOL_THREAD_HEAPS)) {
+		mempool_unlock(&pool->heap_shared_lock);
+	}
+}
+
+static void mempool_heaps_clear(BLI_mempool *pool)
+{
+	memset(pool->heaps, 0, sizeof(*pool->heaps) * (MEMPOOL_THREAD_HEAPS + 1));
+	pool->free_batches = NULL;
+}
+
 BLI_mempool *BLI_mempool_create(unsigned int esize, unsigned int totelem,
                                 unsigned int pchunk, unsigned int flag)
 {
@@ -284,6 +578,10 @@ BLI_mempool *BLI_mempool_create(unsigned int esize, unsigned int totelem,
 		esize = MAX2(esize, (unsigned int)sizeof(BLI_freenode));
 	}
 
+	if (flag & BLI_MEMPOOL_THREADSAFE) {
+		esize = MAX2(esize, (unsigned int)sizeof(BLI_freebatch));
+	}
+
 	maxchunks = mempool_maxchunks(totelem, pchunk);
 
 	pool->chunks = NULL;
@@ -311,6 +609,18 @@ BLI_mempool *BLI_mempool_create(unsigned int esize, unsigned int totelem,
 #endif
 	pool->totused = 0;
 
+	if (flag & BLI_MEMPOOL_THREADSAFE) {
+		pool->heaps = MEM_mallocN_aligned(
+		        sizeof(*pool->heaps) * (MEMPOOL_THREAD_HEAPS + 1), MEMPOOL_CACHELINE_SIZE, "memory pool heaps");
+		mempool_heaps_clear(pool);
+		pool->lock = 0;
+		pool->heap_shared_lock = 0;
+	}
+	else {
+		pool->heaps = NULL;
+		pool->free_batches = NULL;
+	}
+
 	if (totelem) {
 		/* allocate the actual chunks */
 		for (i = 0; i < maxchunks; i++) {
@@ -330,6 +640,14 @@ void *BLI_mempool_alloc(BLI_mempool *pool)
 {
 	BLI_freenode *free_pop;
 
+	if (pool->flag & BLI_MEMPOOL_THREADSAFE) {
+		free_pop = mempool_alloc_threadsafe(pool);
+#ifdef WITH_MEM_VALGRIND
+		VALGRIND_MEMPOOL_ALLOC(pool, free_pop, pool->esize);
+#endif
+		return (void *)free_pop;
+	}
+
 	if (UNLIKELY(pool->free == NULL)) {
 		/* need to allocate a new chunk */
 		BLI_mempool_chunk *mpchunk = mempool_chunk_alloc(pool);
@@ -374,12 +692,18 @@ void BLI_mempool_free(BLI_mempool *pool, void *addr)
 	{
 		BLI_mempool_chunk *chunk;
 		bool found = false;
+		if (pool->flag & BLI_MEMPOOL_THREADSAFE) {
+			mempool_lock(&pool->lock);
+		}
 		for (chunk = pool->chunks; chunk; chunk = chunk->next) {
 			if (ARRAY_HAS_ITEM((char *)addr, (char *)CHUNK_DATA(chunk), pool->csize)) {
 				found = true;
 				break;
 			}
 		}
+		if (pool->flag & BLI_MEMPOOL_THREADSAFE) {
+			mempool_unlock(&pool->lock);
+		}
 		if (!found) {
 			BLI_assert(!"Attempt to free data which is not in pool.\n");
 		}
@@ -399,6 +723,14 @@ void BLI_mempool_free(BLI_mempool *pool, void *addr)
 		newhead->freeword = FREEWORD;
 	}
 
+	if (pool->flag & BLI_MEMPOOL_THREADSAFE) {
+		mempool_free_threadsafe(pool, newhead);
+#ifdef WITH_MEM_VALGRIND
+		VALGRIND_MEMPOOL_FREE(pool, addr);
+#endif
+		return;
+	}
+
 	newhead->next = pool->free;
 	pool->free = newhead;
 
@@ -448,8 +780,20 @@ void BLI_mempool_free(BLI_mempool *pool, void *addr)
 	}
 }
 
+/**
+ * \note For threadsafe pools, this is only exact when no other thread uses the pool meanwhile.
+ */
 int BLI_mempool_count(BLI_mempool *pool)
 {
+	if (pool->flag & BLI_MEMPOOL_THREADSAFE) {
+		int totused = 0;
+		unsigned int i;
+		for (i = 0; i <= MEMPOOL_THREAD_HEAPS; i++) {
+			totused += pool->heaps[i].h.totused;
+		}
+		return totused;
+	}
+
 	return (int)pool->totused;
 }
 
@@ -457,7 +801,7 @@ void *BLI_mempool_findelem(BLI_mempool *pool, unsigned int index)
 {
 	BLI_assert(pool->flag & BLI_MEMPOOL_ALLOW_ITER);
 
-	if (index < pool->totused) {
+	if (index < (unsigned int)BLI_mempool_count(pool)) {
 		/* we could have some faster mem chunk stepping code inline */
 		BLI_mempool_iter iter;
 		void *elem;
@@ -488,7 +832,7 @@ void BLI_mempool_as_table(BLI_mempool *pool, void **data)
 	while ((elem = BLI_mempool_iterstep(&iter))) {
 		*p++ = elem;
 	}
-	BLI_assert((unsigned int)(p - data) == pool->totused);
+	BLI_assert((int)(p - data) == BLI_mempool_count(pool));
 }
 
 /**
@@ -496,7 +840,7 @@ void BLI_mempool_as_table(BLI_mempool *pool, void **data)
  */
 void **BLI_mempool_as_tableN(BLI_mempool *pool, const char *allocstr)
 {
-	void **data = MEM_mallocN((size_t)pool->totused * sizeof(void *), allocstr);
+	void **data = MEM_mallocN((size_t)BLI_mempool_count(pool) * sizeof(void *), allocstr);
 	BLI_mempool_as_table(pool, data);
 	return data;
 }
@@ -515,7 +859,7 @@ void BLI_mempool_as_array(BLI_mempool *pool, void *data)
 		memcpy(p, elem, (size_t)esize);
 		p = NODE_STEP_NEXT(p);
 	}
-	BLI_assert((unsigned int)(p - (char *)data) == pool->totused * esize);
+	BLI_assert((unsigned int)(p - (char *)data) == (unsigned int)BLI_mempool_count(pool) * esize);
 }
 
 /**
@@ -523,7 +867,7 @@ void BLI_mempool_as_array(BLI_mempool *pool, void *data)
  */
 void *BLI_mempool_as_arrayN(BLI_mempool *pool, const char *allocstr)
 {
-	char *data = MEM_mallocN((size_t)(pool->totused * pool->esize), allocstr);
+	char *data = MEM_mallocN((size_t)BLI_mempool_count(pool) * (size_t)pool->esize, allocstr);
 	BLI_mempool_as_array(pool, data);
 	return data;
 }
@@ -538,6 +882,69 @@ void BLI_mempool_iternew(BLI_mempool *pool, BLI_mempool_iter *iter)
 	iter->pool = pool;
 	iter->curchunk = pool->chunks;
 	iter->curindex = 0;
+
+	iter->curchunk_threaded_shared = NULL;
+}
+
+/**
+ * Create an array of mempool iterators, \a BLI_MEMPOOL_ALLOW_ITER flag must be set.
+ *
+ * This is used in threaded code, where each task needs its own iterator.
+ * Each iterator starts on its own chunk, once exhausted it takes the next chunk nobody
+ * iterated over yet, only this step is shared between iterators (and done lock-free).
+ *
+ * \note The pool must not be modified while these iterators are in use.
+ */
+BLI_mempool_iter *BLI_mempool_iter_threadsafe_create(BLI_mempool *pool, const size_t num_iter)
+{
+	BLI_mempool_iter *iter_arr = MEM_mallocN(sizeof(*iter_arr) * num_iter, __func__);
+	BLI_mempool_chunk **curchunk_threaded_shared = MEM_mallocN(sizeof(void *), __func__);
+	BLI_mempool_chunk *chunk = pool->chunks;
+	size_t i;
+
+	BLI_assert(pool->flag & BLI_MEMPOOL_ALLOW_ITER);
+
+	for (i = 0; i < num_iter; i++) {
+		iter_arr[i].pool = pool;
+		iter_arr[i].curchunk = chunk;
+		iter_arr[i].curindex = 0;
+		iter_arr[i].curchunk_threaded_shared = curchunk_threaded_shared;
+
+		if (chunk) {
+			chunk = chunk->next;
+		}
+	}
+
+	*curchunk_threaded_shared = chunk;
+
+	return iter_arr;
+}
+
+void BLI_mempool_iter_threadsafe_free(BLI_mempool_iter *iter_arr)
+{
+	BLI_assert(iter_arr->curchunk_threaded_shared != NULL);
+
+	MEM_freeN(iter_arr->curchunk_threaded_shared);
+	MEM_freeN(iter_arr);
+}
+
+/**
+ * Advance the iterator to its next chunk,
+ * for threaded iterators this claims the next chunk not taken by any other iterator.
+ */
+BLI_INLINE void mempool_iter_chunk_next(BLI_mempool_iter *iter)
+{
+	if (iter->curchunk_threaded_shared) {
+		BLI_mempool_chunk *chunk;
+		do {
+			chunk = *(BLI_mempool_chunk * volatile *)iter->curchunk_threaded_shared;
+		} while (chunk &&
+		         atomic_cas_ptr((void **)iter->curchunk_threaded_shared, chunk, chunk->next) != chunk);
+		iter->curchunk = chunk;
+	}
+	else {
+		iter->curchunk = iter->curchunk->next;
+	}
 }
 
 #if 0
@@ -554,7 +961,7 @@ static void *bli_mempool_iternext(BLI_mempool_iter *iter)
 	iter->curindex++;
 
 	if (iter->curindex == iter->pool->pchunk) {
-		iter->curchunk = iter->curchunk->next;
+		mempool_iter_chunk_next(iter);
 		iter->curindex = 0;
 	}
 
@@ -593,7 +1000,7 @@ void *BLI_mempool_iterstep(BLI_mempool_iter *iter)
 
 		if (UNLIKELY(++iter->curindex == iter->pool->pchunk)) {
 			iter->curindex = 0;
-			iter->curchunk = iter->curchunk->next;
+			mempool_iter_chunk_next(iter);
 		}
 	} while (ret->freeword == FREEWORD);
 
@@ -646,6 +1053,9 @@ void BLI_mempool_clear_ex(BLI_mempool *pool, const int totelem_reserve)
 	/* re-initialize */
 	pool->free = NULL;
 	pool->totused = 0;
+	if (pool->flag & BLI_MEMPOOL_THREADSAFE) {
+		mempool_heaps_clear(pool);
+	}
 #ifdef USE_TOTALLOC
 	pool->totalloc = 0;
 #endif
@@ -675,6 +1085,10 @@ void BLI_mempool_destroy(BLI_mempool *pool)
 {
 	mempool_chunk_free_all(pool->chunks);
 
+	if (pool->flag & BLI_MEMPOOL_THREADSAFE) {
+		MEM_freeN(pool->heaps);
+	}
+
 #ifdef WITH_MEM_VALGRIND
 	VALGRIND_DESTROY_MEMPOOL(pool);
 #endif
@@ -0,0 +1,271 @@
+/*
+ * ***** BEGIN GPL LICENSE BLOCK *****
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * ***** END GPL LICENSE BLOCK *****
+ */
+
+/** \file blender/blenlib/intern/concurrent_ghash.c
+ *  \ingroup bli
+ *
+ * A (pointer -> pointer) hash table safe to read and write from several threads at once.
+ *
+ * Entries are spread over shards according to their hash, each shard being a regular #GHash
+ * protected by its own mutex. Threads only contend when they hit the same shard at the same time,
+ * which gets rare since there are several times more shards than threads.
+ * Shards are cache-line aligned, so their locks don't share cache lines either.
+ *
+ * \note Mutexes rather than spin locks, since a shard may get resized while locked,
+ * spinning on it is much worse than sleeping as soon as threads outnumber cores.
+ *
+ * Shard hashes use #GHASH_FLAG_OPEN_ADDRESSING, since no pointer to their content ever leaves the lock.
+ */
+
+#include "MEM_guardedalloc.h"
+
+#include "BLI_utildefines.h"
+#include "BLI_ghash.h"
+#include "BLI_threads.h"
+
+#include "BLI_concurrent_ghash.h"  /* own include */
+
+#include "BLI_strict_flags.h"
+
+#define CGHASH_CACHELINE_SIZE 64
+
+/* Number of shards per thread, and bounds of the total number of shards (powers of two). */
+#define CGHASH_SHARDS_PER_THREAD 8
+#define CGHASH_SHARDS_MIN 16
+#define CGHASH_SHARDS_MAX 1024
+
+typedef union ConcurrentGHashShard {
+	struct {
+		ThreadMutex lock;
+		GHash *ghash;
+	} s;
+	char _pad[CGHASH_CACHELINE_SIZE];
+} ConcurrentGHashShard;
+
+struct ConcurrentGHash {
+	GHashHashFP hashfp;
+
+	ConcurrentGHashShard *shards;
+	unsigned int nshards;
+	unsigned int shard_shift;
+};
+
+/**
+ * Pick the shard from the top bits of the hash (Fibonacci hashing),
+ * shard hashes use the low bits of the same hash, those should stay independent.
+ */
+BLI_INLINE ConcurrentGHashShard *cghash_shard_get(ConcurrentGHash *cgh, const void *key)
+{
+	const unsigned int hash = cgh->hashfp(key) * 2654435769u;
+	return &cgh->shards[hash >> cgh->shard_shift];
+}
+
+BLI_INLINE GHash *cghash_shard_lock(ConcurrentGHashShard *shard)
+{
+	BLI_mutex_lock(&shard->s.lock);
+	return shard->s.ghash;
+}
+
+BLI_INLINE void cghash_shard_unlock(ConcurrentGHashShard *shard)
+{
+	BLI_mutex_unlock(&shard->s.lock);
+}
+
+/**
+ * Creates a new, empty ConcurrentGHash.
+ *
+ * \param nentries_reserve  Optionally reserve the number of members that the hash will hold (in total).
+ */
+ConcurrentGHash *BLI_concurrent_ghash_new_ex(
+        GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info,
+        const unsigned int nentries_reserve)
+{
+	ConcurrentGHash *cgh = MEM_mallocN(sizeof(*cgh), info);
+	const unsigned int nshards_wanted = (unsigned int)BLI_system_thread_count() * CGHASH_SHARDS_PER_THREAD;
+	unsigned int shard_bits = 0;
+	unsigned int i;
+
+	while (((1u << shard_bits) < CGHASH_SHARDS_MIN) ||
+	       (((1u << shard_bits) < nshards_wanted) && ((1u << shard_bits) < CGHASH_SHARDS_MAX)))
+	{
+		shard_bits++;
+	}
+
+	cgh->hashfp = hashfp;
+	cgh->nshards = 1u << shard_bits;
+	cgh->shard_shift = 32 - shard_bits;
+	cgh->shards = MEM_mallocN_aligned(sizeof(*cgh->shards) * cgh->nshards, CGHASH_CACHELINE_SIZE, info);
+
+	for (i = 0; i < cgh->nshards; i++) {
+		BLI_mutex_init(&cgh->shards[i].s.lock);
+		cgh->shards[i].s.ghash = BLI_ghash_new_flag(
+		        hashfp, cmpfp, info, nentries_reserve / cgh->nshards, GHASH_FLAG_OPEN_ADDRESSING);
+	}
+
+	return cgh;
+}
+
+ConcurrentGHash *BLI_concurrent_ghash_new(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info)
+{
+	return BLI_concurrent_ghash_new_ex(hashfp, cmpfp, info, 0);
+}
+
+void BLI_concurrent_ghash_free(ConcurrentGHash *cgh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	unsigned int i;
+
+	for (i = 0; i < cgh->nshards; i++) {
+		BLI_ghash_free(cgh->shards[i].s.ghash, keyfreefp, valfreefp);
+		BLI_mutex_end(&cgh->shards[i].s.lock);
+	}
+
+	MEM_freeN(cgh->shards);
+	MEM_freeN(cgh);
+}
+
+/**
+ * Insert a key/value pair, the key must not already be in \a cgh (see #BLI_ghash_insert).
+ */
+void BLI_concurrent_ghash_insert(ConcurrentGHash *cgh, void *key, void *val)
+{
+	ConcurrentGHashShard *shard = cghash_shard_get(cgh, key);
+	BLI_ghash_insert(cghash_shard_lock(shard), key, val);
+	cghash_shard_unlock(shard);
+}
+
+/**
+ * Insert a key/value pair only if the key is not already in \a cgh.
+ * When several threads add the same key, exactly one of them succeeds.
+ *
+ * \returns true if the key has been added.
+ */
+bool BLI_concurrent_ghash_add(ConcurrentGHash *cgh, void *key, void *val)
+{
+	void *val_found;
+	return !BLI_concurrent_ghash_ensure(cgh, key, val, &val_found);
+}
+
+/**
+ * Insert a key/value pair, replacing existing one if any (see #BLI_ghash_reinsert).
+ * Free callbacks are called while the shard is locked.
+ *
+ * \returns true if a new key has been added.
+ */
+bool BLI_concurrent_ghash_reinsert(
+        ConcurrentGHash *cgh, void *key, void *val, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	ConcurrentGHashShard *shard = cghash_shard_get(cgh, key);
+	const bool added = BLI_ghash_reinsert(cghash_shard_lock(shard), key, val, keyfreefp, valfreefp);
+	cghash_shard_unlock(shard);
+	return added;
+}
+
+/**
+ * Ensure \a key is in \a cgh, adding it with \a val if not,
+ * in both cases \a r_val gets the value stored in \a cgh.
+ *
+ * This is the atomic version of a lookup followed by an insertion.
+ *
+ * \returns true when the key was already there.
+ */
+bool BLI_concurrent_ghash_ensure(ConcurrentGHash *cgh, void *key, void *val, void **r_val)
+{
+	ConcurrentGHashShard *shard = cghash_shard_get(cgh, key);
+	void **val_p;
+	bool haskey;
+
+	haskey = BLI_ghash_ensure_p(cghash_shard_lock(shard), key, &val_p);
+	if (!haskey) {
+		*val_p = val;
+	}
+	*r_val = *val_p;
+	cghash_shard_unlock(shard);
+
+	return haskey;
+}
+
+void *BLI_concurrent_ghash_lookup(ConcurrentGHash *cgh, const void *key)
+{
+	return BLI_concurrent_ghash_lookup_default(cgh, key, NULL);
+}
+
+void *BLI_concurrent_ghash_lookup_default(ConcurrentGHash *cgh, const void *key, void *val_default)
+{
+	ConcurrentGHashShard *shard = cghash_shard_get(cgh, key);
+	void *val = BLI_ghash_lookup_default(cghash_shard_lock(shard), key, val_default);
+	cghash_shard_unlock(shard);
+	return val;
+}
+
+bool BLI_concurrent_ghash_haskey(ConcurrentGHash *cgh, const void *key)
+{
+	ConcurrentGHashShard *shard = cghash_shard_get(cgh, key);
+	const bool haskey = BLI_ghash_haskey(cghash_shard_lock(shard), key);
+	cghash_shard_unlock(shard);
+	return haskey;
+}
+
+bool BLI_concurrent_ghash_remove(
+        ConcurrentGHash *cgh, void *key, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	ConcurrentGHashShard *shard = cghash_shard_get(cgh, key);
+	const bool removed = BLI_ghash_remove(cghash_shard_lock(shard), key, keyfreefp, valfreefp);
+	cghash_shard_unlock(shard);
+	return removed;
+}
+
+void *BLI_concurrent_ghash_popkey(ConcurrentGHash *cgh, void *key, GHashKeyFreeFP keyfreefp)
+{
+	ConcurrentGHashShard *shard = cghash_shard_get(cgh, key);
+	void *val = BLI_ghash_popkey(cghash_shard_lock(shard), key, keyfreefp);
+	cghash_shard_unlock(shard);
+	return val;
+}
+
+/**
+ * \return size of \a cgh, only exact when no other thread modifies it meanwhile.
+ */
+int BLI_concurrent_ghash_size(ConcurrentGHash *cgh)
+{
+	unsigned int i;
+	int size = 0;
+
+	for (i = 0; i < cgh->nshards; i++) {
+		size += BLI_ghash_size(cghash_shard_lock(&cgh->shards[i]));
+		cghash_shard_unlock(&cgh->shards[i]);
+	}
+
+	return size;
+}
+
+/**
+ * Call \a func for all entries, in no particular order.
+ */
+void BLI_concurrent_ghash_foreach(ConcurrentGHash *cgh, ConcurrentGHashForeachFP func, void *userdata)
+{
+	unsigned int i;
+
+	for (i = 0; i < cgh->nshards; i++) {
+		GHashIterator gh_iter;
+		GHASH_ITER (gh_iter, cgh->shards[i].s.ghash) {
+			func(BLI_ghashIterator_getKey(&gh_iter), BLI_ghashIterator_getValue(&gh_iter), userdata);
+		}
+	}
+}
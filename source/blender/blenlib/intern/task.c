@@ -22,19 +22,32 @@
  *  \ingroup bli
  *
  * A generic task system which can be used for any task based subsystem.
+ *
+ * Each thread owns a queue, tasks are pushed to the queue of the thread that
+ * creates them and are popped from there first. Threads running out of work
+ * steal tasks from the queues of other threads, picking a random victim so
+ * thieves spread over the queues. Queues are guarded by their own spin lock,
+ * which is almost never contended since only the owner and occasional
+ * thieves access it.
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "MEM_guardedalloc.h"
 
 #include "BLI_listbase.h"
 #include "BLI_math.h"
+#include "BLI_mempool.h"
 #include "BLI_task.h"
 #include "BLI_threads.h"
 
 #include "atomic_ops.h"
 
+/* Number of task nodes each thread keeps around for reuse,
+ * tasks freed past this are given back to the allocator. */
+#define TASK_FREELIST_MAX 512
+
 /* Types */
 
 typedef struct Task {
@@ -49,10 +62,12 @@ typedef struct Task {
 struct TaskPool {
 	TaskScheduler *scheduler;
 
-	volatile size_t num;
-	volatile size_t done;
+	size_t num;
+	size_t done;
 	size_t num_threads;
 	size_t currently_running_tasks;
+	/* number of threads sleeping in BLI_task_pool_work_and_wait() */
+	size_t num_waiting;
 	ThreadMutex num_mutex;
 	ThreadCondition num_cond;
 
@@ -62,88 +77,265 @@ struct TaskPool {
 	volatile bool do_cancel;
 };
 
+typedef struct TaskQueue {
+	ListBase tasks;
+	SpinLock lock;
+	/* modified under the lock, read without it to skip empty queues */
+	size_t num;
+} TaskQueue;
+
+typedef struct TaskThread {
+	TaskScheduler *scheduler;
+	int id;
+
+	TaskQueue queue;
+
+	/* recycled task nodes, only accessed by the owning thread */
+	Task *freelist;
+	int freelist_len;
+
+	unsigned int rng_state;
+
+	/* keep data of different threads on different cache lines */
+	char _pad[64];
+} TaskThread;
+
 struct TaskScheduler {
 	pthread_t *threads;
+	/* one per worker thread, the first one is used by the main thread and
+	 * by any thread which is not a worker of this scheduler */
 	struct TaskThread *task_threads;
 	int num_threads;
 
-	ListBase queue;
-	ThreadMutex queue_mutex;
-	ThreadCondition queue_cond;
+	pthread_key_t tls_key;
+
+	/* idle workers sleep here until new tasks are pushed */
+	ThreadMutex sleep_mutex;
+	ThreadCondition sleep_cond;
+	unsigned int sleep_epoch;
+	size_t num_sleeping;
 
 	volatile bool do_exit;
 };
 
-typedef struct TaskThread {
-	TaskScheduler *scheduler;
-	int id;
-} TaskThread;
-
 /* Task Scheduler */
 
-static void task_pool_num_decrease(TaskPool *pool, size_t done)
+static TaskThread *task_thread_local_get(TaskScheduler *scheduler)
 {
-	BLI_mutex_lock(&pool->num_mutex);
+	TaskThread *thread = pthread_getspecific(scheduler->tls_key);
 
-	BLI_assert(pool->num >= done);
+	if (thread == NULL && BLI_thread_is_main()) {
+		thread = &scheduler->task_threads[0];
+	}
 
-	pool->num -= done;
-	atomic_sub_z(&pool->currently_running_tasks, done);
-	pool->done += done;
+	return thread;
+}
 
-	if (pool->num == 0)
-		BLI_condition_notify_all(&pool->num_cond);
+BLI_INLINE unsigned int task_thread_rng_next(TaskThread *thread)
+{
+	unsigned int x = thread->rng_state;
 
-	BLI_mutex_unlock(&pool->num_mutex);
+	/* xorshift32 */
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	thread->rng_state = x;
+	return x;
 }
 
-static void task_pool_num_increase(TaskPool *pool)
+static Task *task_alloc(TaskThread *thread)
+{
+	if (thread && thread->freelist) {
+		Task *task = thread->freelist;
+		thread->freelist = task->next;
+		thread->freelist_len--;
+		return task;
+	}
+
+	return MEM_mallocN(sizeof(Task), "Task");
+}
+
+static void task_free(TaskThread *thread, Task *task)
+{
+	if (task->free_taskdata)
+		MEM_freeN(task->taskdata);
+
+	if (thread && thread->freelist_len < TASK_FREELIST_MAX) {
+		task->next = thread->freelist;
+		thread->freelist = task;
+		thread->freelist_len++;
+	}
+	else {
+		MEM_freeN(task);
+	}
+}
+
+static void task_pool_num_decrease(TaskPool *pool, size_t done)
 {
+	size_t num = pool->num;
+
+	atomic_add_z(&pool->done, done);
+
+	/* Lock-free path while other tasks remain, nobody needs to be woken up
+	 * then, unless the pool limits its threads and waiters could now run. */
+	if (pool->num_threads == 0) {
+		while (num > done) {
+			size_t num_prev = atomic_cas_z(&pool->num, num, num - done);
+			if (num_prev == num)
+				return;
+			num = num_prev;
+		}
+	}
+
+	/* Finishing the pool is done under the lock, the waiting thread may free
+	 * the pool as soon as it sees no tasks are left. */
 	BLI_mutex_lock(&pool->num_mutex);
 
-	pool->num++;
+	BLI_assert(pool->num >= done);
+
+	atomic_sub_z(&pool->num, done);
 	BLI_condition_notify_all(&pool->num_cond);
 
 	BLI_mutex_unlock(&pool->num_mutex);
 }
 
-static bool task_scheduler_thread_wait_pop(TaskScheduler *scheduler, Task **task)
+static bool task_pool_thread_acquire(TaskPool *pool)
 {
-	bool found_task = false;
-	BLI_mutex_lock(&scheduler->queue_mutex);
+	size_t num_running;
 
-	while (!scheduler->queue.first && !scheduler->do_exit)
-		BLI_condition_wait(&scheduler->queue_cond, &scheduler->queue_mutex);
+	if (pool->num_threads == 0)
+		return true;
 
-	do {
-		Task *current_task;
-		if (!scheduler->queue.first) {
-			BLI_mutex_unlock(&scheduler->queue_mutex);
-			BLI_assert(scheduler->do_exit);
-			return false;
-		}
-		for (current_task = scheduler->queue.first;
-		     current_task != NULL;
-		     current_task = current_task->next)
+	num_running = pool->currently_running_tasks;
+	while (num_running < pool->num_threads) {
+		size_t num_prev = atomic_cas_z(&pool->currently_running_tasks, num_running, num_running + 1);
+		if (num_prev == num_running)
+			return true;
+		num_running = num_prev;
+	}
+
+	return false;
+}
+
+static void task_scheduler_wake(TaskScheduler *scheduler, bool all)
+{
+	if (scheduler->num_sleeping == 0)
+		return;
+
+	BLI_mutex_lock(&scheduler->sleep_mutex);
+
+	scheduler->sleep_epoch++;
+	if (all)
+		BLI_condition_notify_all(&scheduler->sleep_cond);
+	else
+		BLI_condition_notify_one(&scheduler->sleep_cond);
+
+	BLI_mutex_unlock(&scheduler->sleep_mutex);
+}
+
+/* Pop the first task that is allowed to run, optionally only from the given pool. */
+static Task *task_queue_pop(TaskQueue *queue, TaskPool *pool)
+{
+	Task *task;
+
+	if (queue->num == 0)
+		return NULL;
+
+	BLI_spin_lock(&queue->lock);
+
+	for (task = queue->tasks.first; task; task = task->next) {
+		if ((pool == NULL || task->pool == pool) &&
+		    task_pool_thread_acquire(task->pool))
 		{
-			TaskPool *pool = current_task->pool;
-			if (pool->num_threads == 0 ||
-			    pool->currently_running_tasks < pool->num_threads)
-			{
-				*task = current_task;
-				found_task = true;
-				atomic_add_z(&pool->currently_running_tasks, 1);
-				BLI_remlink(&scheduler->queue, *task);
-				break;
-			}
+			BLI_remlink(&queue->tasks, task);
+			atomic_sub_z(&queue->num, 1);
+			break;
 		}
-		if (!found_task)
-			BLI_condition_wait(&scheduler->queue_cond, &scheduler->queue_mutex);
-	} while (!found_task);
+	}
+
+	BLI_spin_unlock(&queue->lock);
+
+	return task;
+}
+
+static Task *task_scheduler_pop(TaskScheduler *scheduler, TaskThread *thread, TaskPool *pool)
+{
+	const int num_queues = scheduler->num_threads + 1;
+	TaskThread *own_thread = thread ? thread : &scheduler->task_threads[0];
+	Task *task;
+	int i, victim;
+
+	/* own queue first, most likely to be in cache */
+	task = task_queue_pop(&own_thread->queue, pool);
+	if (task)
+		return task;
+
+	/* steal from others */
+	victim = thread ? (int)(task_thread_rng_next(thread) % (unsigned int)num_queues) : 0;
+	for (i = 0; i < num_queues; i++) {
+		TaskThread *other_thread = &scheduler->task_threads[victim];
+
+		if (other_thread != own_thread) {
+			task = task_queue_pop(&other_thread->queue, pool);
+			if (task)
+				return task;
+		}
+
+		victim = (victim + 1) % num_queues;
+	}
+
+	return NULL;
+}
+
+static void task_scheduler_push(TaskScheduler *scheduler, TaskThread *thread, Task *task, TaskPriority priority)
+{
+	TaskPool *pool = task->pool;
+	TaskQueue *queue = thread ? &thread->queue : &scheduler->task_threads[0].queue;
+
+	atomic_add_z(&pool->num, 1);
+
+	/* add task to queue */
+	BLI_spin_lock(&queue->lock);
+
+	if (priority == TASK_PRIORITY_HIGH)
+		BLI_addhead(&queue->tasks, task);
+	else
+		BLI_addtail(&queue->tasks, task);
+
+	/* atomic so the task is visible before checking for sleeping threads */
+	atomic_add_z(&queue->num, 1);
 
-	BLI_mutex_unlock(&scheduler->queue_mutex);
+	BLI_spin_unlock(&queue->lock);
 
-	return true;
+	if (pool->num_waiting != 0) {
+		BLI_mutex_lock(&pool->num_mutex);
+		BLI_condition_notify_all(&pool->num_cond);
+		BLI_mutex_unlock(&pool->num_mutex);
+	}
+
+	task_scheduler_wake(scheduler, false);
+}
+
+static void task_scheduler_run(TaskScheduler *scheduler, TaskThread *thread, Task *task, int thread_id)
+{
+	TaskPool *pool = task->pool;
+	const bool is_limited = (pool->num_threads != 0);
+
+	/* run task */
+	task->run(pool, task->taskdata, thread_id);
+
+	/* delete task */
+	task_free(thread, task);
+
+	/* notify pool task was done, it may be freed once this returns */
+	if (is_limited)
+		atomic_sub_z(&pool->currently_running_tasks, 1);
+	task_pool_num_decrease(pool, 1);
+
+	/* tasks which were held back by the thread limit can run now */
+	if (is_limited)
+		task_scheduler_wake(scheduler, true);
 }
 
 static void *task_scheduler_thread_run(void *thread_p)
@@ -151,22 +343,36 @@ static void *task_scheduler_thread_run(void *thread_p)
 	TaskThread *thread = (TaskThread *) thread_p;
 	TaskScheduler *scheduler = thread->scheduler;
 	int thread_id = thread->id;
-	Task *task;
+
+	pthread_setspecific(scheduler->tls_key, thread);
 
 	/* keep popping off tasks */
-	while (task_scheduler_thread_wait_pop(scheduler, &task)) {
-		TaskPool *pool = task->pool;
+	while (!scheduler->do_exit) {
+		Task *task = task_scheduler_pop(scheduler, thread, NULL);
+
+		if (task == NULL) {
+			unsigned int sleep_epoch;
+
+			/* Count ourselves as sleeping before looking once more, so a task
+			 * pushed after that look is guaranteed to wake us up. */
+			atomic_add_z(&scheduler->num_sleeping, 1);
+			sleep_epoch = scheduler->sleep_epoch;
+
+			task = task_scheduler_pop(scheduler, thread, NULL);
+			if (task == NULL) {
+				BLI_mutex_lock(&scheduler->sleep_mutex);
+				while (scheduler->sleep_epoch == sleep_epoch && !scheduler->do_exit)
+					BLI_condition_wait(&scheduler->sleep_cond, &scheduler->sleep_mutex);
+				BLI_mutex_unlock(&scheduler->sleep_mutex);
+			}
 
-		/* run task */
-		task->run(pool, task->taskdata, thread_id);
+			atomic_sub_z(&scheduler->num_sleeping, 1);
 
-		/* delete task */
-		if (task->free_taskdata)
-			MEM_freeN(task->taskdata);
-		MEM_freeN(task);
+			if (task == NULL)
+				continue;
+		}
 
-		/* notify pool task was done */
-		task_pool_num_decrease(pool, 1);
+		task_scheduler_run(scheduler, thread, task, thread_id);
 	}
 
 	return NULL;
@@ -175,14 +381,16 @@ static void *task_scheduler_thread_run(void *thread_p)
 TaskScheduler *BLI_task_scheduler_create(int num_threads)
 {
 	TaskScheduler *scheduler = MEM_callocN(sizeof(TaskScheduler), "TaskScheduler");
+	int i;
 
 	/* multiple places can use this task scheduler, sharing the same
 	 * threads, so we keep track of the number of users. */
 	scheduler->do_exit = false;
 
-	BLI_listbase_clear(&scheduler->queue);
-	BLI_mutex_init(&scheduler->queue_mutex);
-	BLI_condition_init(&scheduler->queue_cond);
+	BLI_mutex_init(&scheduler->sleep_mutex);
+	BLI_condition_init(&scheduler->sleep_cond);
+
+	pthread_key_create(&scheduler->tls_key, NULL);
 
 	if (num_threads == 0) {
 		/* automatic number of threads will be main thread + num cores */
@@ -191,23 +399,33 @@ TaskScheduler *BLI_task_scheduler_create(int num_threads)
 
 	/* main thread will also work, so we count it too */
 	num_threads -= 1;
-
-	/* launch threads that will be waiting for work */
 	if (num_threads > 0) {
-		int i;
-
 		scheduler->num_threads = num_threads;
+	}
+
+	/* per-thread data, including the main thread */
+	scheduler->task_threads = MEM_callocN(sizeof(TaskThread) * (scheduler->num_threads + 1),
+	                                      "TaskScheduler task threads");
+
+	for (i = 0; i < scheduler->num_threads + 1; i++) {
+		TaskThread *thread = &scheduler->task_threads[i];
+		thread->scheduler = scheduler;
+		thread->id = i;
+		thread->rng_state = ((unsigned int)i + 1) * 2654435761u;
+
+		BLI_listbase_clear(&thread->queue.tasks);
+		BLI_spin_init(&thread->queue.lock);
+	}
+
+	/* launch threads that will be waiting for work */
+	if (scheduler->num_threads > 0) {
 		scheduler->threads = MEM_callocN(sizeof(pthread_t) * num_threads, "TaskScheduler threads");
-		scheduler->task_threads = MEM_callocN(sizeof(TaskThread) * num_threads, "TaskScheduler task threads");
 
 		for (i = 0; i < num_threads; i++) {
-			TaskThread *thread = &scheduler->task_threads[i];
-			thread->scheduler = scheduler;
-			thread->id = i + 1;
+			TaskThread *thread = &scheduler->task_threads[i + 1];
 
 			if (pthread_create(&scheduler->threads[i], NULL, task_scheduler_thread_run, thread) != 0) {
 				fprintf(stderr, "TaskScheduler failed to launch thread %d/%d\n", i, num_threads);
-				MEM_freeN(thread);
 			}
 		}
 	}
@@ -217,18 +435,17 @@ TaskScheduler *BLI_task_scheduler_create(int num_threads)
 
 void BLI_task_scheduler_free(TaskScheduler *scheduler)
 {
-	Task *task;
+	int i;
 
 	/* stop all waiting threads */
-	BLI_mutex_lock(&scheduler->queue_mutex);
+	BLI_mutex_lock(&scheduler->sleep_mutex);
 	scheduler->do_exit = true;
-	BLI_condition_notify_all(&scheduler->queue_cond);
-	BLI_mutex_unlock(&scheduler->queue_mutex);
+	scheduler->sleep_epoch++;
+	BLI_condition_notify_all(&scheduler->sleep_cond);
+	BLI_mutex_unlock(&scheduler->sleep_mutex);
 
 	/* delete threads */
 	if (scheduler->threads) {
-		int i;
-
 		for (i = 0; i < scheduler->num_threads; i++) {
 			if (pthread_join(scheduler->threads[i], NULL) != 0)
 				fprintf(stderr, "TaskScheduler failed to join thread %d/%d\n", i, scheduler->num_threads);
@@ -237,21 +454,32 @@ void BLI_task_scheduler_free(TaskScheduler *scheduler)
 		MEM_freeN(scheduler->threads);
 	}
 
-	/* Delete task thread data */
-	if (scheduler->task_threads) {
-		MEM_freeN(scheduler->task_threads);
-	}
+	/* delete leftover tasks and recycled task nodes */
+	for (i = 0; i < scheduler->num_threads + 1; i++) {
+		TaskThread *thread = &scheduler->task_threads[i];
+		Task *task, *nexttask;
+
+		for (task = thread->queue.tasks.first; task; task = task->next) {
+			if (task->free_taskdata)
+				MEM_freeN(task->taskdata);
+		}
+		BLI_freelistN(&thread->queue.tasks);
+		BLI_spin_end(&thread->queue.lock);
 
-	/* delete leftover tasks */
-	for (task = scheduler->queue.first; task; task = task->next) {
-		if (task->free_taskdata)
-			MEM_freeN(task->taskdata);
+		for (task = thread->freelist; task; task = nexttask) {
+			nexttask = task->next;
+			MEM_freeN(task);
+		}
 	}
-	BLI_freelistN(&scheduler->queue);
+
+	/* Delete task thread data */
+	MEM_freeN(scheduler->task_threads);
+
+	pthread_key_delete(scheduler->tls_key);
 
 	/* delete mutex/condition */
-	BLI_mutex_end(&scheduler->queue_mutex);
-	BLI_condition_end(&scheduler->queue_cond);
+	BLI_mutex_end(&scheduler->sleep_mutex);
+	BLI_condition_end(&scheduler->sleep_cond);
 
 	MEM_freeN(scheduler);
 }
@@ -261,46 +489,37 @@ int BLI_task_scheduler_num_threads(TaskScheduler *scheduler)
 	return scheduler->num_threads + 1;
 }
 
-static void task_scheduler_push(TaskScheduler *scheduler, Task *task, TaskPriority priority)
-{
-	task_pool_num_increase(task->pool);
-
-	/* add task to queue */
-	BLI_mutex_lock(&scheduler->queue_mutex);
-
-	if (priority == TASK_PRIORITY_HIGH)
-		BLI_addhead(&scheduler->queue, task);
-	else
-		BLI_addtail(&scheduler->queue, task);
-
-	BLI_condition_notify_one(&scheduler->queue_cond);
-	BLI_mutex_unlock(&scheduler->queue_mutex);
-}
-
 static void task_scheduler_clear(TaskScheduler *scheduler, TaskPool *pool)
 {
-	Task *task, *nexttask;
 	size_t done = 0;
+	int i;
 
-	BLI_mutex_lock(&scheduler->queue_mutex);
+	/* free all tasks from this pool from the queues */
+	for (i = 0; i < scheduler->num_threads + 1; i++) {
+		TaskQueue *queue = &scheduler->task_threads[i].queue;
+		Task *task, *nexttask;
 
-	/* free all tasks from this pool from the queue */
-	for (task = scheduler->queue.first; task; task = nexttask) {
-		nexttask = task->next;
+		BLI_spin_lock(&queue->lock);
 
-		if (task->pool == pool) {
-			if (task->free_taskdata)
-				MEM_freeN(task->taskdata);
-			BLI_freelinkN(&scheduler->queue, task);
+		for (task = queue->tasks.first; task; task = nexttask) {
+			nexttask = task->next;
 
-			done++;
+			if (task->pool == pool) {
+				if (task->free_taskdata)
+					MEM_freeN(task->taskdata);
+				BLI_freelinkN(&queue->tasks, task);
+				atomic_sub_z(&queue->num, 1);
+
+				done++;
+			}
 		}
-	}
 
-	BLI_mutex_unlock(&scheduler->queue_mutex);
+		BLI_spin_unlock(&queue->lock);
+	}
 
 	/* notify done */
-	task_pool_num_decrease(pool, done);
+	if (done)
+		task_pool_num_decrease(pool, done);
 }
 
 /* Task Pool */
@@ -313,6 +532,7 @@ TaskPool *BLI_task_pool_create(TaskScheduler *scheduler, void *userdata)
 	pool->num = 0;
 	pool->num_threads = 0;
 	pool->currently_running_tasks = 0;
+	pool->num_waiting = 0;
 	pool->do_cancel = false;
 
 	BLI_mutex_init(&pool->num_mutex);
@@ -349,71 +569,53 @@ void BLI_task_pool_free(TaskPool *pool)
 void BLI_task_pool_push(TaskPool *pool, TaskRunFunction run,
 	void *taskdata, bool free_taskdata, TaskPriority priority)
 {
-	Task *task = MEM_callocN(sizeof(Task), "Task");
+	TaskThread *thread = task_thread_local_get(pool->scheduler);
+	Task *task = task_alloc(thread);
 
 	task->run = run;
 	task->taskdata = taskdata;
 	task->free_taskdata = free_taskdata;
 	task->pool = pool;
 
-	task_scheduler_push(pool->scheduler, task, priority);
+	task_scheduler_push(pool->scheduler, thread, task, priority);
 }
 
 void BLI_task_pool_work_and_wait(TaskPool *pool)
 {
 	TaskScheduler *scheduler = pool->scheduler;
-
-	BLI_mutex_lock(&pool->num_mutex);
+	TaskThread *thread = task_thread_local_get(scheduler);
+	const int thread_id = thread ? thread->id : 0;
 
 	while (pool->num != 0) {
-		Task *task, *work_task = NULL;
-		bool found_task = false;
-
-		BLI_mutex_unlock(&pool->num_mutex);
-
-		BLI_mutex_lock(&scheduler->queue_mutex);
-
-		/* find task from this pool. if we get a task from another pool,
-		 * we can get into deadlock */
-
-		if (pool->num_threads == 0 ||
-		    pool->currently_running_tasks < pool->num_threads)
-		{
-			for (task = scheduler->queue.first; task; task = task->next) {
-				if (task->pool == pool) {
-					work_task = task;
-					found_task = true;
-					BLI_remlink(&scheduler->queue, task);
-					break;
-				}
+		/* only take tasks from this pool, running a task from
+		 * another pool here could get us into a deadlock */
+		Task *task = task_scheduler_pop(scheduler, thread, pool);
+
+		if (task == NULL) {
+			/* Nothing to pick up, wait until tasks get pushed or done.
+			 * Pushing threads check num_waiting after queuing their task,
+			 * so look once more after increasing it. */
+			BLI_mutex_lock(&pool->num_mutex);
+			atomic_add_z(&pool->num_waiting, 1);
+
+			if (pool->num != 0) {
+				task = task_scheduler_pop(scheduler, thread, pool);
+				if (task == NULL)
+					BLI_condition_wait(&pool->num_cond, &pool->num_mutex);
 			}
-		}
-
-		BLI_mutex_unlock(&scheduler->queue_mutex);
-
-		/* if found task, do it, otherwise wait until other tasks are done */
-		if (found_task) {
-			/* run task */
-			atomic_add_z(&pool->currently_running_tasks, 1);
-			work_task->run(pool, work_task->taskdata, 0);
-
-			/* delete task */
-			if (work_task->free_taskdata)
-				MEM_freeN(work_task->taskdata);
-			MEM_freeN(work_task);
 
-			/* notify pool task was done */
-			task_pool_num_decrease(pool, 1);
+			atomic_sub_z(&pool->num_waiting, 1);
+			BLI_mutex_unlock(&pool->num_mutex);
 		}
 
-		BLI_mutex_lock(&pool->num_mutex);
-		if (pool->num == 0)
-			break;
-
-		if (!found_task)
-			BLI_condition_wait(&pool->num_cond, &pool->num_mutex);
+		if (task) {
+			task_scheduler_run(scheduler, thread, task, thread_id);
+		}
 	}
 
+	/* the last task decreases the count under the lock,
+	 * make sure it is released before the pool can be freed */
+	BLI_mutex_lock(&pool->num_mutex);
 	BLI_mutex_unlock(&pool->num_mutex);
 }
 
@@ -471,22 +673,36 @@ size_t BLI_task_pool_tasks_done(TaskPool *pool)
  *
  * Main functions:
  * - #BLI_task_parallel_range
+ * - #BLI_task_parallel_range_reduce (with per-task userdata copies, reduced in a final step)
+ * - #BLI_task_parallel_range_chunk (callback gets whole blocks of iterations)
+ * - #BLI_task_parallel_listbase (#ListBase - double linked list)
+ * - #BLI_task_parallel_mempool (#BLI_mempool - iterate over mempools)
  *
  * TODO:
- * - #BLI_task_parallel_foreach_listbase (#ListBase - double linked list)
  * - #BLI_task_parallel_foreach_link (#Link - single linked list)
  * - #BLI_task_parallel_foreach_ghash/gset (#GHash/#GSet - hash & set)
- * - #BLI_task_parallel_foreach_mempool (#BLI_mempool - iterate over mempools)
  *
  * Possible improvements:
  *
  * - Chunk iterations to reduce number of spin locks.
  */
 
+/* Size of each per-task copy of userdata_chunk is rounded up to this,
+ * so tasks don't write to the same cache lines. */
+#define PARALLEL_RANGE_CHUNK_ALIGN 64
+
 typedef struct ParallelRangeState {
 	int start, stop;
 	void *userdata;
+
+	/* only one of those is set */
 	TaskParallelRangeFunc func;
+	TaskParallelRangeReduceFunc func_reduce;
+	TaskParallelRangeChunkFunc func_chunk;
+
+	/* one copy of userdata_chunk for each task, may be NULL */
+	char *userdata_chunks;
+	size_t userdata_chunk_stride;
 
 	int iter;
 	int chunk_size;
@@ -513,23 +729,44 @@ BLI_INLINE bool parallel_range_next_iter_get(
 
 static void parallel_range_func(
         TaskPool * __restrict pool,
-        void *UNUSED(taskdata),
+        void *taskdata,
         int UNUSED(threadid))
 {
 	ParallelRangeState * __restrict state = BLI_task_pool_userdata(pool);
+	void *userdata_chunk = NULL;
 	int iter, count;
+
+	if (state->userdata_chunks) {
+		userdata_chunk = state->userdata_chunks + state->userdata_chunk_stride * (size_t)GET_INT_FROM_POINTER(taskdata);
+	}
+
 	while (parallel_range_next_iter_get(state, &iter, &count)) {
 		int i;
-		for (i = 0; i < count; ++i) {
-			state->func(state->userdata, iter + i);
+		if (state->func_chunk) {
+			state->func_chunk(state->userdata, userdata_chunk, iter, iter + count);
+		}
+		else if (state->func_reduce) {
+			for (i = 0; i < count; ++i) {
+				state->func_reduce(state->userdata, userdata_chunk, iter + i);
+			}
+		}
+		else {
+			for (i = 0; i < count; ++i) {
+				state->func(state->userdata, iter + i);
+			}
 		}
 	}
 }
 
-void BLI_task_parallel_range_ex(
+static void task_parallel_range_do(
         int start, int stop,
         void *userdata,
+        void *userdata_chunk,
+        const size_t userdata_chunk_size,
         TaskParallelRangeFunc func,
+        TaskParallelRangeReduceFunc func_reduce,
+        TaskParallelRangeChunkFunc func_chunk,
+        TaskParallelRangeFinalizeFunc func_finalize,
         const int range_threshold,
         const bool use_dynamic_scheduling)
 {
@@ -539,13 +776,27 @@ void BLI_task_parallel_range_ex(
 	int i, num_threads, num_tasks;
 
 	BLI_assert(start < stop);
+	BLI_assert((userdata_chunk != NULL) == (userdata_chunk_size != 0));
 
 	/* If it's not enough data to be crunched, don't bother with tasks at all,
 	 * do everything from the main thread.
 	 */
 	if (stop - start < range_threshold) {
-		for (i = start; i < stop; ++i) {
-			func(userdata, i);
+		if (func_chunk) {
+			func_chunk(userdata, userdata_chunk, start, stop);
+		}
+		else if (func_reduce) {
+			for (i = start; i < stop; ++i) {
+				func_reduce(userdata, userdata_chunk, i);
+			}
+		}
+		else {
+			for (i = start; i < stop; ++i) {
+				func(userdata, i);
+			}
+		}
+		if (func_finalize) {
+			func_finalize(userdata, userdata_chunk);
 		}
 		return;
 	}
@@ -565,18 +816,34 @@ void BLI_task_parallel_range_ex(
 	state.stop = stop;
 	state.userdata = userdata;
 	state.func = func;
+	state.func_reduce = func_reduce;
+	state.func_chunk = func_chunk;
 	state.iter = start;
 	if (use_dynamic_scheduling) {
 		state.chunk_size = 32;
 	}
 	else {
-		state.chunk_size = (stop - start) / (num_tasks);
+		state.chunk_size = max_ii(1, (stop - start) / (num_tasks));
+	}
+
+	if (userdata_chunk) {
+		state.userdata_chunk_stride =
+		        (userdata_chunk_size + PARALLEL_RANGE_CHUNK_ALIGN - 1) & ~((size_t)PARALLEL_RANGE_CHUNK_ALIGN - 1);
+		state.userdata_chunks = MEM_mallocN_aligned(state.userdata_chunk_stride * (size_t)num_tasks,
+		                                            PARALLEL_RANGE_CHUNK_ALIGN, "parallel range userdata chunks");
+		for (i = 0; i < num_tasks; i++) {
+			memcpy(state.userdata_chunks + state.userdata_chunk_stride * (size_t)i, userdata_chunk, userdata_chunk_size);
+		}
+	}
+	else {
+		state.userdata_chunk_stride = 0;
+		state.userdata_chunks = NULL;
 	}
 
 	for (i = 0; i < num_tasks; i++) {
 		BLI_task_pool_push(task_pool,
 		                   parallel_range_func,
-		                   NULL, false,
+		                   SET_INT_IN_POINTER(i), false,
 		                   TASK_PRIORITY_HIGH);
 	}
 
@@ -584,6 +851,29 @@ void BLI_task_parallel_range_ex(
 	BLI_task_pool_free(task_pool);
 
 	BLI_spin_end(&state.lock);
+
+	/* reduce from the calling thread, so no locking is needed */
+	if (func_finalize) {
+		for (i = 0; i < num_tasks; i++) {
+			func_finalize(userdata, state.userdata_chunks ?
+			              state.userdata_chunks + state.userdata_chunk_stride * (size_t)i : NULL);
+		}
+	}
+
+	if (state.userdata_chunks) {
+		MEM_freeN(state.userdata_chunks);
+	}
+}
+
+void BLI_task_parallel_range_ex(
+        int start, int stop,
+        void *userdata,
+        TaskParallelRangeFunc func,
+        const int range_threshold,
+        const bool use_dynamic_scheduling)
+{
+	task_parallel_range_do(start, stop, userdata, NULL, 0, func, NULL, NULL, NULL,
+	                       range_threshold, use_dynamic_scheduling);
 }
 
 void BLI_task_parallel_range(
@@ -593,3 +883,251 @@ void BLI_task_parallel_range(
 {
 	BLI_task_parallel_range_ex(start, stop, userdata, func, 64, false);
 }
+
+/**
+ * Like #BLI_task_parallel_range_ex, but each task works on its own copy of \a userdata_chunk,
+ * which \a func_finalize then gets one by one from the calling thread once all iterations are done.
+ * This allows reductions (sums, bounds...) without any locking or atomics.
+ *
+ * \note When the range is below \a range_threshold, \a userdata_chunk itself is used (and modified).
+ */
+void BLI_task_parallel_range_reduce(
+        int start, int stop,
+        void *userdata,
+        void *userdata_chunk,
+        const size_t userdata_chunk_size,
+        TaskParallelRangeReduceFunc func,
+        TaskParallelRangeFinalizeFunc func_finalize,
+        const int range_threshold,
+        const bool use_dynamic_scheduling)
+{
+	task_parallel_range_do(start, stop, userdata, userdata_chunk, userdata_chunk_size,
+	                       NULL, func, NULL, func_finalize,
+	                       range_threshold, use_dynamic_scheduling);
+}
+
+/**
+ * Same as #BLI_task_parallel_range_reduce, but \a func is called for blocks of iterations
+ * [iter_start, iter_stop), so its inner loop can be optimized (vectorized...) by the compiler.
+ * \a userdata_chunk and \a func_finalize are optional here.
+ */
+void BLI_task_parallel_range_chunk(
+        int start, int stop,
+        void *userdata,
+        void *userdata_chunk,
+        const size_t userdata_chunk_size,
+        TaskParallelRangeChunkFunc func,
+        TaskParallelRangeFinalizeFunc func_finalize,
+        const int range_threshold,
+        const bool use_dynamic_scheduling)
+{
+	task_parallel_range_do(start, stop, userdata, userdata_chunk, userdata_chunk_size,
+	                       NULL, NULL, func, func_finalize,
+	                       range_threshold, use_dynamic_scheduling);
+}
+
+
+/* Number of links each task takes from the list at once. */
+#define PARALLEL_LISTBASE_CHUNK_SIZE 32
+
+typedef struct ParallelListState {
+	void *userdata;
+	TaskParallelListbaseFunc func;
+
+	int index;
+	Link *link;
+	SpinLock lock;
+} ParallelListState;
+
+BLI_INLINE Link *parallel_listbase_next_iter_get(
+        ParallelListState * __restrict state,
+        int * __restrict index,
+        int * __restrict count)
+{
+	int task_count = 0;
+	Link *result;
+
+	BLI_spin_lock(&state->lock);
+	result = state->link;
+	if (LIKELY(result != NULL)) {
+		*index = state->index;
+		while (state->link != NULL && task_count < PARALLEL_LISTBASE_CHUNK_SIZE) {
+			task_count++;
+			state->link = state->link->next;
+		}
+		state->index += task_count;
+	}
+	BLI_spin_unlock(&state->lock);
+	*count = task_count;
+	return result;
+}
+
+static void parallel_listbase_func(
+        TaskPool * __restrict pool,
+        void *UNUSED(taskdata),
+        int UNUSED(threadid))
+{
+	ParallelListState * __restrict state = BLI_task_pool_userdata(pool);
+	Link *link;
+	int index, count;
+
+	while ((link = parallel_listbase_next_iter_get(state, &index, &count)) != NULL) {
+		int i;
+		for (i = 0; i < count; i++) {
+			state->func(state->userdata, link, index + i);
+			link = link->next;
+		}
+	}
+}
+
+/**
+ * This function allows to parallelize for loops over ListBase items.
+ *
+ * \param listbase The double linked list to loop over.
+ * \param userdata Common userdata passed to all instances of \a func.
+ * \param func Callback function, gets the link and its index in the list.
+ * \param use_threading If \a true, actually split-execute loop in threads, else just do a sequential forloop
+ *                      (allows caller to use any kind of test to switch on parallelization or not).
+ *
+ * \note There is no static scheduling here, since it would need another full loop over items to count them.
+ */
+void BLI_task_parallel_listbase(
+        struct ListBase *listbase,
+        void *userdata,
+        TaskParallelListbaseFunc func,
+        const bool use_threading)
+{
+	TaskScheduler *task_scheduler;
+	TaskPool *task_pool;
+	ParallelListState state;
+	int i, num_threads, num_tasks;
+
+	if (BLI_listbase_is_empty(listbase)) {
+		return;
+	}
+
+	if (!use_threading) {
+		Link *link;
+		i = 0;
+		for (link = listbase->first; link != NULL; link = link->next, i++) {
+			func(userdata, link, i);
+		}
+		return;
+	}
+
+	task_scheduler = BLI_task_scheduler_get();
+	task_pool = BLI_task_pool_create(task_scheduler, &state);
+	num_threads = BLI_task_scheduler_num_threads(task_scheduler);
+
+	/* The idea here is to prevent creating task for each of the loop iterations
+	 * and instead have tasks which are evenly distributed across CPU cores and
+	 * pull next iter to be crunched using the queue.
+	 */
+	num_tasks = num_threads * 2;
+
+	state.index = 0;
+	state.link = listbase->first;
+	state.userdata = userdata;
+	state.func = func;
+	BLI_spin_init(&state.lock);
+
+	for (i = 0; i < num_tasks; i++) {
+		BLI_task_pool_push(task_pool,
+		                   parallel_listbase_func,
+		                   NULL, false,
+		                   TASK_PRIORITY_HIGH);
+	}
+
+	BLI_task_pool_work_and_wait(task_pool);
+	BLI_task_pool_free(task_pool);
+
+	BLI_spin_end(&state.lock);
+}
+
+typedef struct ParallelMempoolState {
+	void *userdata;
+	TaskParallelMempoolFunc func;
+} ParallelMempoolState;
+
+static void parallel_mempool_func(
+        TaskPool * __restrict pool,
+        void *taskdata,
+        int UNUSED(threadid))
+{
+	ParallelMempoolState * __restrict state = BLI_task_pool_userdata(pool);
+	BLI_mempool_iter *iter = taskdata;
+	void *item;
+
+	while ((item = BLI_mempool_iterstep(iter))) {
+		state->func(state->userdata, item);
+	}
+}
+
+/**
+ * This function allows to parallelize for loops over Mempool items.
+ *
+ * Each task iterates over whole chunks of the pool, taking a new one once done with its own,
+ * so there is no per-item locking at all.
+ *
+ * \param mempool The iterable BLI_mempool to loop over.
+ * \param userdata Common userdata passed to all instances of \a func.
+ * \param func Callback function.
+ * \param use_threading If \a true, actually split-execute loop in threads, else just do a sequential forloop
+ *                      (allows caller to use any kind of test to switch on parallelization or not).
+ *
+ * \note There is no static scheduling here.
+ */
+void BLI_task_parallel_mempool(
+        BLI_mempool *mempool,
+        void *userdata,
+        TaskParallelMempoolFunc func,
+        const bool use_threading)
+{
+	TaskScheduler *task_scheduler;
+	TaskPool *task_pool;
+	ParallelMempoolState state;
+	BLI_mempool_iter *mempool_iterators;
+	int i, num_threads, num_tasks;
+
+	if (BLI_mempool_count(mempool) == 0) {
+		return;
+	}
+
+	if (!use_threading) {
+		BLI_mempool_iter iter;
+		void *item;
+
+		BLI_mempool_iternew(mempool, &iter);
+		while ((item = BLI_mempool_iterstep(&iter))) {
+			func(userdata, item);
+		}
+		return;
+	}
+
+	task_scheduler = BLI_task_scheduler_get();
+	task_pool = BLI_task_pool_create(task_scheduler, &state);
+	num_threads = BLI_task_scheduler_num_threads(task_scheduler);
+
+	/* The idea here is to prevent creating task for each of the loop iterations
+	 * and instead have tasks which are evenly distributed across CPU cores and
+	 * pull next item to be crunched using the threaded-aware BLI_mempool_iter.
+	 */
+	num_tasks = num_threads * 2;
+
+	state.userdata = userdata;
+	state.func = func;
+
+	mempool_iterators = BLI_mempool_iter_threadsafe_create(mempool, (size_t)num_tasks);
+
+	for (i = 0; i < num_tasks; i++) {
+		BLI_task_pool_push(task_pool,
+		                   parallel_mempool_func,
+		                   &mempool_iterators[i], false,
+		                   TASK_PRIORITY_HIGH);
+	}
+
+	BLI_task_pool_work_and_wait(task_pool);
+	BLI_task_pool_free(task_pool);
+
+	BLI_mempool_iter_threadsafe_free(mempool_iterators);
+}
@@ -44,4 +44,39 @@
 
 #define ENDB BLEND_MAKE_ID('E', 'N', 'D', 'B')
 
+/* BLOCK COMPRESSED FILES
+ *
+ * Written with G_FILE_COMPRESS_FAST, the regular file is split in chunks that are compressed
+ * independently, so they can be (de)compressed in parallel and read without the ones before:
+ *
+ * - BLEND_LZO_MAGIC.
+ * - the chunks, BLEND_LZO_CHUNK_SIZE bytes of the regular file each (the last one may be smaller),
+ *   compressed with LZO1X-1 or stored as is when that doesn't make them smaller.
+ * - the headers, the regular file without the data of its blocks, except for the first
+ *   BLEND_LZO_ID_PREFIX_LEN bytes of blocks other than DATA (holding the ID name).
+ *   This way the blocks of a file are known and ID's are found by name without decompressing it,
+ *   chunks only get decompressed once the data of a block in them is read.
+ * - the index, a BlendLZOChunk for every chunk.
+ * - a BlendLZOFooter, to find the index from the end of the file.
+ *
+ * All integers are little endian. */
+#define BLEND_LZO_MAGIC "BLENDLZO"
+#define BLEND_LZO_MAGIC_LEN 8
+#define BLEND_LZO_CHUNK_SIZE (1 << 20)
+#define BLEND_LZO_ID_PREFIX_LEN 128
+
+typedef struct BlendLZOChunk {
+	uint64_t offset;    /* in the compressed file */
+	uint32_t size;      /* compressed size, when equal to size_raw the chunk is stored as is */
+	uint32_t size_raw;
+} BlendLZOChunk;
+
+typedef struct BlendLZOFooter {
+	uint64_t index_offset;
+	uint64_t size_raw;  /* of the regular file */
+	uint32_t chunks_num;
+	uint32_t chunk_size;
+	char magic[8];      /* BLEND_LZO_MAGIC */
+} BlendLZOFooter;
+
 #endif  /* __BLO_BLEND_DEFS_H__ */
@@ -38,12 +38,14 @@ typedef struct {
 	
 	char *buf;
 	unsigned int ident, size;
+	unsigned int hash;  /* of buf, see: add_memfilechunk */
 	
 } MemFileChunk;
 
 typedef struct MemFile {
 	ListBase chunks;
-	unsigned int size;
+	unsigned int size;        /* of the buffers it owns */
+	unsigned int size_total;  /* including the ones shared with other steps */
 } MemFile;
 
 /* actually only used writefile.c */
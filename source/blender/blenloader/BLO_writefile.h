@@ -38,6 +38,9 @@ struct Main;
 struct ReportList;
 
 extern int BLO_write_file(struct Main *mainvar, const char *filepath, int write_flags, struct ReportList *reports, const int *thumb);
+extern int BLO_write_file_async(struct Main *mainvar, const char *filepath, int write_flags, struct ReportList *reports);
+extern bool BLO_write_file_async_is_done(void);
+extern bool BLO_write_file_async_wait(struct ReportList *reports);
 extern int BLO_write_file_mem(struct Main *mainvar, struct MemFile *compare, struct MemFile *current, int write_flags);
 
 #define BLEN_THUMB_SIZE 128
@@ -45,6 +45,7 @@
 #include "BLI_utildefines.h"
 #ifndef WIN32
 #  include <unistd.h> // for read close
+#  include <sys/mman.h> // for mmap munmap
 #else
 #  include <io.h> // for open close read
 #  include "winsock2.h"
@@ -108,6 +109,9 @@
 #include "BLI_math.h"
 #include "BLI_threads.h"
 #include "BLI_mempool.h"
+#include "BLI_task.h"
+
+#include "PIL_time.h" /* for USE_OLDNEWMAP_STATS */
 
 #include "BLF_translation.h"
 
@@ -157,6 +161,14 @@
 
 #include <errno.h>
 
+#ifdef WITH_LZO
+#  ifdef WITH_SYSTEM_LZO
+#    include <lzo/lzo1x.h>
+#  else
+#    include "minilzo.h"
+#  endif
+#endif
+
 /*
  * Remark: still a weak point is the newaddress() function, that doesnt solve reading from
  * multiple files at the same time
@@ -209,18 +221,42 @@
 /* use GHash for BHead name-based lookups (speeds up linking) */
 #define USE_GHASH_BHEAD
 
+/* memory map uncompressed files, block data is then copied straight from the file mapping
+ * instead of being read into a buffer for each block first.
+ * Block data is only 4 byte aligned in files, so keep this to CPU's allowing unaligned access. */
+#if !defined(WIN32) && (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__))
+#  define USE_BLEND_MMAP
+#endif
+
+/* read the direct data of simple ID types (meshes, curves...) on the task scheduler,
+ * once all other blocks of the file are read (see: direct_link_tasks_run).
+ * Lib-linking and versioning still run afterwards, in a single thread. */
+#define USE_PARALLEL_DIRECT_LINK
+
+/* print the OldNewMap lookup counts and the time spent in every read_libblock (for profiling) */
+// #define USE_OLDNEWMAP_STATS
+
 /***/
 
 typedef struct OldNew {
 	void *old, *newp;
 	int nr;
+	/* index of the next entry sharing this old pointer, -1 for none */
+	int next;
 } OldNew;
 
 typedef struct OldNewMap {
 	OldNew *entries;
 	int nentries, entriessize;
-	int sorted;
 	int lasthit;
+
+	/* old pointer -> index of its first entry, entries sharing an old pointer are chained
+	 * in insertion order through OldNew.next (entries are never removed on their own) */
+	GHash *map;
+
+#ifdef USE_OLDNEWMAP_STATS
+	unsigned int stats_lookups, stats_hash_lookups;
+#endif
 } OldNewMap;
 
 
@@ -263,36 +299,41 @@ static const char *library_parent_filepath(Library *lib)
 	return lib->parent ? lib->parent->filepath : "<direct>";
 }
 
+#define OLDNEWMAP_SIZE_INIT 1024
+
+/**
+ * \return the first entry for \a addr, NULL when there is none.
+ */
+BLI_INLINE OldNew *oldnewmap_lookup_entry(OldNewMap *onm, const void *addr)
+{
+	void **index_p;
+
+#ifdef USE_OLDNEWMAP_STATS
+	onm->stats_hash_lookups++;
+#endif
+
+	index_p = BLI_ghash_lookup_p(onm->map, addr);
+	return index_p ? &onm->entries[GET_INT_FROM_POINTER(*index_p)] : NULL;
+}
+
 static OldNewMap *oldnewmap_new(void) 
 {
 	OldNewMap *onm= MEM_callocN(sizeof(*onm), "OldNewMap");
 	
-	onm->entriessize = 1024;
+	onm->entriessize = OLDNEWMAP_SIZE_INIT;
 	onm->entries = MEM_mallocN(sizeof(*onm->entries)*onm->entriessize, "OldNewMap.entries");
+	/* values are only read right after lookups, never kept over insertions */
+	onm->map = BLI_ghash_new_flag(BLI_ghashutil_ptrhash, BLI_ghashutil_ptrcmp, "OldNewMap.map",
+	                              0, GHASH_FLAG_OPEN_ADDRESSING);
 	
 	return onm;
 }
 
-static int verg_oldnewmap(const void *v1, const void *v2)
-{
-	const struct OldNew *x1=v1, *x2=v2;
-	
-	if (x1->old > x2->old) return 1;
-	else if (x1->old < x2->old) return -1;
-	return 0;
-}
-
-
-static void oldnewmap_sort(FileData *fd) 
-{
-	qsort(fd->libmap->entries, fd->libmap->nentries, sizeof(OldNew), verg_oldnewmap);
-	fd->libmap->sorted = 1;
-}
-
 /* nr is zero for data, and ID code for libdata */
 static void oldnewmap_insert(OldNewMap *onm, void *oldaddr, void *newaddr, int nr) 
 {
 	OldNew *entry;
+	void **index_p;
 	
 	if (oldaddr==NULL || newaddr==NULL) return;
 	
@@ -301,10 +342,23 @@ static void oldnewmap_insert(OldNewMap *onm, void *oldaddr, void *newaddr, int n
 		onm->entries = MEM_reallocN(onm->entries, sizeof(*onm->entries) * onm->entriessize);
 	}
 
+	if (BLI_ghash_ensure_p(onm->map, oldaddr, &index_p)) {
+		/* append to the entries sharing this old pointer, so lookups keep returning the first */
+		entry = &onm->entries[GET_INT_FROM_POINTER(*index_p)];
+		while (entry->next != -1) {
+			entry = &onm->entries[entry->next];
+		}
+		entry->next = onm->nentries;
+	}
+	else {
+		*index_p = SET_INT_IN_POINTER(onm->nentries);
+	}
+
 	entry = &onm->entries[onm->nentries++];
 	entry->old = oldaddr;
 	entry->newp = newaddr;
 	entry->nr = nr;
+	entry->next = -1;
 }
 
 void blo_do_versions_oldnewmap_insert(OldNewMap *onm, void *oldaddr, void *newaddr, int nr)
@@ -314,12 +368,17 @@ void blo_do_versions_oldnewmap_insert(OldNewMap *onm, void *oldaddr, void *newad
 
 static void *oldnewmap_lookup_and_inc(OldNewMap *onm, void *addr, bool increase_users) 
 {
-	int i;
+	OldNew *entry;
 	
 	if (addr == NULL) return NULL;
 	
+#ifdef USE_OLDNEWMAP_STATS
+	onm->stats_lookups++;
+#endif
+	
+	/* most pointers are looked up in the same sequence as they were written */
 	if (onm->lasthit < onm->nentries-1) {
-		OldNew *entry = &onm->entries[++onm->lasthit];
+		entry = &onm->entries[++onm->lasthit];
 		
 		if (entry->old == addr) {
 			if (increase_users)
@@ -328,16 +387,13 @@ static void *oldnewmap_lookup_and_inc(OldNewMap *onm, void *addr, bool increase_
 		}
 	}
 	
-	for (i = 0; i < onm->nentries; i++) {
-		OldNew *entry = &onm->entries[i];
+	entry = oldnewmap_lookup_entry(onm, addr);
+	if (entry) {
+		onm->lasthit = (int)(entry - onm->entries);
 		
-		if (entry->old == addr) {
-			onm->lasthit = i;
-			
-			if (increase_users)
-				entry->nr++;
-			return entry->newp;
-		}
+		if (increase_users)
+			entry->nr++;
+		return entry->newp;
 	}
 	
 	return NULL;
@@ -346,38 +402,24 @@ static void *oldnewmap_lookup_and_inc(OldNewMap *onm, void *addr, bool increase_
 /* for libdata, nr has ID code, no increment */
 static void *oldnewmap_liblookup(OldNewMap *onm, void *addr, void *lib)
 {
+	OldNew *entry;
+
 	if (addr == NULL) {
 		return NULL;
 	}
 
-	/* lasthit works fine for non-libdata, linking there is done in same sequence as writing */
-	if (onm->sorted) {
-		OldNew entry_s, *entry;
-
-		entry_s.old = addr;
-
-		entry = bsearch(&entry_s, onm->entries, onm->nentries, sizeof(OldNew), verg_oldnewmap);
-		if (entry) {
-			ID *id = entry->newp;
+#ifdef USE_OLDNEWMAP_STATS
+	onm->stats_lookups++;
+#endif
 
-			if (id && (!lib || id->lib)) {
-				return id;
-			}
-		}
-	}
-	else {
-		/* note, this can be a bottle neck when loading some files */
-		unsigned int nentries = (unsigned int)onm->nentries;
-		unsigned int i;
-		OldNew *entry;
+	for (entry = oldnewmap_lookup_entry(onm, addr);
+	     entry;
+	     entry = (entry->next != -1) ? &onm->entries[entry->next] : NULL)
+	{
+		ID *id = entry->newp;
 
-		for (i = 0, entry = onm->entries; i < nentries; i++, entry++) {
-			if (entry->old == addr) {
-				ID *id = entry->newp;
-				if (id && (!lib || id->lib)) {
-					return id;
-				}
-			}
+		if (id && (!lib || id->lib)) {
+			return id;
 		}
 	}
 
@@ -399,6 +441,9 @@ static void oldnewmap_free_unused(OldNewMap *onm)
 
 static void oldnewmap_clear(OldNewMap *onm) 
 {
+	/* the datamap is cleared after every libblock, most of them only hold a few entries */
+	BLI_ghash_clear(onm->map, NULL, NULL);
+
 	onm->nentries = 0;
 	onm->lasthit = 0;
 }
@@ -406,9 +451,18 @@ static void oldnewmap_clear(OldNewMap *onm)
 static void oldnewmap_free(OldNewMap *onm) 
 {
 	MEM_freeN(onm->entries);
+	BLI_ghash_free(onm->map, NULL, NULL);
 	MEM_freeN(onm);
 }
 
+#ifdef USE_OLDNEWMAP_STATS
+static void oldnewmap_stats_reset(OldNewMap *onm)
+{
+	onm->stats_lookups = 0;
+	onm->stats_hash_lookups = 0;
+}
+#endif
+
 /***/
 
 static void read_libraries(FileData *basefd, ListBase *mainlist);
@@ -587,6 +641,309 @@ static Main *blo_find_main(FileData *fd, const char *filepath, const char *relab
 
 /* ************ FILE PARSING ****************** */
 
+#ifdef WITH_LZO
+
+/**
+ * A block compressed file (see: BLEND_LZO_MAGIC), opened without decompressing it.
+ * Chunks get decompressed into a cache of their own as the data of the blocks in them is read,
+ * see #blo_bhead_data. So linking a few ID's out of a large library only decompresses these.
+ *
+ * The blocks are read from the headers (see: BLO_blend_defs.h), where the data of
+ * blocks other than DATA starts with the ID name.
+ *
+ * \note The chunk cache is not thread safe, #blo_read_file_internal reads the data of all blocks
+ * (#lzo_bhead_read_all) before the direct data of ID's is read in parallel, after that
+ * #blo_bhead_data doesn't touch it anymore.
+ */
+typedef struct FileDataLZO {
+	const unsigned char *in;  /* the compressed file */
+	size_t in_size;
+	bool in_is_mapped;
+	
+	BlendLZOChunk *index;
+	unsigned int chunks_num;
+	size_t chunk_size, size_raw;
+	char **chunks;  /* decompressed, NULL until needed */
+	bool is_read_all, error;
+	
+	/* position in the regular file, of what fd->read reads next */
+	size_t seek;
+	
+	/* the regular file without the data of blocks */
+	const char *headers;
+	size_t headers_size, headers_seek;
+} FileDataLZO;
+
+static void lzo_filedata_free(FileData *fd)
+{
+	FileDataLZO *lzo = fd->lzo;
+	BHeadN *bheadn;
+	unsigned int i;
+	
+	for (bheadn = fd->listbase.first; bheadn; bheadn = bheadn->next) {
+		if (bheadn->lzo_is_alloc) {
+			MEM_freeN(bheadn->data);
+		}
+	}
+	
+#ifdef USE_BLEND_MMAP
+	if (lzo->in_is_mapped) {
+		munmap((void *)lzo->in, lzo->in_size);
+	}
+	else
+#endif
+	{
+		MEM_freeN((void *)lzo->in);
+	}
+	
+	for (i = 0; i < lzo->chunks_num; i++) {
+		MEM_SAFE_FREE(lzo->chunks[i]);
+	}
+	MEM_freeN(lzo->chunks);
+	MEM_freeN(lzo->index);
+	MEM_freeN(lzo);
+	fd->lzo = NULL;
+}
+
+/* damaged chunks are zeroed, so at least the data read from them is predictable */
+static bool lzo_chunk_decompress(const FileDataLZO *lzo, char *out, unsigned int i)
+{
+	const BlendLZOChunk *chunk = &lzo->index[i];
+	
+	if (chunk->size == chunk->size_raw) {
+		memcpy(out, lzo->in + chunk->offset, chunk->size);
+	}
+	else {
+		lzo_uint out_len = chunk->size_raw;
+		const int r = lzo1x_decompress_safe(lzo->in + chunk->offset, chunk->size, (unsigned char *)out, &out_len, NULL);
+		
+		if ((r != LZO_E_OK) || (out_len != chunk->size_raw)) {
+			memset(out, 0, chunk->size_raw);
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+static void lzo_report_damaged(FileData *fd)
+{
+	if (!fd->lzo->error) {
+		fd->lzo->error = true;
+		BKE_reportf(fd->reports, RPT_ERROR, "Failed to read blend file '%s', damaged", fd->relabase);
+	}
+}
+
+/* a chunk from the cache, decompressed first when it isn't there */
+static const char *lzo_chunk_get(FileData *fd, unsigned int i)
+{
+	FileDataLZO *lzo = fd->lzo;
+	
+	if (lzo->chunks[i] == NULL) {
+		lzo->chunks[i] = MEM_mallocN(lzo->index[i].size_raw, __func__);
+		if (!lzo_chunk_decompress(lzo, lzo->chunks[i], i)) {
+			lzo_report_damaged(fd);
+		}
+	}
+	
+	return lzo->chunks[i];
+}
+
+/**
+ * Copy a range of the regular file.
+ * Chunks entirely inside the range don't hold anything else, these are decompressed in place
+ * (unless \a skip_inner is set, when they already are) instead of going through the cache.
+ */
+static void lzo_range_read(FileData *fd, char *out, size_t offset, size_t len, const bool skip_inner)
+{
+	FileDataLZO *lzo = fd->lzo;
+	const size_t end = offset + len;
+	unsigned int i;
+	
+	for (i = (unsigned int)(offset / lzo->chunk_size); (len != 0) && (i < lzo->chunks_num); i++) {
+		const size_t chunk_start = lzo->chunk_size * i;
+		const size_t chunk_end = chunk_start + lzo->index[i].size_raw;
+		
+		if (chunk_start >= end) {
+			break;
+		}
+		
+		if ((chunk_start >= offset) && (chunk_end <= end) && (lzo->chunks[i] == NULL)) {
+			if (!skip_inner && !lzo_chunk_decompress(lzo, out + (chunk_start - offset), i)) {
+				lzo_report_damaged(fd);
+			}
+		}
+		else {
+			const size_t start = MAX2(chunk_start, offset);
+			memcpy(out + (start - offset), lzo_chunk_get(fd, i) + (start - chunk_start), MIN2(chunk_end, end) - start);
+		}
+	}
+}
+
+/* the data of a block, referenced in the cached chunk holding it or copied when it spans chunks */
+static void lzo_bhead_read(FileData *fd, BHeadN *bheadn, const bool skip_inner)
+{
+	FileDataLZO *lzo = fd->lzo;
+	const size_t offset = bheadn->lzo_offset;
+	const size_t len = (size_t)bheadn->bhead.len;
+	const unsigned int i = (unsigned int)(offset / lzo->chunk_size);
+	
+	if (len == 0) {
+		/* nothing to read, point at something valid */
+		bheadn->data = bheadn + 1;
+	}
+	else if ((offset + len) <= lzo->chunk_size * (i + 1)) {
+		bheadn->data = (char *)lzo_chunk_get(fd, i) + (offset - lzo->chunk_size * i);
+	}
+	else {
+		if (!bheadn->lzo_is_alloc) {
+			bheadn->data = MEM_mallocN(len, "new_bhead data");
+			bheadn->lzo_is_alloc = true;
+		}
+		lzo_range_read(fd, bheadn->data, offset, len, skip_inner);
+	}
+	
+	bheadn->lzo_is_read = true;
+}
+
+typedef struct LZODecompressData {
+	const FileDataLZO *lzo;
+	char **out;  /* per chunk */
+	bool error;
+} LZODecompressData;
+
+static void lzo_chunk_decompress_task(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	LZODecompressData *data = BLI_task_pool_userdata(pool);
+	const unsigned int i = GET_UINT_FROM_POINTER(taskdata);
+	
+	if (!lzo_chunk_decompress(data->lzo, data->out[i], i)) {
+		data->error = true;
+	}
+}
+
+/**
+ * Read the data of all blocks at once, decompressing their chunks in parallel.
+ * Chunks inside a single block are decompressed right into its data, only the others get cached.
+ * Returns false when the file is damaged.
+ */
+static bool lzo_bhead_read_all(FileData *fd)
+{
+	FileDataLZO *lzo = fd->lzo;
+	LZODecompressData data = {lzo, NULL, false};
+	TaskPool *pool;
+	BHead *bhead;
+	BHeadN *bheadn;
+	unsigned int i;
+	
+	if (lzo->is_read_all) {
+		return !lzo->error;
+	}
+	
+	/* know all blocks first */
+	for (bhead = blo_firstbhead(fd); bhead; bhead = blo_nextbhead(fd, bhead)) {
+		/* pass */
+	}
+	
+	data.out = MEM_callocN(sizeof(*data.out) * lzo->chunks_num, __func__);
+	
+	for (bheadn = fd->listbase.first; bheadn; bheadn = bheadn->next) {
+		const size_t offset = bheadn->lzo_offset;
+		const size_t end = offset + (size_t)bheadn->bhead.len;
+		
+		if (bheadn->lzo_is_read || (offset == end) || (offset / lzo->chunk_size) == ((end - 1) / lzo->chunk_size)) {
+			continue;
+		}
+		
+		bheadn->data = MEM_mallocN((size_t)bheadn->bhead.len, "new_bhead data");
+		bheadn->lzo_is_alloc = true;
+		
+		for (i = (unsigned int)((offset + lzo->chunk_size - 1) / lzo->chunk_size); i < lzo->chunks_num; i++) {
+			const size_t chunk_start = lzo->chunk_size * i;
+			
+			if (chunk_start + lzo->index[i].size_raw > end) {
+				break;
+			}
+			if (lzo->chunks[i] == NULL) {
+				data.out[i] = (char *)bheadn->data + (chunk_start - offset);
+			}
+		}
+	}
+	
+	pool = BLI_task_pool_create(BLI_task_scheduler_get(), &data);
+	for (i = 0; i < lzo->chunks_num; i++) {
+		if (lzo->chunks[i] == NULL) {
+			if (data.out[i] == NULL) {
+				lzo->chunks[i] = data.out[i] = MEM_mallocN(lzo->index[i].size_raw, __func__);
+			}
+			BLI_task_pool_push(pool, lzo_chunk_decompress_task, SET_UINT_IN_POINTER(i), false, TASK_PRIORITY_HIGH);
+		}
+	}
+	BLI_task_pool_work_and_wait(pool);
+	BLI_task_pool_free(pool);
+	
+	MEM_freeN(data.out);
+	
+	if (data.error) {
+		lzo_report_damaged(fd);
+	}
+	
+	for (bheadn = fd->listbase.first; bheadn; bheadn = bheadn->next) {
+		if (!bheadn->lzo_is_read) {
+			lzo_bhead_read(fd, bheadn, true);
+		}
+	}
+	
+	lzo->is_read_all = true;
+	
+	return !lzo->error;
+}
+
+static int fd_read_from_lzo(FileData *filedata, void *buffer, unsigned int size)
+{
+	FileDataLZO *lzo = filedata->lzo;
+	size_t readsize;
+	
+	readsize = MIN2((size_t)size, lzo->headers_size - lzo->headers_seek);
+	memcpy(buffer, lzo->headers + lzo->headers_seek, readsize);
+	lzo->headers_seek += readsize;
+	lzo->seek += readsize;
+	
+	return (int)readsize;
+}
+
+/* the block data gets read on first use, only the ID name is needed until then (see: bhead_id_name) */
+static BHeadN *lzo_bhead_new(FileData *fd, const BHead *bhead)
+{
+	FileDataLZO *lzo = fd->lzo;
+	BHeadN *new_bhead;
+	
+	if ((size_t)bhead->len > lzo->size_raw - lzo->seek) {
+		return NULL;
+	}
+	
+	new_bhead = MEM_callocN(sizeof(BHeadN), "new_bhead");
+	new_bhead->bhead = *bhead;
+	new_bhead->lzo_offset = lzo->seek;
+	lzo->seek += (size_t)bhead->len;
+	
+	if (bhead->code != DATA) {
+		/* the start of the data follows the header */
+		const size_t len = MIN2((size_t)bhead->len, BLEND_LZO_ID_PREFIX_LEN);
+		
+		if (len > lzo->headers_size - lzo->headers_seek) {
+			MEM_freeN(new_bhead);
+			return NULL;
+		}
+		new_bhead->data = (void *)(lzo->headers + lzo->headers_seek);
+		lzo->headers_seek += len;
+	}
+	
+	return new_bhead;
+}
+
+#endif  /* WITH_LZO */
+
 static void switch_endian_bh4(BHead4 *bhead)
 {
 	/* the ID_.. codes */
@@ -720,10 +1077,34 @@ static BHeadN *get_bhead(FileData *fd)
 			/* bhead now contains the (converted) bhead structure. Now read
 			 * the associated data and put everything in a BHeadN (creative naming !)
 			 */
-			if (!fd->eof) {
+#ifdef WITH_LZO
+			if (!fd->eof && fd->lzo) {
+				new_bhead = lzo_bhead_new(fd, &bhead);
+				if (new_bhead == NULL) {
+					fd->eof = 1;
+				}
+			}
+			else
+#endif
+			if (!fd->eof && fd->mmap_buffer) {
+				/* reference the data in place, it only gets copied by read_struct */
+				if ((size_t)bhead.len <= fd->mmap_size - fd->mmap_seek) {
+					new_bhead = MEM_mallocN(sizeof(BHeadN), "new_bhead");
+					new_bhead->next = new_bhead->prev = NULL;
+					new_bhead->data = fd->mmap_buffer + fd->mmap_seek;
+					new_bhead->bhead = bhead;
+					
+					fd->mmap_seek += (size_t)bhead.len;
+				}
+				else {
+					fd->eof = 1;
+				}
+			}
+			else if (!fd->eof) {
 				new_bhead = MEM_mallocN(sizeof(BHeadN) + bhead.len, "new_bhead");
 				if (new_bhead) {
 					new_bhead->next = new_bhead->prev = NULL;
+					new_bhead->data = new_bhead + 1;
 					new_bhead->bhead = bhead;
 					
 					readsize = fd->read(fd, new_bhead + 1, bhead.len);
@@ -773,7 +1154,7 @@ BHead *blo_firstbhead(FileData *fd)
 
 BHead *blo_prevbhead(FileData *UNUSED(fd), BHead *thisblock)
 {
-	BHeadN *bheadn = (BHeadN *)POINTER_OFFSET(thisblock, -offsetof(BHeadN, bhead));
+	BHeadN *bheadn = BHEADN_FROM_BHEAD(thisblock);
 	BHeadN *prev = bheadn->prev;
 	
 	return (prev) ? &prev->bhead : NULL;
@@ -787,7 +1168,7 @@ BHead *blo_nextbhead(FileData *fd, BHead *thisblock)
 	if (thisblock) {
 		/* bhead is actually a sub part of BHeadN
 		 * We calculate the BHeadN pointer from the BHead pointer below */
-		new_bhead = (BHeadN *)POINTER_OFFSET(thisblock, -offsetof(BHeadN, bhead));
+		new_bhead = BHEADN_FROM_BHEAD(thisblock);
 		
 		/* get the next BHeadN. If it doesn't exist we read in the next one */
 		new_bhead = new_bhead->next;
@@ -805,6 +1186,25 @@ BHead *blo_nextbhead(FileData *fd, BHead *thisblock)
 	return(bhead);
 }
 
+/**
+ * The data of a block, use instead of (bhead + 1).
+ * For block compressed files the chunks holding it are decompressed first.
+ */
+void *blo_bhead_data(FileData *fd, const BHead *bhead)
+{
+	BHeadN *bheadn = BHEADN_FROM_BHEAD(bhead);
+	
+#ifdef WITH_LZO
+	if (fd->lzo && !bheadn->lzo_is_read) {
+		lzo_bhead_read(fd, bheadn, false);
+	}
+#else
+	UNUSED_VARS(fd);
+#endif
+	
+	return bheadn->data;
+}
+
 static void decode_blender_header(FileData *fd)
 {
 	char header[SIZEOFBLENDERHEADER], num[4];
@@ -855,10 +1255,11 @@ static int read_file_dna(FileData *fd)
 		if (bhead->code == DNA1) {
 			const bool do_endian_swap = (fd->flags & FD_FLAGS_SWITCH_ENDIAN) != 0;
 			
-			fd->filesdna = DNA_sdna_from_data(&bhead[1], bhead->len, do_endian_swap);
+			fd->filesdna = DNA_sdna_from_data(blo_bhead_data(fd, bhead), bhead->len, do_endian_swap);
 			if (fd->filesdna) {
 				fd->compflags = DNA_struct_get_compareflags(fd->filesdna, fd->memsdna);
-				/* used to retrieve ID names from (bhead+1) */
+				fd->reconstruct_info = DNA_reconstruct_info_create(fd->filesdna, fd->memsdna, fd->compflags);
+				/* used to retrieve ID names from the data of ID blocks */
 				fd->id_name_offs = DNA_elem_offset(fd->filesdna, "ID", "char", "name[]");
 			}
 			
@@ -910,6 +1311,17 @@ static int fd_read_from_memory(FileData *filedata, void *buffer, unsigned int si
 	return (readsize);
 }
 
+static int fd_read_from_mmap(FileData *filedata, void *buffer, unsigned int size)
+{
+	/* don't read more bytes then there are available in the mapping */
+	const size_t readsize = MIN2((size_t)size, filedata->mmap_size - filedata->mmap_seek);
+	
+	memcpy(buffer, filedata->mmap_buffer + filedata->mmap_seek, readsize);
+	filedata->mmap_seek += readsize;
+	
+	return (int)readsize;
+}
+
 static int fd_read_from_memfile(FileData *filedata, void *buffer, unsigned int size)
 {
 	static unsigned int seek = (1<<30);	/* the current position */
@@ -1009,11 +1421,264 @@ static FileData *blo_decode_and_check(FileData *fd, ReportList *reports)
 	return fd;
 }
 
+#ifdef USE_BLEND_MMAP
+/**
+ * Map an uncompressed file into memory, returns NULL for compressed files
+ * or when mapping fails, these are read with zlib instead.
+ *
+ * \note The mapping is private and writable, so endian switching can still be done in place,
+ * pages are only copied once they get written to.
+ */
+static FileData *blo_openblenderfile_mmap(const char *filepath)
+{
+	FileData *fd = NULL;
+	unsigned char magic[2];
+	size_t size;
+	void *buffer;
+	int file;
+	
+	file = BLI_open(filepath, O_BINARY | O_RDONLY, 0);
+	if (file == -1) {
+		return NULL;
+	}
+	
+	size = BLI_file_descriptor_size(file);
+	
+	if ((size >= SIZEOFBLENDERHEADER) && (size != (size_t)-1) &&
+	    (read(file, magic, sizeof(magic)) == sizeof(magic)) &&
+	    !(magic[0] == 0x1f && magic[1] == 0x8b))
+	{
+		buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+		if (buffer != MAP_FAILED) {
+			fd = filedata_new();
+			fd->mmap_buffer = buffer;
+			fd->mmap_size = size;
+			fd->read = fd_read_from_mmap;
+		}
+	}
+	
+	/* the mapping stays valid after closing */
+	close(file);
+	
+	return fd;
+}
+#endif
+
+static bool blo_file_is_lzo(const char *filepath)
+{
+	char magic[BLEND_LZO_MAGIC_LEN];
+	bool is_lzo = false;
+	int file;
+	
+	file = BLI_open(filepath, O_BINARY | O_RDONLY, 0);
+	if (file != -1) {
+		is_lzo = (read(file, magic, sizeof(magic)) == sizeof(magic)) &&
+		         (memcmp(magic, BLEND_LZO_MAGIC, sizeof(magic)) == 0);
+		close(file);
+	}
+	
+	return is_lzo;
+}
+
+#ifdef WITH_LZO
+
+static bool blo_read_all(int file, void *buffer, size_t size)
+{
+	char *cp = buffer;
+	
+	while (size) {
+		const int readsize = (int)read(file, cp, MIN2(size, (size_t)INT_MAX));
+		if (readsize <= 0) {
+			return false;
+		}
+		cp += readsize;
+		size -= (size_t)readsize;
+	}
+	
+	return true;
+}
+
+/**
+ * Open a block compressed file, only reading its index,
+ * the chunks get decompressed once the blocks in them are read.
+ */
+static FileData *blo_openblenderfile_lzo(const char *filepath, ReportList *reports)
+{
+	FileData *fd = NULL;
+	FileDataLZO *lzo;
+	BlendLZOFooter footer;
+	BlendLZOChunk *index = NULL;
+	unsigned char *in = NULL;
+	bool in_is_mapped = false;
+	size_t size, size_index;
+	uint64_t size_raw = 0, headers_offset = BLEND_LZO_MAGIC_LEN;
+	unsigned int i;
+	int file;
+	
+	file = BLI_open(filepath, O_BINARY | O_RDONLY, 0);
+	if (file == -1) {
+		BKE_reportf(reports, RPT_WARNING, "Unable to open '%s': %s", filepath, strerror(errno));
+		return NULL;
+	}
+	
+	size = BLI_file_descriptor_size(file);
+	if ((size != (size_t)-1) && (size >= BLEND_LZO_MAGIC_LEN + sizeof(footer))) {
+#ifdef USE_BLEND_MMAP
+		/* chunks only get paged in once decompressed */
+		in = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (in != MAP_FAILED) {
+			in_is_mapped = true;
+		}
+		else
+#endif
+		{
+			in = MEM_mallocN(size, __func__);
+			if (!blo_read_all(file, in, size)) {
+				MEM_freeN(in);
+				in = NULL;
+			}
+		}
+	}
+	close(file);
+	
+	if (in == NULL) {
+		goto finally;
+	}
+	
+	memcpy(&footer, in + size - sizeof(footer), sizeof(footer));
+	if (ENDIAN_ORDER == B_ENDIAN) {
+		BLI_endian_switch_uint64(&footer.index_offset);
+		BLI_endian_switch_uint64(&footer.size_raw);
+		BLI_endian_switch_uint32(&footer.chunks_num);
+		BLI_endian_switch_uint32(&footer.chunk_size);
+	}
+	
+	/* the index is right before the footer */
+	size_index = sizeof(*index) * (size_t)footer.chunks_num;
+	if ((memcmp(footer.magic, BLEND_LZO_MAGIC, sizeof(footer.magic)) != 0) ||
+	    (footer.chunk_size == 0) ||
+	    (size_index > size - sizeof(footer)) ||
+	    (footer.index_offset != size - sizeof(footer) - size_index) ||
+	    (footer.size_raw > (uint64_t)(size_t)-1))
+	{
+		goto finally;
+	}
+	
+	/* copied, the index is not aligned in the file */
+	index = MEM_mallocN(size_index + 1, __func__);
+	memcpy(index, in + footer.index_offset, size_index);
+	
+	for (i = 0; i < footer.chunks_num; i++) {
+		BlendLZOChunk *chunk = &index[i];
+		
+		if (ENDIAN_ORDER == B_ENDIAN) {
+			BLI_endian_switch_uint64(&chunk->offset);
+			BLI_endian_switch_uint32(&chunk->size);
+			BLI_endian_switch_uint32(&chunk->size_raw);
+		}
+		
+		/* chunks are contiguous in the uncompressed file, only the last one may be smaller */
+		if ((chunk->offset < BLEND_LZO_MAGIC_LEN) ||
+		    (chunk->offset > footer.index_offset) ||
+		    (chunk->size > footer.index_offset - chunk->offset) ||
+		    (chunk->size > chunk->size_raw) ||
+		    (chunk->size_raw != footer.chunk_size && i != footer.chunks_num - 1) ||
+		    (chunk->size_raw > footer.chunk_size))
+		{
+			goto finally;
+		}
+		size_raw += chunk->size_raw;
+		headers_offset = MAX2(headers_offset, chunk->offset + chunk->size);
+	}
+	
+	/* the headers fill the space between the chunks and the index */
+	if ((size_raw != footer.size_raw) || (footer.index_offset <= headers_offset)) {
+		goto finally;
+	}
+	
+	lzo = MEM_callocN(sizeof(*lzo), __func__);
+	lzo->in = in;
+	lzo->in_size = size;
+	lzo->in_is_mapped = in_is_mapped;
+	lzo->index = index;
+	lzo->chunks_num = footer.chunks_num;
+	lzo->chunk_size = footer.chunk_size;
+	lzo->size_raw = (size_t)size_raw;
+	lzo->chunks = MEM_callocN(sizeof(*lzo->chunks) * (size_t)footer.chunks_num + 1, __func__);
+	lzo->headers = (const char *)in + headers_offset;
+	lzo->headers_size = (size_t)(footer.index_offset - headers_offset);
+	
+	fd = filedata_new();
+	fd->read = fd_read_from_lzo;
+	fd->lzo = lzo;
+	
+	/* owned by fd now */
+	in = NULL;
+	index = NULL;
+	
+finally:
+	if (fd == NULL) {
+		BKE_reportf(reports, RPT_ERROR, "Failed to read blend file '%s', incomplete", filepath);
+	}
+	
+	if (in) {
+#ifdef USE_BLEND_MMAP
+		if (in_is_mapped) {
+			munmap(in, size);
+		}
+		else
+#endif
+		{
+			MEM_freeN(in);
+		}
+	}
+	MEM_SAFE_FREE(index);
+	
+	return fd;
+}
+
+#endif  /* WITH_LZO */
+
 /* cannot be called with relative paths anymore! */
 /* on each new library added, it now checks for the current FileData and expands relativeness */
 FileData *blo_openblenderfile(const char *filepath, ReportList *reports)
 {
 	gzFile gzfile;
+	
+	if (blo_file_is_lzo(filepath)) {
+#ifdef WITH_LZO
+		FileData *fd = blo_openblenderfile_lzo(filepath, reports);
+		if (fd) {
+			/* needed for library_append and read_libraries */
+			BLI_strncpy(fd->relabase, filepath, sizeof(fd->relabase));
+			
+			fd = blo_decode_and_check(fd, reports);
+			
+			/* ID names are expected at the start of the block data, see: bhead_id_name */
+			if (fd && (fd->id_name_offs + MAX_ID_NAME > BLEND_LZO_ID_PREFIX_LEN)) {
+				lzo_bhead_read_all(fd);
+			}
+			
+			return fd;
+		}
+#else
+		BKE_reportf(reports, RPT_ERROR, "Failed to read blend file '%s', built without LZO compression", filepath);
+#endif
+		return NULL;
+	}
+	
+#ifdef USE_BLEND_MMAP
+	{
+		FileData *fd = blo_openblenderfile_mmap(filepath);
+		if (fd) {
+			/* needed for library_append and read_libraries */
+			BLI_strncpy(fd->relabase, filepath, sizeof(fd->relabase));
+			
+			return blo_decode_and_check(fd, reports);
+		}
+	}
+#endif
+	
 	errno = 0;
 	gzfile = BLI_gzopen(filepath, "rb");
 	
@@ -1132,6 +1797,18 @@ void blo_freefiledata(FileData *fd)
 			gzclose(fd->gzfiledes);
 		}
 		
+#ifdef WITH_LZO
+		if (fd->lzo) {
+			lzo_filedata_free(fd);
+		}
+#endif
+		
+#ifdef USE_BLEND_MMAP
+		if (fd->mmap_buffer) {
+			munmap(fd->mmap_buffer, fd->mmap_size);
+		}
+#endif
+		
 		if (fd->strm.next_in) {
 			if (inflateEnd (&fd->strm) != Z_OK) {
 				printf("close gzip stream error\n");
@@ -1146,6 +1823,9 @@ void blo_freefiledata(FileData *fd)
 		// Free all BHeadN data blocks
 		BLI_freelistN(&fd->listbase);
 		
+		/* uses both SDNA's */
+		if (fd->reconstruct_info)
+			DNA_reconstruct_info_free(fd->reconstruct_info);
 		if (fd->memsdna)
 			DNA_sdna_free(fd->memsdna);
 		if (fd->filesdna)
@@ -1613,12 +2293,13 @@ void blo_add_library_pointer_map(ListBase *mainlist, FileData *fd)
 /* ********** END OLD POINTERS ****************** */
 /* ********** READ FILE ****************** */
 
-static void switch_endian_structs(struct SDNA *filesdna, BHead *bhead)
+static void switch_endian_structs(FileData *fd, BHead *bhead)
 {
+	struct SDNA *filesdna = fd->filesdna;
 	int blocksize, nblocks;
 	char *data;
 	
-	data = (char *)(bhead+1);
+	data = blo_bhead_data(fd, bhead);
 	blocksize = filesdna->typelens[ filesdna->structs[bhead->SDNAnr][0] ];
 	
 	nblocks = bhead->nr;
@@ -1636,15 +2317,16 @@ static void *read_struct(FileData *fd, BHead *bh, const char *blockname)
 	if (bh->len) {
 		/* switch is based on file dna */
 		if (bh->SDNAnr && (fd->flags & FD_FLAGS_SWITCH_ENDIAN))
-			switch_endian_structs(fd->filesdna, bh);
+			switch_endian_structs(fd, bh);
 		
 		if (fd->compflags[bh->SDNAnr]) {	/* flag==0: doesn't exist anymore */
 			if (fd->compflags[bh->SDNAnr] == 2) {
-				temp = DNA_struct_reconstruct(fd->memsdna, fd->filesdna, fd->compflags, bh->SDNAnr, bh->nr, (bh+1));
+				temp = DNA_struct_reconstruct(fd->reconstruct_info, bh->SDNAnr, bh->nr, blo_bhead_data(fd, bh));
 			}
 			else {
+				/* same layout as in memory, a single copy (straight from the file when it is mapped) */
 				temp = MEM_mallocN(bh->len, blockname);
-				memcpy(temp, (bh+1), bh->len);
+				memcpy(temp, blo_bhead_data(fd, bh), bh->len);
 			}
 		}
 	}
@@ -7523,51 +8205,26 @@ static BHead *read_data_into_oldnewmap(FileData *fd, BHead *bhead, const char *a
 	return bhead;
 }
 
-static BHead *read_libblock(FileData *fd, Main *main, BHead *bhead, int flag, ID **r_id)
+/**
+ * Reads the direct data following the block of \a id and links it, \a main is only used by libraries.
+ * \return the first block after the data.
+ */
+static BHead *read_libblock_data(FileData *fd, Main *main, BHead *bhead, ID *id, bool *r_wrong_id)
 {
-	/* this routine reads a libblock and its direct data. Use link functions
-	 * to connect it all
-	 */
-	ID *id;
-	ListBase *lb;
 	const char *allocname;
 	bool wrong_id = false;
-	
-	/* read libblock */
-	id = read_struct(fd, bhead, "lib block");
-	if (r_id)
-		*r_id = id;
-	if (!id)
-		return blo_nextbhead(fd, bhead);
-	
-	oldnewmap_insert(fd->libmap, bhead->old, id, bhead->code);	/* for ID_ID check */
-	
-	/* do after read_struct, for dna reconstruct */
-	if (bhead->code == ID_ID) {
-		lb = which_libbase(main, GS(id->name));
-	}
-	else {
-		lb = which_libbase(main, bhead->code);
-	}
-	
-	BLI_addtail(lb, id);
-	
-	/* clear first 8 bits */
-	id->flag = (id->flag & 0xFF00) | flag | LIB_NEED_LINK;
-	id->lib = main->curlib;
-	if (id->flag & LIB_FAKEUSER) id->us= 1;
-	else id->us = 0;
-	id->icon_id = 0;
-	id->flag &= ~(LIB_ID_RECALC|LIB_ID_RECALC_DATA|LIB_DOIT);
-	
-	/* this case cannot be direct_linked: it's just the ID part */
-	if (bhead->code == ID_ID) {
-		return blo_nextbhead(fd, bhead);
-	}
+#ifdef USE_OLDNEWMAP_STATS
+	double time_start;
+#endif
 	
 	/* need a name for the mallocN, just for debugging and sane prints on leaks */
 	allocname = dataname(GS(id->name));
 	
+#ifdef USE_OLDNEWMAP_STATS
+	time_start = PIL_check_seconds_timer();
+	oldnewmap_stats_reset(fd->datamap);
+#endif
+	
 	/* read all data into fd->datamap */
 	bhead = read_data_into_oldnewmap(fd, bhead, allocname);
 	
@@ -7679,9 +8336,182 @@ static BHead *read_libblock(FileData *fd, Main *main, BHead *bhead, int flag, ID
 			break;
 	}
 	
+#ifdef USE_OLDNEWMAP_STATS
+	printf("read_libblock %s: %d data blocks, %u lookups, %u hashed, %.6fs\n",
+	       id->name, fd->datamap->nentries, fd->datamap->stats_lookups,
+	       fd->datamap->stats_hash_lookups,
+	       PIL_check_seconds_timer() - time_start);
+#endif
+	
 	oldnewmap_free_unused(fd->datamap);
 	oldnewmap_clear(fd->datamap);
 	
+	*r_wrong_id = wrong_id;
+	
+	return (bhead);
+}
+
+#ifdef USE_PARALLEL_DIRECT_LINK
+
+/* below this many ID's, run the direct linking in place */
+#define DIRECT_LINK_TASKS_MIN 16
+
+typedef struct DirectLinkTask {
+	ID *id;
+	BHead *bhead;  /* block of the ID, followed by its data */
+} DirectLinkTask;
+
+typedef struct DirectLinkTasks {
+	DirectLinkTask *tasks;
+	int tasks_len, tasks_alloc;
+
+	/* copies of the FileData, each thread needs its own datamap */
+	FileData *fd_threads;
+} DirectLinkTasks;
+
+/**
+ * ID types whose direct data can be read in parallel,
+ * their direct_link functions only touch the ID itself and the datamap of the FileData.
+ */
+static bool direct_link_is_deferrable(const short idcode)
+{
+	return ELEM(idcode, ID_ME, ID_CU, ID_MB, ID_LT, ID_KE, ID_AC);
+}
+
+static void direct_link_tasks_add(DirectLinkTasks *dlt, ID *id, BHead *bhead)
+{
+	DirectLinkTask *task;
+	
+	if (UNLIKELY(dlt->tasks_len == dlt->tasks_alloc)) {
+		dlt->tasks_alloc = dlt->tasks_alloc ? dlt->tasks_alloc * 2 : 256;
+		dlt->tasks = MEM_reallocN(dlt->tasks, sizeof(*dlt->tasks) * (size_t)dlt->tasks_alloc);
+	}
+	
+	task = &dlt->tasks[dlt->tasks_len++];
+	task->id = id;
+	task->bhead = bhead;
+}
+
+static void direct_link_task_run(TaskPool *__restrict pool, void *taskdata, int threadid)
+{
+	DirectLinkTasks *dlt = BLI_task_pool_userdata(pool);
+	DirectLinkTask *task = taskdata;
+	bool wrong_id;
+	
+	read_libblock_data(&dlt->fd_threads[threadid], NULL, task->bhead, task->id, &wrong_id);
+}
+
+/**
+ * Reads and links the direct data of all deferred ID's.
+ *
+ * All blocks of the file are read already (up to ENDB or the end of the file),
+ * so the tasks never call fd->read and only need their own datamap.
+ * They get a shallow copy of the FileData each, its shared members are only read from.
+ */
+static void direct_link_tasks_run(FileData *fd)
+{
+	DirectLinkTasks *dlt = fd->direct_link_tasks;
+	bool wrong_id;
+	int i;
+	
+	fd->direct_link_tasks = NULL;
+	
+#ifdef WITH_LZO
+	/* the chunk cache isn't thread safe, the data of all blocks must be read */
+	BLI_assert(!fd->lzo || fd->lzo->is_read_all);
+#endif
+	
+	if (dlt->tasks_len < DIRECT_LINK_TASKS_MIN) {
+		for (i = 0; i < dlt->tasks_len; i++) {
+			read_libblock_data(fd, NULL, dlt->tasks[i].bhead, dlt->tasks[i].id, &wrong_id);
+		}
+	}
+	else {
+		TaskScheduler *scheduler = BLI_task_scheduler_get();
+		const int num_threads = BLI_task_scheduler_num_threads(scheduler);
+		TaskPool *pool;
+		
+		dlt->fd_threads = MEM_mallocN(sizeof(*dlt->fd_threads) * (size_t)num_threads, __func__);
+		for (i = 0; i < num_threads; i++) {
+			dlt->fd_threads[i] = *fd;
+			dlt->fd_threads[i].datamap = oldnewmap_new();
+		}
+		
+		pool = BLI_task_pool_create(scheduler, dlt);
+		for (i = 0; i < dlt->tasks_len; i++) {
+			BLI_task_pool_push(pool, direct_link_task_run, &dlt->tasks[i], false, TASK_PRIORITY_LOW);
+		}
+		BLI_task_pool_work_and_wait(pool);
+		BLI_task_pool_free(pool);
+		
+		for (i = 0; i < num_threads; i++) {
+			oldnewmap_free(dlt->fd_threads[i].datamap);
+		}
+		MEM_freeN(dlt->fd_threads);
+	}
+	
+	MEM_SAFE_FREE(dlt->tasks);
+	MEM_freeN(dlt);
+}
+
+#endif  /* USE_PARALLEL_DIRECT_LINK */
+
+static BHead *read_libblock(FileData *fd, Main *main, BHead *bhead, int flag, ID **r_id)
+{
+	/* this routine reads a libblock and its direct data. Use link functions
+	 * to connect it all
+	 */
+	ID *id;
+	ListBase *lb;
+	bool wrong_id = false;
+	
+	/* read libblock */
+	id = read_struct(fd, bhead, "lib block");
+	if (r_id)
+		*r_id = id;
+	if (!id)
+		return blo_nextbhead(fd, bhead);
+	
+	oldnewmap_insert(fd->libmap, bhead->old, id, bhead->code);	/* for ID_ID check */
+	
+	/* do after read_struct, for dna reconstruct */
+	if (bhead->code == ID_ID) {
+		lb = which_libbase(main, GS(id->name));
+	}
+	else {
+		lb = which_libbase(main, bhead->code);
+	}
+	
+	BLI_addtail(lb, id);
+	
+	/* clear first 8 bits */
+	id->flag = (id->flag & 0xFF00) | flag | LIB_NEED_LINK;
+	id->lib = main->curlib;
+	if (id->flag & LIB_FAKEUSER) id->us= 1;
+	else id->us = 0;
+	id->icon_id = 0;
+	id->flag &= ~(LIB_ID_RECALC|LIB_ID_RECALC_DATA|LIB_DOIT);
+	
+	/* this case cannot be direct_linked: it's just the ID part */
+	if (bhead->code == ID_ID) {
+		return blo_nextbhead(fd, bhead);
+	}
+	
+#ifdef USE_PARALLEL_DIRECT_LINK
+	if (fd->direct_link_tasks && direct_link_is_deferrable(GS(id->name))) {
+		direct_link_tasks_add(fd->direct_link_tasks, id, bhead);
+		
+		/* skip the data for now */
+		do {
+			bhead = blo_nextbhead(fd, bhead);
+		} while (bhead && bhead->code == DATA);
+		
+		return bhead;
+	}
+#endif
+	
+	bhead = read_libblock_data(fd, main, bhead, id, &wrong_id);
+	
 	if (wrong_id) {
 		BKE_libblock_free(main, id);
 	}
@@ -7833,8 +8663,11 @@ static void do_versions_after_linking(FileData *fd, Library *lib, Main *main)
 
 static void lib_link_all(FileData *fd, Main *main)
 {
-	oldnewmap_sort(fd);
-	
+#ifdef USE_OLDNEWMAP_STATS
+	const double time_start = PIL_check_seconds_timer();
+	oldnewmap_stats_reset(fd->libmap);
+#endif
+
 	/* No load UI for undo memfiles */
 	if (fd->memfile == NULL) {
 		lib_link_windowmanager(fd, main);
@@ -7874,6 +8707,13 @@ static void lib_link_all(FileData *fd, Main *main)
 	lib_link_mesh(fd, main);		/* as last: tpage images with users at zero */
 	
 	lib_link_library(fd, main);		/* only init users */
+
+#ifdef USE_OLDNEWMAP_STATS
+	printf("lib_link_all: %d ID blocks, %u lookups, %u hashed, %.6fs\n",
+	       fd->libmap->nentries, fd->libmap->stats_lookups,
+	       fd->libmap->stats_hash_lookups,
+	       PIL_check_seconds_timer() - time_start);
+#endif
 }
 
 static void direct_link_keymapitem(FileData *fd, wmKeyMapItem *kmi)
@@ -7957,6 +8797,13 @@ BlendFileData *blo_read_file_internal(FileData *fd, const char *filepath)
 	BlendFileData *bfd;
 	ListBase mainlist = {NULL, NULL};
 	
+#ifdef WITH_LZO
+	/* all blocks get read, decompress them at once */
+	if (fd->lzo && !lzo_bhead_read_all(fd)) {
+		return NULL;
+	}
+#endif
+	
 	bfd = MEM_callocN(sizeof(BlendFileData), "blendfiledata");
 	bfd->main = BKE_main_new();
 	BLI_addtail(&mainlist, bfd->main);
@@ -7967,6 +8814,13 @@ BlendFileData *blo_read_file_internal(FileData *fd, const char *filepath)
 	bfd->type = BLENFILETYPE_BLEND;
 	BLI_strncpy(bfd->main->name, filepath, sizeof(bfd->main->name));
 
+#ifdef USE_PARALLEL_DIRECT_LINK
+	/* reading the data later only pays off with more than one thread */
+	if (BLI_task_scheduler_num_threads(BLI_task_scheduler_get()) > 1) {
+		fd->direct_link_tasks = MEM_callocN(sizeof(*fd->direct_link_tasks), "DirectLinkTasks");
+	}
+#endif
+
 	while (bhead) {
 		switch (bhead->code) {
 		case DATA:
@@ -8016,6 +8870,12 @@ BlendFileData *blo_read_file_internal(FileData *fd, const char *filepath)
 		}
 	}
 	
+#ifdef USE_PARALLEL_DIRECT_LINK
+	if (fd->direct_link_tasks) {
+		direct_link_tasks_run(fd);
+	}
+#endif
+	
 	/* do before read_libraries, but skip undo case */
 	if (fd->memfile==NULL)
 		do_versions(fd, NULL, bfd->main);
@@ -8158,7 +9018,8 @@ static BHead *find_bhead_from_idname(FileData *fd, const char *idname)
 
 const char *bhead_id_name(const FileData *fd, const BHead *bhead)
 {
-	return (const char *)POINTER_OFFSET(bhead, sizeof(*bhead) + fd->id_name_offs);
+	/* without decompressing block compressed files, the name is kept with the block header */
+	return (const char *)POINTER_OFFSET(BHEADN_FROM_BHEAD(bhead)->data, fd->id_name_offs);
 }
 
 static ID *is_yet_read(FileData *fd, Main *mainvar, BHead *bhead)
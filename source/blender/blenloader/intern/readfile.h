@@ -62,6 +62,13 @@ typedef struct FileData {
 	int filedes;
 	gzFile gzfiledes;
 
+	// variables needed for reading from a memory mapped file
+	char *mmap_buffer;
+	size_t mmap_size, mmap_seek;
+	
+	// block compressed files, chunks get decompressed as blocks are read
+	struct FileDataLZO *lzo;
+
 	// now only in use for library appending
 	char relabase[FILE_MAX];
 	
@@ -76,9 +83,10 @@ typedef struct FileData {
 	struct SDNA *filesdna;
 	struct SDNA *memsdna;
 	char *compflags;
+	struct DNA_ReconstructInfo *reconstruct_info;
 	
 	int fileversion;
-	int id_name_offs;       /* used to retrieve ID names from (bhead+1) */
+	int id_name_offs;       /* used to retrieve ID names from the block data (BHeadN.data) */
 	int globalf, fileflags; /* for do_versions patching */
 	
 	struct OldNewMap *datamap;
@@ -94,6 +102,9 @@ typedef struct FileData {
 
 	/* see: USE_GHASH_BHEAD */
 	struct GHash *bhead_idname_hash;
+
+	/* see: USE_PARALLEL_DIRECT_LINK, only set while reading the main file */
+	struct DirectLinkTasks *direct_link_tasks;
 	
 	ListBase *mainlist;
 	
@@ -106,9 +117,19 @@ typedef struct FileData {
 
 typedef struct BHeadN {
 	struct BHeadN *next, *prev;
+	/* points right after bhead, or into the file when it is memory mapped,
+	 * for block compressed files it's only set once read, see: blo_bhead_data */
+	void *data;
+#ifdef WITH_LZO
+	size_t lzo_offset;  /* of the data in the regular file */
+	bool lzo_is_read;   /* else data is NULL or only holds the start of the block */
+	bool lzo_is_alloc;  /* data spans chunks so it's a copy, freed with the block */
+#endif
 	struct BHead bhead;
 } BHeadN;
 
+#define BHEADN_FROM_BHEAD(bh) ((BHeadN *)POINTER_OFFSET(bh, -offsetof(BHeadN, bhead)))
+
 
 #define FD_FLAGS_SWITCH_ENDIAN             (1 << 0)
 #define FD_FLAGS_FILE_POINTSIZE_IS_4       (1 << 1)
@@ -146,6 +167,7 @@ void blo_freefiledata(FileData *fd);
 BHead *blo_firstbhead(FileData *fd);
 BHead *blo_nextbhead(FileData *fd, BHead *thisblock);
 BHead *blo_prevbhead(FileData *fd, BHead *thisblock);
+void *blo_bhead_data(FileData *fd, const BHead *bhead);
 
 const char *bhead_id_name(const FileData *fd, const BHead *bhead);
 
@@ -40,6 +40,8 @@
 #include "DNA_listBase.h"
 
 #include "BLI_blenlib.h"
+#include "BLI_ghash.h"
+#include "BLI_hash_mm2a.h"
 
 #include "BLO_undofile.h"
 
@@ -56,56 +58,109 @@ void BLO_free_memfile(MemFile *memfile)
 		MEM_freeN(chunk);
 	}
 	memfile->size = 0;
+	memfile->size_total = 0;
 }
 
 /* to keep list of memfiles consistent, 'first' is always first in list */
 /* result is that 'first' is being freed */
 void BLO_merge_memfile(MemFile *first, MemFile *second)
 {
+	/* buffers shared by 'second' are usually in the chunk at the same position in 'first',
+	 * but can be anywhere in it (see add_memfilechunk), those are found by address */
+	GHash *owners = NULL;  /* created on the first buffer not found at its position */
 	MemFileChunk *fc, *sc;
 	
-	fc = first->chunks.first;
-	sc = second->chunks.first;
-	while (fc || sc) {
-		if (fc && sc) {
-			if (sc->ident) {
+	for (fc = first->chunks.first, sc = second->chunks.first; sc; sc = sc->next) {
+		if (sc->ident) {
+			MemFileChunk *owner = NULL;
+			
+			if (fc && fc->ident == 0 && fc->buf == sc->buf) {
+				owner = fc;
+			}
+			else {
+				if (owners == NULL) {
+					MemFileChunk *chunk;
+					
+					owners = BLI_ghash_ptr_new_ex(__func__, (unsigned int)BLI_listbase_count(&first->chunks));
+					for (chunk = first->chunks.first; chunk; chunk = chunk->next) {
+						if (chunk->ident == 0) {
+							BLI_ghash_insert(owners, chunk->buf, chunk);
+						}
+					}
+				}
+				owner = BLI_ghash_popkey(owners, sc->buf, NULL);
+			}
+			
+			/* the owner can be handed over already, when 'second' shares its buffer twice */
+			if (owner && owner->ident == 0) {
 				sc->ident = 0;
-				fc->ident = 1;
+				owner->ident = 1;  /* free in 'first' */
+				second->size += sc->size;
 			}
 		}
-		if (fc) fc = fc->next;
-		if (sc) sc = sc->next;
+		
+		if (fc) {
+			fc = fc->next;
+		}
+	}
+	
+	if (owners) {
+		BLI_ghash_free(owners, NULL, NULL);
 	}
 	
 	BLO_free_memfile(first);
 }
 
-static int my_memcmp(const int *mem1, const int *mem2, const int len)
+/* chunks of the previous step, by content */
+static unsigned int memfilechunk_hash(const void *key)
+{
+	return ((const MemFileChunk *)key)->hash;
+}
+
+static bool memfilechunk_cmp(const void *a, const void *b)
 {
-	register int a = len;
-	register const int *mema = mem1;
-	register const int *memb = mem2;
+	const MemFileChunk *chunk_a = a, *chunk_b = b;
 	
-	while (a--) {
-		if (*mema != *memb) return 1;
-		mema++;
-		memb++;
+	return !((chunk_a->hash == chunk_b->hash) &&
+	         (chunk_a->size == chunk_b->size) &&
+	         (memcmp(chunk_a->buf, chunk_b->buf, chunk_a->size) == 0));
+}
+
+static GHash *memfilechunk_hash_new(MemFile *compare)
+{
+	GHash *gh = BLI_ghash_new_ex(memfilechunk_hash, memfilechunk_cmp, __func__,
+	                             (unsigned int)BLI_listbase_count(&compare->chunks));
+	MemFileChunk *chunk;
+	
+	for (chunk = compare->chunks.first; chunk; chunk = chunk->next) {
+		BLI_ghash_reinsert(gh, chunk, chunk, NULL, NULL);
 	}
-	return 0;
+	
+	return gh;
 }
 
+/**
+ * Add a chunk to \a current, sharing the buffer of an identical chunk of the previous step when there is one.
+ *
+ * The chunk at the same position is tried first, then all chunks by their content,
+ * so data that moved (like when an ID was added before it) is still shared.
+ * writefile.c starts every ID in a new chunk, so unchanged ID's give identical chunks.
+ */
 void add_memfilechunk(MemFile *compare, MemFile *current, const char *buf, unsigned int size)
 {
+	static MemFile *compfile = NULL;
 	static MemFileChunk *compchunk = NULL;
+	static GHash *comphash = NULL;  /* created on the first chunk that moved */
 	MemFileChunk *curchunk;
 	
 	/* this function inits when compare != NULL or when current == NULL  */
-	if (compare) {
-		compchunk = compare->chunks.first;
-		return;
-	}
-	if (current == NULL) {
-		compchunk = NULL;
+	if (compare || current == NULL) {
+		if (comphash) {
+			BLI_ghash_free(comphash, NULL, NULL);
+			comphash = NULL;
+		}
+		compfile = compare;
+		compchunk = compare ? compare->chunks.first : NULL;
 		return;
 	}
 	
@@ -117,20 +172,42 @@ void add_memfilechunk(MemFile *compare, MemFile *current, const char *buf, unsig
 	
 	/* we compare compchunk with buf */
 	if (compchunk) {
-		if (compchunk->size == curchunk->size) {
-			if (my_memcmp((int *)compchunk->buf, (const int *)buf, size / 4) == 0) {
-				curchunk->buf = compchunk->buf;
-				curchunk->ident = 1;
-			}
+		if ((compchunk->size == size) && (memcmp(compchunk->buf, buf, size) == 0)) {
+			curchunk->buf = compchunk->buf;
+			curchunk->hash = compchunk->hash;
+			curchunk->ident = 1;
 		}
 		compchunk = compchunk->next;
 	}
 	
-	/* not equal... */
 	if (curchunk->buf == NULL) {
-		curchunk->buf = MEM_mallocN(size, "Chunk buffer");
-		memcpy(curchunk->buf, buf, size);
-		current->size += size;
+		curchunk->buf = (char *)buf;
+		curchunk->hash = BLI_hash_mm2((const unsigned char *)buf, size, 0);
+		
+		if (compfile) {
+			MemFileChunk *chunk;
+			
+			if (comphash == NULL) {
+				comphash = memfilechunk_hash_new(compfile);
+			}
+			
+			chunk = BLI_ghash_lookup(comphash, curchunk);
+			if (chunk) {
+				curchunk->buf = chunk->buf;
+				curchunk->ident = 1;
+				/* continue comparing after it */
+				compchunk = chunk->next;
+			}
+		}
+		
+		/* not equal... */
+		if (curchunk->ident == 0) {
+			curchunk->buf = MEM_mallocN(size, "Chunk buffer");
+			memcpy(curchunk->buf, buf, size);
+			current->size += size;
+		}
 	}
+	
+	current->size_total += size;
 }
 
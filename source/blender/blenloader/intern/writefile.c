@@ -143,6 +143,9 @@
 #include "BLI_blenlib.h"
 #include "BLI_linklist.h"
 #include "BLI_mempool.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
+#include "BLI_endian_switch.h"
 
 #include "BKE_action.h"
 #include "BKE_blender.h"
@@ -175,6 +178,15 @@
 
 #include <errno.h>
 
+#ifdef WITH_LZO
+#  ifdef WITH_SYSTEM_LZO
+#    include <lzo/lzo1x.h>
+#  else
+#    include "minilzo.h"
+#  endif
+#  define LZO_OUT_LEN(size)     ((size) + (size) / 16 + 64 + 3)
+#endif
+
 /* ********* my write, buffered writing with minimum size chunks ************ */
 
 #define MYWRITE_BUFFER_SIZE	100000
@@ -188,8 +200,11 @@
 typedef enum {
 	WW_WRAP_NONE = 1,
 	WW_WRAP_ZLIB,
+	WW_WRAP_LZO,
 } eWriteWrapType;
 
+struct WriteWrapLZO;
+
 typedef struct WriteWrap WriteWrap;
 struct WriteWrap {
 	/* callbacks */
@@ -201,6 +216,7 @@ struct WriteWrap {
 	union {
 		int file_handle;
 		gzFile gz_handle;
+		struct WriteWrapLZO *lzo_handle;
 	} _user_data;
 };
 
@@ -260,6 +276,287 @@ static size_t ww_write_zlib(WriteWrap *ww, const char *buf, size_t buf_len)
 }
 #undef FILE_HANDLE
 
+#ifdef WITH_LZO
+
+/* lzo, block compressed in parallel, see: BLEND_LZO_MAGIC */
+#define FILE_HANDLE(ww) \
+	(ww)->_user_data.lzo_handle
+
+/* max chunks kept in memory while they're compressed */
+#define WW_LZO_BATCH_MAX 32
+
+typedef struct WriteWrapLZOChunk {
+	unsigned char *in, *out;
+	lzo_uint in_len, out_len;
+} WriteWrapLZOChunk;
+
+typedef struct WriteWrapLZO {
+	int file_handle;
+	bool error;
+
+	TaskPool *pool;
+	void **wrkmem;  /* per thread */
+	int num_threads;
+
+	/* chunks being compressed, the last one gets filled */
+	WriteWrapLZOChunk *batch;
+	int batch_len, batch_size;
+
+	BlendLZOChunk *index;
+	unsigned int index_len, index_alloc;
+	uint64_t offset, size_raw;
+
+	/* the file without the data of its blocks, see: BLEND_LZO_ID_PREFIX_LEN */
+	char *headers;
+	size_t headers_len, headers_alloc;
+	unsigned int headers_num;   /* the first one is the file header */
+	size_t header_fill;         /* of the header being added */
+	uint64_t data_keep, data_skip;  /* left of the current block */
+} WriteWrapLZO;
+
+static void ww_lzo_chunk_compress(TaskPool *__restrict pool, void *taskdata, int threadid)
+{
+	WriteWrapLZO *lzo = BLI_task_pool_userdata(pool);
+	WriteWrapLZOChunk *chunk = taskdata;
+	int r;
+
+	r = lzo1x_1_compress(chunk->in, chunk->in_len, chunk->out, &chunk->out_len, lzo->wrkmem[threadid]);
+
+	/* store as is */
+	if ((r != LZO_E_OK) || (chunk->out_len >= chunk->in_len)) {
+		chunk->out_len = chunk->in_len;
+	}
+}
+
+static void ww_lzo_write_raw(WriteWrapLZO *lzo, const void *buf, size_t buf_len)
+{
+	const char *cp = buf;
+
+	while (buf_len && !lzo->error) {
+		const int len = (int)write(lzo->file_handle, cp, MIN2(buf_len, (size_t)INT_MAX));
+		if (len <= 0) {
+			lzo->error = true;
+		}
+		else {
+			cp += len;
+			buf_len -= (size_t)len;
+		}
+	}
+}
+
+static void ww_lzo_headers_append(WriteWrapLZO *lzo, const char *buf, size_t len)
+{
+	if (lzo->headers_len + len > lzo->headers_alloc) {
+		lzo->headers_alloc = MAX2(lzo->headers_alloc * 2, lzo->headers_len + len + 4096);
+		lzo->headers = MEM_reallocN(lzo->headers, lzo->headers_alloc);
+	}
+	memcpy(lzo->headers + lzo->headers_len, buf, len);
+	lzo->headers_len += len;
+}
+
+/* follow the blocks in what gets written, keeping their headers */
+static void ww_lzo_headers_add(WriteWrapLZO *lzo, const char *buf, size_t buf_len)
+{
+	while (buf_len) {
+		size_t len;
+
+		if (lzo->data_keep) {
+			len = (size_t)MIN2((uint64_t)buf_len, lzo->data_keep);
+			ww_lzo_headers_append(lzo, buf, len);
+			lzo->data_keep -= len;
+		}
+		else if (lzo->data_skip) {
+			len = (size_t)MIN2((uint64_t)buf_len, lzo->data_skip);
+			lzo->data_skip -= len;
+		}
+		else {
+			const size_t header_size = lzo->headers_num ? sizeof(BHead) : SIZEOFBLENDERHEADER;
+
+			len = MIN2(buf_len, header_size - lzo->header_fill);
+			ww_lzo_headers_append(lzo, buf, len);
+			lzo->header_fill += len;
+
+			if (lzo->header_fill == header_size) {
+				if (lzo->headers_num) {
+					BHead bhead;
+					uint64_t bhead_len;
+
+					memcpy(&bhead, lzo->headers + lzo->headers_len - sizeof(bhead), sizeof(bhead));
+					bhead_len = (uint64_t)MAX2(bhead.len, 0);
+					lzo->data_keep = (bhead.code != DATA) ? MIN2(bhead_len, BLEND_LZO_ID_PREFIX_LEN) : 0;
+					lzo->data_skip = bhead_len - lzo->data_keep;
+				}
+				lzo->headers_num++;
+				lzo->header_fill = 0;
+			}
+		}
+
+		buf += len;
+		buf_len -= len;
+	}
+}
+
+/* wait for the chunks of the batch and write them out in order */
+static void ww_lzo_batch_write(WriteWrapLZO *lzo)
+{
+	int i;
+
+	BLI_task_pool_work_and_wait(lzo->pool);
+
+	for (i = 0; i < lzo->batch_len; i++) {
+		WriteWrapLZOChunk *chunk = &lzo->batch[i];
+		const bool is_stored = (chunk->out_len == chunk->in_len);
+		BlendLZOChunk *entry;
+
+		if (lzo->index_len == lzo->index_alloc) {
+			lzo->index_alloc = lzo->index_alloc ? lzo->index_alloc * 2 : 64;
+			lzo->index = MEM_reallocN(lzo->index, sizeof(*lzo->index) * lzo->index_alloc);
+		}
+
+		entry = &lzo->index[lzo->index_len++];
+		entry->offset = lzo->offset;
+		entry->size = (uint32_t)chunk->out_len;
+		entry->size_raw = (uint32_t)chunk->in_len;
+
+		ww_lzo_write_raw(lzo, is_stored ? chunk->in : chunk->out, chunk->out_len);
+
+		lzo->offset += chunk->out_len;
+		lzo->size_raw += chunk->in_len;
+		chunk->in_len = 0;
+	}
+
+	lzo->batch_len = 0;
+}
+
+/* the last chunk of the batch is filled, compress it meanwhile the next ones are */
+static void ww_lzo_chunk_push(WriteWrapLZO *lzo)
+{
+	WriteWrapLZOChunk *chunk = &lzo->batch[lzo->batch_len++];
+
+	chunk->out_len = LZO_OUT_LEN(chunk->in_len);
+	BLI_task_pool_push(lzo->pool, ww_lzo_chunk_compress, chunk, false, TASK_PRIORITY_HIGH);
+
+	if (lzo->batch_len == lzo->batch_size) {
+		ww_lzo_batch_write(lzo);
+	}
+}
+
+static bool ww_open_lzo(WriteWrap *ww, const char *filepath)
+{
+	TaskScheduler *scheduler = BLI_task_scheduler_get();
+	const int num_threads = BLI_task_scheduler_num_threads(scheduler);
+	WriteWrapLZO *lzo;
+	int file, i;
+
+	file = BLI_open(filepath, O_BINARY + O_WRONLY + O_CREAT + O_TRUNC, 0666);
+
+	if (file == -1) {
+		return false;
+	}
+
+	lzo = MEM_callocN(sizeof(*lzo), __func__);
+	lzo->file_handle = file;
+	lzo->num_threads = num_threads;
+
+	lzo->wrkmem = MEM_mallocN(sizeof(*lzo->wrkmem) * (size_t)num_threads, __func__);
+	for (i = 0; i < num_threads; i++) {
+		lzo->wrkmem[i] = MEM_mallocN(LZO1X_1_MEM_COMPRESS, __func__);
+	}
+
+	lzo->batch_size = CLAMPIS(num_threads * 2, 2, WW_LZO_BATCH_MAX);
+	lzo->batch = MEM_callocN(sizeof(*lzo->batch) * (size_t)lzo->batch_size, __func__);
+	for (i = 0; i < lzo->batch_size; i++) {
+		lzo->batch[i].in = MEM_mallocN(BLEND_LZO_CHUNK_SIZE, __func__);
+		lzo->batch[i].out = MEM_mallocN(LZO_OUT_LEN(BLEND_LZO_CHUNK_SIZE), __func__);
+	}
+
+	lzo->pool = BLI_task_pool_create(scheduler, lzo);
+
+	ww_lzo_write_raw(lzo, BLEND_LZO_MAGIC, BLEND_LZO_MAGIC_LEN);
+	lzo->offset = BLEND_LZO_MAGIC_LEN;
+
+	FILE_HANDLE(ww) = lzo;
+	return true;
+}
+static bool ww_close_lzo(WriteWrap *ww)
+{
+	WriteWrapLZO *lzo = FILE_HANDLE(ww);
+	BlendLZOFooter footer;
+	bool ok;
+	int i;
+
+	if (lzo->batch[lzo->batch_len].in_len) {
+		ww_lzo_chunk_push(lzo);
+	}
+	ww_lzo_batch_write(lzo);
+
+	footer.index_offset = lzo->offset + lzo->headers_len;
+	footer.size_raw = lzo->size_raw;
+	footer.chunks_num = lzo->index_len;
+	footer.chunk_size = BLEND_LZO_CHUNK_SIZE;
+	memcpy(footer.magic, BLEND_LZO_MAGIC, sizeof(footer.magic));
+
+	if (ENDIAN_ORDER == B_ENDIAN) {
+		for (i = 0; i < (int)lzo->index_len; i++) {
+			BLI_endian_switch_uint64(&lzo->index[i].offset);
+			BLI_endian_switch_uint32(&lzo->index[i].size);
+			BLI_endian_switch_uint32(&lzo->index[i].size_raw);
+		}
+		BLI_endian_switch_uint64(&footer.index_offset);
+		BLI_endian_switch_uint64(&footer.size_raw);
+		BLI_endian_switch_uint32(&footer.chunks_num);
+		BLI_endian_switch_uint32(&footer.chunk_size);
+	}
+
+	ww_lzo_write_raw(lzo, lzo->headers, lzo->headers_len);
+	ww_lzo_write_raw(lzo, lzo->index, sizeof(*lzo->index) * lzo->index_len);
+	ww_lzo_write_raw(lzo, &footer, sizeof(footer));
+
+	ok = (close(lzo->file_handle) != -1) && !lzo->error;
+
+	BLI_task_pool_free(lzo->pool);
+	for (i = 0; i < lzo->batch_size; i++) {
+		MEM_freeN(lzo->batch[i].in);
+		MEM_freeN(lzo->batch[i].out);
+	}
+	for (i = 0; i < lzo->num_threads; i++) {
+		MEM_freeN(lzo->wrkmem[i]);
+	}
+	MEM_freeN(lzo->wrkmem);
+	MEM_freeN(lzo->batch);
+	MEM_SAFE_FREE(lzo->index);
+	MEM_SAFE_FREE(lzo->headers);
+	MEM_freeN(lzo);
+
+	return ok;
+}
+static size_t ww_write_lzo(WriteWrap *ww, const char *buf, size_t buf_len)
+{
+	WriteWrapLZO *lzo = FILE_HANDLE(ww);
+	size_t remaining = buf_len;
+
+	ww_lzo_headers_add(lzo, buf, buf_len);
+
+	while (remaining) {
+		WriteWrapLZOChunk *chunk = &lzo->batch[lzo->batch_len];
+		const size_t len = MIN2(remaining, BLEND_LZO_CHUNK_SIZE - chunk->in_len);
+
+		memcpy(chunk->in + chunk->in_len, buf, len);
+		chunk->in_len += len;
+		buf += len;
+		remaining -= len;
+
+		if (chunk->in_len == BLEND_LZO_CHUNK_SIZE) {
+			ww_lzo_chunk_push(lzo);
+		}
+	}
+
+	return lzo->error ? 0 : buf_len;
+}
+#undef FILE_HANDLE
+
+#endif  /* WITH_LZO */
+
 /* --- end compression types --- */
 
 static void ww_handle_init(eWriteWrapType ww_type, WriteWrap *r_ww)
@@ -274,6 +571,15 @@ static void ww_handle_init(eWriteWrapType ww_type, WriteWrap *r_ww)
 			r_ww->write = ww_write_zlib;
 			break;
 		}
+#ifdef WITH_LZO
+		case WW_WRAP_LZO:
+		{
+			r_ww->open  = ww_open_lzo;
+			r_ww->close = ww_close_lzo;
+			r_ww->write = ww_write_lzo;
+			break;
+		}
+#endif
 		default:
 		{
 			r_ww->open  = ww_open_none;
@@ -287,6 +593,228 @@ static void ww_handle_init(eWriteWrapType ww_type, WriteWrap *r_ww)
 /** \} */
 
 
+/** \name Writing in a thread
+ *
+ * Files are written (and compressed) by a thread, while the data is still being serialized.
+ * Filled buffers are queued for the thread, which returns them once they're written.
+ * The thread also flushes the file to disk, before it replaces the previous file.
+ *
+ * With a single CPU the thread only adds the copy into its buffers, so data is written
+ * directly while serializing, without starting it (see: #WriteThread.use_thread).
+ * \{ */
+
+/* buffers in use at once, when waiting for the thread */
+#define WRITE_THREAD_BUFFERS 32
+/* buffers in use at once for #BLO_write_file_async (~32MB), once they're all filled
+ * serializing waits for the disk, instead of keeping the whole file in memory */
+#define WRITE_THREAD_BUFFERS_ASYNC 320
+
+typedef struct WriteBuffer {
+	unsigned char *data;
+	int len;
+} WriteBuffer;
+
+typedef struct WriteThread {
+	WriteWrap ww;
+	ListBase threads;
+	/* when false, buffers are written directly by #writedata_do_write */
+	bool use_thread;
+
+	ThreadQueue *queue_filled;
+	ThreadQueue *queue_free;
+	int buffers_len;
+	int buffers_max;
+
+	/* set by the thread */
+	bool error;
+	int error_errno;
+	/* the file is complete (or failed), protected by 'done_mutex' */
+	bool done;
+	ThreadMutex done_mutex;
+
+	char tempname[FILE_MAX + 1];
+	/* when set, the thread moves the written file here, see: #BLO_write_file_async */
+	char filepath[FILE_MAX];
+} WriteThread;
+
+/* a write still being finished by its thread */
+static WriteThread *write_thread_async = NULL;
+
+/* result of the last #BLO_write_file_async, kept until #BLO_write_file_async_wait reports it */
+static struct {
+	bool error;
+	int error_errno;
+	char filepath[FILE_MAX];
+} write_async_result = {false};
+
+/**
+ * Flush the file to disk, so it's complete once it replaces the previous file.
+ */
+static void write_file_sync(const char *filepath)
+{
+#ifndef WIN32
+	const int file = BLI_open(filepath, O_BINARY | O_RDONLY, 0);
+
+	if (file != -1) {
+		fsync(file);
+		close(file);
+	}
+#else
+	UNUSED_VARS(filepath);
+#endif
+}
+
+static void write_thread_write(WriteThread *wt, const void *data, const int len)
+{
+	if (!wt->error) {
+		errno = 0;
+		if (wt->ww.write(&wt->ww, data, (size_t)len) != (size_t)len) {
+			wt->error = true;
+			/* a short write (the disk is full) doesn't set errno */
+			wt->error_errno = errno ? errno : ENOSPC;
+		}
+	}
+}
+
+/* close the file and move it in place */
+static void write_thread_finish(WriteThread *wt)
+{
+	/* compressed data may only be written on closing */
+	if (wt->ww.close(&wt->ww) == false && !wt->error) {
+		wt->error = true;
+		wt->error_errno = errno;
+	}
+
+	if (!wt->error) {
+		write_file_sync(wt->tempname);
+
+		if (wt->filepath[0] && (BLI_rename(wt->tempname, wt->filepath) != 0)) {
+			wt->error = true;
+			wt->error_errno = errno;
+		}
+	}
+	else if (wt->filepath[0]) {
+		remove(wt->tempname);
+	}
+
+	BLI_mutex_lock(&wt->done_mutex);
+	wt->done = true;
+	BLI_mutex_unlock(&wt->done_mutex);
+}
+
+static void *write_thread_do(void *data)
+{
+	WriteThread *wt = data;
+	WriteBuffer *wb;
+
+	/* returns NULL once all buffers are written and no more will be pushed */
+	while ((wb = BLI_thread_queue_pop(wt->queue_filled))) {
+		write_thread_write(wt, wb->data, wb->len);
+		BLI_thread_queue_push(wt->queue_free, wb);
+	}
+
+	write_thread_finish(wt);
+
+	return NULL;
+}
+
+static WriteThread *write_thread_begin(const WriteWrap *ww, const char *tempname, const int buffers_max)
+{
+	WriteThread *wt = MEM_callocN(sizeof(*wt), __func__);
+
+	wt->ww = *ww;
+	BLI_strncpy(wt->tempname, tempname, sizeof(wt->tempname));
+	wt->queue_filled = BLI_thread_queue_init();
+	wt->queue_free = BLI_thread_queue_init();
+	wt->buffers_max = buffers_max;
+	BLI_mutex_init(&wt->done_mutex);
+
+	wt->use_thread = (BLI_system_thread_count() > 1);
+	if (wt->use_thread) {
+		BLI_init_threads(&wt->threads, write_thread_do, 1);
+		BLI_insert_thread(&wt->threads, wt);
+	}
+
+	return wt;
+}
+
+static bool write_thread_is_done(WriteThread *wt)
+{
+	bool done;
+
+	BLI_mutex_lock(&wt->done_mutex);
+	done = wt->done;
+	BLI_mutex_unlock(&wt->done_mutex);
+
+	return done;
+}
+
+/* a free buffer, only waits for the thread when the limit of buffers is reached */
+static WriteBuffer *write_thread_buffer_get(WriteThread *wt)
+{
+	WriteBuffer *wb;
+
+	if ((BLI_thread_queue_size(wt->queue_free) == 0) && (wt->buffers_len < wt->buffers_max)) {
+		wb = MEM_mallocN(sizeof(*wb), __func__);
+		wb->data = MEM_mallocN(MYWRITE_BUFFER_SIZE, __func__);
+		wt->buffers_len++;
+	}
+	else {
+		wb = BLI_thread_queue_pop(wt->queue_free);
+	}
+
+	wb->len = 0;
+	return wb;
+}
+
+static void write_thread_buffer_push(WriteThread *wt, WriteBuffer *wb)
+{
+	BLI_thread_queue_push(wt->queue_filled, wb);
+}
+
+static void write_thread_buffer_release(WriteThread *wt, WriteBuffer *wb)
+{
+	BLI_thread_queue_push(wt->queue_free, wb);
+}
+
+/**
+ * Wait for the thread to write all buffers and close the file.
+ * \return true on success.
+ */
+static bool write_thread_end(WriteThread *wt)
+{
+	WriteBuffer *wb;
+	bool ok;
+
+	if (wt->use_thread) {
+		BLI_thread_queue_nowait(wt->queue_filled);
+		BLI_end_threads(&wt->threads);
+	}
+	else if (!wt->done) {
+		write_thread_finish(wt);
+	}
+
+	while ((wb = BLI_thread_queue_pop_timeout(wt->queue_free, 0))) {
+		MEM_freeN(wb->data);
+		MEM_freeN(wb);
+	}
+	BLI_thread_queue_free(wt->queue_filled);
+	BLI_thread_queue_free(wt->queue_free);
+	BLI_mutex_end(&wt->done_mutex);
+
+	if (wt->error) {
+		errno = wt->error_errno;
+	}
+	ok = !wt->error;
+
+	MEM_freeN(wt);
+
+	return ok;
+}
+
+/** \} */
+
+
 
 typedef struct {
 	struct SDNA *sdna;
@@ -297,17 +825,18 @@ typedef struct {
 	
 	int tot, count, error, memsize;
 
-	/* Wrap writing, so we can use zlib or
-	 * other compression types later, see: G_FILE_COMPRESS
+	/* Writes in a thread, wrapping zlib or
+	 * other compression types, see: G_FILE_COMPRESS
 	 * Will be NULL for UNDO. */
-	WriteWrap *ww;
+	WriteThread *wt;
+	WriteBuffer *wbuf;  /* owner of 'buf' when writing in a thread */
 
 #ifdef USE_BMESH_SAVE_AS_COMPAT
 	char use_mesh_compat; /* option to save with older mesh format */
 #endif
 } WriteData;
 
-static WriteData *writedata_new(WriteWrap *ww)
+static WriteData *writedata_new(WriteThread *wt)
 {
 	WriteData *wd= MEM_callocN(sizeof(*wd), "writedata");
 
@@ -319,9 +848,15 @@ static WriteData *writedata_new(WriteWrap *ww)
 
 	wd->sdna = DNA_sdna_from_data(DNAstr, DNAlen, false);
 
-	wd->ww = ww;
+	wd->wt = wt;
 
-	wd->buf= MEM_mallocN(MYWRITE_BUFFER_SIZE, "wd->buf");
+	if (wt) {
+		wd->wbuf = write_thread_buffer_get(wt);
+		wd->buf = wd->wbuf->data;
+	}
+	else {
+		wd->buf= MEM_mallocN(MYWRITE_BUFFER_SIZE, "wd->buf");
+	}
 
 	return wd;
 }
@@ -335,18 +870,32 @@ static void writedata_do_write(WriteData *wd, const void *mem, int memlen)
 	if (wd->current) {
 		add_memfilechunk(NULL, wd->current, mem, memlen);
 	}
-	else {
-		if (wd->ww->write(wd->ww, mem, memlen) != memlen) {
+	else if (!wd->wt->use_thread) {
+		write_thread_write(wd->wt, mem, memlen);
+		if (wd->wt->error) {
 			wd->error = 1;
 		}
 	}
+	else {
+		/* hand the buffer to the thread and continue in a free one */
+		BLI_assert(mem == wd->buf);
+		wd->wbuf->len = memlen;
+		write_thread_buffer_push(wd->wt, wd->wbuf);
+		wd->wbuf = write_thread_buffer_get(wd->wt);
+		wd->buf = wd->wbuf->data;
+	}
 }
 
 static void writedata_free(WriteData *wd)
 {
 	DNA_sdna_free(wd->sdna);
 
-	MEM_freeN(wd->buf);
+	if (wd->wt) {
+		write_thread_buffer_release(wd->wt, wd->wbuf);
+	}
+	else {
+		MEM_freeN(wd->buf);
+	}
 	MEM_freeN(wd);
 }
 
@@ -376,6 +925,24 @@ static void mywrite(WriteData *wd, const void *adr, int len)
 
 	wd->tot+= len;
 	
+	/* the thread writes the buffers later, so data is always copied into them */
+	if (wd->wt && wd->wt->use_thread) {
+		while (len > 0) {
+			const int writelen = MIN2(len, MYWRITE_BUFFER_SIZE - wd->count);
+
+			memcpy(&wd->buf[wd->count], adr, writelen);
+			wd->count += writelen;
+			adr = (const char *)adr + writelen;
+			len -= writelen;
+
+			if (wd->count == MYWRITE_BUFFER_SIZE) {
+				writedata_do_write(wd, wd->buf, wd->count);
+				wd->count = 0;
+			}
+		}
+		return;
+	}
+
 	/* if we have a single big chunk, write existing data in
 	 * buffer and write out big chunk in smaller pieces */
 	if (len>MYWRITE_MAX_CHUNK) {
@@ -407,14 +974,14 @@ static void mywrite(WriteData *wd, const void *adr, int len)
 
 /**
  * BeGiN initializer for mywrite
- * \param file File descriptor
+ * \param wt Thread writing the file (NULL for undo).
  * \param compare Previous memory file (can be NULL).
  * \param current The current memory file (can be NULL).
  * \warning Talks to other functions with global parameters
  */
-static WriteData *bgnwrite(WriteWrap *ww, MemFile *compare, MemFile *current)
+static WriteData *bgnwrite(WriteThread *wt, MemFile *compare, MemFile *current)
 {
-	WriteData *wd= writedata_new(ww);
+	WriteData *wd= writedata_new(wt);
 
 	if (wd == NULL) return NULL;
 
@@ -441,6 +1008,11 @@ static int endwrite(WriteData *wd)
 		wd->count= 0;
 	}
 	
+	/* ends comparing */
+	if (wd->current) {
+		add_memfilechunk(NULL, NULL, NULL, 0);
+	}
+	
 	err= wd->error;
 	writedata_free(wd);
 
@@ -472,6 +1044,11 @@ static void writestruct_at_address(WriteData *wd, int filecode, const char *stru
 
 	if (bh.len==0) return;
 
+	/* for undo, start ID's in a new chunk, so unchanged ones can be shared, see: add_memfilechunk */
+	if (wd->current && (filecode != DATA)) {
+		mywrite(wd, MYWRITE_FLUSH, 0);
+	}
+
 	mywrite(wd, &bh, sizeof(BHead));
 	mywrite(wd, data, bh.len);
 }
@@ -3561,7 +4138,7 @@ static void write_thumb(WriteData *wd, const int *img)
 /* if MemFile * there's filesave to memory */
 static int write_file_handle(
         Main *mainvar,
-        WriteWrap *ww,
+        WriteThread *wt,
         MemFile *compare, MemFile *current,
         int write_user_block, int write_flags, const int *thumb)
 {
@@ -3572,7 +4149,7 @@ static int write_file_handle(
 
 	blo_split_main(&mainlist, mainvar);
 
-	wd = bgnwrite(ww, compare, current);
+	wd = bgnwrite(wt, compare, current);
 
 #ifdef USE_BMESH_SAVE_AS_COMPAT
 	wd->use_mesh_compat = (write_flags & G_FILE_MESH_COMPAT) != 0;
@@ -3694,22 +4271,54 @@ static bool do_history(const char *name, ReportList *reports)
 	return 0;
 }
 
+/* finish the file written by #BLO_write_file_async, keeping its result for the caller */
+static void write_thread_async_end(void)
+{
+	if (write_thread_async) {
+		WriteThread *wt = write_thread_async;
+
+		char filepath[FILE_MAX];
+
+		BLI_strncpy(filepath, wt->filepath, sizeof(filepath));
+		if (write_thread_end(wt) == false) {
+			write_async_result.error = true;
+			write_async_result.error_errno = errno;
+			BLI_strncpy(write_async_result.filepath, filepath, sizeof(write_async_result.filepath));
+		}
+		write_thread_async = NULL;
+	}
+}
+
 /* return: success (1) */
-int BLO_write_file(Main *mainvar, const char *filepath, int write_flags, ReportList *reports, const int *thumb)
+static int write_file_ex(
+        Main *mainvar, const char *filepath, int write_flags, ReportList *reports, const int *thumb,
+        const bool use_async)
 {
 	char tempname[FILE_MAX+1];
 	int err, write_user_block;
 	eWriteWrapType ww_type;
 	WriteWrap ww;
+	WriteThread *wt;
 
 	/* path backup/restore */
 	void     *path_list_backup = NULL;
 	const int path_list_flag = (BKE_BPATH_TRAVERSE_SKIP_LIBRARY | BKE_BPATH_TRAVERSE_SKIP_MULTIFILE);
 
+	/* one write at a time, the previous one may have been to the same file,
+	 * its result is still reported by #BLO_write_file_async_wait */
+	write_thread_async_end();
+
 	/* open temporary file, so we preserve the original in case we crash */
 	BLI_snprintf(tempname, sizeof(tempname), "%s@", filepath);
 
-	if (write_flags & G_FILE_COMPRESS) {
+	if (write_flags & G_FILE_COMPRESS_FAST) {
+#ifdef WITH_LZO
+		ww_type = WW_WRAP_LZO;
+#else
+		ww_type = WW_WRAP_ZLIB;
+#endif
+	}
+	else if (write_flags & G_FILE_COMPRESS) {
 		ww_type = WW_WRAP_ZLIB;
 	}
 	else {
@@ -3723,6 +4332,8 @@ int BLO_write_file(Main *mainvar, const char *filepath, int write_flags, ReportL
 		return 0;
 	}
 
+	wt = write_thread_begin(&ww, tempname, use_async ? WRITE_THREAD_BUFFERS_ASYNC : WRITE_THREAD_BUFFERS);
+
 	/* check if we need to backup and restore paths */
 	if (UNLIKELY((write_flags & G_FILE_RELATIVE_REMAP) && (G_FILE_SAVE_COPY & write_flags))) {
 		path_list_backup = BKE_bpath_list_backup(mainvar, path_list_flag);
@@ -3759,15 +4370,27 @@ int BLO_write_file(Main *mainvar, const char *filepath, int write_flags, ReportL
 		BKE_bpath_relative_convert(mainvar, filepath, NULL); /* note, making relative to something OTHER then G.main->name */
 
 	/* actual file writing */
-	err = write_file_handle(mainvar, &ww, NULL, NULL, write_user_block, write_flags, thumb);
-
-	ww.close(&ww);
+	err = write_file_handle(mainvar, wt, NULL, NULL, write_user_block, write_flags, thumb);
 
 	if (UNLIKELY(path_list_backup)) {
 		BKE_bpath_list_restore(mainvar, path_list_flag, path_list_backup);
 		BKE_bpath_list_free(path_list_backup);
 	}
 
+	/* without a thread the file is already written, finish it like any other */
+	if (use_async && wt->use_thread && !err) {
+		/* all data is in the buffers of the thread, it finishes the file on its own */
+		BLI_strncpy(wt->filepath, filepath, sizeof(wt->filepath));
+		BLI_thread_queue_nowait(wt->queue_filled);
+		write_thread_async = wt;
+
+		return 1;
+	}
+
+	if (write_thread_end(wt) == false) {
+		err = 1;
+	}
+
 	if (err) {
 		BKE_report(reports, RPT_ERROR, strerror(errno));
 		remove(tempname);
@@ -3793,6 +4416,57 @@ int BLO_write_file(Main *mainvar, const char *filepath, int write_flags, ReportL
 	return 1;
 }
 
+/* return: success (1) */
+int BLO_write_file(Main *mainvar, const char *filepath, int write_flags, ReportList *reports, const int *thumb)
+{
+	return write_file_ex(mainvar, filepath, write_flags, reports, thumb, false);
+}
+
+/**
+ * Write a file without waiting for the disk: once the data is serialized (into memory),
+ * the thread writing it finishes the file on its own, see: #BLO_write_file_async_wait.
+ * Only the last #WRITE_THREAD_BUFFERS_ASYNC buffers are kept in memory, serializing waits
+ * for the thread when they're all in use. With a single CPU the file is written before returning.
+ *
+ * Meant for autosave, there is no thumbnail or version backup (#G_FILE_HISTORY).
+ *
+ * \return success (1) of serializing the data,
+ * failing to write it is only known from #BLO_write_file_async_wait.
+ */
+int BLO_write_file_async(Main *mainvar, const char *filepath, int write_flags, ReportList *reports)
+{
+	return write_file_ex(mainvar, filepath, write_flags & ~G_FILE_HISTORY, reports, NULL, true);
+}
+
+/**
+ * \return false while the file written by #BLO_write_file_async is still being written,
+ * so #BLO_write_file_async_wait would have to wait for it.
+ */
+bool BLO_write_file_async_is_done(void)
+{
+	return (write_thread_async == NULL) || write_thread_is_done(write_thread_async);
+}
+
+/**
+ * Wait for the file written by #BLO_write_file_async to be complete.
+ * A failure is reported here once, also when another write already waited for the file.
+ *
+ * \return false (and an error in \a reports) when it couldn't be written.
+ */
+bool BLO_write_file_async_wait(ReportList *reports)
+{
+	write_thread_async_end();
+
+	if (write_async_result.error) {
+		write_async_result.error = false;
+		BKE_reportf(reports, RPT_ERROR, "Cannot write file '%s' in the background: %s",
+		            write_async_result.filepath, strerror(write_async_result.error_errno));
+		return false;
+	}
+
+	return true;
+}
+
 /* return: success (1) */
 int BLO_write_file_mem(Main *mainvar, MemFile *compare, MemFile *current, int write_flags)
 {
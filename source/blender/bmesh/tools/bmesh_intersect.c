@@ -774,6 +774,23 @@ static void bm_isect_tri_tri(
 	}
 }
 
+#ifdef USE_BVH
+/**
+ * Skip triangles sharing a vertex while finding overlaps,
+ * #bm_isect_tri_tri ignores them and there are many of those.
+ */
+static bool bm_bvhtree_overlap_cb(void *userdata, int index_a, int index_b, int UNUSED(thread))
+{
+	BMLoop *(*looptris)[3] = userdata;
+	BMLoop **a = looptris[index_a];
+	BMLoop **b = looptris[index_b];
+
+	return !(ELEM(a[0]->v, b[0]->v, b[1]->v, b[2]->v) ||
+	         ELEM(a[1]->v, b[0]->v, b[1]->v, b[2]->v) ||
+	         ELEM(a[2]->v, b[0]->v, b[1]->v, b[2]->v));
+}
+#endif
+
 /**
  * Intersect tessellated faces
  * leaving the resulting edges tagged.
@@ -885,7 +902,7 @@ bool BM_mesh_intersect(
 		tree_b = tree_a;
 	}
 
-	overlap = BLI_bvhtree_overlap(tree_b, tree_a, &tree_overlap_tot);
+	overlap = BLI_bvhtree_overlap(tree_b, tree_a, &tree_overlap_tot, bm_bvhtree_overlap_cb, looptris);
 
 	if (overlap) {
 		unsigned int i;
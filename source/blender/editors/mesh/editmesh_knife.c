@@ -1514,7 +1514,7 @@ static void knife_find_line_hits(KnifeTool_OpData *kcd)
 	BLI_bvhtree_insert(planetree, 0, plane_cos, 4);
 	BLI_bvhtree_balance(planetree);
 
-	results = BLI_bvhtree_overlap(tree, planetree, &tot);
+	results = BLI_bvhtree_overlap(tree, planetree, &tot, NULL, NULL);
 	if (!results) {
 		BLI_bvhtree_free(planetree);
 		return;
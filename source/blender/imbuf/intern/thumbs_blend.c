@@ -26,9 +26,27 @@
 
 
 #include <string.h>
+#include <fcntl.h>
+
+#ifdef WIN32
+#  include <io.h>
+#  include "BLI_winstuff.h"
+#else
+#  include <unistd.h>
+#endif
 
 #include "zlib.h"
 
+#ifdef WITH_LZO
+#  ifdef WITH_SYSTEM_LZO
+#    include <lzo/lzo1x.h>
+#  else
+#    include "minilzo.h"
+#  endif
+#endif
+
+#include "MEM_guardedalloc.h"
+
 #include "BLI_utildefines.h"
 #include "BLI_endian_switch.h"
 #include "BLI_fileops.h"
@@ -41,10 +59,179 @@
 #include "IMB_imbuf.h"
 #include "IMB_thumbs.h"
 
+/* the start of a blend file, compressed with gzip or not, or block compressed (see: BLEND_LZO_MAGIC) */
+typedef struct BlendThumbFile {
+	gzFile gzfile;
+#ifdef WITH_LZO
+	/* when the file is block compressed, chunk is set */
+	int file;
+	BlendLZOFooter footer;
+	unsigned int chunk_next;
+	unsigned char *in;
+	char *chunk;
+	size_t chunk_len, chunk_seek;
+#endif
+} BlendThumbFile;
+
+#ifdef WITH_LZO
+
+static bool blend_thumb_lzo_read_raw(int file, uint64_t offset, void *buf, size_t len)
+{
+	return (lseek(file, (off_t)offset, SEEK_SET) != -1) &&
+	       (read(file, buf, (unsigned int)len) == (int)len);
+}
+
+/* only the chunks at the start of the file are read, the thumbnail comes right after the 'REND' blocks */
+static bool blend_thumb_lzo_chunk_next(BlendThumbFile *tf)
+{
+	BlendLZOChunk chunk;
+
+	if (tf->chunk_next == tf->footer.chunks_num) {
+		return false;
+	}
+
+	if (!blend_thumb_lzo_read_raw(tf->file, tf->footer.index_offset + sizeof(chunk) * tf->chunk_next,
+	                              &chunk, sizeof(chunk)))
+	{
+		return false;
+	}
+
+	if (ENDIAN_ORDER == B_ENDIAN) {
+		BLI_endian_switch_uint64(&chunk.offset);
+		BLI_endian_switch_uint32(&chunk.size);
+		BLI_endian_switch_uint32(&chunk.size_raw);
+	}
+
+	if ((chunk.size > chunk.size_raw) || (chunk.size_raw > tf->footer.chunk_size) ||
+	    !blend_thumb_lzo_read_raw(tf->file, chunk.offset, tf->in, chunk.size))
+	{
+		return false;
+	}
+
+	if (chunk.size == chunk.size_raw) {
+		memcpy(tf->chunk, tf->in, chunk.size);
+	}
+	else {
+		lzo_uint out_len = chunk.size_raw;
+		const int r = lzo1x_decompress_safe(tf->in, chunk.size, (unsigned char *)tf->chunk, &out_len, NULL);
+
+		if ((r != LZO_E_OK) || (out_len != chunk.size_raw)) {
+			return false;
+		}
+	}
+
+	tf->chunk_len = chunk.size_raw;
+	tf->chunk_seek = 0;
+	tf->chunk_next++;
+
+	return true;
+}
+
+static bool blend_thumb_lzo_open(BlendThumbFile *tf, const char *path)
+{
+	char magic[BLEND_LZO_MAGIC_LEN];
+	const int file = BLI_open(path, O_BINARY | O_RDONLY, 0);
+
+	if (file == -1) {
+		return false;
+	}
+
+	if ((read(file, magic, sizeof(magic)) == sizeof(magic)) &&
+	    (memcmp(magic, BLEND_LZO_MAGIC, sizeof(magic)) == 0) &&
+	    (lseek(file, -(off_t)sizeof(tf->footer), SEEK_END) != -1) &&
+	    (read(file, &tf->footer, sizeof(tf->footer)) == sizeof(tf->footer)) &&
+	    (memcmp(tf->footer.magic, BLEND_LZO_MAGIC, sizeof(tf->footer.magic)) == 0))
+	{
+		if (ENDIAN_ORDER == B_ENDIAN) {
+			BLI_endian_switch_uint64(&tf->footer.index_offset);
+			BLI_endian_switch_uint64(&tf->footer.size_raw);
+			BLI_endian_switch_uint32(&tf->footer.chunks_num);
+			BLI_endian_switch_uint32(&tf->footer.chunk_size);
+		}
+
+		/* larger chunks are never written, don't trust them */
+		if (tf->footer.chunk_size <= BLEND_LZO_CHUNK_SIZE) {
+			tf->file = file;
+			tf->in = MEM_mallocN(tf->footer.chunk_size, __func__);
+			tf->chunk = MEM_mallocN(tf->footer.chunk_size, __func__);
+			return true;
+		}
+	}
+
+	close(file);
+	return false;
+}
+
+#endif  /* WITH_LZO */
+
+static bool blend_thumb_open(BlendThumbFile *tf, const char *path)
+{
+	memset(tf, 0, sizeof(*tf));
+
+#ifdef WITH_LZO
+	if (blend_thumb_lzo_open(tf, path)) {
+		return true;
+	}
+#endif
+
+	/* not necessarily a gzip */
+	tf->gzfile = BLI_gzopen(path, "rb");
+
+	return (tf->gzfile != NULL);
+}
+
+static void blend_thumb_close(BlendThumbFile *tf)
+{
+#ifdef WITH_LZO
+	if (tf->chunk) {
+		close(tf->file);
+		MEM_freeN(tf->in);
+		MEM_freeN(tf->chunk);
+		return;
+	}
+#endif
+
+	gzclose(tf->gzfile);
+}
+
+/* reads len bytes into buf, or skips them when buf is NULL, returns the number of bytes read */
+static int blend_thumb_read(BlendThumbFile *tf, void *buf, int len)
+{
+#ifdef WITH_LZO
+	if (tf->chunk) {
+		char *cp = buf;
+		int readsize = 0;
+
+		while (readsize < len) {
+			int chunk_len;
+
+			if ((tf->chunk_seek == tf->chunk_len) && !blend_thumb_lzo_chunk_next(tf)) {
+				break;
+			}
+
+			chunk_len = (int)MIN2((size_t)(len - readsize), tf->chunk_len - tf->chunk_seek);
+			if (cp) {
+				memcpy(cp + readsize, tf->chunk + tf->chunk_seek, (size_t)chunk_len);
+			}
+			tf->chunk_seek += (size_t)chunk_len;
+			readsize += chunk_len;
+		}
+
+		return readsize;
+	}
+#endif
+
+	if (buf == NULL) {
+		return (gzseek(tf->gzfile, len, SEEK_CUR) != -1) ? len : 0;
+	}
+
+	return gzread(tf->gzfile, buf, len);
+}
+
 /* extracts the thumbnail from between the 'REND' and the 'GLOB'
  * chunks of the header, don't use typical blend loader because its too slow */
 
-static ImBuf *loadblend_thumb(gzFile gzfile)
+static ImBuf *loadblend_thumb(BlendThumbFile *tf)
 {
 	char buf[12];
 	int bhead[24 / sizeof(int)]; /* max size on 64bit */
@@ -53,7 +240,7 @@ static ImBuf *loadblend_thumb(gzFile gzfile)
 	int sizeof_bhead;
 
 	/* read the blend file header */
-	if (gzread(gzfile, buf, 12) != 12)
+	if (blend_thumb_read(tf, buf, 12) != 12)
 		return NULL;
 	if (!STREQLEN(buf, "BLENDER", 7))
 		return NULL;
@@ -76,12 +263,12 @@ static ImBuf *loadblend_thumb(gzFile gzfile)
 
 	endian_switch = ((ENDIAN_ORDER != endian)) ? 1 : 0;
 
-	while (gzread(gzfile, bhead, sizeof_bhead) == sizeof_bhead) {
+	while (blend_thumb_read(tf, bhead, sizeof_bhead) == sizeof_bhead) {
 		if (endian_switch)
 			BLI_endian_switch_int32(&bhead[1]);  /* length */
 
 		if (bhead[0] == REND) {
-			gzseek(gzfile, bhead[1], SEEK_CUR); /* skip to the next */
+			blend_thumb_read(tf, NULL, bhead[1]); /* skip to the next */
 		}
 		else {
 			break;
@@ -93,7 +280,7 @@ static ImBuf *loadblend_thumb(gzFile gzfile)
 		ImBuf *img = NULL;
 		int size[2];
 
-		if (gzread(gzfile, size, sizeof(size)) != sizeof(size))
+		if (blend_thumb_read(tf, size, sizeof(size)) != sizeof(size))
 			return NULL;
 
 		if (endian_switch) {
@@ -110,7 +297,7 @@ static ImBuf *loadblend_thumb(gzFile gzfile)
 		/* finally malloc and read the data */
 		img = IMB_allocImBuf(size[0], size[1], 32, IB_rect | IB_metadata);
 	
-		if (gzread(gzfile, img->rect, bhead[1]) != bhead[1]) {
+		if (blend_thumb_read(tf, img->rect, bhead[1]) != bhead[1]) {
 			IMB_freeImBuf(img);
 			img = NULL;
 		}
@@ -123,18 +310,16 @@ static ImBuf *loadblend_thumb(gzFile gzfile)
 
 ImBuf *IMB_loadblend_thumb(const char *path)
 {
-	gzFile gzfile;
-	/* not necessarily a gzip */
-	gzfile = BLI_gzopen(path, "rb");
+	BlendThumbFile tf;
 
-	if (NULL == gzfile) {
+	if (!blend_thumb_open(&tf, path)) {
 		return NULL;
 	}
 	else {
-		ImBuf *img = loadblend_thumb(gzfile);
+		ImBuf *img = loadblend_thumb(&tf);
 
 		/* read ok! */
-		gzclose(gzfile);
+		blend_thumb_close(&tf);
 
 		return img;
 	}
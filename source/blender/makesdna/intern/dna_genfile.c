@@ -705,32 +705,19 @@ static eSDNA_Type sdna_type_nr(const char *dna_type)
  * Note there is no optimization for the case where otype and ctype are the same:
  * assumption is that caller will handle this case.
  *
- * \param ctype  Name of type to convert to
- * \param otype  Name of type to convert from
- * \param name  Field name to extract array-size information
+ * \param ctypenr  Type to convert to
+ * \param otypenr  Type to convert from
+ * \param arrlen  Number of values to convert
  * \param curdata  Where to put converted data
  * \param olddata  Data of type otype to convert
  */
 static void cast_elem(
-        const char *ctype, const char *otype, const char *name,
+        const eSDNA_Type ctypenr, const eSDNA_Type otypenr, int arrlen,
         char *curdata, const char *olddata)
 {
 	double val = 0.0;
-	int arrlen, curlen = 1, oldlen = 1;
-
-	eSDNA_Type ctypenr, otypenr;
-
-	arrlen = DNA_elem_array_size(name);
-
-	if ( (otypenr = sdna_type_nr(otype)) == -1 ||
-	     (ctypenr = sdna_type_nr(ctype)) == -1)
-	{
-		return;
-	}
-
-	/* define lengths */
-	oldlen = DNA_elem_type_size(otypenr);
-	curlen = DNA_elem_type_size(ctypenr);
+	const int oldlen = DNA_elem_type_size(otypenr);
+	const int curlen = DNA_elem_type_size(ctypenr);
 
 	while (arrlen > 0) {
 		switch (otypenr) {
@@ -798,16 +785,13 @@ static void cast_elem(
  *
  * \param curlen  Pointer length to conver to
  * \param oldlen  Length of pointers in olddata
- * \param name  Field name to extract array-size information
+ * \param arrlen  Number of pointers to convert
  * \param curdata  Where to put converted data
  * \param olddata  Data to convert
  */
-static void cast_pointer(int curlen, int oldlen, const char *name, char *curdata, const char *olddata)
+static void cast_pointer(int curlen, int oldlen, int arrlen, char *curdata, const char *olddata)
 {
 	int64_t lval;
-	int arrlen;
-	
-	arrlen = DNA_elem_array_size(name);
 	
 	while (arrlen > 0) {
 	
@@ -854,31 +838,28 @@ static int elem_strcmp(const char *name, const char *oname)
 }
 
 /**
- * Returns the address of the data for the specified field within olddata
- * according to the struct format pointed to by old, or NULL if no such
- * field can be found.
+ * Returns the offset of the specified field within the struct format pointed to by old,
+ * or -1 if no such field can be found.
  *
  * \param sdna  Old SDNA
  * \param type  Current field type name
  * \param name  Current field name
  * \param old  Pointer to struct information in sdna
- * \param olddata  Struct data
  * \param sppo  Optional place to return pointer to field info in sdna
- * \return Data address.
+ * \return Field offset.
  */
-static char *find_elem(
+static int elem_offset(
         const SDNA *sdna,
         const char *type,
         const char *name,
         const short *old,
-        char *olddata,
         const short **sppo)
 {
-	int a, elemcount, len;
+	int a, elemcount, offset = 0;
 	const char *otype, *oname;
-	
+
 	/* without arraypart, so names can differ: return old namenr and type */
-	
+
 	/* in old is the old struct */
 	elemcount = old[1];
 	old += 2;
@@ -887,42 +868,168 @@ static char *find_elem(
 		otype = sdna->types[old[0]];
 		oname = sdna->names[old[1]];
 
-		len = elementsize(sdna, old[0], old[1]);
-
 		if (elem_strcmp(name, oname) == 0) {  /* name equal */
 			if (strcmp(type, otype) == 0) {   /* type equal */
 				if (sppo) *sppo = old;
-				return olddata;
+				return offset;
 			}
-			
-			return NULL;
+
+			return -1;
 		}
-		
-		olddata += len;
+
+		offset += elementsize(sdna, old[0], old[1]);
 	}
-	return NULL;
+	return -1;
+}
+
+/**
+ * Returns the address of the data for the specified field within olddata
+ * according to the struct format pointed to by old, or NULL if no such
+ * field can be found.
+ *
+ * \param sdna  Old SDNA
+ * \param type  Current field type name
+ * \param name  Current field name
+ * \param old  Pointer to struct information in sdna
+ * \param olddata  Struct data
+ * \param sppo  Optional place to return pointer to field info in sdna
+ * \return Data address.
+ */
+static char *find_elem(
+        const SDNA *sdna,
+        const char *type,
+        const char *name,
+        const short *old,
+        char *olddata,
+        const short **sppo)
+{
+	const int offset = elem_offset(sdna, type, name, old, sppo);
+	
+	return (offset != -1) ? olddata + offset : NULL;
+}
+
+/* ************************* RECONSTRUCT ********************** */
+
+/**
+ * \section dna_reconstruct Reconstruct Steps
+ *
+ * Finding the old field for every new one by name is too slow to do for every block of a file.
+ * So this is done once per struct (see: #DNA_reconstruct_info_create), the result is a list
+ * of steps only copying or casting data between known offsets, to run for every block.
+ */
+
+typedef enum eReconstructStepType {
+	RECONSTRUCT_STEP_MEMCPY,
+	RECONSTRUCT_STEP_CAST_PRIMITIVE,
+	RECONSTRUCT_STEP_CAST_POINTER,
+	RECONSTRUCT_STEP_SUBSTRUCT,
+	RECONSTRUCT_STEP_TERMINATE_STRING,
+} eReconstructStepType;
+
+typedef struct ReconstructStep {
+	eReconstructStepType type;
+	int old_offset, new_offset;
+	int len;  /* bytes to copy for RECONSTRUCT_STEP_MEMCPY, array length otherwise */
+	union {
+		struct {
+			eSDNA_Type old_type, new_type;
+		} cast_primitive;
+		struct {
+			int old_struct_nr;
+			int old_stride, new_stride;
+		} substruct;
+	} data;
+} ReconstructStep;
+
+typedef struct DNA_ReconstructInfo {
+	const SDNA *oldsdna;
+	const SDNA *newsdna;
+
+	/* per struct in oldsdna */
+	int *new_struct_nrs;      /* -1 when not in newsdna */
+	ReconstructStep **steps;  /* NULL when not in newsdna */
+	int *steps_len;
+} DNA_ReconstructInfo;
+
+static ReconstructStep *reconstruct_step_add(
+        ReconstructStep *steps, int *steps_len, const eReconstructStepType type,
+        const int old_offset, const int new_offset, const int len)
+{
+	ReconstructStep *step;
+
+	if ((type == RECONSTRUCT_STEP_MEMCPY) && (*steps_len != 0)) {
+		/* data directly following the previous copy in both structs: one copy */
+		step = &steps[*steps_len - 1];
+		if ((step->type == RECONSTRUCT_STEP_MEMCPY) &&
+		    (step->old_offset + step->len == old_offset) &&
+		    (step->new_offset + step->len == new_offset))
+		{
+			step->len += len;
+			return step;
+		}
+	}
+
+	step = &steps[(*steps_len)++];
+	step->type = type;
+	step->old_offset = old_offset;
+	step->new_offset = new_offset;
+	step->len = len;
+
+	return step;
+}
+
+static void reconstruct_pointer_step_add(
+        const SDNA *newsdna, const SDNA *oldsdna, ReconstructStep *steps, int *steps_len,
+        const int old_offset, const int new_offset, const int arrlen)
+{
+	if (newsdna->pointerlen == oldsdna->pointerlen) {
+		reconstruct_step_add(steps, steps_len, RECONSTRUCT_STEP_MEMCPY,
+		                     old_offset, new_offset, arrlen * oldsdna->pointerlen);
+	}
+	else {
+		reconstruct_step_add(steps, steps_len, RECONSTRUCT_STEP_CAST_POINTER,
+		                     old_offset, new_offset, arrlen);
+	}
+}
+
+static void reconstruct_primitive_step_add(
+        ReconstructStep *steps, int *steps_len, const char *type, const char *otype,
+        const int old_offset, const int new_offset, const int arrlen)
+{
+	eSDNA_Type ctypenr, otypenr;
+	ReconstructStep *step;
+
+	if ( (otypenr = sdna_type_nr(otype)) == -1 ||
+	     (ctypenr = sdna_type_nr(type)) == -1)
+	{
+		return;
+	}
+
+	step = reconstruct_step_add(steps, steps_len, RECONSTRUCT_STEP_CAST_PRIMITIVE, old_offset, new_offset, arrlen);
+	step->data.cast_primitive.old_type = otypenr;
+	step->data.cast_primitive.new_type = ctypenr;
 }
 
 /**
- * Converts the contents of a single field of a struct, of a non-struct type,
- * from oldsdna to newsdna format.
+ * Adds the steps converting a single field of a struct, of a non-struct type,
+ * from oldsdna to newsdna format. Fields not in oldsdna get no steps, they stay zero.
  *
  * \param newsdna  SDNA of current Blender
  * \param oldsdna  SDNA of Blender that saved file
  * \param type  current field type name
  * \param name  current field name
- * \param curdata  put field data converted to newsdna here
+ * \param new_offset  offset of the field in the current struct
  * \param old  pointer to struct info in oldsdna
- * \param olddata  struct contents laid out according to oldsdna
  */
-static void reconstruct_elem(
+static void reconstruct_elem_steps_add(
         const SDNA *newsdna,
         const SDNA *oldsdna,
         const char *type,
         const char *name,
-        char *curdata,
+        const int new_offset,
         const short *old,
-        const char *olddata)
+        ReconstructStep *steps,
+        int *steps_len)
 {
 	/* rules: test for NAME:
 	 *      - name equal:
@@ -933,7 +1040,7 @@ static void reconstruct_elem(
 	 * (nzc 2-4-2001 I want the 'unsigned' bit to be parsed as well. Where
 	 * can I force this?)
 	 */
-	int a, elemcount, len, countpos, oldsize, cursize, mul;
+	int a, elemcount, len, countpos, oldsize, cursize, mul, old_offset = 0;
 	const char *otype, *oname, *cp;
 	
 	/* is 'name' an array? */
@@ -955,13 +1062,15 @@ static void reconstruct_elem(
 		if (strcmp(name, oname) == 0) { /* name equal */
 			
 			if (ispointer(name)) {  /* pointer of functionpointer afhandelen */
-				cast_pointer(newsdna->pointerlen, oldsdna->pointerlen, name, curdata, olddata);
+				reconstruct_pointer_step_add(newsdna, oldsdna, steps, steps_len,
+				                             old_offset, new_offset, DNA_elem_array_size(name));
 			}
 			else if (strcmp(type, otype) == 0) {    /* type equal */
-				memcpy(curdata, olddata, len);
+				reconstruct_step_add(steps, steps_len, RECONSTRUCT_STEP_MEMCPY, old_offset, new_offset, len);
 			}
 			else {
-				cast_elem(type, otype, name, curdata, olddata);
+				reconstruct_primitive_step_add(steps, steps_len, type, otype,
+				                               old_offset, new_offset, DNA_elem_array_size(name));
 			}
 
 			return;
@@ -974,34 +1083,33 @@ static void reconstruct_elem(
 				oldsize = DNA_elem_array_size(oname);
 
 				if (ispointer(name)) {  /* handle pointer or functionpointer */
-					cast_pointer(newsdna->pointerlen, oldsdna->pointerlen,
-					             cursize > oldsize ? oname : name,
-					             curdata, olddata);
+					reconstruct_pointer_step_add(newsdna, oldsdna, steps, steps_len,
+					                             old_offset, new_offset, MIN2(cursize, oldsize));
 				}
 				else if (strcmp(type, otype) == 0) {  /* type equal */
 					mul = len / oldsize; /* size of single old array element */
 					mul *= (cursize < oldsize) ? cursize : oldsize; /* smaller of sizes of old and new arrays */
-					memcpy(curdata, olddata, mul);
+					reconstruct_step_add(steps, steps_len, RECONSTRUCT_STEP_MEMCPY, old_offset, new_offset, mul);
 					
 					if (oldsize > cursize && strcmp(type, "char") == 0) {
 						/* string had to be truncated, ensure it's still null-terminated */
-						curdata[mul - 1] = '\0';
+						reconstruct_step_add(steps, steps_len, RECONSTRUCT_STEP_TERMINATE_STRING,
+						                     old_offset, new_offset + mul - 1, 1);
 					}
 				}
 				else {
-					cast_elem(type, otype,
-					          cursize > oldsize ? oname : name,
-					          curdata, olddata);
+					reconstruct_primitive_step_add(steps, steps_len, type, otype,
+					                               old_offset, new_offset, MIN2(cursize, oldsize));
 				}
 				return;
 			}
 		}
-		olddata += len;
+		old_offset += len;
 	}
 }
 
 /**
- * Converts the contents of an entire struct from oldsdna to newsdna format.
+ * Creates the steps converting an entire struct from oldsdna to newsdna format.
  *
  * \param newsdna  SDNA of current Blender
  * \param oldsdna  SDNA of Blender that saved file
@@ -1009,51 +1117,47 @@ static void reconstruct_elem(
  *
  * Result from DNA_struct_get_compareflags to avoid needless conversions.
  * \param oldSDNAnr  Index of old struct definition in oldsdna
- * \param data  Struct contents laid out according to oldsdna
  * \param curSDNAnr  Index of current struct definition in newsdna
- * \param cur  Where to put converted struct contents
+ * \param r_steps_len  Number of steps returned
  */
-static void reconstruct_struct(
+static ReconstructStep *reconstruct_steps_create(
         SDNA *newsdna,
         SDNA *oldsdna,
         const char *compflags,
 
         int oldSDNAnr,
-        char *data,
         int curSDNAnr,
-        char *cur)
+        int *r_steps_len)
 {
-	/* Recursive!
-	 * Per element from cur_struct, read data from old_struct.
-	 * If element is a struct, call recursive.
+	/* Per element from cur_struct, find the data in old_struct.
+	 * Struct fields get a step running the steps of that struct.
 	 */
-	int a, elemcount, elen, eleno, mul, mulo, firststructtypenr;
+	int a, elemcount, elen, eleno, mul, mulo, firststructtypenr, new_offset, old_offset, steps_len = 0;
 	const short *spo, *spc, *sppo;
 	const char *type;
-	char *cpo, *cpc;
 	const char *name, *nameo;
+	ReconstructStep *steps, *step;
 
-	if (oldSDNAnr == -1) return;
-	if (curSDNAnr == -1) return;
+	spo = oldsdna->structs[oldSDNAnr];
+	spc = newsdna->structs[curSDNAnr];
 
 	if (compflags[oldSDNAnr] == 1) {        /* if recursive: test for equal */
+		steps = MEM_mallocN(sizeof(*steps), __func__);
+		reconstruct_step_add(steps, &steps_len, RECONSTRUCT_STEP_MEMCPY, 0, 0, oldsdna->typelens[spo[0]]);
 	
-		spo = oldsdna->structs[oldSDNAnr];
-		elen = oldsdna->typelens[spo[0]];
-		memcpy(cur, data, elen);
-		
-		return;
+		*r_steps_len = steps_len;
+		return steps;
 	}
 
 	firststructtypenr = *(newsdna->structs[0]);
 
-	spo = oldsdna->structs[oldSDNAnr];
-	spc = newsdna->structs[curSDNAnr];
-
 	elemcount = spc[1];
 
+	/* at most a copy and a string terminator per field */
+	steps = MEM_mallocN(sizeof(*steps) * (size_t)MAX2(elemcount * 2, 1), __func__);
+
 	spc += 2;
-	cpc = cur;
+	new_offset = 0;
 	for (a = 0; a < elemcount; a++, spc += 2) {  /* convert each field */
 		type = newsdna->types[spc[0]];
 		name = newsdna->names[spc[1]];
@@ -1064,40 +1168,91 @@ static void reconstruct_struct(
 		if (spc[0] >= firststructtypenr && !ispointer(name)) {
 			/* struct field type */
 			/* where does the old struct data start (and is there an old one?) */
-			cpo = find_elem(oldsdna, type, name, spo, data, &sppo);
+			old_offset = elem_offset(oldsdna, type, name, spo, &sppo);
 			
-			if (cpo) {
-				oldSDNAnr = DNA_struct_find_nr(oldsdna, type);
-				curSDNAnr = DNA_struct_find_nr(newsdna, type);
+			if (old_offset != -1) {
+				const int old_struct_nr = DNA_struct_find_nr(oldsdna, type);
 				
 				/* array! */
 				mul = DNA_elem_array_size(name);
 				nameo = oldsdna->names[sppo[1]];
 				mulo = DNA_elem_array_size(nameo);
 				
-				eleno = elementsize(oldsdna, sppo[0], sppo[1]);
-				
-				elen /= mul;
-				eleno /= mulo;
+				eleno = elementsize(oldsdna, sppo[0], sppo[1]) / mulo;
 				
-				while (mul--) {
-					reconstruct_struct(newsdna, oldsdna, compflags, oldSDNAnr, cpo, curSDNAnr, cpc);
-					cpo += eleno;
-					cpc += elen;
-					
-					/* new struct array larger than old */
-					mulo--;
-					if (mulo <= 0) break;
+				if (old_struct_nr != -1 && DNA_struct_find_nr(newsdna, type) != -1) {
+					/* when the new struct array is larger than the old, the rest stays zero */
+					if (compflags[old_struct_nr] == 1 && eleno == elen / mul) {
+						reconstruct_step_add(steps, &steps_len, RECONSTRUCT_STEP_MEMCPY,
+						                     old_offset, new_offset, eleno * MIN2(mul, mulo));
+					}
+					else {
+						step = reconstruct_step_add(steps, &steps_len, RECONSTRUCT_STEP_SUBSTRUCT,
+						                            old_offset, new_offset, MIN2(mul, mulo));
+						step->data.substruct.old_struct_nr = old_struct_nr;
+						step->data.substruct.old_stride = eleno;
+						step->data.substruct.new_stride = elen / mul;
+					}
 				}
 			}
-			else {
-				cpc += elen;  /* skip field no longer present */
-			}
 		}
 		else {
 			/* non-struct field type */
-			reconstruct_elem(newsdna, oldsdna, type, name, cpc, spo, data);
-			cpc += elen;
+			reconstruct_elem_steps_add(newsdna, oldsdna, type, name, new_offset, spo, steps, &steps_len);
+		}
+		new_offset += elen;
+	}
+
+	*r_steps_len = steps_len;
+	return steps;
+}
+
+/**
+ * Converts the contents of an entire struct from oldsdna to newsdna format,
+ * running the steps made by #DNA_reconstruct_info_create.
+ *
+ * \param oldSDNAnr  Index of old struct definition in oldsdna
+ * \param data  Struct contents laid out according to oldsdna
+ * \param cur  Where to put converted struct contents
+ */
+static void reconstruct_struct(
+        const DNA_ReconstructInfo *reconstruct_info,
+        int oldSDNAnr,
+        const char *data,
+        char *cur)
+{
+	const ReconstructStep *step = reconstruct_info->steps[oldSDNAnr];
+	const ReconstructStep *step_end;
+	int a;
+
+	if (step == NULL) return;
+
+	for (step_end = step + reconstruct_info->steps_len[oldSDNAnr]; step != step_end; step++) {
+		const char *olddata = data + step->old_offset;
+		char *curdata = cur + step->new_offset;
+
+		switch (step->type) {
+			case RECONSTRUCT_STEP_MEMCPY:
+				memcpy(curdata, olddata, step->len);
+				break;
+			case RECONSTRUCT_STEP_CAST_PRIMITIVE:
+				cast_elem(step->data.cast_primitive.new_type, step->data.cast_primitive.old_type, step->len,
+				          curdata, olddata);
+				break;
+			case RECONSTRUCT_STEP_CAST_POINTER:
+				cast_pointer(reconstruct_info->newsdna->pointerlen, reconstruct_info->oldsdna->pointerlen, step->len,
+				             curdata, olddata);
+				break;
+			case RECONSTRUCT_STEP_SUBSTRUCT:
+				for (a = 0; a < step->len; a++) {
+					reconstruct_struct(reconstruct_info, step->data.substruct.old_struct_nr,
+					                   olddata + a * step->data.substruct.old_stride,
+					                   curdata + a * step->data.substruct.new_stride);
+				}
+				break;
+			case RECONSTRUCT_STEP_TERMINATE_STRING:
+				*curdata = '\0';
+				break;
 		}
 	}
 }
@@ -1237,33 +1392,77 @@ void DNA_struct_switch_endian(SDNA *oldsdna, int oldSDNAnr, char *data)
 }
 
 /**
- * \param newsdna  SDNA of current Blender
+ * Prepares converting the structs of oldsdna to newsdna format, once per file,
+ * so #DNA_struct_reconstruct doesn't have to look up fields by name for every block.
+ *
  * \param oldsdna  SDNA of Blender that saved file
+ * \param newsdna  SDNA of current Blender
  * \param compflags
  *
  * Result from DNA_struct_get_compareflags to avoid needless conversions
+ */
+DNA_ReconstructInfo *DNA_reconstruct_info_create(SDNA *oldsdna, SDNA *newsdna, const char *compflags)
+{
+	DNA_ReconstructInfo *reconstruct_info = MEM_mallocN(sizeof(*reconstruct_info), __func__);
+	int a;
+
+	reconstruct_info->oldsdna = oldsdna;
+	reconstruct_info->newsdna = newsdna;
+	reconstruct_info->new_struct_nrs = MEM_mallocN(sizeof(int) * (size_t)oldsdna->nr_structs, __func__);
+	reconstruct_info->steps = MEM_callocN(sizeof(ReconstructStep *) * (size_t)oldsdna->nr_structs, __func__);
+	reconstruct_info->steps_len = MEM_callocN(sizeof(int) * (size_t)oldsdna->nr_structs, __func__);
+
+	for (a = 0; a < oldsdna->nr_structs; a++) {
+		const short *spo = oldsdna->structs[a];
+		const int curSDNAnr = DNA_struct_find_nr(newsdna, oldsdna->types[spo[0]]);
+
+		reconstruct_info->new_struct_nrs[a] = curSDNAnr;
+		if (curSDNAnr != -1) {
+			reconstruct_info->steps[a] = reconstruct_steps_create(
+			        newsdna, oldsdna, compflags, a, curSDNAnr, &reconstruct_info->steps_len[a]);
+		}
+	}
+
+	return reconstruct_info;
+}
+
+void DNA_reconstruct_info_free(DNA_ReconstructInfo *reconstruct_info)
+{
+	int a;
+
+	for (a = 0; a < reconstruct_info->oldsdna->nr_structs; a++) {
+		if (reconstruct_info->steps[a]) {
+			MEM_freeN(reconstruct_info->steps[a]);
+		}
+	}
+	MEM_freeN(reconstruct_info->new_struct_nrs);
+	MEM_freeN(reconstruct_info->steps);
+	MEM_freeN(reconstruct_info->steps_len);
+	MEM_freeN(reconstruct_info);
+}
+
+/**
+ * \param reconstruct_info  Result from #DNA_reconstruct_info_create
  * \param oldSDNAnr  Index of struct info within oldsdna
  * \param blocks  The number of array elements
  * \param data  Array of struct data
  * \return An allocated reconstructed struct
  */
-void *DNA_struct_reconstruct(SDNA *newsdna, SDNA *oldsdna, char *compflags, int oldSDNAnr, int blocks, void *data)
+void *DNA_struct_reconstruct(const DNA_ReconstructInfo *reconstruct_info, int oldSDNAnr, int blocks, const void *data)
 {
-	int a, curSDNAnr, curlen = 0, oldlen;
-	const short *spo, *spc;
-	char *cur, *cpc, *cpo;
-	const char *type;
+	const SDNA *oldsdna = reconstruct_info->oldsdna;
+	const SDNA *newsdna = reconstruct_info->newsdna;
+	const int curSDNAnr = reconstruct_info->new_struct_nrs[oldSDNAnr];
+	int a, curlen = 0, oldlen;
+	char *cur, *cpc;
+	const char *cpo;
 	
 	/* oldSDNAnr == structnr, we're looking for the corresponding 'cur' number */
-	spo = oldsdna->structs[oldSDNAnr];
-	type = oldsdna->types[spo[0]];
-	oldlen = oldsdna->typelens[spo[0]];
-	curSDNAnr = DNA_struct_find_nr(newsdna, type);
+	oldlen = oldsdna->typelens[oldsdna->structs[oldSDNAnr][0]];
 
 	/* init data and alloc */
 	if (curSDNAnr != -1) {
-		spc = newsdna->structs[curSDNAnr];
-		curlen = newsdna->typelens[spc[0]];
+		curlen = newsdna->typelens[newsdna->structs[curSDNAnr][0]];
 	}
 	if (curlen == 0) {
 		return NULL;
@@ -1273,7 +1472,7 @@ void *DNA_struct_reconstruct(SDNA *newsdna, SDNA *oldsdna, char *compflags, int
 	cpc = cur;
 	cpo = data;
 	for (a = 0; a < blocks; a++) {
-		reconstruct_struct(newsdna, oldsdna, compflags, oldSDNAnr, cpo, curSDNAnr, cpc);
+		reconstruct_struct(reconstruct_info, oldSDNAnr, cpo, cpc);
 		cpc += curlen;
 		cpo += oldlen;
 	}
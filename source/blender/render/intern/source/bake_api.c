@@ -267,52 +267,70 @@ static void calc_barycentric_from_point(
 	*r_primitive_id = index;
 }
 
+/* number of pixels whose rays are cast at once, bounds the memory used for their hits */
+#define BAKE_RAY_BATCH_SIZE (1 << 16)
+
 /**
- * This function populates pixel_array and returns TRUE if things are correct
+ * This function populates pixel_array of the highpoly objects for \a pixels_num pixels,
+ * casting the rays of all these pixels at once for every object.
+ * The original pixels without any hit get masked out.
  */
-static bool cast_ray_highpoly(
+static void cast_rays_highpoly(
         BVHTreeFromMesh *treeData, TriTessFace *triangles[], BakeHighPolyData *highpoly,
-        const float co[3], const float dir[3], const int pixel_id, const int tot_highpoly,
-        const float du_dx, const float du_dy, const float dv_dx, const float dv_dy)
+        BakePixel pixel_array_from[], const float (*cos)[3], const float (*dirs)[3], const int *pixel_ids,
+        const int pixels_num, const int tot_highpoly, BVHTreeRay *rays, BVHTreeRayHit *hits)
 {
-	int i;
-	int primitive_id = -1;
-	float uv[2];
-	int hit_mesh = -1;
-	float hit_distance = FLT_MAX;
-
-	BVHTreeRayHit *hits;
-	hits = MEM_mallocN(sizeof(BVHTreeRayHit) * tot_highpoly, "Bake Highpoly to Lowpoly: BVH Rays");
+	int i, k;
 
 	for (i = 0; i < tot_highpoly; i++) {
-		float co_high[3], dir_high[3];
+		BVHTreeRayHit *hits_high = &hits[i * pixels_num];
+
+		for (k = 0; k < pixels_num; k++) {
+			hits_high[k].index = -1;
+			/* TODO: we should use FLT_MAX here, but sweepsphere code isn't prepared for that */
+			hits_high[k].dist = 10000.0f;
 
-		hits[i].index = -1;
-		/* TODO: we should use FLT_MAX here, but sweepsphere code isn't prepared for that */
-		hits[i].dist = 10000.0f;
+			/* transform the ray from the world space to the highpoly space */
+			mul_v3_m4v3(rays[k].origin, highpoly[i].imat, cos[k]);
 
-		/* transform the ray from the world space to the highpoly space */
-		mul_v3_m4v3(co_high, highpoly[i].imat, co);
+			/* rotates */
+			mul_v3_m4v3(rays[k].direction, highpoly[i].rotmat, dirs[k]);
+			normalize_v3(rays[k].direction);
 
-		/* rotates */
-		mul_v3_m4v3(dir_high, highpoly[i].rotmat, dir);
-		normalize_v3(dir_high);
+			rays[k].radius = 0.0f;
+		}
 
-		/* cast ray */
+		/* cast rays */
 		if (treeData[i].tree) {
-			BLI_bvhtree_ray_cast(treeData[i].tree, co_high, dir_high, 0.0f, &hits[i], treeData[i].raycast_callback, &treeData[i]);
+			BLI_bvhtree_ray_cast_batch(treeData[i].tree, rays, pixels_num, hits_high,
+			                           treeData[i].raycast_callback, &treeData[i]);
 		}
 
-		if (hits[i].index != -1) {
+		for (k = 0; k < pixels_num; k++) {
 			/* cull backface */
-			const float dot = dot_v3v3(dir_high, hits[i].no);
-			if (dot < 0.0f) {
+			if ((hits_high[k].index != -1) && (dot_v3v3(rays[k].direction, hits_high[k].no) >= 0.0f)) {
+				hits_high[k].index = -1;
+			}
+		}
+	}
+
+	for (k = 0; k < pixels_num; k++) {
+		const int pixel_id = pixel_ids[k];
+		int primitive_id = -1;
+		float uv[2];
+		int hit_mesh = -1;
+		float hit_distance = FLT_MAX;
+
+		for (i = 0; i < tot_highpoly; i++) {
+			const BVHTreeRayHit *hit = &hits[i * pixels_num + k];
+
+			if (hit->index != -1) {
 				float distance;
 				float hit_world[3];
 
 				/* distance comparison in world space */
-				mul_v3_m4v3(hit_world, highpoly[i].obmat, hits[i].co);
-				distance = len_squared_v3v3(hit_world, co);
+				mul_v3_m4v3(hit_world, highpoly[i].obmat, hit->co);
+				distance = len_squared_v3v3(hit_world, cos[k]);
 
 				if (distance < hit_distance) {
 					hit_mesh = i;
@@ -320,28 +338,32 @@ static bool cast_ray_highpoly(
 				}
 			}
 		}
-	}
 
-	for (i = 0; i < tot_highpoly; i++) {
-		if (hit_mesh == i) {
-			calc_barycentric_from_point(triangles[i], hits[i].index, hits[i].co, &primitive_id, uv);
-			highpoly[i].pixel_array[pixel_id].primitive_id = primitive_id;
-			copy_v2_v2(highpoly[i].pixel_array[pixel_id].uv, uv);
-
-			/* the differentials are relative to the UV/image space, so the highpoly differentials
-			 * are the same as the low poly differentials */
-			highpoly[i].pixel_array[pixel_id].du_dx = du_dx;
-			highpoly[i].pixel_array[pixel_id].du_dy = du_dy;
-			highpoly[i].pixel_array[pixel_id].dv_dx = dv_dx;
-			highpoly[i].pixel_array[pixel_id].dv_dy = dv_dy;
+		for (i = 0; i < tot_highpoly; i++) {
+			if (hit_mesh == i) {
+				const BVHTreeRayHit *hit = &hits[i * pixels_num + k];
+
+				calc_barycentric_from_point(triangles[i], hit->index, hit->co, &primitive_id, uv);
+				highpoly[i].pixel_array[pixel_id].primitive_id = primitive_id;
+				copy_v2_v2(highpoly[i].pixel_array[pixel_id].uv, uv);
+
+				/* the differentials are relative to the UV/image space, so the highpoly differentials
+				 * are the same as the low poly differentials */
+				highpoly[i].pixel_array[pixel_id].du_dx = pixel_array_from[pixel_id].du_dx;
+				highpoly[i].pixel_array[pixel_id].du_dy = pixel_array_from[pixel_id].du_dy;
+				highpoly[i].pixel_array[pixel_id].dv_dx = pixel_array_from[pixel_id].dv_dx;
+				highpoly[i].pixel_array[pixel_id].dv_dy = pixel_array_from[pixel_id].dv_dy;
+			}
+			else {
+				highpoly[i].pixel_array[pixel_id].primitive_id = -1;
+			}
 		}
-		else {
-			highpoly[i].pixel_array[pixel_id].primitive_id = -1;
+
+		if (hit_mesh == -1) {
+			/* if it fails mask out the original pixel array */
+			pixel_array_from[pixel_id].primitive_id = -1;
 		}
 	}
-
-	MEM_freeN(hits);
-	return hit_mesh != -1;
 }
 
 /**
@@ -452,6 +474,13 @@ bool RE_bake_pixels_populate_from_objects(
 	DerivedMesh **dm_highpoly;
 	BVHTreeFromMesh *treeData;
 
+	/* rays of the pixels cast at once */
+	float (*ray_cos)[3] = NULL, (*ray_dirs)[3] = NULL;
+	int *ray_pixel_ids = NULL;
+	BVHTreeRay *rays = NULL;
+	BVHTreeRayHit *hits = NULL;
+	int rays_num = 0;
+
 	/* Note: all coordinates are in local space */
 	TriTessFace *tris_low = NULL;
 	TriTessFace *tris_cage = NULL;
@@ -501,9 +530,15 @@ bool RE_bake_pixels_populate_from_objects(
 		}
 	}
 
+	ray_cos = MEM_mallocN(sizeof(*ray_cos) * BAKE_RAY_BATCH_SIZE, "Bake Highpoly to Lowpoly: Ray Origins");
+	ray_dirs = MEM_mallocN(sizeof(*ray_dirs) * BAKE_RAY_BATCH_SIZE, "Bake Highpoly to Lowpoly: Ray Directions");
+	ray_pixel_ids = MEM_mallocN(sizeof(*ray_pixel_ids) * BAKE_RAY_BATCH_SIZE, "Bake Highpoly to Lowpoly: Ray Pixels");
+	rays = MEM_mallocN(sizeof(*rays) * BAKE_RAY_BATCH_SIZE, "Bake Highpoly to Lowpoly: BVH Rays");
+	hits = MEM_mallocN(sizeof(*hits) * BAKE_RAY_BATCH_SIZE * tot_highpoly, "Bake Highpoly to Lowpoly: BVH Hits");
+
 	for (i = 0; i < num_pixels; i++) {
-		float co[3];
-		float dir[3];
+		float *co = ray_cos[rays_num];
+		float *dir = ray_dirs[rays_num];
 
 		primitive_id = pixel_array_from[i].primitive_id;
 
@@ -529,15 +564,23 @@ bool RE_bake_pixels_populate_from_objects(
 			calc_point_from_barycentric_extrusion(tris_low, mat_low, imat_low, primitive_id, u, v, cage_extrusion, co, dir, false);
 		}
 
-		/* cast ray */
-		if (!cast_ray_highpoly(treeData, tris_high, highpoly, co, dir, i, tot_highpoly,
-		                       pixel_array_from[i].du_dx, pixel_array_from[i].du_dy,
-		                       pixel_array_from[i].dv_dx, pixel_array_from[i].dv_dy)) {
-			/* if it fails mask out the original pixel array */
-			pixel_array_from[i].primitive_id = -1;
+		ray_pixel_ids[rays_num++] = (int)i;
+
+		/* cast rays */
+		if (rays_num == BAKE_RAY_BATCH_SIZE) {
+			cast_rays_highpoly(treeData, tris_high, highpoly, pixel_array_from,
+			                   (const float (*)[3])ray_cos, (const float (*)[3])ray_dirs, ray_pixel_ids,
+			                   rays_num, tot_highpoly, rays, hits);
+			rays_num = 0;
 		}
 	}
 
+	if (rays_num) {
+		cast_rays_highpoly(treeData, tris_high, highpoly, pixel_array_from,
+		                   (const float (*)[3])ray_cos, (const float (*)[3])ray_dirs, ray_pixel_ids,
+		                   rays_num, tot_highpoly, rays, hits);
+	}
+
 
 	/* garbage collection */
 cleanup:
@@ -557,6 +600,12 @@ cleanup:
 	MEM_freeN(treeData);
 	MEM_freeN(dm_highpoly);
 
+	MEM_SAFE_FREE(ray_cos);
+	MEM_SAFE_FREE(ray_dirs);
+	MEM_SAFE_FREE(ray_pixel_ids);
+	MEM_SAFE_FREE(rays);
+	MEM_SAFE_FREE(hits);
+
 	if (dm_low) {
 		dm_low->release(dm_low);
 	}
@@ -82,6 +82,7 @@
 #include "BKE_sound.h"
 #include "BKE_screen.h"
 
+#include "BLO_blend_defs.h"
 #include "BLO_readfile.h"
 #include "BLO_writefile.h"
 
@@ -338,7 +339,7 @@ static int wm_read_exotic(Scene *UNUSED(scene), const char *name)
 {
 	int len;
 	gzFile gzfile;
-	char header[7];
+	char header[BLEND_LZO_MAGIC_LEN];
 	int retval;
 
 	/* make sure we're not trying to read a directory.... */
@@ -355,7 +356,9 @@ static int wm_read_exotic(Scene *UNUSED(scene), const char *name)
 		else {
 			len = gzread(gzfile, header, sizeof(header));
 			gzclose(gzfile);
-			if (len == sizeof(header) && STREQLEN(header, "BLENDER", 7)) {
+			if (len == sizeof(header) &&
+			    (STREQLEN(header, "BLENDER", 7) || STREQLEN(header, BLEND_LZO_MAGIC, BLEND_LZO_MAGIC_LEN)))
+			{
 				retval = BKE_READ_EXOTIC_OK_BLEND;
 			}
 			else {
@@ -979,6 +982,7 @@ int wm_file_write(bContext *C, const char *filepath, int fileflags, ReportList *
 		}
 
 		BKE_BIT_TEST_SET(G.fileflags, fileflags & G_FILE_COMPRESS, G_FILE_COMPRESS);
+		BKE_BIT_TEST_SET(G.fileflags, fileflags & G_FILE_COMPRESS_FAST, G_FILE_COMPRESS_FAST);
 		BKE_BIT_TEST_SET(G.fileflags, fileflags & G_FILE_AUTOPLAY, G_FILE_AUTOPLAY);
 
 		/* prevent background mode scripts from clobbering history */
@@ -1035,7 +1039,7 @@ int wm_homefile_write_exec(bContext *C, wmOperator *op)
 	ED_editors_flush_edits(C, false);
 
 	/*  force save as regular blend file */
-	fileflags = G.fileflags & ~(G_FILE_COMPRESS | G_FILE_AUTOPLAY | G_FILE_LOCK | G_FILE_SIGN | G_FILE_HISTORY);
+	fileflags = G.fileflags & ~(G_FILE_COMPRESS | G_FILE_COMPRESS_FAST | G_FILE_AUTOPLAY | G_FILE_LOCK | G_FILE_SIGN | G_FILE_HISTORY);
 
 	if (BLO_write_file(CTX_data_main(C), filepath, fileflags | G_FILE_USERPREFS, op->reports, NULL) == 0) {
 		printf("fail\n");
@@ -1119,6 +1123,38 @@ void WM_autosave_init(wmWindowManager *wm)
 		wm->autosavetimer = WM_event_add_timer(wm, NULL, TIMERAUTOSAVE, U.savetime * 60.0);
 }
 
+/* seconds between checks whether an autosave written in the background is done */
+#define WM_AUTOSAVE_ASYNC_CHECK_TIME 1.0
+
+/* an autosave is written in the background, its result isn't reported yet */
+static bool wm_autosave_async_pending = false;
+
+static void wm_autosave_async_report(const bContext *C, ReportList *reports)
+{
+	Report *report;
+
+	for (report = reports->list.first; report; report = report->next) {
+		WM_reportf(C, report->type, "Autosave failed: %s", report->message);
+	}
+}
+
+/* wait for the autosave written in the background, reporting a failure once */
+static void wm_autosave_async_end(const bContext *C)
+{
+	ReportList reports;
+
+	if (!wm_autosave_async_pending) {
+		return;
+	}
+
+	BKE_reports_init(&reports, RPT_STORE);
+	BLO_write_file_async_wait(&reports);
+	wm_autosave_async_report(C, &reports);
+	BKE_reports_clear(&reports);
+
+	wm_autosave_async_pending = false;
+}
+
 void wm_autosave_timer(const bContext *C, wmWindowManager *wm, wmTimer *UNUSED(wt))
 {
 	wmWindow *win;
@@ -1127,6 +1163,18 @@ void wm_autosave_timer(const bContext *C, wmWindowManager *wm, wmTimer *UNUSED(w
 	
 	WM_event_remove_timer(wm, NULL, wm->autosavetimer);
 
+	/* report the previous autosave once its file is written */
+	if (wm_autosave_async_pending) {
+		if (!BLO_write_file_async_is_done()) {
+			wm->autosavetimer = WM_event_add_timer(wm, NULL, TIMERAUTOSAVE, WM_AUTOSAVE_ASYNC_CHECK_TIME);
+			return;
+		}
+
+		wm_autosave_async_end(C);
+		wm->autosavetimer = WM_event_add_timer(wm, NULL, TIMERAUTOSAVE, U.savetime * 60.0);
+		return;
+	}
+
 	/* if a modal operator is running, don't autosave, but try again in 10 seconds */
 	for (win = wm->windows.first; win; win = win->next) {
 		for (handler = win->modalhandlers.first; handler; handler = handler->next) {
@@ -1147,13 +1195,20 @@ void wm_autosave_timer(const bContext *C, wmWindowManager *wm, wmTimer *UNUSED(w
 	}
 	else {
 		/*  save as regular blend file */
-		int fileflags = G.fileflags & ~(G_FILE_COMPRESS | G_FILE_AUTOPLAY | G_FILE_LOCK | G_FILE_SIGN | G_FILE_HISTORY);
+		int fileflags = G.fileflags & ~(G_FILE_COMPRESS | G_FILE_COMPRESS_FAST | G_FILE_AUTOPLAY | G_FILE_LOCK | G_FILE_SIGN | G_FILE_HISTORY);
+		ReportList reports;
 
-		/* no error reporting to console */
-		BLO_write_file(CTX_data_main(C), filepath, fileflags, NULL, NULL);
+		/* the disk is written to in the background, failing to write is reported once it's done */
+		BKE_reports_init(&reports, RPT_STORE);
+		if (BLO_write_file_async(CTX_data_main(C), filepath, fileflags, &reports)) {
+			wm_autosave_async_pending = true;
+		}
+		wm_autosave_async_report(C, &reports);
+		BKE_reports_clear(&reports);
 	}
 	/* do timer after file write, just in case file write takes a long time */
-	wm->autosavetimer = WM_event_add_timer(wm, NULL, TIMERAUTOSAVE, U.savetime * 60.0);
+	wm->autosavetimer = WM_event_add_timer(wm, NULL, TIMERAUTOSAVE,
+	                                       wm_autosave_async_pending ? WM_AUTOSAVE_ASYNC_CHECK_TIME : U.savetime * 60.0);
 }
 
 void wm_autosave_timer_ended(wmWindowManager *wm)
@@ -1184,6 +1239,8 @@ void wm_autosave_read(bContext *C, ReportList *reports)
 {
 	char filename[FILE_MAX];
 
+	wm_autosave_async_end(C);
+
 	wm_autosave_location(filename);
 	WM_file_read(C, filename, reports);
 }
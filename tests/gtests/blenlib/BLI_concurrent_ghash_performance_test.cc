@@ -0,0 +1,208 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "atomic_ops.h"
+#include "BLI_utildefines.h"
+#include "BLI_math_base.h"
+#include "BLI_concurrent_ghash.h"
+#include "BLI_ghash.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
+#include "PIL_time_utildefines.h"
+}
+
+/* Each task inserts then looks up its own slice of keys,
+ * either in a ConcurrentGHash or in a single GHash guarded by a mutex (for reference). */
+
+#define TASKS_PER_THREAD 4
+
+typedef struct CGHashTestData {
+	ConcurrentGHash *cgh;
+	GHash *gh;
+	ThreadMutex mutex;
+
+	unsigned int keys_per_task;
+	unsigned int lookups_found;
+	unsigned int adds_done;
+} CGHashTestData;
+
+static void cghash_insert_lookup_run(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	CGHashTestData *data = (CGHashTestData *)BLI_task_pool_userdata(pool);
+	const unsigned int key_start = GET_UINT_FROM_POINTER(taskdata) * data->keys_per_task + 1;
+	const unsigned int key_stop = key_start + data->keys_per_task;
+	unsigned int found = 0;
+
+	for (unsigned int i = key_start; i < key_stop; i++) {
+		BLI_concurrent_ghash_insert(data->cgh, SET_UINT_IN_POINTER(i), SET_UINT_IN_POINTER(i));
+	}
+	for (unsigned int i = key_start; i < key_stop; i++) {
+		if (GET_UINT_FROM_POINTER(BLI_concurrent_ghash_lookup(data->cgh, SET_UINT_IN_POINTER(i))) == i) {
+			found++;
+		}
+	}
+
+	atomic_add_u(&data->lookups_found, found);
+}
+
+static void ghash_mutex_insert_lookup_run(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	CGHashTestData *data = (CGHashTestData *)BLI_task_pool_userdata(pool);
+	const unsigned int key_start = GET_UINT_FROM_POINTER(taskdata) * data->keys_per_task + 1;
+	const unsigned int key_stop = key_start + data->keys_per_task;
+	unsigned int found = 0;
+
+	for (unsigned int i = key_start; i < key_stop; i++) {
+		BLI_mutex_lock(&data->mutex);
+		BLI_ghash_insert(data->gh, SET_UINT_IN_POINTER(i), SET_UINT_IN_POINTER(i));
+		BLI_mutex_unlock(&data->mutex);
+	}
+	for (unsigned int i = key_start; i < key_stop; i++) {
+		void *val;
+		BLI_mutex_lock(&data->mutex);
+		val = BLI_ghash_lookup(data->gh, SET_UINT_IN_POINTER(i));
+		BLI_mutex_unlock(&data->mutex);
+		if (GET_UINT_FROM_POINTER(val) == i) {
+			found++;
+		}
+	}
+
+	atomic_add_u(&data->lookups_found, found);
+}
+
+/* All tasks try to add the same keys, each key must be added exactly once. */
+static void cghash_add_run(TaskPool *__restrict pool, void *UNUSED(taskdata), int UNUSED(threadid))
+{
+	CGHashTestData *data = (CGHashTestData *)BLI_task_pool_userdata(pool);
+	unsigned int added = 0;
+
+	for (unsigned int i = 1; i <= data->keys_per_task; i++) {
+		if (BLI_concurrent_ghash_add(data->cgh, SET_UINT_IN_POINTER(i), SET_UINT_IN_POINTER(i))) {
+			added++;
+		}
+	}
+
+	atomic_add_u(&data->adds_done, added);
+}
+
+static void cghash_run_tasks(TaskScheduler *scheduler, CGHashTestData *data, TaskRunFunction run, const unsigned int num_tasks)
+{
+	TaskPool *pool = BLI_task_pool_create(scheduler, data);
+
+	for (unsigned int i = 0; i < num_tasks; i++) {
+		BLI_task_pool_push(pool, run, SET_UINT_IN_POINTER(i), false, TASK_PRIORITY_HIGH);
+	}
+	BLI_task_pool_work_and_wait(pool);
+	BLI_task_pool_free(pool);
+}
+
+static void cghash_scalability_tests(const int num_threads, const unsigned int nkeys)
+{
+	TaskScheduler *scheduler = BLI_task_scheduler_create(num_threads);
+	const unsigned int num_tasks = (unsigned int)BLI_task_scheduler_num_threads(scheduler) * TASKS_PER_THREAD;
+	CGHashTestData data = {NULL};
+
+	printf("\n========== STARTING concurrent ghash, %d threads, %u keys ==========\n",
+	       BLI_task_scheduler_num_threads(scheduler), nkeys);
+
+	data.keys_per_task = nkeys / num_tasks;
+
+	{
+		data.cgh = BLI_concurrent_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+		data.lookups_found = 0;
+
+		TIMEIT_START(concurrent_ghash_insert_lookup);
+		cghash_run_tasks(scheduler, &data, cghash_insert_lookup_run, num_tasks);
+		TIMEIT_END(concurrent_ghash_insert_lookup);
+
+		EXPECT_EQ(data.keys_per_task * num_tasks, BLI_concurrent_ghash_size(data.cgh));
+		EXPECT_EQ(data.keys_per_task * num_tasks, data.lookups_found);
+
+		BLI_concurrent_ghash_free(data.cgh, NULL, NULL);
+		data.cgh = NULL;
+	}
+
+	{
+		data.gh = BLI_ghash_int_new(__func__);
+		data.lookups_found = 0;
+		BLI_mutex_init(&data.mutex);
+
+		TIMEIT_START(ghash_mutex_insert_lookup);
+		cghash_run_tasks(scheduler, &data, ghash_mutex_insert_lookup_run, num_tasks);
+		TIMEIT_END(ghash_mutex_insert_lookup);
+
+		EXPECT_EQ(data.keys_per_task * num_tasks, BLI_ghash_size(data.gh));
+		EXPECT_EQ(data.keys_per_task * num_tasks, data.lookups_found);
+
+		BLI_mutex_end(&data.mutex);
+		BLI_ghash_free(data.gh, NULL, NULL);
+		data.gh = NULL;
+	}
+
+	{
+		data.cgh = BLI_concurrent_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+		data.adds_done = 0;
+
+		TIMEIT_START(concurrent_ghash_add_same_keys);
+		cghash_run_tasks(scheduler, &data, cghash_add_run, num_tasks);
+		TIMEIT_END(concurrent_ghash_add_same_keys);
+
+		EXPECT_EQ(data.keys_per_task, data.adds_done);
+		EXPECT_EQ(data.keys_per_task, BLI_concurrent_ghash_size(data.cgh));
+
+		BLI_concurrent_ghash_free(data.cgh, NULL, NULL);
+		data.cgh = NULL;
+	}
+
+	BLI_task_scheduler_free(scheduler);
+
+	printf("========== ENDED concurrent ghash ==========\n\n");
+}
+
+TEST(concurrent_ghash, PopKeyEnsure)
+{
+	ConcurrentGHash *cgh = BLI_concurrent_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	void *val;
+
+	EXPECT_FALSE(BLI_concurrent_ghash_ensure(cgh, SET_UINT_IN_POINTER(1), SET_UINT_IN_POINTER(10), &val));
+	EXPECT_EQ(10, GET_UINT_FROM_POINTER(val));
+	EXPECT_TRUE(BLI_concurrent_ghash_ensure(cgh, SET_UINT_IN_POINTER(1), SET_UINT_IN_POINTER(20), &val));
+	EXPECT_EQ(10, GET_UINT_FROM_POINTER(val));
+
+	EXPECT_FALSE(BLI_concurrent_ghash_reinsert(cgh, SET_UINT_IN_POINTER(1), SET_UINT_IN_POINTER(30), NULL, NULL));
+	EXPECT_EQ(30, GET_UINT_FROM_POINTER(BLI_concurrent_ghash_lookup(cgh, SET_UINT_IN_POINTER(1))));
+	EXPECT_EQ(40, GET_UINT_FROM_POINTER(BLI_concurrent_ghash_lookup_default(cgh, SET_UINT_IN_POINTER(2), SET_UINT_IN_POINTER(40))));
+
+	EXPECT_EQ(30, GET_UINT_FROM_POINTER(BLI_concurrent_ghash_popkey(cgh, SET_UINT_IN_POINTER(1), NULL)));
+	EXPECT_FALSE(BLI_concurrent_ghash_haskey(cgh, SET_UINT_IN_POINTER(1)));
+	EXPECT_FALSE(BLI_concurrent_ghash_remove(cgh, SET_UINT_IN_POINTER(1), NULL, NULL));
+	EXPECT_EQ(0, BLI_concurrent_ghash_size(cgh));
+
+	BLI_concurrent_ghash_free(cgh, NULL, NULL);
+}
+
+TEST(concurrent_ghash, Scalability)
+{
+	const int max_threads = max_ii(8, BLI_system_thread_count());
+
+	BLI_threadapi_init();
+	for (int num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+		cghash_scalability_tests(num_threads, 1000000);
+	}
+	BLI_threadapi_exit();
+}
+
+/* Thread and key counts not evenly dividing the shards. */
+TEST(concurrent_ghash, ScalabilityUneven)
+{
+	const int thread_counts[] = {1, 3, 5, 6, 7, BLI_system_thread_count() | 1};
+
+	BLI_threadapi_init();
+	for (int i = 0; i < (int)ARRAY_SIZE(thread_counts); i++) {
+		cghash_scalability_tests(thread_counts[i], 999983);
+	}
+	BLI_threadapi_exit();
+}
@@ -158,6 +158,14 @@ TEST(ghash, TextMurmur2a)
 	str_ghash_tests(ghash, "StrGHash - Murmur");
 }
 
+TEST(ghash, TextOpenAddressing)
+{
+	GHash *ghash = BLI_ghash_new_flag(BLI_ghashutil_strhash_p, BLI_ghashutil_strcmp, __func__,
+	                                  0, GHASH_FLAG_OPEN_ADDRESSING);
+
+	str_ghash_tests(ghash, "StrGHash - Open Addressing");
+}
+
 
 /* Int: uniform 100M first integers. */
 
@@ -229,6 +237,22 @@ TEST(ghash, IntMurmur2a100000000)
 	int_ghash_tests(ghash, "IntGHash - Murmur - 100000000", 100000000);
 }
 
+TEST(ghash, IntOpenAddressing12000)
+{
+	GHash *ghash = BLI_ghash_new_flag(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__,
+	                                  0, GHASH_FLAG_OPEN_ADDRESSING);
+
+	int_ghash_tests(ghash, "IntGHash - Open Addressing - 12000", 12000);
+}
+
+TEST(ghash, IntOpenAddressing50000000)
+{
+	GHash *ghash = BLI_ghash_new_flag(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__,
+	                                  0, GHASH_FLAG_OPEN_ADDRESSING);
+
+	int_ghash_tests(ghash, "IntGHash - Open Addressing - 50000000", 50000000);
+}
+
 
 /* Int: random 50M integers. */
 
@@ -308,6 +332,22 @@ TEST(ghash, IntRandMurmur2a50000000)
 	randint_ghash_tests(ghash, "RandIntGHash - Murmur - 50000000", 50000000);
 }
 
+TEST(ghash, IntRandOpenAddressing12000)
+{
+	GHash *ghash = BLI_ghash_new_flag(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__,
+	                                  0, GHASH_FLAG_OPEN_ADDRESSING);
+
+	randint_ghash_tests(ghash, "RandIntGHash - Open Addressing - 12000", 12000);
+}
+
+TEST(ghash, IntRandOpenAddressing50000000)
+{
+	GHash *ghash = BLI_ghash_new_flag(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__,
+	                                  0, GHASH_FLAG_OPEN_ADDRESSING);
+
+	randint_ghash_tests(ghash, "RandIntGHash - Open Addressing - 50000000", 50000000);
+}
+
 static unsigned int ghashutil_tests_nohash_p(const void *p)
 {
 	return GET_UINT_FROM_POINTER(p);
@@ -413,3 +453,19 @@ TEST(ghash, Int4Murmur2a20000000)
 
 	int4_ghash_tests(ghash, "Int4GHash - Murmur - 20000000", 20000000);
 }
+
+TEST(ghash, Int4OpenAddressing2000)
+{
+	GHash *ghash = BLI_ghash_new_flag(BLI_ghashutil_uinthash_v4_p, BLI_ghashutil_uinthash_v4_cmp, __func__,
+	                                  0, GHASH_FLAG_OPEN_ADDRESSING);
+
+	int4_ghash_tests(ghash, "Int4GHash - Open Addressing - 2000", 2000);
+}
+
+TEST(ghash, Int4OpenAddressing20000000)
+{
+	GHash *ghash = BLI_ghash_new_flag(BLI_ghashutil_uinthash_v4_p, BLI_ghashutil_uinthash_v4_cmp, __func__,
+	                                  0, GHASH_FLAG_OPEN_ADDRESSING);
+
+	int4_ghash_tests(ghash, "Int4GHash - Open Addressing - 20000000", 20000000);
+}
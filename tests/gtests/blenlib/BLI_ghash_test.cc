@@ -156,3 +156,161 @@ TEST(ghash, Copy)
 	BLI_ghash_free(ghash, NULL, NULL);
 	BLI_ghash_free(ghash_copy, NULL, NULL);
 }
+
+/* Open addressing storage, same checks as above. */
+
+static GHash *ghash_oa_new(const char *info)
+{
+	return BLI_ghash_new_flag(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, info, 0, GHASH_FLAG_OPEN_ADDRESSING);
+}
+
+TEST(ghash, OpenAddressingInsertLookup)
+{
+	GHash *ghash = ghash_oa_new(__func__);
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i;
+
+	init_keys(keys, 40);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		BLI_ghash_insert(ghash, SET_UINT_IN_POINTER(*k), SET_UINT_IN_POINTER(*k));
+	}
+
+	EXPECT_EQ(TESTCASE_SIZE, BLI_ghash_size(ghash));
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		void *v = BLI_ghash_lookup(ghash, SET_UINT_IN_POINTER(*k));
+		EXPECT_EQ(*k, GET_UINT_FROM_POINTER(v));
+	}
+
+	BLI_ghash_free(ghash, NULL, NULL);
+}
+
+/* Remove half of the keys and insert them back several times, so deleted slots get reused and purged. */
+TEST(ghash, OpenAddressingInsertRemove)
+{
+	GHash *ghash = ghash_oa_new(__func__);
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i, pass;
+
+	init_keys(keys, 50);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		BLI_ghash_insert(ghash, SET_UINT_IN_POINTER(*k), SET_UINT_IN_POINTER(*k));
+	}
+
+	for (pass = 0; pass < 8; pass++) {
+		for (i = 0; i < TESTCASE_SIZE; i += 2) {
+			void *v = BLI_ghash_popkey(ghash, SET_UINT_IN_POINTER(keys[i]), NULL);
+			EXPECT_EQ(keys[i], GET_UINT_FROM_POINTER(v));
+		}
+		EXPECT_EQ(TESTCASE_SIZE / 2, BLI_ghash_size(ghash));
+
+		for (i = 0; i < TESTCASE_SIZE; i++) {
+			EXPECT_EQ((i % 2) != 0, BLI_ghash_haskey(ghash, SET_UINT_IN_POINTER(keys[i])));
+		}
+
+		for (i = 0; i < TESTCASE_SIZE; i += 2) {
+			void **val;
+			EXPECT_FALSE(BLI_ghash_ensure_p(ghash, SET_UINT_IN_POINTER(keys[i]), &val));
+			*val = SET_UINT_IN_POINTER(keys[i]);
+		}
+		EXPECT_EQ(TESTCASE_SIZE, BLI_ghash_size(ghash));
+	}
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		void *v = BLI_ghash_lookup(ghash, SET_UINT_IN_POINTER(*k));
+		EXPECT_EQ(*k, GET_UINT_FROM_POINTER(v));
+		EXPECT_TRUE(BLI_ghash_remove(ghash, SET_UINT_IN_POINTER(*k), NULL, NULL));
+	}
+
+	EXPECT_EQ(0, BLI_ghash_size(ghash));
+
+	BLI_ghash_free(ghash, NULL, NULL);
+}
+
+TEST(ghash, OpenAddressingInsertRemoveShrink)
+{
+	GHash *ghash = ghash_oa_new(__func__);
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i, bkt_size;
+
+	BLI_ghash_flag_set(ghash, GHASH_FLAG_ALLOW_SHRINK);
+	init_keys(keys, 60);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		BLI_ghash_insert(ghash, SET_UINT_IN_POINTER(*k), SET_UINT_IN_POINTER(*k));
+	}
+
+	EXPECT_EQ(TESTCASE_SIZE, BLI_ghash_size(ghash));
+	bkt_size = BLI_ghash_buckets_size(ghash);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		void *v = BLI_ghash_popkey(ghash, SET_UINT_IN_POINTER(*k), NULL);
+		EXPECT_EQ(*k, GET_UINT_FROM_POINTER(v));
+	}
+
+	EXPECT_EQ(0, BLI_ghash_size(ghash));
+	EXPECT_LT(BLI_ghash_buckets_size(ghash), bkt_size);
+
+	BLI_ghash_free(ghash, NULL, NULL);
+}
+
+TEST(ghash, OpenAddressingCopyIter)
+{
+	GHash *ghash = ghash_oa_new(__func__);
+	GHash *ghash_copy;
+	GHashIterator gh_iter;
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i, count = 0;
+
+	init_keys(keys, 70);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		BLI_ghash_insert(ghash, SET_UINT_IN_POINTER(*k), SET_UINT_IN_POINTER(*k));
+	}
+
+	ghash_copy = BLI_ghash_copy(ghash, NULL, NULL);
+
+	EXPECT_EQ(TESTCASE_SIZE, BLI_ghash_size(ghash_copy));
+	EXPECT_EQ(BLI_ghash_buckets_size(ghash), BLI_ghash_buckets_size(ghash_copy));
+
+	GHASH_ITER (gh_iter, ghash_copy) {
+		void *key = BLI_ghashIterator_getKey(&gh_iter);
+		EXPECT_EQ(key, BLI_ghashIterator_getValue(&gh_iter));
+		EXPECT_EQ(key, BLI_ghash_lookup(ghash, key));
+		count++;
+	}
+	EXPECT_EQ(TESTCASE_SIZE, count);
+
+	BLI_ghash_free(ghash, NULL, NULL);
+	BLI_ghash_free(ghash_copy, NULL, NULL);
+}
+
+TEST(ghash, OpenAddressingGSet)
+{
+	GSet *gset = BLI_gset_new_flag(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__,
+	                               TESTCASE_SIZE, GHASH_FLAG_OPEN_ADDRESSING);
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i;
+
+	init_keys(keys, 80);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		EXPECT_TRUE(BLI_gset_add(gset, SET_UINT_IN_POINTER(*k)));
+	}
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		EXPECT_FALSE(BLI_gset_add(gset, SET_UINT_IN_POINTER(*k)));
+	}
+
+	EXPECT_EQ(TESTCASE_SIZE, BLI_gset_size(gset));
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		EXPECT_TRUE(BLI_gset_remove(gset, SET_UINT_IN_POINTER(*k), NULL));
+		EXPECT_FALSE(BLI_gset_haskey(gset, SET_UINT_IN_POINTER(*k)));
+	}
+
+	EXPECT_EQ(0, BLI_gset_size(gset));
+
+	BLI_gset_free(gset, NULL);
+}
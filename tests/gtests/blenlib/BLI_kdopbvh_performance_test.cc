@@ -0,0 +1,245 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_kdopbvh.h"
+#include "BLI_math.h"
+#include "BLI_rand.h"
+#include "BLI_threads.h"
+#include "PIL_time_utildefines.h"
+}
+
+/* Ray casts against a triangulated height field, like shrinkwrap projection or baking do. */
+
+typedef struct TerrainMesh {
+	int res;
+	float (*co)[3];
+	unsigned int (*tris)[3];
+	int tris_num;
+} TerrainMesh;
+
+static void terrain_mesh_create(TerrainMesh *mesh, const int res)
+{
+	const int verts_num = (res + 1) * (res + 1);
+	int i = 0;
+
+	mesh->res = res;
+	mesh->co = (float (*)[3])MEM_mallocN(sizeof(*mesh->co) * (size_t)verts_num, __func__);
+	mesh->tris_num = res * res * 2;
+	mesh->tris = (unsigned int (*)[3])MEM_mallocN(sizeof(*mesh->tris) * (size_t)mesh->tris_num, __func__);
+
+	for (int y = 0; y <= res; y++) {
+		for (int x = 0; x <= res; x++, i++) {
+			const float u = (float)x / (float)res, v = (float)y / (float)res;
+			mesh->co[i][0] = u;
+			mesh->co[i][1] = v;
+			mesh->co[i][2] = 0.05f * sinf(u * 31.0f) * cosf(v * 17.0f);
+		}
+	}
+
+	i = 0;
+	for (int y = 0; y < res; y++) {
+		for (int x = 0; x < res; x++) {
+			const unsigned int v = (unsigned int)(y * (res + 1) + x);
+			const unsigned int v_up = v + (unsigned int)(res + 1);
+			ARRAY_SET_ITEMS(mesh->tris[i], v, v + 1, v_up + 1);
+			ARRAY_SET_ITEMS(mesh->tris[i + 1], v, v_up + 1, v_up);
+			i += 2;
+		}
+	}
+}
+
+static void terrain_mesh_free(TerrainMesh *mesh)
+{
+	MEM_freeN(mesh->co);
+	MEM_freeN(mesh->tris);
+}
+
+static BVHTree *terrain_bvhtree_create(const TerrainMesh *mesh, const char tree_type)
+{
+	BVHTree *tree = BLI_bvhtree_new(mesh->tris_num, 0.0f, tree_type, 6);
+
+	for (int i = 0; i < mesh->tris_num; i++) {
+		float co[3][3];
+		copy_v3_v3(co[0], mesh->co[mesh->tris[i][0]]);
+		copy_v3_v3(co[1], mesh->co[mesh->tris[i][1]]);
+		copy_v3_v3(co[2], mesh->co[mesh->tris[i][2]]);
+		BLI_bvhtree_insert(tree, i, co[0], 3);
+	}
+	BLI_bvhtree_balance(tree);
+
+	return tree;
+}
+
+static void terrain_raycast_cb(void *userdata, int index, const BVHTreeRay *ray, BVHTreeRayHit *hit)
+{
+	const TerrainMesh *mesh = (const TerrainMesh *)userdata;
+	const unsigned int *tri = mesh->tris[index];
+	float dist;
+
+	if (isect_ray_tri_v3(ray->origin, ray->direction,
+	                     mesh->co[tri[0]], mesh->co[tri[1]], mesh->co[tri[2]], &dist, NULL) &&
+	    (dist < hit->dist))
+	{
+		hit->index = index;
+		hit->dist = dist;
+		madd_v3_v3v3fl(hit->co, ray->origin, ray->direction, dist);
+	}
+}
+
+/* Coherent rays are cast down onto the terrain from a regular grid,
+ * incoherent rays start and point anywhere. */
+static BVHTreeRay *terrain_rays_create(const int rays_num, const bool coherent)
+{
+	BVHTreeRay *rays = (BVHTreeRay *)MEM_mallocN(sizeof(*rays) * (size_t)rays_num, __func__);
+	RNG *rng = BLI_rng_new(0);
+	const int grid = (int)sqrtf((float)rays_num);
+
+	for (int i = 0; i < rays_num; i++) {
+		BVHTreeRay *ray = &rays[i];
+		if (coherent) {
+			ARRAY_SET_ITEMS(ray->origin, (float)(i % grid) / (float)grid, (float)(i / grid) / (float)grid, 1.0f);
+			ARRAY_SET_ITEMS(ray->direction, 0.1f, 0.05f, -1.0f);
+		}
+		else {
+			ARRAY_SET_ITEMS(ray->origin, BLI_rng_get_float(rng), BLI_rng_get_float(rng), BLI_rng_get_float(rng) * 0.2f);
+			BLI_rng_get_float_unit_v3(rng, ray->direction);
+		}
+		normalize_v3(ray->direction);
+		ray->radius = 0.0f;
+	}
+
+	BLI_rng_free(rng);
+	return rays;
+}
+
+static void bvhtree_raycast_perf_test(const int res, const int rays_num, const char tree_type)
+{
+	TerrainMesh mesh;
+	BVHTree *tree;
+
+	printf("\n========== STARTING kdopbvh, %d triangles, %d rays, tree type %d ==========\n",
+	       res * res * 2, rays_num, tree_type);
+
+	BLI_threadapi_init();
+
+	terrain_mesh_create(&mesh, res);
+
+	TIMEIT_START(bvhtree_build);
+	tree = terrain_bvhtree_create(&mesh, tree_type);
+	TIMEIT_END(bvhtree_build);
+
+	for (int coherent = 1; coherent >= 0; coherent--) {
+		BVHTreeRay *rays = terrain_rays_create(rays_num, coherent != 0);
+		BVHTreeRayHit *hits = (BVHTreeRayHit *)MEM_mallocN(sizeof(*hits) * (size_t)rays_num, __func__);
+		BVHTreeRayHit *hits_batch = (BVHTreeRayHit *)MEM_mallocN(sizeof(*hits) * (size_t)rays_num, __func__);
+		long long checksum = 0;
+		int mismatch = 0;
+
+		printf("%s rays:\n", coherent ? "coherent" : "incoherent");
+
+		TIMEIT_START(bvhtree_ray_cast);
+		for (int i = 0; i < rays_num; i++) {
+			hits[i].index = -1;
+			hits[i].dist = FLT_MAX;
+			BLI_bvhtree_ray_cast(tree, rays[i].origin, rays[i].direction, 0.0f, &hits[i], terrain_raycast_cb, &mesh);
+		}
+		TIMEIT_END(bvhtree_ray_cast);
+
+		for (int i = 0; i < rays_num; i++) {
+			hits_batch[i].index = -1;
+			hits_batch[i].dist = FLT_MAX;
+		}
+
+		TIMEIT_START(bvhtree_ray_cast_batch);
+		BLI_bvhtree_ray_cast_batch(tree, rays, rays_num, hits_batch, terrain_raycast_cb, &mesh);
+		TIMEIT_END(bvhtree_ray_cast_batch);
+
+		for (int i = 0; i < rays_num; i++) {
+			checksum += hits[i].index;
+			/* the index may differ for rays hitting an edge, the distance may not */
+			if (hits[i].dist != hits_batch[i].dist) {
+				mismatch++;
+			}
+		}
+		printf("(checksum %lld)\n", checksum);
+		EXPECT_EQ(0, mismatch);
+
+		MEM_freeN(rays);
+		MEM_freeN(hits);
+		MEM_freeN(hits_batch);
+	}
+
+	BLI_bvhtree_free(tree);
+	terrain_mesh_free(&mesh);
+
+	BLI_threadapi_exit();
+
+	printf("========== ENDED kdopbvh ==========\n\n");
+}
+
+/* Self overlap, like cloth self collision or self intersection do. */
+static bool overlap_skip_adjacent_cb(void *userdata, int index_a, int index_b, int UNUSED(thread))
+{
+	const TerrainMesh *mesh = (const TerrainMesh *)userdata;
+	const unsigned int *tri_a = mesh->tris[index_a], *tri_b = mesh->tris[index_b];
+
+	return !(ELEM(tri_a[0], tri_b[0], tri_b[1], tri_b[2]) ||
+	         ELEM(tri_a[1], tri_b[0], tri_b[1], tri_b[2]) ||
+	         ELEM(tri_a[2], tri_b[0], tri_b[1], tri_b[2]));
+}
+
+static void bvhtree_overlap_perf_test(const int res, const char tree_type)
+{
+	TerrainMesh mesh;
+	BVHTree *tree;
+	BVHTreeOverlap *overlap;
+	unsigned int overlap_num;
+
+	printf("\n========== STARTING kdopbvh overlap, %d triangles, tree type %d ==========\n",
+	       res * res * 2, tree_type);
+
+	BLI_threadapi_init();
+
+	terrain_mesh_create(&mesh, res);
+	tree = terrain_bvhtree_create(&mesh, tree_type);
+
+	TIMEIT_START(bvhtree_overlap);
+	overlap = BLI_bvhtree_overlap(tree, tree, &overlap_num, NULL, NULL);
+	TIMEIT_END(bvhtree_overlap);
+	printf("(%u pairs)\n", overlap_num);
+	MEM_freeN(overlap);
+
+	TIMEIT_START(bvhtree_overlap_callback);
+	overlap = BLI_bvhtree_overlap(tree, tree, &overlap_num, overlap_skip_adjacent_cb, &mesh);
+	TIMEIT_END(bvhtree_overlap_callback);
+	printf("(%u pairs)\n", overlap_num);
+	if (overlap) {
+		MEM_freeN(overlap);
+	}
+
+	BLI_bvhtree_free(tree);
+	terrain_mesh_free(&mesh);
+
+	BLI_threadapi_exit();
+
+	printf("========== ENDED kdopbvh overlap ==========\n\n");
+}
+
+TEST(kdopbvh, Overlap500k)
+{
+	bvhtree_overlap_perf_test(500, 4);
+}
+
+TEST(kdopbvh, RayCast2M_Quad)
+{
+	bvhtree_raycast_perf_test(1000, 1000000, 4);
+}
+
+TEST(kdopbvh, RayCast2M_Binary)
+{
+	bvhtree_raycast_perf_test(1000, 1000000, 2);
+}
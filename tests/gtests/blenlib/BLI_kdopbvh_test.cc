@@ -0,0 +1,258 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_bitmap.h"
+#include "BLI_kdopbvh.h"
+#include "BLI_math.h"
+#include "BLI_rand.h"
+#include "BLI_threads.h"
+}
+
+#define NUM_RAYS 1000
+
+/* Random triangles in a unit cube, ray casts are compared with brute force intersections. */
+
+static void raycast_tris_cb(void *userdata, int index, const BVHTreeRay *ray, BVHTreeRayHit *hit)
+{
+	const float (*tris)[3][3] = (const float (*)[3][3])userdata;
+	float dist;
+
+	if (isect_ray_tri_v3(ray->origin, ray->direction, tris[index][0], tris[index][1], tris[index][2], &dist, NULL) &&
+	    (dist < hit->dist))
+	{
+		hit->index = index;
+		hit->dist = dist;
+	}
+}
+
+static float raycast_brute_force(const float (*tris)[3][3], const int tris_num, const BVHTreeRay *ray)
+{
+	float dir[3], dist, dist_min = FLT_MAX;
+
+	normalize_v3_v3(dir, ray->direction);
+	for (int i = 0; i < tris_num; i++) {
+		if (isect_ray_tri_v3(ray->origin, dir, tris[i][0], tris[i][1], tris[i][2], &dist, NULL)) {
+			dist_min = min_ff(dist_min, dist);
+		}
+	}
+	return dist_min;
+}
+
+static void raycast_test(const int tris_num, const char tree_type, const bool use_callback, const float radius)
+{
+	float (*tris)[3][3] = (float (*)[3][3])MEM_mallocN(sizeof(*tris) * (size_t)tris_num, __func__);
+	BVHTreeRay *rays = (BVHTreeRay *)MEM_mallocN(sizeof(*rays) * NUM_RAYS, __func__);
+	BVHTreeRayHit *hits = (BVHTreeRayHit *)MEM_mallocN(sizeof(*hits) * NUM_RAYS, __func__);
+	BVHTreeRayHit *hits_batch = (BVHTreeRayHit *)MEM_mallocN(sizeof(*hits) * NUM_RAYS, __func__);
+	BVHTree_RayCastCallback callback = use_callback ? raycast_tris_cb : NULL;
+	RNG *rng = BLI_rng_new((unsigned int)tris_num);
+	BVHTree *tree = BLI_bvhtree_new(tris_num, 0.0f, tree_type, 6);
+
+	for (int i = 0; i < tris_num; i++) {
+		if (i % 4 == 3) {
+			/* Duplicates, which one is hit depends on the order nodes are visited in. */
+			memcpy(tris[i], tris[i - 1], sizeof(*tris));
+		}
+		else {
+			float center[3];
+			BLI_rng_get_float_unit_v3(rng, center);
+			mul_v3_fl(center, 0.5f);
+			for (int j = 0; j < 3; j++) {
+				BLI_rng_get_float_unit_v3(rng, tris[i][j]);
+				madd_v3_v3fl(tris[i][j], center, 10.0f);
+				mul_v3_fl(tris[i][j], 0.1f);
+			}
+		}
+		BLI_bvhtree_insert(tree, i, tris[i][0], 3);
+	}
+	BLI_bvhtree_balance(tree);
+
+	for (int i = 0; i < NUM_RAYS; i++) {
+		/* Groups of coherent and random rays, to test both packets and single rays. */
+		if ((i / 16) % 3 == 1) {
+			ARRAY_SET_ITEMS(rays[i].origin, -1.0f, (float)(i % 16) / 32.0f, (float)(i % 7) / 16.0f);
+			ARRAY_SET_ITEMS(rays[i].direction, 1.0f, 0.1f, -0.2f);
+		}
+		else if ((i / 16) % 3 == 2) {
+			/* Same octant, but every other ray is nearly perpendicular to the z axis,
+			 * so the rays of a packet visit children in a different order. */
+			ARRAY_SET_ITEMS(rays[i].origin, -1.0f, (float)(i % 16) / 32.0f, (float)(i % 7) / 16.0f);
+			ARRAY_SET_ITEMS(rays[i].direction, 1.0f, 0.1f, (i % 2) ? 1e-8f : 0.2f);
+		}
+		else {
+			BLI_rng_get_float_unit_v3(rng, rays[i].origin);
+			BLI_rng_get_float_unit_v3(rng, rays[i].direction);
+		}
+		rays[i].radius = ((i % 3) == 0) ? radius : 0.0f;
+
+		hits[i].index = hits_batch[i].index = -1;
+		hits[i].dist = hits_batch[i].dist = (i % 5) ? FLT_MAX : 0.5f;
+	}
+	BLI_rng_free(rng);
+
+	for (int i = 0; i < NUM_RAYS; i++) {
+		BLI_bvhtree_ray_cast(tree, rays[i].origin, rays[i].direction, rays[i].radius, &hits[i], callback, tris);
+
+		if (use_callback && (rays[i].radius == 0.0f)) {
+			const float dist = raycast_brute_force(tris, tris_num, &rays[i]);
+			if (dist < ((i % 5) ? FLT_MAX : 0.5f)) {
+				EXPECT_FLOAT_EQ(dist, hits[i].dist);
+			}
+			else {
+				EXPECT_EQ(-1, hits[i].index);
+			}
+		}
+	}
+
+	BLI_bvhtree_ray_cast_batch(tree, rays, NUM_RAYS, hits_batch, callback, tris);
+
+	for (int i = 0; i < NUM_RAYS; i++) {
+		EXPECT_EQ(hits[i].dist, hits_batch[i].dist);
+		EXPECT_EQ(hits[i].index, hits_batch[i].index);
+	}
+
+	BLI_bvhtree_free(tree);
+	MEM_freeN(tris);
+	MEM_freeN(rays);
+	MEM_freeN(hits);
+	MEM_freeN(hits_batch);
+}
+
+TEST(kdopbvh, RayCastSmall)
+{
+	BLI_threadapi_init();
+	raycast_test(1, 2, true, 0.0f);
+	raycast_test(3, 4, true, 0.0f);
+	raycast_test(7, 8, true, 0.0f);
+	BLI_threadapi_exit();
+}
+
+TEST(kdopbvh, RayCast)
+{
+	BLI_threadapi_init();
+	for (char tree_type = 2; tree_type <= 8; tree_type++) {
+		raycast_test(5000, tree_type, true, 0.0f);
+	}
+	BLI_threadapi_exit();
+}
+
+TEST(kdopbvh, RayCastRadius)
+{
+	BLI_threadapi_init();
+	raycast_test(5000, 4, true, 0.05f);
+	BLI_threadapi_exit();
+}
+
+TEST(kdopbvh, RayCastNoCallback)
+{
+	BLI_threadapi_init();
+	raycast_test(5000, 2, false, 0.0f);
+	raycast_test(5000, 4, false, 0.0f);
+	BLI_threadapi_exit();
+}
+
+/* Random boxes, overlapping pairs are compared with brute force box tests. */
+
+static BVHTree *overlap_tree_create(float (*boxes)[2][3], const int boxes_num, const char tree_type, RNG *rng)
+{
+	BVHTree *tree = BLI_bvhtree_new(boxes_num, 0.0f, tree_type, 6);
+
+	for (int i = 0; i < boxes_num; i++) {
+		float size[3];
+		BLI_rng_get_float_unit_v3(rng, boxes[i][0]);
+		BLI_rng_get_float_unit_v3(rng, size);
+		abs_v3(size);
+		mul_v3_fl(size, 0.05f);
+		add_v3_v3v3(boxes[i][1], boxes[i][0], size);
+		BLI_bvhtree_insert(tree, i, boxes[i][0], 2);
+	}
+	BLI_bvhtree_balance(tree);
+
+	return tree;
+}
+
+static bool overlap_odd_sum_cb(void *UNUSED(userdata), int index_a, int index_b, int UNUSED(thread))
+{
+	return ((index_a + index_b) % 2) != 0;
+}
+
+static void overlap_test(const int boxes_num_a, const int boxes_num_b,
+                         const char tree_type_a, const char tree_type_b, const bool use_callback)
+{
+	float (*boxes_a)[2][3] = (float (*)[2][3])MEM_mallocN(sizeof(*boxes_a) * (size_t)boxes_num_a, __func__);
+	float (*boxes_b)[2][3] = (float (*)[2][3])MEM_mallocN(sizeof(*boxes_b) * (size_t)boxes_num_b, __func__);
+	BLI_bitmap *found = BLI_BITMAP_NEW((size_t)boxes_num_a * (size_t)boxes_num_b, __func__);
+	RNG *rng = BLI_rng_new((unsigned int)(boxes_num_a + boxes_num_b));
+	BVHTree *tree_a = overlap_tree_create(boxes_a, boxes_num_a, tree_type_a, rng);
+	BVHTree *tree_b = overlap_tree_create(boxes_b, boxes_num_b, tree_type_b, rng);
+	BVHTreeOverlap *overlap, *overlap_again;
+	unsigned int overlap_num, overlap_again_num, expected_num = 0;
+
+	BLI_rng_free(rng);
+
+	overlap = BLI_bvhtree_overlap(tree_a, tree_b, &overlap_num, use_callback ? overlap_odd_sum_cb : NULL, NULL);
+
+	for (unsigned int i = 0; i < overlap_num; i++) {
+		const size_t index = (size_t)overlap[i].indexA * (size_t)boxes_num_b + (size_t)overlap[i].indexB;
+		EXPECT_FALSE(BLI_BITMAP_TEST(found, index));
+		BLI_BITMAP_ENABLE(found, index);
+	}
+
+	for (int i = 0; i < boxes_num_a; i++) {
+		for (int j = 0; j < boxes_num_b; j++) {
+			const bool isect = isect_aabb_aabb_v3(boxes_a[i][0], boxes_a[i][1], boxes_b[j][0], boxes_b[j][1]);
+			const bool expected = isect && (!use_callback || overlap_odd_sum_cb(NULL, i, j, 0));
+			EXPECT_EQ(expected, BLI_BITMAP_TEST_BOOL(found, (size_t)i * (size_t)boxes_num_b + (size_t)j));
+			expected_num += expected;
+		}
+	}
+	EXPECT_EQ(expected_num, overlap_num);
+
+	/* results are joined in a fixed order, whatever the threads did */
+	overlap_again = BLI_bvhtree_overlap(tree_a, tree_b, &overlap_again_num, use_callback ? overlap_odd_sum_cb : NULL, NULL);
+	EXPECT_EQ(overlap_num, overlap_again_num);
+	if (overlap_num) {
+		EXPECT_EQ(0, memcmp(overlap, overlap_again, sizeof(*overlap) * overlap_num));
+		MEM_freeN(overlap);
+		MEM_freeN(overlap_again);
+	}
+	else {
+		EXPECT_TRUE(overlap == NULL);
+		EXPECT_TRUE(overlap_again == NULL);
+	}
+
+	BLI_bvhtree_free(tree_a);
+	BLI_bvhtree_free(tree_b);
+	MEM_freeN(boxes_a);
+	MEM_freeN(boxes_b);
+	MEM_freeN(found);
+}
+
+TEST(kdopbvh, OverlapSmall)
+{
+	BLI_threadapi_init();
+	overlap_test(1, 1, 2, 2, false);
+	overlap_test(3, 5, 4, 2, false);
+	BLI_threadapi_exit();
+}
+
+TEST(kdopbvh, Overlap)
+{
+	BLI_threadapi_init();
+	for (char tree_type = 2; tree_type <= 8; tree_type++) {
+		overlap_test(3000, 2000, tree_type, 4, false);
+	}
+	overlap_test(2000, 3000, 8, 2, false);
+	BLI_threadapi_exit();
+}
+
+TEST(kdopbvh, OverlapCallback)
+{
+	BLI_threadapi_init();
+	overlap_test(3000, 3000, 4, 4, true);
+	BLI_threadapi_exit();
+}
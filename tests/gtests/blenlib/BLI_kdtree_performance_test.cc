@@ -0,0 +1,124 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include <cmath>
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_kdtree.h"
+#include "BLI_rand.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
+#include "PIL_time_utildefines.h"
+}
+
+#define NEAREST_N 8
+
+static float (*kdtree_random_points(const unsigned int num, const unsigned int seed))[3]
+{
+	float (*points)[3] = (float (*)[3])MEM_mallocN(sizeof(*points) * num, __func__);
+	RNG *rng = BLI_rng_new(seed);
+
+	for (unsigned int i = 0; i < num; i++) {
+		points[i][0] = BLI_rng_get_float(rng);
+		points[i][1] = BLI_rng_get_float(rng);
+		points[i][2] = BLI_rng_get_float(rng);
+	}
+
+	BLI_rng_free(rng);
+	return points;
+}
+
+static void kdtree_perf_test(const unsigned int num_points, const unsigned int num_queries)
+{
+	float (*points)[3] = kdtree_random_points(num_points, 0);
+	float (*queries)[3] = kdtree_random_points(num_queries, 1);
+	const float range = powf(32.0f / (float)num_points, 1.0f / 3.0f);
+	KDTree *tree;
+	long long found_total = 0;
+
+	printf("\n========== STARTING kdtree, %u points, %u queries ==========\n", num_points, num_queries);
+
+	BLI_threadapi_init();
+
+	TIMEIT_START(kdtree_build);
+	tree = BLI_kdtree_new(num_points);
+	for (unsigned int i = 0; i < num_points; i++) {
+		BLI_kdtree_insert(tree, (int)i, points[i]);
+	}
+	BLI_kdtree_balance(tree);
+	TIMEIT_END(kdtree_build);
+
+	TIMEIT_START(kdtree_find_nearest);
+	for (unsigned int i = 0; i < num_queries; i++) {
+		found_total += BLI_kdtree_find_nearest(tree, queries[i], NULL);
+	}
+	TIMEIT_END(kdtree_find_nearest);
+
+	{
+		KDTreeNearest nearest[NEAREST_N];
+
+		TIMEIT_START(kdtree_find_nearest_n);
+		for (unsigned int i = 0; i < num_queries; i++) {
+			found_total += BLI_kdtree_find_nearest_n(tree, queries[i], nearest, NEAREST_N);
+		}
+		TIMEIT_END(kdtree_find_nearest_n);
+	}
+
+	TIMEIT_START(kdtree_range_search);
+	for (unsigned int i = 0; i < num_queries; i++) {
+		KDTreeNearest *nearest = NULL;
+		found_total += BLI_kdtree_range_search(tree, queries[i], &nearest, range);
+		if (nearest) {
+			MEM_freeN(nearest);
+		}
+	}
+	TIMEIT_END(kdtree_range_search);
+
+	printf("(checksum %lld)\n", found_total);
+
+	/* Batch versions of the nearest queries, spread over the task scheduler. */
+	{
+		int *r_index = (int *)MEM_mallocN(sizeof(int) * num_queries, __func__);
+		int *r_found = (int *)MEM_mallocN(sizeof(int) * num_queries, __func__);
+		KDTreeNearest *r_nearest = (KDTreeNearest *)MEM_mallocN(sizeof(KDTreeNearest) * num_queries * NEAREST_N, __func__);
+		long long found_batch_total = 0;
+
+		TIMEIT_START(kdtree_find_nearest_batch);
+		BLI_kdtree_find_nearest_batch(tree, queries, (int)num_queries, r_index, NULL);
+		TIMEIT_END(kdtree_find_nearest_batch);
+
+		TIMEIT_START(kdtree_find_nearest_n_batch);
+		BLI_kdtree_find_nearest_n_batch(tree, queries, (int)num_queries, r_nearest, r_found, NEAREST_N);
+		TIMEIT_END(kdtree_find_nearest_n_batch);
+
+		for (unsigned int i = 0; i < num_queries; i++) {
+			found_batch_total += r_index[i] + r_found[i];
+		}
+		printf("(batch checksum %lld)\n", found_batch_total);
+
+		MEM_freeN(r_index);
+		MEM_freeN(r_found);
+		MEM_freeN(r_nearest);
+	}
+
+	BLI_kdtree_free(tree);
+	MEM_freeN(points);
+	MEM_freeN(queries);
+
+	BLI_threadapi_exit();
+
+	printf("========== ENDED kdtree ==========\n\n");
+}
+
+TEST(kdtree, Perf100k)
+{
+	kdtree_perf_test(100000, 100000);
+}
+
+TEST(kdtree, Perf2M)
+{
+	kdtree_perf_test(2000000, 500000);
+}
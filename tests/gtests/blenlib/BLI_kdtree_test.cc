@@ -0,0 +1,177 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_kdtree.h"
+#include "BLI_math_vector.h"
+#include "BLI_rand.h"
+#include "BLI_threads.h"
+}
+
+#define NEAREST_N 5
+#define NUM_QUERIES 200
+
+/* Compare tree results with brute force searches over all points. */
+
+static float brute_force_dist(const float co[3], const float point[3], const float nor[3])
+{
+	float d[3], dist;
+	sub_v3_v3v3(d, point, co);
+	dist = len_squared_v3(d);
+	if (nor && dot_v3v3(d, nor) < 0.0f) {
+		dist *= 10.0f;
+	}
+	return sqrtf(dist);
+}
+
+/* Distance of the n-th nearest point (index starting at 0), and number of points within range. */
+static float brute_force_nth_dist(float (*points)[3], const int num_points, const float co[3], const float nor[3], const int n)
+{
+	float *dists = (float *)MEM_mallocN(sizeof(float) * (size_t)num_points, __func__);
+	float dist_nth = FLT_MAX;
+
+	for (int i = 0; i < num_points; i++) {
+		dists[i] = brute_force_dist(co, points[i], nor);
+	}
+	/* selection, fine for small tests */
+	for (int k = 0; k <= n && k < num_points; k++) {
+		int i_min = k;
+		for (int i = k + 1; i < num_points; i++) {
+			if (dists[i] < dists[i_min]) {
+				i_min = i;
+			}
+		}
+		SWAP(float, dists[k], dists[i_min]);
+		dist_nth = dists[k];
+	}
+
+	MEM_freeN(dists);
+	return dist_nth;
+}
+
+static void kdtree_test(const int num_points, const unsigned int seed)
+{
+	float (*points)[3] = (float (*)[3])MEM_mallocN(sizeof(*points) * (size_t)max_ii(num_points, 1), __func__);
+	float queries[NUM_QUERIES][3];
+	const float nor[3] = {0.0f, 0.0f, 1.0f};
+	RNG *rng = BLI_rng_new(seed);
+	KDTree *tree = BLI_kdtree_new((unsigned int)num_points);
+
+	for (int i = 0; i < num_points; i++) {
+		/* Snap some coordinates, so equal coordinates on split axes are tested too. */
+		for (int j = 0; j < 3; j++) {
+			points[i][j] = (i % 3) ? BLI_rng_get_float(rng) : floorf(BLI_rng_get_float(rng) * 8.0f) / 8.0f;
+		}
+		BLI_kdtree_insert(tree, i, points[i]);
+	}
+	for (int i = 0; i < NUM_QUERIES; i++) {
+		queries[i][0] = BLI_rng_get_float(rng) * 1.2f - 0.1f;
+		queries[i][1] = BLI_rng_get_float(rng) * 1.2f - 0.1f;
+		queries[i][2] = BLI_rng_get_float(rng) * 1.2f - 0.1f;
+	}
+	BLI_rng_free(rng);
+
+	BLI_kdtree_balance(tree);
+
+	for (int i = 0; i < NUM_QUERIES; i++) {
+		const float *co = queries[i];
+		KDTreeNearest nearest, nearest_n[NEAREST_N];
+		int index, found;
+
+		index = BLI_kdtree_find_nearest(tree, co, &nearest);
+		if (num_points == 0) {
+			EXPECT_EQ(-1, index);
+		}
+		else {
+			EXPECT_EQ(index, nearest.index);
+			EXPECT_FLOAT_EQ(brute_force_nth_dist(points, num_points, co, NULL, 0), nearest.dist);
+			EXPECT_FLOAT_EQ(brute_force_dist(co, points[index], NULL), nearest.dist);
+		}
+
+		for (int use_normal = 0; use_normal < 2; use_normal++) {
+			const float *n = use_normal ? nor : NULL;
+			found = BLI_kdtree_find_nearest_n__normal(tree, co, n, nearest_n, NEAREST_N);
+			EXPECT_EQ(min_ii(NEAREST_N, num_points), found);
+			for (int k = 0; k < found; k++) {
+				EXPECT_FLOAT_EQ(brute_force_nth_dist(points, num_points, co, n, k), nearest_n[k].dist);
+				EXPECT_FLOAT_EQ(brute_force_dist(co, points[nearest_n[k].index], n), nearest_n[k].dist);
+			}
+		}
+
+		{
+			KDTreeNearest *nearest_range = NULL;
+			const float range = 0.15f;
+			int num_in_range = 0;
+
+			for (int j = 0; j < num_points; j++) {
+				if (brute_force_dist(co, points[j], NULL) <= range) {
+					num_in_range++;
+				}
+			}
+
+			found = BLI_kdtree_range_search(tree, co, &nearest_range, range);
+			EXPECT_EQ(num_in_range, found);
+			for (int k = 0; k < found; k++) {
+				EXPECT_LE(nearest_range[k].dist, range);
+				if (k) {
+					EXPECT_LE(nearest_range[k - 1].dist, nearest_range[k].dist);
+				}
+			}
+			if (nearest_range) {
+				MEM_freeN(nearest_range);
+			}
+		}
+	}
+
+	/* Batch queries must match single ones. */
+	{
+		int r_index[NUM_QUERIES], r_found[NUM_QUERIES];
+		KDTreeNearest *r_nearest_n = (KDTreeNearest *)MEM_mallocN(sizeof(KDTreeNearest) * NUM_QUERIES * NEAREST_N, __func__);
+
+		BLI_kdtree_find_nearest_batch(tree, queries, NUM_QUERIES, r_index, NULL);
+		BLI_kdtree_find_nearest_n_batch(tree, queries, NUM_QUERIES, r_nearest_n, r_found, NEAREST_N);
+
+		for (int i = 0; i < NUM_QUERIES; i++) {
+			KDTreeNearest nearest_n[NEAREST_N];
+			const int found = BLI_kdtree_find_nearest_n(tree, queries[i], nearest_n, NEAREST_N);
+
+			EXPECT_EQ(BLI_kdtree_find_nearest(tree, queries[i], NULL), r_index[i]);
+			EXPECT_EQ(found, r_found[i]);
+			for (int k = 0; k < found; k++) {
+				EXPECT_EQ(nearest_n[k].index, r_nearest_n[i * NEAREST_N + k].index);
+			}
+		}
+
+		MEM_freeN(r_nearest_n);
+	}
+
+	BLI_kdtree_free(tree);
+	MEM_freeN(points);
+}
+
+TEST(kdtree, Empty)
+{
+	kdtree_test(0, 0);
+}
+
+TEST(kdtree, Single)
+{
+	kdtree_test(1, 1);
+}
+
+TEST(kdtree, Small)
+{
+	kdtree_test(7, 2);
+	kdtree_test(50, 3);
+}
+
+TEST(kdtree, Large)
+{
+	/* Large enough to be balanced in several tasks. */
+	BLI_threadapi_init();
+	kdtree_test(60000, 4);
+	BLI_threadapi_exit();
+}
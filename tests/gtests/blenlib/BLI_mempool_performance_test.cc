@@ -0,0 +1,131 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_mempool.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
+#include "PIL_time_utildefines.h"
+}
+
+/* Allocating and freeing from tasks in a threadsafe pool, compared to the same
+ * work done by a single thread in a regular pool. */
+
+#define MEMPOOL_TASK_ELEMS 1000
+#define MEMPOOL_NUM_ELEMS (10000 * MEMPOOL_TASK_ELEMS)
+
+typedef struct MempoolTestElem {
+	int value;
+	int pad[3];
+} MempoolTestElem;
+
+typedef struct MempoolThreadData {
+	BLI_mempool *pool;
+	MempoolTestElem **elems;
+	int num_elems;
+} MempoolThreadData;
+
+static void mempool_alloc_range(MempoolThreadData *data, const int start, const int end)
+{
+	for (int i = start; i < end; i++) {
+		data->elems[i] = (MempoolTestElem *)BLI_mempool_alloc(data->pool);
+		data->elems[i]->value = i;
+	}
+}
+
+static void mempool_free_range(MempoolThreadData *data, const int start, const int end)
+{
+	for (int i = start; i < end; i++) {
+		BLI_mempool_free(data->pool, data->elems[i]);
+	}
+}
+
+static void mempool_alloc_run(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	MempoolThreadData *data = (MempoolThreadData *)BLI_task_pool_userdata(pool);
+	const int start = GET_INT_FROM_POINTER(taskdata);
+
+	mempool_alloc_range(data, start, start + MEMPOOL_TASK_ELEMS);
+}
+
+static void mempool_free_run(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	MempoolThreadData *data = (MempoolThreadData *)BLI_task_pool_userdata(pool);
+	/* Reverse order, so elements are mostly freed from other tasks than the ones which allocated them. */
+	const int start = data->num_elems - MEMPOOL_TASK_ELEMS - GET_INT_FROM_POINTER(taskdata);
+
+	mempool_free_range(data, start, start + MEMPOOL_TASK_ELEMS);
+}
+
+static void mempool_run_tasks(TaskScheduler *scheduler, MempoolThreadData *data, TaskRunFunction run)
+{
+	TaskPool *pool = BLI_task_pool_create(scheduler, data);
+
+	for (int i = 0; i < data->num_elems; i += MEMPOOL_TASK_ELEMS) {
+		BLI_task_pool_push(pool, run, SET_INT_IN_POINTER(i), false, TASK_PRIORITY_HIGH);
+	}
+	BLI_task_pool_work_and_wait(pool);
+	BLI_task_pool_free(pool);
+}
+
+TEST(mempool, SingleThreadAllocFree)
+{
+	MempoolThreadData data;
+
+	data.num_elems = MEMPOOL_NUM_ELEMS;
+	data.pool = BLI_mempool_create(sizeof(MempoolTestElem), 0, 512, BLI_MEMPOOL_NOP);
+	data.elems = (MempoolTestElem **)MEM_mallocN(sizeof(*data.elems) * data.num_elems, __func__);
+
+	TIMEIT_START(mempool_alloc);
+	mempool_alloc_range(&data, 0, data.num_elems);
+	TIMEIT_END(mempool_alloc);
+
+	TIMEIT_START(mempool_free);
+	mempool_free_range(&data, 0, data.num_elems);
+	TIMEIT_END(mempool_free);
+
+	MEM_freeN(data.elems);
+	BLI_mempool_destroy(data.pool);
+}
+
+static void mempool_threadsafe_test(const int num_threads)
+{
+	TaskScheduler *scheduler;
+	MempoolThreadData data;
+
+	BLI_threadapi_init();
+	scheduler = BLI_task_scheduler_create(num_threads);
+
+	data.num_elems = MEMPOOL_NUM_ELEMS;
+	data.pool = BLI_mempool_create(sizeof(MempoolTestElem), 0, 512, BLI_MEMPOOL_THREADSAFE);
+	data.elems = (MempoolTestElem **)MEM_mallocN(sizeof(*data.elems) * data.num_elems, __func__);
+
+	printf("%d threads:\n", num_threads);
+
+	TIMEIT_START(mempool_threadsafe_alloc);
+	mempool_run_tasks(scheduler, &data, mempool_alloc_run);
+	TIMEIT_END(mempool_threadsafe_alloc);
+
+	TIMEIT_START(mempool_threadsafe_free);
+	mempool_run_tasks(scheduler, &data, mempool_free_run);
+	TIMEIT_END(mempool_threadsafe_free);
+
+	MEM_freeN(data.elems);
+	BLI_mempool_destroy(data.pool);
+
+	BLI_task_scheduler_free(scheduler);
+	BLI_threadapi_exit();
+}
+
+TEST(mempool, ThreadsafeAllocFree_1)
+{
+	mempool_threadsafe_test(1);
+}
+
+TEST(mempool, ThreadsafeAllocFree_8)
+{
+	mempool_threadsafe_test(8);
+}
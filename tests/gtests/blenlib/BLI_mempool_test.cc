@@ -0,0 +1,182 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_mempool.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
+}
+
+typedef struct MempoolTestElem {
+	int value;
+	int pad[3];
+} MempoolTestElem;
+
+/* Check iteration finds exactly the elements of \a elems which are not NULL. */
+static void mempool_check_iter(BLI_mempool *pool, MempoolTestElem **elems, const int num_elems)
+{
+	BLI_mempool_iter iter;
+	MempoolTestElem *elem;
+	bool *found = (bool *)MEM_callocN(sizeof(*found) * num_elems, __func__);
+	int num_used = 0, num_found = 0;
+
+	for (int i = 0; i < num_elems; i++) {
+		if (elems[i]) {
+			num_used++;
+		}
+	}
+	EXPECT_EQ(num_used, BLI_mempool_count(pool));
+
+	BLI_mempool_iternew(pool, &iter);
+	while ((elem = (MempoolTestElem *)BLI_mempool_iterstep(&iter))) {
+		ASSERT_TRUE(elem->value >= 0 && elem->value < num_elems);
+		EXPECT_EQ(elem, elems[elem->value]);
+		EXPECT_FALSE(found[elem->value]);
+		found[elem->value] = true;
+		num_found++;
+	}
+	EXPECT_EQ(num_used, num_found);
+
+	MEM_freeN(found);
+}
+
+static void mempool_alloc_free_test(const unsigned int flag)
+{
+	const int num_elems = 10000;
+	BLI_mempool *pool = BLI_mempool_create(sizeof(MempoolTestElem), 0, 256, BLI_MEMPOOL_ALLOW_ITER | flag);
+	MempoolTestElem **elems = (MempoolTestElem **)MEM_mallocN(sizeof(*elems) * num_elems, __func__);
+
+	for (int i = 0; i < num_elems; i++) {
+		elems[i] = (MempoolTestElem *)BLI_mempool_alloc(pool);
+		elems[i]->value = i;
+	}
+	mempool_check_iter(pool, elems, num_elems);
+
+	for (int i = 0; i < num_elems; i += 3) {
+		BLI_mempool_free(pool, elems[i]);
+		elems[i] = NULL;
+	}
+	mempool_check_iter(pool, elems, num_elems);
+
+	for (int i = 0; i < num_elems; i += 3) {
+		elems[i] = (MempoolTestElem *)BLI_mempool_alloc(pool);
+		elems[i]->value = i;
+	}
+	mempool_check_iter(pool, elems, num_elems);
+
+	BLI_mempool_clear(pool);
+	EXPECT_EQ(0, BLI_mempool_count(pool));
+	for (int i = 0; i < num_elems; i++) {
+		elems[i] = (MempoolTestElem *)BLI_mempool_alloc(pool);
+		elems[i]->value = i;
+	}
+	mempool_check_iter(pool, elems, num_elems);
+
+	MEM_freeN(elems);
+	BLI_mempool_destroy(pool);
+}
+
+TEST(mempool, AllocFree)
+{
+	mempool_alloc_free_test(0);
+}
+
+TEST(mempool, ThreadsafeAllocFree)
+{
+	mempool_alloc_free_test(BLI_MEMPOOL_THREADSAFE);
+}
+
+/* Elements allocated and freed from tasks, with frees mostly happening on other threads
+ * than the ones which allocated the elements. */
+
+#define MEMPOOL_TASK_ELEMS 1000
+
+typedef struct MempoolThreadData {
+	BLI_mempool *pool;
+	MempoolTestElem **elems;
+	int num_elems;
+} MempoolThreadData;
+
+static void mempool_alloc_elem(MempoolThreadData *data, const int index)
+{
+	data->elems[index] = (MempoolTestElem *)BLI_mempool_alloc(data->pool);
+	data->elems[index]->value = index;
+}
+
+static void mempool_alloc_run(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	MempoolThreadData *data = (MempoolThreadData *)BLI_task_pool_userdata(pool);
+	const int start = GET_INT_FROM_POINTER(taskdata);
+
+	for (int i = start; i < start + MEMPOOL_TASK_ELEMS; i++) {
+		mempool_alloc_elem(data, i);
+	}
+}
+
+static void mempool_free_run(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	MempoolThreadData *data = (MempoolThreadData *)BLI_task_pool_userdata(pool);
+	/* Reverse order, so elements are freed from other tasks than the ones which allocated them. */
+	const int start = data->num_elems - MEMPOOL_TASK_ELEMS - GET_INT_FROM_POINTER(taskdata);
+
+	for (int i = start; i < start + MEMPOOL_TASK_ELEMS; i++) {
+		if (i % 2) {
+			BLI_mempool_free(data->pool, data->elems[i]);
+			data->elems[i] = NULL;
+		}
+	}
+}
+
+static void mempool_realloc_run(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	MempoolThreadData *data = (MempoolThreadData *)BLI_task_pool_userdata(pool);
+	const int start = GET_INT_FROM_POINTER(taskdata);
+
+	for (int i = start; i < start + MEMPOOL_TASK_ELEMS; i++) {
+		if (i % 2) {
+			mempool_alloc_elem(data, i);
+		}
+	}
+}
+
+static void mempool_run_tasks(TaskScheduler *scheduler, MempoolThreadData *data, TaskRunFunction run)
+{
+	TaskPool *pool = BLI_task_pool_create(scheduler, data);
+
+	for (int i = 0; i < data->num_elems; i += MEMPOOL_TASK_ELEMS) {
+		BLI_task_pool_push(pool, run, SET_INT_IN_POINTER(i), false, TASK_PRIORITY_HIGH);
+	}
+	BLI_task_pool_work_and_wait(pool);
+	BLI_task_pool_free(pool);
+}
+
+TEST(mempool, ThreadsafeParallel)
+{
+	TaskScheduler *scheduler;
+	MempoolThreadData data;
+
+	BLI_threadapi_init();
+	scheduler = BLI_task_scheduler_create(8);
+
+	data.num_elems = 1000 * MEMPOOL_TASK_ELEMS;
+	data.pool = BLI_mempool_create(sizeof(MempoolTestElem), 0, 512, BLI_MEMPOOL_ALLOW_ITER | BLI_MEMPOOL_THREADSAFE);
+	data.elems = (MempoolTestElem **)MEM_mallocN(sizeof(*data.elems) * data.num_elems, __func__);
+
+	mempool_run_tasks(scheduler, &data, mempool_alloc_run);
+	mempool_check_iter(data.pool, data.elems, data.num_elems);
+
+	mempool_run_tasks(scheduler, &data, mempool_free_run);
+	mempool_check_iter(data.pool, data.elems, data.num_elems);
+
+	mempool_run_tasks(scheduler, &data, mempool_realloc_run);
+	mempool_check_iter(data.pool, data.elems, data.num_elems);
+
+	MEM_freeN(data.elems);
+	BLI_mempool_destroy(data.pool);
+
+	BLI_task_scheduler_free(scheduler);
+	BLI_threadapi_exit();
+}
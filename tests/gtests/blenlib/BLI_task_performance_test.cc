@@ -0,0 +1,323 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include <climits>
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_listbase.h"
+#include "BLI_math_base.h"
+#include "BLI_mempool.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
+#include "PIL_time_utildefines.h"
+#include "DNA_listBase.h"
+}
+
+/* Counters are kept per thread and padded, so the benchmark measures the
+ * scheduler and not contention on the counter itself. */
+#define COUNTER_STRIDE 16
+
+typedef struct TaskCounters {
+	int num_threads;
+	unsigned int *counts;
+} TaskCounters;
+
+static void task_counters_init(TaskCounters *counters, int num_threads)
+{
+	counters->num_threads = num_threads;
+	counters->counts = (unsigned int *)MEM_callocN(sizeof(unsigned int) * COUNTER_STRIDE * num_threads, __func__);
+}
+
+static unsigned int task_counters_free(TaskCounters *counters)
+{
+	unsigned int total = 0;
+	for (int i = 0; i < counters->num_threads; i++) {
+		total += counters->counts[i * COUNTER_STRIDE];
+	}
+	MEM_freeN(counters->counts);
+	return total;
+}
+
+static void task_count_run(TaskPool *__restrict pool, void *UNUSED(taskdata), int threadid)
+{
+	TaskCounters *counters = (TaskCounters *)BLI_task_pool_userdata(pool);
+	counters->counts[threadid * COUNTER_STRIDE]++;
+}
+
+/* Each task spawns two children until depth is exhausted,
+ * so most tasks are pushed from worker threads. */
+static void task_spawn_run(TaskPool *__restrict pool, void *taskdata, int threadid)
+{
+	TaskCounters *counters = (TaskCounters *)BLI_task_pool_userdata(pool);
+	const int depth = GET_INT_FROM_POINTER(taskdata);
+
+	counters->counts[threadid * COUNTER_STRIDE]++;
+
+	if (depth > 0) {
+		BLI_task_pool_push(pool, task_spawn_run, SET_INT_IN_POINTER(depth - 1), false, TASK_PRIORITY_HIGH);
+		BLI_task_pool_push(pool, task_spawn_run, SET_INT_IN_POINTER(depth - 1), false, TASK_PRIORITY_HIGH);
+	}
+}
+
+static void task_flat_tests(const int num_threads, const unsigned int num_tasks)
+{
+	TaskScheduler *scheduler = BLI_task_scheduler_create(num_threads);
+	TaskCounters counters;
+
+	printf("\n========== STARTING flat pool, %d threads, %u tasks ==========\n",
+	       BLI_task_scheduler_num_threads(scheduler), num_tasks);
+
+	task_counters_init(&counters, BLI_task_scheduler_num_threads(scheduler));
+
+	{
+		TaskPool *pool = BLI_task_pool_create(scheduler, &counters);
+
+		TIMEIT_START(flat_push_and_wait);
+
+		for (unsigned int i = 0; i < num_tasks; i++) {
+			BLI_task_pool_push(pool, task_count_run, NULL, false, TASK_PRIORITY_LOW);
+		}
+		BLI_task_pool_work_and_wait(pool);
+
+		TIMEIT_END(flat_push_and_wait);
+
+		EXPECT_EQ(num_tasks, BLI_task_pool_tasks_done(pool));
+		BLI_task_pool_free(pool);
+	}
+
+	EXPECT_EQ(num_tasks, task_counters_free(&counters));
+
+	BLI_task_scheduler_free(scheduler);
+
+	printf("========== ENDED flat pool ==========\n\n");
+}
+
+static void task_spawn_tests(const int num_threads, const int depth)
+{
+	TaskScheduler *scheduler = BLI_task_scheduler_create(num_threads);
+	TaskCounters counters;
+	const unsigned int num_tasks = (1u << (depth + 1)) - 1;
+
+	printf("\n========== STARTING nested spawn, %d threads, %u tasks ==========\n",
+	       BLI_task_scheduler_num_threads(scheduler), num_tasks);
+
+	task_counters_init(&counters, BLI_task_scheduler_num_threads(scheduler));
+
+	{
+		TaskPool *pool = BLI_task_pool_create(scheduler, &counters);
+
+		TIMEIT_START(nested_spawn);
+
+		BLI_task_pool_push(pool, task_spawn_run, SET_INT_IN_POINTER(depth), false, TASK_PRIORITY_HIGH);
+		BLI_task_pool_work_and_wait(pool);
+
+		TIMEIT_END(nested_spawn);
+
+		BLI_task_pool_free(pool);
+	}
+
+	EXPECT_EQ(num_tasks, task_counters_free(&counters));
+
+	BLI_task_scheduler_free(scheduler);
+
+	printf("========== ENDED nested spawn ==========\n\n");
+}
+
+TEST(task, FlatPool1Thread)
+{
+	BLI_threadapi_init();
+	task_flat_tests(1, 1000000);
+	BLI_threadapi_exit();
+}
+
+TEST(task, FlatPoolAllThreads)
+{
+	BLI_threadapi_init();
+	task_flat_tests(TASK_SCHEDULER_AUTO_THREADS, 1000000);
+	BLI_threadapi_exit();
+}
+
+TEST(task, FlatPool8Threads)
+{
+	BLI_threadapi_init();
+	task_flat_tests(8, 1000000);
+	BLI_threadapi_exit();
+}
+
+TEST(task, NestedSpawn1Thread)
+{
+	BLI_threadapi_init();
+	task_spawn_tests(1, 20);
+	BLI_threadapi_exit();
+}
+
+TEST(task, NestedSpawnAllThreads)
+{
+	BLI_threadapi_init();
+	task_spawn_tests(TASK_SCHEDULER_AUTO_THREADS, 20);
+	BLI_threadapi_exit();
+}
+
+TEST(task, NestedSpawn8Threads)
+{
+	BLI_threadapi_init();
+	task_spawn_tests(8, 20);
+	BLI_threadapi_exit();
+}
+
+/* Parallel range reduction: sum and bounds of an integer array. */
+
+typedef struct RangeReduceData {
+	const int *values;
+	long long sum;
+	int min, max;
+} RangeReduceData;
+
+typedef struct RangeReduceChunk {
+	long long sum;
+	int min, max;
+} RangeReduceChunk;
+
+static void range_reduce_iter(void *userdata, void *userdata_chunk, int iter)
+{
+	RangeReduceData *data = (RangeReduceData *)userdata;
+	RangeReduceChunk *chunk = (RangeReduceChunk *)userdata_chunk;
+	const int value = data->values[iter];
+
+	chunk->sum += value;
+	chunk->min = min_ii(chunk->min, value);
+	chunk->max = max_ii(chunk->max, value);
+}
+
+static void range_reduce_chunk(void *userdata, void *userdata_chunk, int iter_start, int iter_stop)
+{
+	for (int i = iter_start; i < iter_stop; i++) {
+		range_reduce_iter(userdata, userdata_chunk, i);
+	}
+}
+
+static void range_reduce_finalize(void *userdata, void *userdata_chunk)
+{
+	RangeReduceData *data = (RangeReduceData *)userdata;
+	RangeReduceChunk *chunk = (RangeReduceChunk *)userdata_chunk;
+
+	data->sum += chunk->sum;
+	data->min = min_ii(data->min, chunk->min);
+	data->max = max_ii(data->max, chunk->max);
+}
+
+TEST(task, ParallelRangeReduce)
+{
+	const int num = 10000000;
+	int *values = (int *)MEM_mallocN(sizeof(*values) * num, __func__);
+	long long sum = 0;
+
+	BLI_threadapi_init();
+
+	for (int i = 0; i < num; i++) {
+		values[i] = (int)(((long long)i * 7919) % 100003) - 50000;
+		sum += values[i];
+	}
+
+	for (int use_chunk = 0; use_chunk < 2; use_chunk++) {
+		RangeReduceData data = {values, 0, INT_MAX, INT_MIN};
+		RangeReduceChunk chunk = {0, INT_MAX, INT_MIN};
+
+		if (use_chunk) {
+			TIMEIT_START(parallel_range_chunk);
+			BLI_task_parallel_range_chunk(0, num, &data, &chunk, sizeof(chunk),
+			                              range_reduce_chunk, range_reduce_finalize, 0, false);
+			TIMEIT_END(parallel_range_chunk);
+		}
+		else {
+			TIMEIT_START(parallel_range_reduce);
+			BLI_task_parallel_range_reduce(0, num, &data, &chunk, sizeof(chunk),
+			                               range_reduce_iter, range_reduce_finalize, 0, false);
+			TIMEIT_END(parallel_range_reduce);
+		}
+
+		EXPECT_EQ(sum, data.sum);
+		EXPECT_EQ(-50000, data.min);
+		EXPECT_EQ(50002, data.max);
+	}
+
+	MEM_freeN(values);
+
+	BLI_threadapi_exit();
+}
+
+/* Parallel loops over mempools and lists, each item must be visited exactly once. */
+
+static void parallel_mempool_func(void *UNUSED(userdata), void *item)
+{
+	int *data = (int *)item;
+	*data += 1;
+}
+
+TEST(task, ParallelMempool)
+{
+	const int num_items = 1000000;
+	BLI_mempool *mempool = BLI_mempool_create(sizeof(int), 0, 512, BLI_MEMPOOL_ALLOW_ITER);
+	int **items = (int **)MEM_mallocN(sizeof(*items) * num_items, __func__);
+
+	BLI_threadapi_init();
+
+	for (int i = 0; i < num_items; i++) {
+		items[i] = (int *)BLI_mempool_alloc(mempool);
+		*items[i] = i;
+	}
+	/* Leave some holes in the pool, those must be skipped. */
+	for (int i = 0; i < num_items; i += 3) {
+		BLI_mempool_free(mempool, items[i]);
+		items[i] = NULL;
+	}
+
+	TIMEIT_START(parallel_mempool);
+	BLI_task_parallel_mempool(mempool, NULL, parallel_mempool_func, true);
+	TIMEIT_END(parallel_mempool);
+
+	for (int i = 0; i < num_items; i++) {
+		if (items[i]) {
+			EXPECT_EQ(i + 1, *items[i]);
+		}
+	}
+
+	MEM_freeN(items);
+	BLI_mempool_destroy(mempool);
+
+	BLI_threadapi_exit();
+}
+
+static void parallel_listbase_func(void *UNUSED(userdata), Link *item, int index)
+{
+	LinkData *link = (LinkData *)item;
+	link->data = SET_INT_IN_POINTER(GET_INT_FROM_POINTER(link->data) + index + 1);
+}
+
+TEST(task, ParallelListbase)
+{
+	const int num_items = 100000;
+	ListBase list = {NULL, NULL};
+	LinkData *links = (LinkData *)MEM_callocN(sizeof(*links) * num_items, __func__);
+
+	BLI_threadapi_init();
+
+	for (int i = 0; i < num_items; i++) {
+		BLI_addtail(&list, &links[i]);
+	}
+
+	TIMEIT_START(parallel_listbase);
+	BLI_task_parallel_listbase(&list, NULL, parallel_listbase_func, true);
+	TIMEIT_END(parallel_listbase);
+
+	for (int i = 0; i < num_items; i++) {
+		EXPECT_EQ(i + 1, GET_INT_FROM_POINTER(links[i].data));
+	}
+
+	MEM_freeN(links);
+
+	BLI_threadapi_exit();
+}
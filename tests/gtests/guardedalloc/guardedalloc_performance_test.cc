@@ -0,0 +1,194 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_math_base.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
+#include "PIL_time_utildefines.h"
+#include "DNA_listBase.h"
+}
+
+/* Each task allocates and frees blocks of varying sizes, keeping some of them alive,
+ * those are freed later from other threads. */
+
+#define TASKS_PER_THREAD 4
+#define BLOCKS_PER_ROUND 64
+
+typedef struct AllocTestData {
+	unsigned int rounds;
+	/* Blocks left allocated by each task, freed by the next task. */
+	void ***kept_blocks;
+} AllocTestData;
+
+static size_t alloc_test_block_len(const unsigned int i)
+{
+	/* Mostly small blocks, with a few larger ones. */
+	return (i % 16 == 15) ? 4096 + i : 8 + (i * 37) % 600;
+}
+
+static void alloc_blocks(AllocTestData *data, const unsigned int index)
+{
+	void *blocks[BLOCKS_PER_ROUND];
+
+	for (unsigned int round = 0; round < data->rounds; round++) {
+		for (unsigned int i = 0; i < BLOCKS_PER_ROUND; i++) {
+			const size_t len = alloc_test_block_len(round + i);
+			if (i % 8 == 0) {
+				blocks[i] = MEM_mallocN_aligned(len, 16, __func__);
+			}
+			else if (i % 2) {
+				blocks[i] = MEM_callocN(len, __func__);
+			}
+			else {
+				blocks[i] = MEM_mallocN(len, __func__);
+			}
+		}
+		for (unsigned int i = 0; i < BLOCKS_PER_ROUND; i++) {
+			MEM_freeN(blocks[i]);
+		}
+	}
+
+	if (data->kept_blocks) {
+		void **kept = (void **)MEM_mallocN(sizeof(void *) * BLOCKS_PER_ROUND, __func__);
+		for (unsigned int i = 0; i < BLOCKS_PER_ROUND; i++) {
+			kept[i] = MEM_mallocN(alloc_test_block_len(index + i), __func__);
+		}
+		data->kept_blocks[index] = kept;
+	}
+}
+
+static void free_kept_blocks(AllocTestData *data, const unsigned int index)
+{
+	void **kept = data->kept_blocks[index];
+
+	for (unsigned int i = 0; i < BLOCKS_PER_ROUND; i++) {
+		MEM_freeN(kept[i]);
+	}
+	MEM_freeN(kept);
+}
+
+/* Counters are checked with plain threads, which exit before the checks. */
+
+typedef struct AllocThreadData {
+	AllocTestData *data;
+	unsigned int index;
+	bool do_free;
+} AllocThreadData;
+
+static void *alloc_thread_run(void *thread_data_v)
+{
+	AllocThreadData *thread_data = (AllocThreadData *)thread_data_v;
+
+	if (thread_data->do_free) {
+		free_kept_blocks(thread_data->data, thread_data->index);
+	}
+	else {
+		alloc_blocks(thread_data->data, thread_data->index);
+	}
+	return NULL;
+}
+
+static void alloc_run_threads(AllocTestData *data, const unsigned int num_threads, const bool do_free)
+{
+	AllocThreadData thread_data[BLENDER_MAX_THREADS];
+	ListBase threads;
+
+	BLI_init_threads(&threads, alloc_thread_run, (int)num_threads);
+	for (unsigned int i = 0; i < num_threads; i++) {
+		thread_data[i].data = data;
+		/* Free blocks from other threads than the ones which allocated them. */
+		thread_data[i].index = do_free ? (i + 1) % num_threads : i;
+		thread_data[i].do_free = do_free;
+		BLI_insert_thread(&threads, &thread_data[i]);
+	}
+	BLI_end_threads(&threads);
+}
+
+TEST(guardedalloc, ThreadedCounters)
+{
+	const unsigned int num_threads = 8;
+	const unsigned int blocks_start = MEM_get_memory_blocks_in_use();
+	const size_t mem_start = MEM_get_memory_in_use();
+	size_t mem_kept = 0;
+	AllocTestData data;
+
+	BLI_threadapi_init();
+
+	data.rounds = 100;
+	data.kept_blocks = (void ***)MEM_callocN(sizeof(void **) * num_threads, __func__);
+
+	alloc_run_threads(&data, num_threads, false);
+
+	for (unsigned int i = 0; i < num_threads; i++) {
+		mem_kept += MEM_allocN_len(data.kept_blocks[i]);
+		for (unsigned int j = 0; j < BLOCKS_PER_ROUND; j++) {
+			mem_kept += MEM_allocN_len(data.kept_blocks[i][j]);
+		}
+	}
+	mem_kept += MEM_allocN_len(data.kept_blocks);
+
+	/* Counters of exited threads must not get lost. */
+	EXPECT_EQ(blocks_start + num_threads * (BLOCKS_PER_ROUND + 1) + 1, MEM_get_memory_blocks_in_use());
+	EXPECT_EQ(mem_start + mem_kept, MEM_get_memory_in_use());
+	EXPECT_LE(mem_start + mem_kept, MEM_get_peak_memory());
+
+	alloc_run_threads(&data, num_threads, true);
+	MEM_freeN(data.kept_blocks);
+
+	EXPECT_EQ(blocks_start, MEM_get_memory_blocks_in_use());
+	EXPECT_EQ(mem_start, MEM_get_memory_in_use());
+
+	BLI_threadapi_exit();
+}
+
+static void alloc_run(TaskPool *__restrict pool, void *taskdata, int UNUSED(threadid))
+{
+	alloc_blocks((AllocTestData *)BLI_task_pool_userdata(pool), GET_UINT_FROM_POINTER(taskdata));
+}
+
+static void alloc_run_tasks(TaskScheduler *scheduler, AllocTestData *data, const unsigned int num_tasks)
+{
+	TaskPool *pool = BLI_task_pool_create(scheduler, data);
+
+	for (unsigned int i = 0; i < num_tasks; i++) {
+		BLI_task_pool_push(pool, alloc_run, SET_UINT_IN_POINTER(i), false, TASK_PRIORITY_HIGH);
+	}
+	BLI_task_pool_work_and_wait(pool);
+	BLI_task_pool_free(pool);
+}
+
+static void alloc_scalability_tests(const int num_threads, const unsigned int rounds)
+{
+	TaskScheduler *scheduler = BLI_task_scheduler_create(num_threads);
+	const unsigned int num_tasks = (unsigned int)BLI_task_scheduler_num_threads(scheduler) * TASKS_PER_THREAD;
+	AllocTestData data;
+
+	printf("\n========== STARTING threaded alloc, %d threads, %u allocations ==========\n",
+	       BLI_task_scheduler_num_threads(scheduler), num_tasks * rounds * BLOCKS_PER_ROUND);
+
+	data.rounds = rounds;
+	data.kept_blocks = NULL;
+
+	TIMEIT_START(threaded_alloc_free);
+	alloc_run_tasks(scheduler, &data, num_tasks);
+	TIMEIT_END(threaded_alloc_free);
+
+	BLI_task_scheduler_free(scheduler);
+
+	printf("========== ENDED threaded alloc ==========\n\n");
+}
+
+TEST(guardedalloc, ThreadedAllocScalability)
+{
+	const int max_threads = max_ii(8, BLI_system_thread_count());
+
+	BLI_threadapi_init();
+	for (int num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+		alloc_scalability_tests(num_threads, 20000 / (unsigned int)num_threads);
+	}
+	BLI_threadapi_exit();
+}